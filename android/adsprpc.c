@@ -142,10 +142,17 @@
 			(int64_t *)(perf_ptr + offset)\
 				: (int64_t *)NULL) : (int64_t *)NULL)
 
+/* ATOP_TRACE_PRINTK logs into the ftrace ring buffer, formatted by atop */
+#ifdef ATOP_TRACE_PRINTK
+#define ATOP_LOG(fmt, args...) trace_printk(fmt, ## args)
+#else
+#define ATOP_LOG(fmt, args...) pr_alert(fmt, ## args)
+#endif
+
 #define PRINTK_IF(fmt, args...) \
 	do { \
 		if(atomic_read(&logging_enabled)) \
-			pr_alert(fmt, ## args); \
+			ATOP_LOG(fmt, ## args); \
 	} while (0)
 
 static int fastrpc_glink_open(int cid);
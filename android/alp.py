@@ -306,7 +306,11 @@ def parse_model_cfg(cfg_path: str = str(Path.cwd() / 'models.cfg')) -> List[str]
     assert(file_exists_on_device('/data/local/tmp/benchmark_model'))
     with open(cfg_path) as cfg_f:
         for line in cfg_f:
-            model_path = line.strip()
+            # Optional second column is the weight used by `atopctl loadgen`
+            fields = line.split()
+            if len(fields) == 0 or fields[0].startswith('#'):
+                continue
+            model_path = fields[0]
             assert(file_exists_on_device(model_path))
             models.append(model_path)
 
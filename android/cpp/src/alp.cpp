@@ -0,0 +1,304 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "alp.h"
+#include "fifo.h"
+#include "logger.h"
+
+bool atop::alp::parse_trace_line( std::string const& line, Access& out )
+{
+	char const* p = line.c_str();
+	while( *p == ' ' || *p == '\t' )
+		++p;
+	if( *p == '\0' || *p == '#' )
+		return false;
+
+	char* end;
+	out.ts_ns = std::strtoull( p, &end, 10 );
+	if( end == p )
+		throw std::runtime_error( fmt::format( "Malformed trace record: '{0}'", line ) );
+
+	p       = end;
+	out.pid = static_cast<int32_t>( std::strtol( p, &end, 10 ) );
+	if( end == p )
+		throw std::runtime_error( fmt::format( "Malformed trace record: '{0}'", line ) );
+
+	p = end;
+	while( *p == ' ' || *p == '\t' )
+		++p;
+	switch( *p )
+	{
+		case 'R': out.kind = AccessKind::Read; break;
+		case 'W': out.kind = AccessKind::Write; break;
+		case 'X': out.kind = AccessKind::Fetch; break;
+		default: throw std::runtime_error( fmt::format( "Unknown access kind in: '{0}'", line ) );
+	}
+
+	// strtoull with base 16 accepts an optional "0x"
+	++p;
+	out.addr = std::strtoull( p, &end, 16 );
+	if( end == p )
+		throw std::runtime_error( fmt::format( "Malformed trace record: '{0}'", line ) );
+
+	p        = end;
+	out.size = static_cast<uint32_t>( std::strtoul( p, &end, 10 ) );
+	if( end == p )
+		out.size = 4; // word-sized access if the tracer doesn't report sizes
+
+	out.region = atop::physmap::PhysMap::npos;
+	return true;
+}
+
+atop::alp::PagemapTranslator::PagemapTranslator( std::string const& root, size_t max_pages )
+    : proc_root( root )
+    , page_size( static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) ) )
+    , max_cached_pages( max_pages )
+    , pfn_cache()
+    , fds()
+{
+}
+
+atop::alp::PagemapTranslator::~PagemapTranslator()
+{
+	for( auto&& p: this->fds )
+		if( p.second >= 0 )
+			close( p.second );
+}
+
+int atop::alp::PagemapTranslator::pagemap_fd( int32_t pid )
+{
+	if( auto it{ this->fds.find( pid ) }; it != std::end( this->fds ) )
+		return it->second;
+
+	auto path = fmt::format( "{0}/{1}/pagemap", this->proc_root, pid );
+	int fd    = open( path.c_str(), O_RDONLY );
+	if( fd < 0 )
+		atop::logger::warn( fmt::format( "Could not open {0}: accesses of pid {1} will be "
+		                                 "reported as untranslated",
+		                                 path, pid ) );
+	this->fds[pid] = fd;
+	return fd;
+}
+
+static uint64_t page_key( int32_t pid, uint64_t vpn )
+{
+	return ( static_cast<uint64_t>( static_cast<uint32_t>( pid ) ) << 40 )
+	       | ( vpn & ( ( uint64_t{ 1 } << 40 ) - 1 ) );
+}
+
+void atop::alp::PagemapTranslator::translate( batch_t& batch )
+{
+	// Bits 0-54: page frame number, bit 63: page present
+	// (see Documentation/admin-guide/mm/pagemap.rst)
+	constexpr uint64_t pfn_mask    = ( uint64_t{ 1 } << 55 ) - 1;
+	constexpr uint64_t present_bit = uint64_t{ 1 } << 63;
+
+	// Simple bound on memory: start over once the cache is full. The cache
+	// may exceed the bound by at most one batch
+	if( this->pfn_cache.size() > this->max_cached_pages )
+		this->pfn_cache.clear();
+
+	std::vector<std::pair<int32_t, uint64_t>> missing;
+	for( auto&& a: batch )
+	{
+		auto vpn = a.addr / this->page_size;
+		if( this->pfn_cache.find( page_key( a.pid, vpn ) ) == std::end( this->pfn_cache ) )
+			missing.emplace_back( a.pid, vpn );
+	}
+
+	std::sort( missing.begin(), missing.end() );
+	missing.erase( std::unique( missing.begin(), missing.end() ), missing.end() );
+
+	for( auto&& [pid, vpn]: missing )
+	{
+		uint64_t entry = 0;
+		int fd         = this->pagemap_fd( pid );
+		auto offset    = static_cast<off_t>( vpn * sizeof( entry ) );
+		if( fd < 0 || pread( fd, &entry, sizeof( entry ), offset ) != sizeof( entry ) )
+			entry = 0;
+
+		// Without CAP_SYS_ADMIN the kernel reports a PFN of 0
+		uint64_t pfn = entry & pfn_mask;
+		this->pfn_cache[page_key( pid, vpn )]
+		    = ( ( entry & present_bit ) && pfn != 0 ) ? pfn : atop::alp::untranslated;
+	}
+
+	for( auto&& a: batch )
+	{
+		auto pfn = this->pfn_cache[page_key( a.pid, a.addr / this->page_size )];
+		a.addr   = ( pfn == atop::alp::untranslated )
+		             ? atop::alp::untranslated
+		             : pfn * this->page_size + a.addr % this->page_size;
+	}
+}
+
+std::vector<atop::alp::WindowStats> atop::alp::estimate( std::istream& trace,
+                                                         atop::physmap::PhysMap const& map,
+                                                         Translator& translator,
+                                                         Options const& opts )
+{
+	if( opts.window_ns == 0 || opts.batch_size == 0 || opts.queue_depth == 0 )
+		throw std::runtime_error( "ALP estimator options must be non-zero" );
+
+	using queue_t = atop::fifo::BoundedQueue<batch_t>;
+	queue_t parsed( opts.queue_depth );
+	queue_t filtered( opts.queue_depth );
+	queue_t translated( opts.queue_depth );
+	queue_t classified( opts.queue_depth );
+
+	// Exceptions of worker threads are rethrown on the calling thread
+	std::mutex err_mtx;
+	std::exception_ptr err;
+	auto guard = [&]( auto&& stage, std::vector<queue_t*> to_close ) {
+		return [&, stage, to_close]() {
+			try
+			{
+				stage();
+			}
+			catch( ... )
+			{
+				std::lock_guard<std::mutex> lock( err_mtx );
+				if( !err )
+					err = std::current_exception();
+				parsed.close();
+				filtered.close();
+				translated.close();
+				classified.close();
+			}
+			for( auto* q: to_close )
+				q->close();
+		};
+	};
+
+	auto reader = [&]() {
+		std::string line;
+		batch_t batch;
+		batch.reserve( opts.batch_size );
+		Access a;
+		while( std::getline( trace, line ) )
+		{
+			if( !atop::alp::parse_trace_line( line, a ) )
+				continue;
+
+			batch.push_back( a );
+			if( batch.size() == opts.batch_size )
+			{
+				if( !parsed.push( std::move( batch ) ) )
+					return;
+				batch = batch_t();
+				batch.reserve( opts.batch_size );
+			}
+		}
+		if( !batch.empty() )
+			parsed.push( std::move( batch ) );
+	};
+
+	auto filter = [&]() {
+		batch_t batch;
+		while( parsed.pop( batch ) )
+		{
+			auto new_end = std::remove_if( batch.begin(), batch.end(), [&]( Access const& a ) {
+				if( !opts.include_fetches && a.kind == AccessKind::Fetch )
+					return true;
+				return !opts.pids.empty()
+				       && std::find( opts.pids.begin(), opts.pids.end(), a.pid ) == opts.pids.end();
+			} );
+			batch.erase( new_end, batch.end() );
+			if( !batch.empty() && !filtered.push( std::move( batch ) ) )
+				return;
+		}
+	};
+
+	auto translate = [&]() {
+		batch_t batch;
+		while( filtered.pop( batch ) )
+		{
+			translator.translate( batch );
+			if( !translated.push( std::move( batch ) ) )
+				return;
+		}
+	};
+
+	auto classify = [&]() {
+		batch_t batch;
+		while( translated.pop( batch ) )
+		{
+			for( auto&& a: batch )
+				if( a.addr != atop::alp::untranslated )
+					a.region = map.lookup_idx( a.addr );
+			if( !classified.push( std::move( batch ) ) )
+				return;
+		}
+	};
+
+	std::map<uint64_t, WindowStats> windows;
+	auto count = [&]() {
+		batch_t batch;
+		while( classified.pop( batch ) )
+		{
+			for( auto&& a: batch )
+			{
+				auto start = a.ts_ns - a.ts_ns % opts.window_ns;
+				auto& w    = windows[start];
+
+				w.window_start_ns = start;
+				if( a.addr == atop::alp::untranslated )
+					++w.untranslated;
+				else if( a.region == atop::physmap::PhysMap::npos )
+					++w.unmapped;
+				else
+				{
+					auto ip = IP_IDX( map.regions()[static_cast<size_t>( a.region )].ip );
+					++w.accesses[ip];
+					w.bytes[ip] += a.size;
+				}
+			}
+		}
+	};
+
+	// Classification runs on several threads; the last one to finish
+	// closes the queue to the counters
+	unsigned num_classifiers = std::max( 1u, opts.classify_threads );
+	std::atomic<unsigned> classifiers_running{ num_classifiers };
+	auto classify_and_close = [&]() {
+		classify();
+		if( --classifiers_running == 0 )
+			classified.close();
+	};
+
+	std::vector<std::thread> threads;
+	threads.emplace_back( guard( reader, { &parsed } ) );
+	threads.emplace_back( guard( filter, { &filtered } ) );
+	threads.emplace_back( guard( translate, { &translated } ) );
+	for( unsigned i = 0; i < num_classifiers; ++i )
+		threads.emplace_back( guard( classify_and_close, {} ) );
+
+	// The counters run on the calling thread
+	guard( count, {} )();
+
+	for( auto&& t: threads )
+		t.join();
+
+	if( err )
+		std::rethrow_exception( err );
+
+	std::vector<WindowStats> res;
+	res.reserve( windows.size() );
+	for( auto&& p: windows )
+		res.push_back( p.second );
+	return res;
+}
@@ -0,0 +1,138 @@
+#ifndef ALP_H_IN
+#define ALP_H_IN
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "physmap.h"
+
+namespace atop
+{
+namespace alp
+{
+// Kind of a traced instruction
+enum class AccessKind : uint8_t
+{
+	Read,
+	Write,
+	Fetch // instruction fetch; not an address reference of interest by default
+};
+
+struct Access
+{
+	uint64_t ts_ns;
+	uint64_t addr; // virtual on input, physical after translation
+	uint32_t size;
+	int32_t pid;
+	AccessKind kind;
+	int32_t region; // index into PhysMap::regions() after classification
+};
+
+// Marks an address that could not be translated (e.g., page not present)
+constexpr uint64_t untranslated = ~uint64_t{ 0 };
+
+using batch_t = std::vector<Access>;
+
+// Translates the addresses of a batch from virtual to physical in place
+class Translator
+{
+  public:
+	virtual ~Translator() = default;
+	virtual void translate( batch_t& batch ) = 0;
+};
+
+// For traces that already contain physical addresses
+class IdentityTranslator : public Translator
+{
+  public:
+	void translate( batch_t& ) override {}
+};
+
+// Translates through /proc/<pid>/pagemap below proc_root (i.e., "/proc" on
+// the device itself or on a Linux host). Page frame numbers are cached per
+// (pid, virtual page); lookups missing from the cache are sorted and
+// resolved with one pread per page so every page is read only once per
+// batch.
+class PagemapTranslator : public Translator
+{
+  public:
+	explicit PagemapTranslator( std::string const& root = "/proc", size_t max_pages = 1 << 20 );
+	~PagemapTranslator() override;
+	PagemapTranslator( PagemapTranslator const& ) = delete;
+	PagemapTranslator( PagemapTranslator&& )      = delete;
+
+	void translate( batch_t& batch ) override;
+
+	uint64_t get_page_size() const { return this->page_size; }
+
+  private:
+	int pagemap_fd( int32_t pid );
+
+	std::string proc_root;
+	uint64_t page_size;
+	size_t max_cached_pages;
+
+	// (pid << 40 | vpn) -> pfn (or untranslated)
+	std::unordered_map<uint64_t, uint64_t> pfn_cache;
+	std::unordered_map<int32_t, int> fds;
+};
+
+struct Options
+{
+	// Length of a reporting window
+	uint64_t window_ns = 1000000000;
+
+	// Accesses per batch and batches in flight between two stages.
+	// Memory in flight is bounded by ~ batch_size * queue_depth * stages
+	size_t batch_size  = 4096;
+	size_t queue_depth = 8;
+
+	unsigned classify_threads = 2;
+
+	// Only keep accesses of these processes (all if empty)
+	std::vector<int32_t> pids;
+	bool include_fetches = false;
+};
+
+struct WindowStats
+{
+	uint64_t window_start_ns = 0;
+	std::array<uint64_t, IP_IDX( atop::physmap::IpBlocks::LAST )> accesses{};
+	std::array<uint64_t, IP_IDX( atop::physmap::IpBlocks::LAST )> bytes{};
+	uint64_t unmapped     = 0;
+	uint64_t untranslated = 0;
+
+	// Bytes per second for an IP block over a window of window_ns
+	double bandwidth( atop::physmap::IpBlocks ip, uint64_t window_ns ) const
+	{
+		return static_cast<double>( this->bytes[IP_IDX( ip )] )
+		       / ( static_cast<double>( window_ns ) / 1.0e9 );
+	}
+};
+
+// Parses one trace record of the form
+//
+//     <timestamp ns> <pid> <R|W|X> <hex address> [<size in bytes>]
+//
+// Lines that are empty or start with '#' are skipped (returns false)
+bool parse_trace_line( std::string const& line, Access& out );
+
+// Runs the stage chain
+//
+//     reader -> address filter -> V2P translation -> region classification
+//            -> per-IP counters
+//
+// with every stage on its own thread (classification on
+// opts.classify_threads threads) and bounded queues in between.
+// Returns per-window statistics ordered by window start.
+std::vector<WindowStats> estimate( std::istream& trace, atop::physmap::PhysMap const& map,
+                                   Translator& translator, Options const& opts = {} );
+
+} // namespace alp
+} // namespace atop
+
+#endif // ALP_H_IN
@@ -1,15 +1,22 @@
 #include <errno.h>
 #include <sys/wait.h>
 
+#include <algorithm>
 #include <array>
+#include <cctype>
+#include <charconv>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <future>
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -26,6 +33,8 @@
 
 #include "atop.h"
 #include "logger.h"
+#include "selfprof.h"
+#include "subprocess.h"
 #include "util.h"
 
 using namespace std::chrono_literals;
@@ -37,6 +46,17 @@ static const std::string SNPE_BENCHMARK_BIN
     = "/data/local/tmp/snpebm/artifacts/arm-android-clang6.0/bin/snpe-net-run";
 static const std::string logcat_time_fmt = "%m-%d %T";
 
+// Awkward ADSP_LIBRARY_PATH because paths need to be
+// separated by ";" instead of the usual ":"
+static const std::string SNPE_ENV_PREFIX
+    = "export LD_LIBRARY_PATH=/data/local/tmp/snpebm/artifacts/"
+      "arm-android-clang6.0/lib:$LD_LIBRARY_PATH"
+      ";"
+      "export ADSP_LIBRARY_PATH=\\\"/data/local/tmp/snpebm/artifacts/"
+      "arm-android-clang6.0/lib/../../dsp/lib;/system/lib/rfsa/adsp;"
+      "/usr/lib/rfsa/adsp;/system/vendor/lib/rfsa/adsp;"
+      "/dsp;/etc/images/dsp;\\\"";
+
 static inline void handle_system_return( int status, bool terminate_on_err = false )
 {
 	if( status < 0 )
@@ -54,55 +74,53 @@ static inline void handle_system_return( int status, bool terminate_on_err = fal
 	}
 }
 
-// TODO: check exit code using WEXITSTATUS
 atop::shell_out_t atop::check_console_output( std::string const& cmd )
 {
-	std::vector<char> buffer( 512 );
-	std::unique_ptr<FILE, decltype( &pclose )> pipe( popen( cmd.c_str(), "r" ), pclose );
-	std::string output;
-
-	if( !pipe )
-	{
-		throw std::runtime_error( "popen() failed!" );
-	}
-
-	// TODO: Use fread() instead?
-	while( fgets( buffer.data(), static_cast<int>( buffer.size() ), pipe.get() ) != nullptr )
-	{
-		output += buffer.data();
-	}
+	// Device round trips are told apart from local commands
+	static auto& adb_time    = atop::selfprof::timer( "adb.command" );
+	static auto& adb_bytes   = atop::selfprof::counter( "adb.bytes" );
+	static auto& shell_time  = atop::selfprof::timer( "shell.command" );
+	static auto& shell_bytes = atop::selfprof::counter( "shell.bytes" );
+	bool adb                 = cmd.rfind( "adb ", 0 ) == 0;
+
+	auto result = atop::selfprof::timed( adb ? adb_time : shell_time, [&cmd]() {
+		return atop::subprocess::default_loop().run( cmd ).get();
+	} );
+	( adb ? adb_bytes : shell_bytes ).add( result.out.size() );
+
+	// Callers check the output; commands like "ls <missing file>" fail as
+	// part of normal operation
+	if( !result.ok() )
+		atop::logger::verbose_info(
+		    fmt::format( "Command '{0}' exited with status {1}", cmd, result.status ) );
 
-	atop::util::trim( output );
+	atop::util::trim( result.out );
 
-	return atop::util::split( output, '\n' );
+	return atop::util::split( result.out, '\n' );
 }
 
 static bool in_adb_root() { return atop::check_console_output( "adb shell whoami" )[0] == "root"; }
 
-void atop::check_reqs()
+// Returns the serial of the single connected and authorized device
+static std::string check_connected_device()
 {
-	std::array required_bins{ "adb" };
-	std::vector<std::string> not_found_bins{};
-
-	for( auto& bin: required_bins )
-	{
-		if( atop::check_console_output( fmt::format( "which {0}", bin ) ).size() == 0 )
-			not_found_bins.push_back( bin );
-	}
-
-	if( not_found_bins.size() > 0 )
-	{
-		spdlog::error( "Following required binaries not found:" );
-		for( auto& bin: not_found_bins )
-			spdlog::error( fmt::format( "\t{0}", bin ) );
-		std::abort();
-	}
-
 	// Is device connected?
 	// NOTE: command will always return a header line followed by
 	//       one line for each connected device
 	auto devices = atop::check_console_output( "adb devices" );
-	if( devices.size() == 1 )
+	if( devices.size() == 0 )
+	{
+		// Only look for the missing binary once adb didn't run
+		std::array required_bins{ "adb" };
+		spdlog::error( "Following required binaries not found:" );
+		for( auto& bin: required_bins )
+		{
+			if( atop::check_console_output( fmt::format( "which {0}", bin ) ).size() == 0 )
+				spdlog::error( fmt::format( "\t{0}", bin ) );
+		}
+		std::abort();
+	}
+	else if( devices.size() == 1 )
 		atop::logger::log_and_exit( "No devices connected" );
 	else if( devices.size() > 2 )
 		atop::logger::log_and_exit( "atop expects only a single connected Android device" );
@@ -116,6 +134,13 @@ void atop::check_reqs()
 		    "Permission denied...please allow adb access to your device (e.g., "
 		    "enable USB debugging)" );
 
+	return device_name;
+}
+
+void atop::check_reqs()
+{
+	auto device_name = check_connected_device();
+
 	// Is adb connected as root?
 	if( !in_adb_root() )
 	{
@@ -130,12 +155,228 @@ void atop::check_reqs()
 	// TODO: check adb write permissions
 }
 
-static atop::shell_out_t check_adb_shell_output( std::string const& cmd )
+// Directories whose mtimes change when benchmarks or models are added
+// or removed
+static const std::string MODEL_DIRS
+    = "/data/app /data/local/tmp /data/local/tmp/snpebm/models /data/local/tmp/snpebm/models/*";
+
+// Keys of the script's output that are cached
+static bool is_capability_key( std::string_view key )
+{
+	return key == "framework" || key == "knob" || key == "file" || key.rfind( "model.", 0 ) == 0;
+}
+
+static std::string device_probe_script( std::vector<std::string> const& setup_cmds,
+                                        std::string const& cached_key )
+{
+	// The script is passed in single quotes so must not contain any
+	std::vector<std::string> lines = {
+	    "echo user=$(whoami)", "echo nn_vlog=$(getprop debug.nn.vlog)",
+	    fmt::format( R"sh(K="$(getprop ro.build.fingerprint)@)sh"
+	                 R"sh($(echo $(stat -c %Y {0} 2>/dev/null))")sh",
+	                 MODEL_DIRS ),
+	    "echo cache_key=$K" };
+
+	std::vector<std::string> capabilities = {
+	    fmt::format( "[ -e {0} ] && echo framework=tflite", TFLITE_BENCHMARK_BIN ),
+	    fmt::format( "[ -e {0} ] && echo framework=SNPE", SNPE_BENCHMARK_BIN ),
+	    fmt::format( "pm list packages {0} | grep -qx package:{0} && echo framework=tflite_app",
+	                 TFLITE_BENCHMARK_APK ),
+	    "ls -d /data/local/tmp/*.tflite 2>/dev/null | sed s/^/model.tflite=/",
+	    R"(find /data/local/tmp/snpebm/models -name \*.dlc 2>/dev/null | sed s/^/model.SNPE=/)",
+	    R"sh(for f in $(ls -d /data/local/tmp/*.tflite 2>/dev/null; )sh"
+	    R"sh(find /data/local/tmp/snpebm/models -name \*.dlc 2>/dev/null); )sh"
+	    R"sh(do echo file=$(stat -c %s $f) $(md5sum $f); done)sh" };
+	for( auto&& knob: atop::debugfs_knobs )
+		capabilities.push_back(
+		    fmt::format( "[ -e {0} ] && echo knob={1}", knob.second, knob.first ) );
+
+	std::string listing;
+	for( auto&& line: capabilities )
+		listing += line + "; ";
+	lines.push_back( fmt::format( R"sh(if [ "$K" != "{0}" ]; then {1}fi)sh", cached_key, listing ) );
+
+	if( !setup_cmds.empty() )
+	{
+		std::string setup;
+		for( auto&& cmd: setup_cmds )
+			setup += cmd + "; ";
+		lines.push_back( fmt::format( R"sh(if [ "$(whoami)" = root ]; then {0}fi)sh", setup ) );
+	}
+
+	std::string script;
+	for( auto&& line: lines )
+		script += line + "; ";
+	return script;
+}
+
+// Whole string as decimal
+static bool parse_u64( std::string const& s, uint64_t& out )
+{
+	auto end = s.data() + s.size();
+	auto res = std::from_chars( s.data(), end, out );
+	return res.ec == std::errc() && res.ptr == end;
+}
+
+atop::DeviceInfo atop::parse_device_probe( shell_out_t const& out )
+{
+	DeviceInfo info;
+	for( auto&& line: out )
+	{
+		auto eq = line.find( '=' );
+		if( eq == std::string::npos )
+			continue;
+
+		auto key   = line.substr( 0, eq );
+		auto value = line.substr( eq + 1 );
+		atop::util::trim( value );
+
+		if( key == "user" )
+			info.root = ( value == "root" );
+		else if( key == "nn_vlog" )
+			info.nn_vlog = value;
+		else if( key == "cache_key" )
+			info.cache_key = value;
+		else if( key == "framework" )
+		{
+			if( frameworks_table.count( value ) )
+				info.frameworks.insert( atop::string2framework( value ) );
+			else
+				++info.malformed_lines;
+		}
+		else if( key == "knob" )
+			info.knobs.insert( value );
+		else if( key == "file" )
+		{
+			// <size> <md5> <path>
+			auto fields = atop::util::split( value, ' ' );
+			uint64_t size;
+			if( fields.size() == 3 && parse_u64( fields[0], size ) )
+				info.model_files[fields[2]] = ModelFile{ size, fields[1] };
+			else
+				++info.malformed_lines;
+		}
+		else if( key.rfind( "model.", 0 ) == 0 && !value.empty() )
+		{
+			if( frameworks_table.count( key.substr( 6 ) ) )
+				info.models[atop::string2framework( key.substr( 6 ) )].push_back( value );
+			else
+				++info.malformed_lines;
+		}
+	}
+
+	// The tflite benchmark app runs the same models as the binary
+	info.models[atop::Frameworks::tflite_app] = info.models[atop::Frameworks::tflite];
+
+	return info;
+}
+
+std::string atop::device_cache_path( std::string const& serial )
+{
+	// Serials of network devices look like "host:port"
+	auto name = serial;
+	std::replace_if( name.begin(), name.end(),
+	                 []( char c ) {
+		                 return !std::isalnum( static_cast<unsigned char>( c ) ) && c != '-'
+		                        && c != '.';
+	                 },
+	                 '_' );
+	return ( std::filesystem::path( atop::util::cache_dir() ) / name ).string();
+}
+
+static atop::shell_out_t read_device_cache( std::string const& path )
+{
+	atop::shell_out_t lines;
+	std::ifstream is{ path };
+	std::string line;
+	while( std::getline( is, line ) )
+		lines.push_back( line );
+	return lines;
+}
+
+static void write_device_cache( std::string const& path, atop::shell_out_t const& probe_out )
+{
+	std::error_code ec;
+	std::filesystem::create_directories( std::filesystem::path( path ).parent_path(), ec );
+
+	// Written to a temporary file first so that concurrent atop instances
+	// never read a partial cache
+	auto tmp = path + ".tmp";
+	{
+		std::ofstream os{ tmp };
+		for( auto&& line: probe_out )
+			if( auto eq = line.find( '=' ); eq != std::string::npos
+			                                && ( line.rfind( "cache_key=", 0 ) == 0
+			                                     || is_capability_key( line.substr( 0, eq ) ) ) )
+				os << line << '\n';
+		if( !os )
+		{
+			atop::logger::warn( fmt::format( "Could not write device cache '{0}'", tmp ) );
+			return;
+		}
+	}
+	std::filesystem::rename( tmp, path, ec );
+	if( ec )
+		atop::logger::warn( fmt::format( "Could not write device cache '{0}'", path ) );
+}
+
+atop::DeviceInfo atop::probe_device( std::vector<std::string> const& setup_cmds )
+{
+	auto device_name = check_connected_device();
+
+	auto cache_path = device_cache_path( device_name );
+	auto cached     = read_device_cache( cache_path );
+	auto cached_info = parse_device_probe( cached );
+	auto cached_key  = cached_info.cache_key;
+
+	// The key is embedded in the script; never match on a key that can't be.
+	// A corrupt cache is dropped so that the capabilities are listed again.
+	if( cached_key.find_first_of( "'\"$`\\" ) != std::string::npos )
+		cached_key.clear();
+	if( cached_info.malformed_lines > 0 )
+	{
+		atop::logger::warn( fmt::format( "Ignoring corrupt device cache '{0}'", cache_path ) );
+		cached_key.clear();
+	}
+
+	auto cmd = fmt::format( "adb shell '{0}'", device_probe_script( setup_cmds, cached_key ) );
+	auto out = atop::check_console_output( cmd );
+
+	auto info = parse_device_probe( out );
+	if( !info.root )
+	{
+		atop::logger::warn( "atop requires adb in root...restarting as root" );
+		handle_system_return( std::system( "adb root" ) );
+		out  = atop::check_console_output( cmd );
+		info = parse_device_probe( out );
+		if( !info.root )
+			atop::logger::log_and_exit( "Failed to restart adb in root" );
+	}
+
+	if( !cached_key.empty() && info.cache_key == cached_key )
+	{
+		// The script skipped listing capabilities
+		out.insert( out.end(), cached.begin(), cached.end() );
+		auto cache_key  = info.cache_key;
+		info            = parse_device_probe( out );
+		info.cache_key  = cache_key;
+		info.from_cache = true;
+	}
+	else
+		write_device_cache( cache_path, out );
+
+	info.serial = device_name;
+	atop::logger::verbose_info( fmt::format( "Found device: {0} (capabilities {1})", device_name,
+	                                         info.from_cache ? "cached" : "probed" ) );
+	return info;
+}
+
+atop::shell_out_t atop::check_adb_shell_output( std::string const& cmd )
 {
 	return atop::check_console_output( fmt::format( "adb shell \"{}\"", cmd ) );
 }
 
-static atop::shell_out_t check_dmesg_log() { return check_adb_shell_output( "dmesg" ); }
+static atop::shell_out_t check_dmesg_log() { return atop::check_adb_shell_output( "dmesg" ); }
 
 static atop::shell_out_t check_logcat_log( std::string const& args = "" )
 {
@@ -199,41 +440,161 @@ static atop::ioctl_dmesg_t process_and_zip_dmesg_log( atop::shell_out_t&& log,
 	                                                       regex_str, inserter );
 }
 
-static double extract_unformatted_dmesg_ts( std::string const& str )
+static atop::util::nanoseconds_t extract_unformatted_dmesg_ts( std::string_view str )
 {
 	// Match timestamp s.a. "[ 3633.459327] ..."
 	// In dmesg this represents seconds since kernel boot
-	static RE2 pattern{ R"(\[([\s\d\.?]+)\])" };
-	std::vector<std::string> matches;
-
-	if( atop::util::regex_find( pattern, str, matches ) )
-		return std::stod( matches[0] );
+	atop::util::nanoseconds_t ts;
+	size_t end;
+	if( atop::util::parse_dmesg_ts( str, ts, end ) )
+		return ts;
 	else // hard error since this should happen
 		throw std::runtime_error( "Error during log line parsing: no timestamp found" );
 }
 
+atop::DmesgPoll atop::dmesg_coverage( atop::shell_out_t const& log,
+                                     atop::util::nanoseconds_t prev_newest_ns )
+{
+	DmesgPoll poll;
+	bool first     = true;
+	bool new_line  = false;
+	poll.newest_ns = prev_newest_ns;
+	for( auto&& line: log )
+	{
+		poll.bytes += line.size() + 1;
+
+		atop::util::nanoseconds_t ts;
+		size_t end;
+		if( atop::util::parse_dmesg_ts( line, ts, end ) )
+		{
+			// If the oldest line is newer than anything seen before, the
+			// lines between the dumps were overwritten
+			if( first && prev_newest_ns > 0 && ts > prev_newest_ns )
+			{
+				poll.wrapped      = true;
+				poll.gap_start_ns = prev_newest_ns + 1;
+				poll.gap_end_ns   = ts;
+			}
+			first          = false;
+			new_line       = ts > prev_newest_ns;
+			poll.newest_ns = std::max( poll.newest_ns, ts );
+		}
+
+		if( new_line )
+			poll.new_bytes += line.size() + 1;
+	}
+
+	return poll;
+}
+
 atop::IoctlDmesgStreamer::IoctlDmesgStreamer( std::vector<std::string> const& probes )
     : utilization_probe( atop::DmesgProbes::IOCTL )
     , is_data_fresh( false )
-    , latest_ts( 0.0 )
-    , latest_data( process_and_zip_dmesg_log( check_dmesg_log(), probes ) )
+    , latest_ts( 0 )
+    , latest_data()
     , latest_interactions( {} )
     , probes( probes )
-    , stream_latency( 0.0 )
+    , stream_latency( 0 )
+    , event_store()
+    , batch_start_ns( 0 )
+    , latest_event_ns( 0 )
+    , poll()
+    , ring_bytes( 0 )
+    , gaps( 0 )
 {
-	std::vector<double> max_tses;
+	auto log          = check_dmesg_log();
+	this->poll        = atop::dmesg_coverage( log, 0 );
+	this->ring_bytes  = this->poll.bytes;
+	this->latest_data = process_and_zip_dmesg_log( std::move( log ), probes );
+
+	std::vector<atop::util::nanoseconds_t> max_tses;
 	max_tses.reserve( this->latest_data.size() );
 	for( size_t i = 0; i < this->latest_data.size(); ++i )
 		if( this->latest_data[i].size() > 0 )
 			max_tses.push_back( extract_unformatted_dmesg_ts( this->latest_data[i].back() ) );
 
+	// Events logged before startup are not added to the store
 	if( max_tses.size() > 0 )
-		this->latest_ts = *std::max_element( max_tses.begin(), max_tses.end() );
+	{
+		this->latest_ts       = *std::max_element( max_tses.begin(), max_tses.end() );
+		this->latest_event_ns = this->latest_ts;
+		this->batch_start_ns  = this->latest_event_ns + 1;
+	}
+}
+
+atop::scheduler::Scheduler::source_id_t
+atop::add_dmesg_source( scheduler::Scheduler& sampler, IoctlDmesgStreamer& streamer,
+                        std::function<void( std::map<std::string, int>& )> fn,
+                        std::function<bool()> paused, std::function<bool()> adaptive )
+{
+	using namespace std::chrono_literals;
+	using clock = scheduler::Scheduler::clock;
+
+	struct Source
+	{
+		scheduler::Scheduler::source_id_t id;
+		scheduler::AdaptivePeriod period;
+		std::optional<clock::time_point> prev_poll;
+	};
+	auto src = std::make_shared<Source>( Source{ 0, scheduler::AdaptivePeriod( 2s ), {} } );
+
+	src->id = sampler.add( "dmesg", 2s, [=, &sampler, &streamer]( clock::time_point scheduled ) {
+		if( paused && paused() )
+		{
+			src->prev_poll.reset();
+			return;
+		}
+
+		auto counts      = streamer.interactions( true /* check full log */ );
+		auto const& poll = streamer.last_poll();
+		if( !adaptive || adaptive() )
+			sampler.set_period( src->id, src->period.update( streamer.ring_fill(),
+			                                                 poll.events > 0, poll.wrapped ) );
+
+		if( src->prev_poll )
+		{
+			double per_2s = std::chrono::duration<double>( 2s )
+			                / std::chrono::duration<double>( scheduled - *src->prev_poll );
+			for( auto&& kv: counts )
+				kv.second = static_cast<int>( std::lround( kv.second * per_2s ) );
+		}
+		src->prev_poll = scheduled;
+
+		fn( counts );
+	} );
+	return src->id;
+}
+
+double atop::IoctlDmesgStreamer::ring_fill() const
+{
+	if( this->ring_bytes == 0 )
+		return 0.0;
+	return static_cast<double>( this->poll.new_bytes ) / static_cast<double>( this->ring_bytes );
 }
 
 atop::ioctl_dmesg_t const& atop::IoctlDmesgStreamer::more()
 {
-	auto data = process_and_zip_dmesg_log( check_dmesg_log(), this->probes );
+	static auto& lines_read  = atop::selfprof::counter( "dmesg.lines" );
+	static auto& regex_time  = atop::selfprof::timer( "dmesg.regex" );
+	static auto& parse_time  = atop::selfprof::timer( "dmesg.parse" );
+	static auto& events_read = atop::selfprof::counter( "dmesg.events" );
+
+	auto log         = check_dmesg_log();
+	lines_read.add( log.size() );
+	this->poll       = atop::dmesg_coverage( log, this->poll.newest_ns );
+	this->ring_bytes = std::max( this->ring_bytes, this->poll.bytes );
+	if( this->poll.wrapped )
+	{
+		this->gaps++;
+		atop::logger::warn( fmt::format(
+		    "dmesg ring wrapped between polls; lines from {0:.6f} s to {1:.6f} s are lost",
+		    atop::util::ns2s( this->poll.gap_start_ns ),
+		    atop::util::ns2s( this->poll.gap_end_ns ) ) );
+	}
+
+	auto data = atop::selfprof::timed( regex_time, [&]() {
+		return process_and_zip_dmesg_log( std::move( log ), this->probes );
+	} );
 	for( size_t i = 0; i < data.size(); ++i )
 	{
 		this->latest_data[i].clear();
@@ -246,7 +607,7 @@ atop::ioctl_dmesg_t const& atop::IoctlDmesgStreamer::more()
 		}
 	}
 
-	std::vector<double> max_tses;
+	std::vector<atop::util::nanoseconds_t> max_tses;
 	max_tses.reserve( this->latest_data.size() );
 	for( size_t i = 0; i < this->latest_data.size(); ++i )
 		if( this->latest_data[i].size() > 0 )
@@ -260,73 +621,69 @@ atop::ioctl_dmesg_t const& atop::IoctlDmesgStreamer::more()
 	else
 		this->is_data_fresh = false;
 
-	return this->latest_data;
-}
-
-static std::string extract_dmesg_accl_tag( std::string_view str )
-{
-	RE2 pattern{ R"(IOCTL ([\w]+):)" };
-	std::vector<std::string> matches;
-
-	if( atop::util::regex_find( pattern, str, matches ) )
+	// Lines are ordered newest first; events are stored oldest first
+	atop::selfprof::ScopedTimer parse_timer( parse_time );
+	std::vector<atop::events::Event> batch;
+	atop::events::Event e;
+	this->batch_start_ns = this->latest_event_ns + 1;
+	for( auto probe: { atop::DmesgProbes::IOCTL, atop::DmesgProbes::INFO } )
 	{
-		std::string ts_str = matches[0];
-		atop::util::trim( ts_str );
-
-		return ts_str;
+		auto const& lines = this->latest_data[PROBE_IDX( probe )];
+		for( auto it = lines.rbegin(); it != lines.rend(); ++it )
+		{
+			if( atop::events::parse_dmesg_line( *it, e ) )
+			{
+				batch.push_back( e );
+				this->latest_event_ns = std::max( this->latest_event_ns, e.ts_ns );
+			}
+		}
 	}
-	else
-		return "";
+	this->event_store.append( batch );
+	if( this->latest_event_ns > atop::events::live_retention_ns )
+		this->event_store.evict_before( this->latest_event_ns - atop::events::live_retention_ns );
+	this->poll.events = batch.size();
+	events_read.add( batch.size() );
+
+	return this->latest_data;
 }
 
-std::map<std::string, int> const& atop::IoctlDmesgStreamer::interactions( bool check_full_log,
-                                                                          double threshold )
+std::map<std::string, int> const&
+atop::IoctlDmesgStreamer::interactions( bool check_full_log, atop::util::nanoseconds_t threshold )
 {
-	auto start = std::chrono::system_clock::now();
-	std::vector<std::string> eligible;
-	auto data = this->more()[PROBE_IDX( this->utilization_probe )];
-	if( data.size() == 0 )
-	{
-		std::for_each( this->latest_interactions.begin(), this->latest_interactions.end(),
-		               [&]( auto& p ) { p.second = 0; } );
-	}
+	static auto& stream_time    = atop::selfprof::timer( "dmesg.stream" );
+	static auto& aggregate_time = atop::selfprof::timer( "dmesg.aggregate" );
+
+	auto start = std::chrono::steady_clock::now();
+	this->more();
+	atop::selfprof::ScopedTimer aggregate_timer( aggregate_time );
+
+	// Either all events of the latest batch or all events within
+	// threshold seconds of the newest one
+	atop::events::Query q;
+	q.kind  = atop::events::EventKinds::ioctl;
+	q.t1_ns = this->latest_event_ns + 1;
+	if( check_full_log )
+		q.t0_ns = this->batch_start_ns;
 	else
-	{
-		auto most_recent = extract_unformatted_dmesg_ts( data[0] );
-		if( check_full_log )
-			eligible = this->latest_data[PROBE_IDX( this->utilization_probe )];
-		else
-		{
-			for( auto it = data.rbegin(); it != data.rend(); ++it )
-			{
-				if( extract_unformatted_dmesg_ts( *it ) >= ( most_recent - threshold ) )
-					eligible.push_back( *it );
-				else
-					break;
-			}
-		}
+		q.t0_ns = this->latest_event_ns > threshold ? this->latest_event_ns - threshold : 0;
 
-		// Reset
-		for( auto& p: this->latest_interactions )
-			this->latest_interactions[p.first] = 0;
-		// this->latest_interactions.clear();
+	auto counts = this->event_store.count_by( atop::events::IdColumns::dev, q );
+	auto& tags  = atop::intern::accel_tags();
 
-		std::string tag;
-		for( auto& line: eligible )
-		{
-			tag = extract_dmesg_accl_tag( line );
-			if( !tag.empty() )
-			{
-				if( this->latest_interactions.find( tag ) == this->latest_interactions.end() )
-					this->latest_interactions.insert( { tag, 0 } );
-				this->latest_interactions[tag] += 1;
-			}
-		}
-	}
-	auto end = std::chrono::system_clock::now();
+	// Accelerators seen before are kept with a count of 0
+	for( auto& p: this->latest_interactions )
+		p.second = 0;
+	for( size_t id = 0; id < counts.size(); ++id )
+		if( counts[id] > 0 )
+			this->latest_interactions[std::string(
+			    tags.name( static_cast<atop::intern::string_id_t>( id ) ) )]
+			    = static_cast<int>( counts[id] );
 
-	this->stream_latency
-	    = std::chrono::duration_cast<std::chrono::milliseconds>( end - start ).count();
+	auto end = std::chrono::steady_clock::now();
+
+	this->stream_latency = static_cast<atop::util::nanoseconds_t>(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count() );
+	stream_time.record( this->stream_latency );
 
 	return this->latest_interactions;
 }
@@ -390,6 +747,33 @@ std::vector<std::string> atop::get_models_on_device( atop::Frameworks fr )
 	    fmt::format( "Framework {0} not supported", atop::framework2string( fr ) ) );
 }
 
+atop::shell_out_t atop::get_models_on_device( DeviceInfo const& info, atop::Frameworks fr )
+{
+	if( fr == atop::Frameworks::mlperf )
+		throw atop::util::NotImplementedException(
+		    fmt::format( "Framework {0} not yet implemented", atop::framework2string( fr ) ) );
+
+	if( info.frameworks.count( fr ) == 0 )
+		atop::logger::log_and_exit( fmt::format( "Benchmark of framework '{0}' is not installed "
+		                                         "on device",
+		                                         atop::framework2string( fr ) ) );
+
+	auto it = info.models.find( fr );
+	return it != std::end( info.models ) ? it->second : shell_out_t{};
+}
+
+static std::string format_benchmark_options( fmt::string_view options_fmt,
+                                             std::map<std::string, std::string> const& options )
+{
+	std::string res;
+	for( auto&& p: options )
+	{
+		res += " ";
+		res += fmt::format( options_fmt, p.first, p.second );
+	}
+	return res;
+}
+
 static std::future<atop::shell_out_t>
 run_benchmark( std::string const& benchmark_bin, fmt::string_view options_fmt,
                fmt::string_view model_fmt, std::vector<std::string> const& model_paths,
@@ -410,12 +794,8 @@ run_benchmark( std::string const& benchmark_bin, fmt::string_view options_fmt,
 	// taskset f0: run benchmark on the big cores of big.LITLE ARM CPUs.
 	// This reduces variance between benchmark runs
 	base_cmd << prefix << ( ( prefix.empty() ) ? "" : ";" )
-	         << ( use_taskset ? " taskset f0 " : " " ) << benchmark_bin;
-	for( auto&& p: options )
-	{
-		base_cmd << " ";
-		base_cmd << fmt::format( options_fmt, p.first, p.second );
-	}
+	         << ( use_taskset ? " taskset f0 " : " " ) << benchmark_bin
+	         << format_benchmark_options( options_fmt, options );
 
 	std::string base_cmd_str{ base_cmd.str() };
 	std::stringstream cmd;
@@ -459,12 +839,12 @@ run_benchmark( std::string const& benchmark_bin, fmt::string_view options_fmt,
 		      // for now this is fine but if any other framework requires it
 		      // later on the return type of run_benchmark will have to change
 		      // to std::vector<atop::shell_out_t>
-		      auto out = check_adb_shell_output( cmd_str );
+		      auto out = atop::check_adb_shell_output( cmd_str );
 		      for( int i = 0; i < repeat; ++i )
 		      {
 			      // TODO: could make this sleep parameter configurable
 			      std::this_thread::sleep_for( 1s );
-			      check_adb_shell_output( cmd_str );
+			      atop::check_adb_shell_output( cmd_str );
 		      }
 
 		      if( after_runner != nullptr )
@@ -500,9 +880,35 @@ atop::run_tflite_app_benchmark( std::vector<std::string> const& model_paths,
 	                      false /* use_taskset */, "'" /* enclose command in single quotes */ );
 }
 
+std::string atop::benchmark_cmd( atop::Frameworks fr, std::string const& model_path,
+                                 std::map<std::string, std::string> const& options )
+{
+	switch( fr )
+	{
+		case atop::Frameworks::tflite:
+			return fmt::format( "taskset f0 {0}{1} --graph={2}", TFLITE_BENCHMARK_BIN,
+			                    format_benchmark_options( "--{0}={1}", options ), model_path );
+		case atop::Frameworks::SNPE:
+			return fmt::format( "{0}; taskset f0 {1}{2} --input_list {3}/target_raw_list.txt "
+			                    "--output {3}/output --container {4}",
+			                    SNPE_ENV_PREFIX, SNPE_BENCHMARK_BIN,
+			                    format_benchmark_options( "--{0} {1}", options ),
+			                    atop::util::basepath( model_path ), model_path );
+		case atop::Frameworks::tflite_app:
+			// "am start" returns before the benchmark finishes
+			throw atop::util::NotImplementedException(
+			    "Blocking benchmark command not available for tflite_app" );
+		case atop::Frameworks::mlperf:
+			throw atop::util::NotImplementedException( "Framework mlperf not yet implemented" );
+	}
+
+	throw std::logic_error(
+	    fmt::format( "Framework {0} not supported", atop::framework2string( fr ) ) );
+}
+
 static atop::shell_out_t get_snpe_diagview_output( std::string const& model_path )
 {
-	auto log_files = check_adb_shell_output(
+	auto log_files = atop::check_adb_shell_output(
 	    fmt::format( "ls {0}/output/SNPEDiag_*.log", atop::util::basepath( model_path ).c_str() ) );
 
 	// TODO: check whether diagview exists
@@ -527,16 +933,6 @@ atop::run_snpe_benchmark( std::vector<std::string> const& model_paths,
                           std::map<std::string, std::string> const& options, int processes,
                           int num_runs )
 {
-	// Awkward ADSP_LIBRARY_PATH because paths need to be
-	// separated by ";" instead of the usual ":"
-	std::string prefix = "export LD_LIBRARY_PATH=/data/local/tmp/snpebm/artifacts/"
-	                     "arm-android-clang6.0/lib:$LD_LIBRARY_PATH"
-	                     ";"
-	                     "export ADSP_LIBRARY_PATH=\\\"/data/local/tmp/snpebm/artifacts/"
-	                     "arm-android-clang6.0/lib/../../dsp/lib;/system/lib/rfsa/adsp;"
-	                     "/usr/lib/rfsa/adsp;/system/vendor/lib/rfsa/adsp;"
-	                     "/dsp;/etc/images/dsp;\\\"";
-
 	for( auto&& m: model_paths )
 	{
 		std::string base_path = atop::util::basepath( m );
@@ -544,11 +940,13 @@ atop::run_snpe_benchmark( std::vector<std::string> const& model_paths,
 		atop::logger::verbose_info(
 		    fmt::format( "Deleting previous benchmark results in {0}/output", base_path ) );
 
-		check_adb_shell_output( fmt::format( "rm -rf {0}/output/SNPEDiag_*.log", base_path ) );
+		atop::check_adb_shell_output(
+		    fmt::format( "rm -rf {0}/output/SNPEDiag_*.log", base_path ) );
 	}
 
 	return run_benchmark(
-	    SNPE_BENCHMARK_BIN, "--{0} {1}", "--container {0}", model_paths, options, processes, prefix,
+	    SNPE_BENCHMARK_BIN, "--{0} {1}", "--container {0}", model_paths, options, processes,
+	    SNPE_ENV_PREFIX,
 	    []( std::string const& model ) {
 		    return fmt::format( "--input_list {0}/target_raw_list.txt --output {0}/output",
 		                        atop::util::basepath( model ) );
@@ -614,6 +1012,9 @@ atop::CpuUtilizationStreamer::CpuUtilizationStreamer()
 
 std::map<std::string, double> const& atop::CpuUtilizationStreamer::utilizations()
 {
+	static auto& poll_time = atop::selfprof::timer( "cpu.poll" );
+	atop::selfprof::ScopedTimer poll_timer( poll_time );
+
 	auto info = get_proc_stat_cpu_info();
 
 	for( size_t i = 0; i < this->total_tick.size(); ++i )
@@ -638,45 +1039,33 @@ std::map<std::string, double> const& atop::CpuUtilizationStreamer::utilizations(
 	return this->latest_utils;
 }
 
-static auto expand_scientific_notation(std::string const& str)
-{
-	char* end;
-	auto exp_pos = str.find('e');
-	auto exp = std::strtoull(str.substr(exp_pos + 2).c_str(), &end, 10);
-	auto mantissa = std::strtod(str.substr(0, exp_pos).c_str(), &end);
-	return mantissa * std::pow(10, exp);
-}
-
 static void summarize_tflite_benchmark_output( atop::shell_out_t const& out,
                                                atop::BenchmarkStats& stats )
 {
-	char* end;
 	// Pattern extracts "Init" and "Inference (avg)" results
-    // NB: Avg could be in scientific notation
+	// NB: Avg could be in scientific notation
 	static const RE2 pattern{ R"(Init: ([\d]+)([\w:\s,\(\)].*)Inference \(avg\): ([\d\.\+e]+))" };
 
 	for( auto& line: out )
 	{
 		if( line.rfind( "PRE-PROCESSING", 0 ) == 0 )
 		{
-			stats.stats["preproc"]
-			    = strtoull( atop::util::split( line, ' ' )[1].c_str(), &end, 10 );
+			stats[atop::BenchmarkPhases::preproc].add( atop::util::decimal2ns(
+			    atop::util::split( line, ' ' )[1], atop::util::ns_per_us ) );
 		}
 		if( line.rfind( "Inference timings in us", 0 ) == 0 )
 		{
 			std::vector<std::string> matches;
 
 			if( atop::util::regex_find( pattern, line, matches ) )
-            {
-				stats.stats["init"] = strtoull( matches[0].c_str(), &end, 10 );
+			{
+				stats[atop::BenchmarkPhases::init].add(
+				    atop::util::decimal2ns( matches[0], atop::util::ns_per_us ) );
 				// Inference time in tflite benchmark doesn't include
 				// pre-/post-processing
 				// TODO: account for offload?
-				auto inf_str = matches[2];
-				if(inf_str.find('e') != std::string::npos)
-					stats.stats["inference"] = static_cast<uint64_t>(expand_scientific_notation(inf_str));
-				else
-                    stats.stats["inference"] = strtoull( inf_str.c_str(), &end, 10 );
+				stats[atop::BenchmarkPhases::inference].add(
+				    atop::util::decimal2ns( matches[2], atop::util::ns_per_us ) );
 			}
 		}
 	}
@@ -686,15 +1075,12 @@ static void summarize_snpe_benchmark_output( atop::shell_out_t const& out,
                                              atop::BenchmarkStats& stats )
 {
 	bool start_parsing = false;
-	char* end;
 
 	// Match e.g. Create Networks(s): 12345 us
 	static const RE2 pattern{ R"(([\w\s\(\)-]+):\s([\d]+) us)" };
 
-	// SNPE Stats
-	std::map<std::string, uint64_t> snpe_stats;
-
-	unsigned header_cnt = 0;
+	// SNPE Stats of each results section
+	std::vector<std::map<std::string, atop::util::nanoseconds_t>> sections;
 
 	for( auto&& line: out )
 	{
@@ -705,7 +1091,7 @@ static void summarize_snpe_benchmark_output( atop::shell_out_t const& out,
 		if( line.rfind( "Dnn Runtime Load/Deserialize/Create/De-Init Statistics", 0 ) == 0 )
 		{
 			start_parsing = true;
-			header_cnt++;
+			sections.emplace_back();
 			continue;
 		}
 
@@ -720,28 +1106,27 @@ static void summarize_snpe_benchmark_output( atop::shell_out_t const& out,
 			std::vector<std::string> matches;
 
 			if( atop::util::regex_find( pattern, line, matches ) )
-			{
-				uint64_t val = strtoull( matches[1].c_str(), &end, 10 );
-				if( auto it{ snpe_stats.find( matches[0] ) }; it != std::end( snpe_stats ) )
-					( *it ).second += val;
-				else
-					snpe_stats.insert( std::pair<std::string, uint64_t>( matches[0], val ) );
-			}
+				sections.back()[matches[0]]
+				    += atop::util::decimal2ns( matches[1], atop::util::ns_per_us );
 		}
 	}
 
-	for( auto& e: snpe_stats )
-		e.second = e.second / header_cnt;
-
-	// SNPE workloads are already pre-processed
-	stats.stats["preproc"] = 0;
+	// SNPE workloads are already pre-processed and not post-processed, so
+	// only inference, offload and init are sampled once per section
+	for( auto&& snpe_stats: sections )
+	{
+		stats[atop::BenchmarkPhases::inference].add( snpe_stats["Forward Propagate Time"] );
 
-	stats.stats["inference"] = snpe_stats["Forward Propagate Time"];
+		auto rpc_init = snpe_stats["RPC Init Time"];
+		auto acc_init = snpe_stats["Accelerator Init Time"];
+		auto rpc_exec = snpe_stats["RPC Execute"];
+		auto acc_exec = snpe_stats["Accelerator"];
+		if( rpc_init >= acc_init && rpc_exec >= acc_exec )
+			stats[atop::BenchmarkPhases::offload].add( ( rpc_init - acc_init )
+			                                           + ( rpc_exec - acc_exec ) );
 
-	stats.stats["offload"] = ( snpe_stats["RPC Init Time"] - snpe_stats["Accelerator Init Time"] )
-	                         + ( snpe_stats["RPC Execute"] - snpe_stats["Accelerator"] );
-	stats.stats["postproc"] = 0;
-	stats.stats["init"]     = snpe_stats["Init"];
+		stats[atop::BenchmarkPhases::init].add( snpe_stats["Init"] );
+	}
 }
 
 void atop::summarize_benchmark_output( shell_out_t const& out, atop::Frameworks fr,
@@ -757,57 +1142,66 @@ void atop::summarize_benchmark_output( shell_out_t const& out, atop::Frameworks
 	};
 }
 
-static void ioctl_breakdown_impl( std::map<std::string, std::map<std::string, int>>& breakdown,
-                                  atop::shell_out_t const& data, RE2 const& pattern )
+atop::IoctlBreakdown::IoctlBreakdown()
+    : counts()
+    , next_event( 0 )
+    , sorted_rows()
+    , dirty( false )
 {
-	std::vector<std::string> matches;
+}
 
-	for( auto&& line: data )
-	{
-		if( atop::util::regex_find( pattern, line, matches ) )
+void atop::IoctlBreakdown::update( atop::events::EventStore const& store )
+{
+	static auto& aggregate_time = atop::selfprof::timer( "breakdown.aggregate" );
+	atop::selfprof::ScopedTimer aggregate_timer( aggregate_time );
+
+	this->next_event = store.scan( this->next_event, [this]( atop::events::Event const& e ) {
+		if( e.app != atop::events::none_id && e.cmd != atop::events::none_id )
 		{
-			std::string app = matches[0];
-			std::string cmd = matches[1];
-			// Application in map?
-			if( auto it{ breakdown.find( app ) }; it == std::end( breakdown ) )
-				breakdown.insert( std::pair<std::string, std::map<std::string, int>>( app, {} ) );
+			this->counts.increment( atop::intern::pack( e.app, e.cmd ) );
+			this->dirty = true;
+		}
+	} );
+}
 
-			if( auto ioctl_it{ breakdown[app].find( cmd ) };
-			    ioctl_it == std::end( breakdown[app] ) )
-				breakdown[app].insert( std::pair<std::string, int>( cmd, 0 ) );
+void atop::IoctlBreakdown::clear()
+{
+	this->counts.clear();
+	this->sorted_rows.clear();
+	this->dirty = false;
+}
 
-			breakdown[app][cmd]++;
-		}
-	}
+int64_t atop::IoctlBreakdown::count( std::string_view app, std::string_view cmd ) const
+{
+	atop::intern::string_id_t app_id, cmd_id;
+	if( !atop::intern::app_names().find( app, app_id )
+	    || !atop::intern::ioctl_cmds().find( cmd, cmd_id ) )
+		return 0;
+	return this->counts.get( atop::intern::pack( app_id, cmd_id ) );
 }
 
-void atop::ioctl_breakdown( std::map<std::string, std::map<std::string, int>>& breakdown,
-                            atop::shell_out_t const& data, atop::DmesgProbes probe )
+std::vector<atop::IoctlBreakdown::Row> const& atop::IoctlBreakdown::rows()
 {
-	switch( probe )
-	{
-		case atop::DmesgProbes::IOCTL:
-		{
-			std::string tag_pattern = R"([\(\)\w\s:\-]*)";
-			std::string cmd_pattern = R"(\(cmd: ([\w\s]+) \[[\d]+\]\))";
-			std::string app_pattern
-			    = tag_pattern + R"(\(app: ([\w_:@\-]+)\))" + " " + cmd_pattern + tag_pattern;
-			auto pattern_str = R"(\[[\d\.\s*]+\] IOCTL [a-zA-Z]+)" + app_pattern;
-			RE2 pattern{ pattern_str };
-			ioctl_breakdown_impl( breakdown, data, pattern );
-		}
-		break;
-		case atop::DmesgProbes::INFO:
-		{
-			auto pattern_str = R"(\[[\d\.\s*]+\] INFO: \(app: ([:@\-\w]+)\) ([\s\/\-\w]+))";
-			RE2 pattern{ pattern_str };
-			ioctl_breakdown_impl( breakdown, data, pattern );
-		}
-		break;
-		default:
-			throw atop::util::NotImplementedException(
-			    "Breakdown for given probe not implemented" );
-	}
+	if( !this->dirty )
+		return this->sorted_rows;
+
+	this->sorted_rows.clear();
+	this->counts.for_each( [this]( uint64_t key, int64_t cnt ) {
+		this->sorted_rows.push_back(
+		    Row{ atop::intern::unpack_hi( key ), atop::intern::unpack_lo( key ), cnt } );
+	} );
+
+	auto& apps = atop::intern::app_names();
+	auto& cmds = atop::intern::ioctl_cmds();
+	std::sort( this->sorted_rows.begin(), this->sorted_rows.end(),
+	           [&]( Row const& r1, Row const& r2 ) {
+		           if( r1.app != r2.app )
+			           return apps.name( r1.app ) < apps.name( r2.app );
+		           return cmds.name( r1.cmd ) < cmds.name( r2.cmd );
+	           } );
+
+	this->dirty = false;
+	return this->sorted_rows;
 }
 
 // TODO: could be std::map<LogcatProbes, std::string>
@@ -883,8 +1277,14 @@ atop::logcat_out_t atop::LogcatStreamer::more()
 	//       once tz.h is fixed and LogcatStreamer constructor has been corrected
 	auto additional_args
 	    = this->latest_ts_.empty() ? "" : fmt::format( " -T \"{0}\"", this->latest_ts_ );
-	auto data = process_and_zip_logcat_log(
-	    check_logcat_log( this->logcat_tag_args_ + additional_args ), this->probes_ );
+	static auto& lines_read = atop::selfprof::counter( "logcat.lines" );
+	static auto& regex_time = atop::selfprof::timer( "logcat.regex" );
+
+	auto log = check_logcat_log( this->logcat_tag_args_ + additional_args );
+	lines_read.add( log.size() );
+	auto data = atop::selfprof::timed( regex_time, [&]() {
+		return process_and_zip_logcat_log( std::move( log ), this->probes_ );
+	} );
 
 	std::vector<std::chrono::system_clock::time_point> max_tses;
 	for( auto&& kv: data )
@@ -930,30 +1330,17 @@ atop::logcat_out_t atop::LogcatStreamer::more()
 	return this->latest_data_;
 }
 
-// offload_t in milliseconds
-static void update_tflite_offload( atop::BenchmarkStats& stats, double offload_t )
+static void update_tflite_offload( atop::BenchmarkStats& stats,
+                                   atop::util::nanoseconds_t offload_ns )
 {
-	if( offload_t >= 0 )
-	{
-		if( auto it{ stats.stats.find( "offload" ) }; it != std::end( stats.stats ) )
-			( *it ).second += static_cast<uint64_t>( offload_t * 1.0e6 );
-		else
-			stats.stats.insert( std::pair<std::string, double>(
-			    "offload", static_cast<uint64_t>( offload_t * 1.0e6 ) ) );
-	}
-	else
-	{
-		atop::logger::verbose_info(
-		    fmt::format( "{0}:{1}: offload calculation negative. Usually this means that a "
-		                 "daemon process start has been included in the calculation",
-		                 __FUNCTION__, __LINE__ ) );
-	}
+	// Streamed batches without offload activity aren't samples
+	if( offload_ns > 0 )
+		stats[atop::BenchmarkPhases::offload].add( offload_ns );
 }
 
 void atop::update_tflite_kernel_offload( atop::shell_out_t const& data,
                                          atop::BenchmarkStats& stats )
 {
-	char* end;
 	// Matches, e.g., [123.123] TIME ioctl (s): (app: myapp) (pid: 123) getinfo:
 	// 0.009123
 	static std::string tag_pattern = R"([\(\)a-z\s:\d\-_]*)";
@@ -965,48 +1352,53 @@ void atop::update_tflite_kernel_offload( atop::shell_out_t const& data,
 	static const RE2 pattern{ pattern_str };
 	std::vector<std::string> matches;
 
-	double ioctl_time  = 0.0;
-	double invoke_time = 0.0;
+	atop::util::nanoseconds_t ioctl_time  = 0;
+	atop::util::nanoseconds_t invoke_time = 0;
 	for( auto& e: data )
 	{
 		if( atop::util::regex_find( pattern, e, matches ) )
 		{
 			if( matches[0] == "ioctl" )
-				ioctl_time += strtod( matches[2].c_str(), &end );
+				ioctl_time += atop::util::decimal2ns( matches[2], atop::util::ns_per_s );
 			else if( matches[0] == "internal_invoke" )
-				invoke_time += strtod( matches[2].c_str(), &end );
+				invoke_time += atop::util::decimal2ns( matches[2], atop::util::ns_per_s );
 		}
 	}
 
-	update_tflite_offload( stats, ( ioctl_time - invoke_time ) * 1.0e3 );
+	if( ioctl_time >= invoke_time )
+		update_tflite_offload( stats, ioctl_time - invoke_time );
+	else
+	{
+		atop::logger::verbose_info(
+		    fmt::format( "{0}:{1}: offload calculation negative. Usually this means that a "
+		                 "daemon process start has been included in the calculation",
+		                 __FUNCTION__, __LINE__ ) );
+	}
 }
 
 void atop::update_tflite_kernel_gpu_offload( atop::shell_out_t const& data,
                                              atop::BenchmarkStats& stats )
 {
-	char* end;
-	// Matches, e.g., [123.123] TIME ioctl (s): (app: myapp) (pid: 123) getinfo:
-	// 0.009123
+	// Matches, e.g., IOCTL kgsl: (app: myapp) (cmd: ...) (device: ...) (time: 0.000012345)
 	static std::string pattern_str
 	    = R"(IOCTL kgsl: \(app: (benchmark_model|neuralnetworks@|HwBinder:[\d_]+)\) [\[\]\-\w:\(\)\s]* \(time: ([\d\.]+)\))";
 	static const RE2 pattern{ pattern_str };
 	std::vector<std::string> matches;
 
-	double ioctl_time = 0.0;
+	atop::util::nanoseconds_t ioctl_time = 0;
 	for( auto& e: data )
 	{
 		if( atop::util::regex_find( pattern, e, matches ) )
-		{
-			ioctl_time += strtod( matches[1].c_str(), &end );
-		}
+			ioctl_time += atop::util::decimal2ns( matches[1], atop::util::ns_per_s );
 	}
 
-	update_tflite_offload( stats, ioctl_time * 1.0e3 );
+	update_tflite_offload( stats, ioctl_time );
 }
 
 void atop::update_tflite_driver_offload( atop::shell_out_t const& data,
                                          atop::BenchmarkStats& stats )
 {
+	// Driver and delegate times are logged in milliseconds
 	static auto nnapi_driver_pattern{ R"((ExecutionBuilder\s*:\s*\(NNAPI ANDROID\) ([\d\.]+)))" };
 	static auto tflite_kernel_pattern{
 	    R"((tflite\s*:\s*TIME NNAPI_DELEGATE: \(driver\) ([\d\.]+) \(delegate\) ([\d\.]+)))" };
@@ -1014,21 +1406,20 @@ void atop::update_tflite_driver_offload( atop::shell_out_t const& data,
 	    fmt::format( "({0}|{1})", nnapi_driver_pattern, tflite_kernel_pattern ) };
 	static const RE2 pattern{ pattern_str };
 	std::vector<std::string> matches;
-	char* end;
 
-	double offload = 0.0;
+	atop::util::nanoseconds_t offload = 0;
 	for( auto& e: data )
 	{
 		if( atop::util::regex_find( pattern, e, matches ) )
 		{
 			if( matches.size() == 3 ) // tflite_kernel_pattern
 			{
-				offload += strtod( matches[2].c_str(), &end );
+				offload += atop::util::decimal2ns( matches[2], atop::util::ns_per_ms );
 			}
 			else // nnapi_driver_pattern
 			{
-				offload += strtod( matches[4].c_str(), &end );
-				offload += strtod( matches[5].c_str(), &end );
+				offload += atop::util::decimal2ns( matches[4], atop::util::ns_per_ms );
+				offload += atop::util::decimal2ns( matches[5], atop::util::ns_per_ms );
 			}
 		}
 	}
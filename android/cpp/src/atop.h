@@ -3,15 +3,21 @@
 
 #include <algorithm>
 #include <array>
+#include <functional>
 #include <future>
 #include <initializer_list>
 #include <map>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <fmt/format.h>
 
+#include "events.h"
+#include "intern.h"
+#include "scheduler.h"
+#include "stats.h"
 #include "util.h"
 
 extern bool VERBOSE;
@@ -61,8 +67,75 @@ inline std::string framework2string( Frameworks fr )
 
 void check_reqs();
 shell_out_t check_console_output( std::string const& cmd );
+shell_out_t check_adb_shell_output( std::string const& cmd );
 shell_out_t get_models_on_device( Frameworks );
 
+// Debugfs knobs of the instrumented drivers by name
+std::map<std::string, std::string> const debugfs_knobs
+    = { { "dsp", "/sys/kernel/debug/adsprpc/global" },
+        { "gpu", "/sys/kernel/debug/kgsl/kgsl-3d0/log_level_perf" },
+        { "camera_sync", "/sys/kernel/debug/camera_sync/logging_enabled" },
+        { "cam_sensor", "/sys/kernel/debug/cam_sensor/logging_enabled" } };
+
+struct ModelFile
+{
+	uint64_t size;
+	std::string md5;
+};
+
+// Connected device as found by probe_device()
+struct DeviceInfo
+{
+	std::string serial{};
+	bool root = false;
+
+	// debug.nn.vlog before atop changed it
+	std::string nn_vlog{};
+
+	// Build fingerprint and mtimes of the directories the capabilities
+	// below are read from; the capabilities are cached while it is
+	// unchanged
+	std::string cache_key{};
+	bool from_cache = false;
+
+	// Frameworks whose benchmark binary or APK is installed
+	std::set<Frameworks> frameworks{};
+	std::map<Frameworks, shell_out_t> models{};
+
+	// Size and hash of each model by path
+	std::map<std::string, ModelFile> model_files{};
+
+	// Names of the debugfs_knobs present
+	std::set<std::string> knobs{};
+
+	// Lines of the probe output that were malformed and skipped
+	size_t malformed_lines = 0;
+};
+
+// Like check_reqs() followed by get_models_on_device() for all
+// frameworks, but all on-device checks run as one script in a single adb
+// shell invocation. setup_cmds (e.g. enabling kernel logging) are
+// appended to the script and only run as root.
+//
+// Capabilities (benchmarks, models, knobs) are cached on disk per device
+// serial. The script only lists and hashes them again if the build
+// fingerprint or the mtime of /data/app or a model directory changed.
+DeviceInfo probe_device( std::vector<std::string> const& setup_cmds = {} );
+
+// Parses the "key=value" lines printed by probe_device()'s script;
+// malformed lines are skipped and counted
+DeviceInfo parse_device_probe( shell_out_t const& out );
+
+// Path of a device's capability cache; <util::cache_dir()>/<serial>
+std::string device_cache_path( std::string const& serial );
+
+// Models of a probed device; exits if fr's benchmark isn't installed
+shell_out_t get_models_on_device( DeviceInfo const& info, Frameworks fr );
+
+// Command running a single, blocking benchmark of model_path on the device
+std::string benchmark_cmd( Frameworks fr, std::string const& model_path,
+                           std::map<std::string, std::string> const& options );
+
 // TODO: use std::variant for options?
 std::future<shell_out_t> run_tflite_benchmark( std::vector<std::string> const& model_paths,
                                                std::map<std::string, std::string> const& options,
@@ -117,6 +190,29 @@ inline DmesgProbes string2dmesgProbes( std::string pr )
 
 using ioctl_dmesg_t = std::array<shell_out_t, PROBE_IDX( DmesgProbes::LAST )>;
 
+// Coverage of one dmesg dump compared to the previous one
+struct DmesgPoll
+{
+	// Size of the dump and of the lines logged since the previous dump
+	size_t bytes     = 0;
+	size_t new_bytes = 0;
+
+	// Timestamp of the newest line
+	util::nanoseconds_t newest_ns = 0;
+
+	// The ring wrapped and lines logged in [gap_start_ns, gap_end_ns) are lost
+	bool wrapped                     = false;
+	util::nanoseconds_t gap_start_ns = 0;
+	util::nanoseconds_t gap_end_ns   = 0;
+
+	// New IOCTL and INFO events
+	size_t events = 0;
+};
+
+// Compares a dmesg dump to the newest timestamp of the previous dump;
+// lines without timestamp are counted as part of the preceding line
+DmesgPoll dmesg_coverage( shell_out_t const& log, util::nanoseconds_t prev_newest_ns );
+
 class IoctlDmesgStreamer
 {
   public:
@@ -131,25 +227,61 @@ class IoctlDmesgStreamer
 	ioctl_dmesg_t const& get_data() { return this->latest_data; }
 	std::map<std::string, int> const& get_interactions() { return this->latest_interactions; }
 
+	// IOCTL and INFO events of the lines returned by more() within
+	// events::live_retention_ns of the newest one, which bounds the
+	// thresholds of interactions(); rows are evicted chunk-wise
+	events::EventStore const& events() const { return this->event_store; }
+
 	ioctl_dmesg_t const& more();
-	std::map<std::string, int> const& interactions( bool check_full_log = false,
-	                                                double threshold    = 20.0 );
+	std::map<std::string, int> const&
+	interactions( bool check_full_log = false, util::nanoseconds_t threshold = 20 * util::ns_per_s );
+
+	util::nanoseconds_t get_duration() const { return this->stream_latency; }
+
+	// Coverage of the last call to more()
+	DmesgPoll const& last_poll() const { return this->poll; }
+
+	// Fraction of the kernel ring written since the previous call to
+	// more(). The ring size is estimated by the largest dump seen.
+	double ring_fill() const;
 
-	float get_duration() const { return this->stream_latency; }
+	// Number of polls which missed lines since the ring wrapped
+	size_t coverage_gaps() const { return this->gaps; }
 
 	DmesgProbes utilization_probe;
 	bool is_data_fresh;
 
   private:
-	double latest_ts;
+	util::nanoseconds_t latest_ts;
 	ioctl_dmesg_t latest_data;
 	std::map<std::string, int> latest_interactions;
 	std::vector<std::string> probes;
 
 	// Latency of last "interactions" call
-	float stream_latency;
+	util::nanoseconds_t stream_latency;
+
+	events::EventStore event_store;
+
+	// Time window of the events added by the last call to more()
+	util::nanoseconds_t batch_start_ns;
+	util::nanoseconds_t latest_event_ns;
+
+	DmesgPoll poll;
+	size_t ring_bytes;
+	size_t gaps;
 };
 
+// Adds a source polling streamer to sampler and calls fn with the
+// interactions of each poll, normalized to counts per 2 s whatever the
+// period. While adaptive() holds, the period follows driver activity (see
+// scheduler::AdaptivePeriod). Polls are skipped while paused() holds.
+// Empty predicates never pause and always adapt.
+scheduler::Scheduler::source_id_t
+add_dmesg_source( scheduler::Scheduler& sampler, IoctlDmesgStreamer& streamer,
+                  std::function<void( std::map<std::string, int>& )> fn,
+                  std::function<bool()> paused   = nullptr,
+                  std::function<bool()> adaptive = nullptr );
+
 class CpuUtilizationStreamer
 {
   public:
@@ -173,16 +305,64 @@ class CpuUtilizationStreamer
 	int num_cpus;
 };
 
+enum class BenchmarkPhases : int
+{
+	preproc = 0,
+	init,
+	inference,
+	offload,
+	// Framework overhead for delegation
+	delegation,
+	postproc,
+
+	// End marker; do not add anything below
+	LAST
+};
+
+std::map<std::string, BenchmarkPhases> const benchmark_phases_table
+    = { { "preproc", BenchmarkPhases::preproc },     { "init", BenchmarkPhases::init },
+        { "inference", BenchmarkPhases::inference }, { "offload", BenchmarkPhases::offload },
+        { "delegation", BenchmarkPhases::delegation }, { "postproc", BenchmarkPhases::postproc } };
+
+inline std::string phase2string( BenchmarkPhases phase )
+{
+	auto it = std::find_if( std::begin( benchmark_phases_table ), std::end( benchmark_phases_table ),
+	                        [&]( auto&& p ) { return p.second == phase; } );
+
+	if( it != std::end( benchmark_phases_table ) )
+		return it->first;
+	else
+		throw std::runtime_error( "Benchmark phase not defined" );
+}
+
+// Per-run latency samples (nanoseconds) of each benchmark phase
+//
+// Summaries of separate benchmark processes are collected into their own
+// BenchmarkStats and merged, so no process overwrites another's results.
 struct BenchmarkStats
 {
-	// Latencies in microseconds
-	std::unordered_map<std::string, uint64_t> stats = { { "preproc", 0 },
-	                                                    { "postproc", 0 },
-	                                                    { "inference", 0 },
-	                                                    { "offload", 0 },
-	                                                    // Framework overhead for delegation
-	                                                    { "delegation", 0 },
-	                                                    { "init", 0 } };
+	std::array<stats::Samples, static_cast<size_t>( BenchmarkPhases::LAST )> phases{};
+
+	stats::Samples& operator[]( BenchmarkPhases phase )
+	{
+		return this->phases[static_cast<size_t>( phase )];
+	}
+	stats::Samples const& operator[]( BenchmarkPhases phase ) const
+	{
+		return this->phases[static_cast<size_t>( phase )];
+	}
+
+	void merge( BenchmarkStats const& other )
+	{
+		for( size_t i = 0; i < this->phases.size(); ++i )
+			this->phases[i].merge( other.phases[i] );
+	}
+
+	void clear()
+	{
+		for( auto&& s: this->phases )
+			s.clear();
+	}
 };
 
 enum class LogcatProbes : int
@@ -222,8 +402,43 @@ class LogcatStreamer
 
 void summarize_benchmark_output( shell_out_t const&, atop::Frameworks, BenchmarkStats& );
 
-void ioctl_breakdown( std::map<std::string, std::map<std::string, int>>& breakdown,
-                      atop::shell_out_t const& data, atop::DmesgProbes probe );
+// Per-application ioctl command counts
+//
+// Aggregated incrementally from an event store: each update() only
+// visits events appended since the previous one. Counts are kept in a
+// flat table keyed by (app id, cmd id).
+class IoctlBreakdown
+{
+  public:
+	struct Row
+	{
+		intern::string_id_t app;
+		intern::string_id_t cmd;
+		int64_t count;
+	};
+
+	IoctlBreakdown();
+	~IoctlBreakdown()                       = default;
+	IoctlBreakdown( IoctlBreakdown const& ) = delete;
+	IoctlBreakdown( IoctlBreakdown&& )      = delete;
+
+	// Counts IOCTL and INFO events appended to store since the last call
+	void update( events::EventStore const& store );
+
+	// Drops counts of events seen so far
+	void clear();
+	bool empty() const { return this->counts.empty(); }
+	int64_t count( std::string_view app, std::string_view cmd ) const;
+
+	// Ordered by app and then command name; only re-sorted after changes
+	std::vector<Row> const& rows();
+
+  private:
+	intern::FlatCounter counts;
+	size_t next_event;
+	std::vector<Row> sorted_rows;
+	bool dirty;
+};
 
 void update_tflite_kernel_offload( atop::shell_out_t const& data, atop::BenchmarkStats& stats );
 void update_tflite_kernel_gpu_offload( atop::shell_out_t const& data, atop::BenchmarkStats& stats );
@@ -0,0 +1,834 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <docopt/docopt.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "alp.h"
+#include "atop.h"
+#include "clocks.h"
+#include "collector.h"
+#include "events.h"
+#include "ftrace.h"
+#include "loadgen.h"
+#include "logger.h"
+#include "metrics.h"
+#include "modelsync.h"
+#include "physmap.h"
+#include "protocol.h"
+#include "scheduler.h"
+#include "timeline.h"
+#include "trace.h"
+#include "util.h"
+
+static constexpr auto USAGE =
+    R"(atopctl - offline analysis tools for atop
+	  Usage:
+			atopctl classify --iomem=<file> [options] [<addr>...]
+			atopctl alp --iomem=<file> [options] [<trace>]
+			atopctl loadgen --models=<cfg> [options] [--option=<kv>...]
+			atopctl events [options] [<dmesg>]
+			atopctl timeline [options] <json> [<dmesg>]
+			atopctl ftrace [options] [<tracefs>]
+			atopctl merge [options] <dmesg> <logcat>
+			atopctl sync [options] <dir>
+			atopctl pack [options] <trace> [<text>]
+			atopctl unpack [options] <trace>
+			atopctl serve [options]
+			atopctl watch [options]
+			atopctl (-h | --help)
+			atopctl --version
+
+	  Options:
+	  		-h, --help        Show usage
+			-v, --verbose     Verbose outputs [default: false]
+			--iomem=<file>    Captured /proc/iomem
+			--dts=<file>      Decompiled device tree with reserved-memory carve-outs
+			--threads=<n>     Worker threads for batch lookups (0: all cores) [default: 0]
+			--summary         Only print number of addresses per IP block
+			--pagemap=<root>  Translate virtual addresses using <root>/<pid>/pagemap
+			                  (e.g., /proc); addresses are physical if omitted
+			--window=<ms>     Reporting window [default: 1000]
+			--pid=<pid>       Only account accesses of this process
+			--fetches         Also account instruction fetches
+			--models=<cfg>    Models to run, one "<path on device> [<weight>]" per line
+			--framework=<fr>  Benchmark framework (tflite or SNPE) [default: tflite]
+			--arrivals=<ap>   Arrival process: poisson, bursty or trace [default: poisson]
+			--rate=<rps>      Mean arrival rate (within bursts for bursty) [default: 1]
+			--on=<s>          Mean length of a burst [default: 1]
+			--off=<s>         Mean pause between bursts [default: 4]
+			--arrival-trace=<file>  Arrival offsets in seconds for --arrivals=trace
+			--duration=<s>    Stop issuing requests or recording after this many seconds
+			                  [default: 60]
+			--requests=<n>    Stop after this many requests (0: unlimited) [default: 0]
+			--concurrency=<n> Requests executing simultaneously on the device [default: 1]
+			--option=<kv>     Benchmark option as key=value (e.g., use_gpu=true)
+			--seed=<n>        Seed for arrivals and model selection (0: random) [default: 0]
+			--csv=<file>      Write per-request latencies to <file>
+			--by=<col>        Group driver events by app, dev or cmd [default: dev]
+			--app=<name>      Only account events of this app
+			--histogram       Print event counts per window instead of totals
+			--live            Record the timeline from the collector at --address
+			--dest=<path>     Device directory mirroring <dir> [default: /data/local/tmp]
+			--jobs=<n>        Concurrent adb pushes [default: 4]
+			--dry-run         Only list the files that would be pushed
+			--address=<addr>  Collector socket: unix:<path>, <host>:<port> or <port>
+			                  [default: 127.0.0.1:7433]
+			--metrics=<addr>  Also serve OpenMetrics on <addr> (e.g., 9433)
+			--clock-offset=<s>  dmesg minus logcat clock in seconds instead of the
+			                  offset estimated from atop-clock lines
+			-V, --version     Show version
+		)";
+
+static constexpr auto VERSION_STRING = "atopctl - Version 0.1";
+
+bool VERBOSE{ false };
+
+// Classifies addresses given on the command line or, if none are given,
+// one hex address per line on stdin
+static int classify( std::map<std::string, docopt::value>& args )
+{
+	atop::physmap::PhysMap map;
+	map.load_iomem( args["--iomem"].asString() );
+	if( args["--dts"] )
+		map.load_dts_carveouts( args["--dts"].asString() );
+	map.build();
+
+	LOG( fmt::format( "Loaded {0} regions", map.regions().size() ) );
+
+	std::vector<atop::physmap::addr_t> addrs;
+	if( args["<addr>"].asStringList().empty() )
+	{
+		std::string line;
+		while( std::getline( std::cin, line ) )
+			if( !line.empty() )
+				addrs.push_back( std::stoull( line, nullptr, 16 ) );
+	}
+	else
+	{
+		for( auto&& a: args["<addr>"].asStringList() )
+			addrs.push_back( std::stoull( a, nullptr, 16 ) );
+	}
+
+	std::vector<int32_t> owners( addrs.size() );
+	map.lookup_batch( addrs.data(), addrs.size(), owners.data(),
+	                  static_cast<unsigned>( args["--threads"].asLong() ) );
+
+	if( args["--summary"].asBool() )
+	{
+		std::vector<size_t> per_ip( IP_IDX( atop::physmap::IpBlocks::LAST ), 0 );
+		size_t unmapped = 0;
+		for( auto&& o: owners )
+		{
+			if( o == atop::physmap::PhysMap::npos )
+				++unmapped;
+			else
+				++per_ip[IP_IDX( map.regions()[static_cast<size_t>( o )].ip )];
+		}
+
+		for( auto&& p: atop::physmap::ip_blocks_table )
+			fmt::print( "{0}: {1}\n", p.first, per_ip[IP_IDX( p.second )] );
+		fmt::print( "unmapped: {0}\n", unmapped );
+		return 0;
+	}
+
+	for( size_t i = 0; i < addrs.size(); ++i )
+	{
+		if( owners[i] == atop::physmap::PhysMap::npos )
+			fmt::print( "{0:#x}: unmapped\n", addrs[i] );
+		else
+		{
+			auto const& r = map.regions()[static_cast<size_t>( owners[i] )];
+			fmt::print( "{0:#x}: {1} ({2})\n", addrs[i], r.name,
+			            atop::physmap::ipBlock2string( r.ip ) );
+		}
+	}
+
+	return 0;
+}
+
+// Per-IP utilization from an address trace (see ALP_ESTIMATOR.md)
+static int alp( std::map<std::string, docopt::value>& args )
+{
+	atop::physmap::PhysMap map;
+	map.load_iomem( args["--iomem"].asString() );
+	if( args["--dts"] )
+		map.load_dts_carveouts( args["--dts"].asString() );
+	map.build();
+
+	atop::alp::Options opts;
+	opts.window_ns        = static_cast<uint64_t>( args["--window"].asLong() ) * 1000000;
+	opts.include_fetches  = args["--fetches"].asBool();
+	opts.classify_threads = static_cast<unsigned>( args["--threads"].asLong() );
+	if( opts.classify_threads == 0 )
+	{
+		// Leave one core each for reader, filter, translator and counters
+		auto cores            = std::thread::hardware_concurrency();
+		opts.classify_threads = ( cores > 5 ) ? cores - 4 : 1;
+	}
+	if( args["--pid"] )
+		opts.pids.push_back( static_cast<int32_t>( args["--pid"].asLong() ) );
+
+	std::unique_ptr<atop::alp::Translator> translator;
+	if( args["--pagemap"] )
+		translator = std::make_unique<atop::alp::PagemapTranslator>( args["--pagemap"].asString() );
+	else
+		translator = std::make_unique<atop::alp::IdentityTranslator>();
+
+	std::vector<atop::alp::WindowStats> windows;
+	if( args["<trace>"] )
+	{
+		std::ifstream is{ args["<trace>"].asString() };
+		if( !is )
+			atop::logger::log_and_exit(
+			    fmt::format( "Could not open trace '{0}'", args["<trace>"].asString() ) );
+		windows = atop::alp::estimate( is, map, *translator, opts );
+	}
+	else
+		windows = atop::alp::estimate( std::cin, map, *translator, opts );
+
+	fmt::print( "window_start_ns" );
+	for( auto&& p: atop::physmap::ip_blocks_table )
+		fmt::print( ",{0}_accesses,{0}_MBps", p.first );
+	fmt::print( ",unmapped,untranslated\n" );
+
+	for( auto&& w: windows )
+	{
+		fmt::print( "{0}", w.window_start_ns );
+		for( auto&& p: atop::physmap::ip_blocks_table )
+			fmt::print( ",{0},{1:.3f}", w.accesses[IP_IDX( p.second )],
+			            w.bandwidth( p.second, opts.window_ns ) / 1.0e6 );
+		fmt::print( ",{0},{1}\n", w.unmapped, w.untranslated );
+	}
+
+	return 0;
+}
+
+static void print_latency_summary( std::string const& what,
+                                   atop::loadgen::LatencySummary const& s )
+{
+	fmt::print( "{0:<10} n={1} mean={2:.2f} p50={3:.2f} p90={4:.2f} p99={5:.2f} p99.9={6:.2f} "
+	            "max={7:.2f} (ms)\n",
+	            what, s.count, s.mean, s.p50, s.p90, s.p99, s.p999, s.max );
+}
+
+// Open-loop load against the accelerators of the connected device
+static int loadgen( std::map<std::string, docopt::value>& args )
+{
+	atop::check_reqs();
+
+	auto models = atop::loadgen::parse_models_cfg( args["--models"].asString() );
+	auto fr     = atop::string2framework( args["--framework"].asString() );
+
+	// One inference per request; the load generator provides the repetition
+	std::map<std::string, std::string> options;
+	if( fr == atop::Frameworks::tflite )
+		options = { { "num_runs", "1" }, { "warmup_runs", "0" } };
+	for( auto&& kv: args["--option"].asStringList() )
+	{
+		auto eq = kv.find( '=' );
+		if( eq == std::string::npos )
+			atop::logger::log_and_exit( fmt::format( "Expected key=value, got '{0}'", kv ) );
+		options[kv.substr( 0, eq )] = kv.substr( eq + 1 );
+	}
+
+	// Frameworks without a blocking benchmark command would fail every request
+	try
+	{
+		atop::benchmark_cmd( fr, "", options );
+	}
+	catch( atop::util::NotImplementedException const& e )
+	{
+		atop::logger::log_and_exit( fmt::format( "loadgen doesn't support framework {0}: {1}",
+		                                         atop::framework2string( fr ), e.what() ) );
+	}
+
+	atop::loadgen::Options opts;
+	opts.duration     = std::chrono::seconds( args["--duration"].asLong() );
+	opts.max_requests = static_cast<uint64_t>( args["--requests"].asLong() );
+	opts.concurrency  = static_cast<int>( args["--concurrency"].asLong() );
+	if( args["--seed"].asLong() != 0 )
+		opts.seed = static_cast<uint64_t>( args["--seed"].asLong() );
+
+	auto rate = std::stod( args["--rate"].asString() );
+	std::unique_ptr<atop::loadgen::ArrivalProcess> arrivals;
+	std::ifstream arrival_trace;
+	switch( atop::loadgen::string2arrivalProcess( args["--arrivals"].asString() ) )
+	{
+		case atop::loadgen::ArrivalProcesses::poisson:
+			arrivals = std::make_unique<atop::loadgen::PoissonArrivals>( rate, opts.seed );
+			break;
+		case atop::loadgen::ArrivalProcesses::bursty:
+			arrivals = std::make_unique<atop::loadgen::BurstyArrivals>(
+			    rate, std::stod( args["--on"].asString() ), std::stod( args["--off"].asString() ),
+			    opts.seed );
+			break;
+		case atop::loadgen::ArrivalProcesses::trace:
+			if( !args["--arrival-trace"] )
+				atop::logger::log_and_exit( "--arrivals=trace requires --arrival-trace" );
+			arrival_trace.open( args["--arrival-trace"].asString() );
+			if( !arrival_trace )
+				atop::logger::log_and_exit( fmt::format( "Could not open arrival trace '{0}'",
+				                                         args["--arrival-trace"].asString() ) );
+			arrivals = std::make_unique<atop::loadgen::TraceArrivals>( arrival_trace );
+			break;
+	}
+
+	// The shell's exit code of the benchmark is appended as last line
+	auto runner = [&]( std::string const& model ) {
+		auto out = atop::check_adb_shell_output(
+		    atop::benchmark_cmd( fr, model, options ) + "; echo atop_exit=$?" );
+		return !out.empty() && out.back() == "atop_exit=0";
+	};
+
+	auto requests = atop::loadgen::run( models, *arrivals, runner, opts );
+
+	std::vector<int64_t> queueing, service, latency;
+	size_t failed = 0;
+	for( auto&& r: requests )
+	{
+		queueing.push_back( r.queueing_ns() );
+		service.push_back( r.service_ns() );
+		latency.push_back( r.latency_ns() );
+		failed += r.ok ? 0 : 1;
+	}
+
+	print_latency_summary( "queueing", atop::loadgen::summarize( queueing ) );
+	print_latency_summary( "service", atop::loadgen::summarize( service ) );
+	print_latency_summary( "total", atop::loadgen::summarize( latency ) );
+	fmt::print( "{0}/{1} requests failed\n", failed, requests.size() );
+
+	if( args["--csv"] )
+	{
+		std::ofstream csv{ args["--csv"].asString() };
+		atop::loadgen::write_csv( csv, requests );
+	}
+
+	return 0;
+}
+
+// Summarises IOCTL and INFO events of a captured dmesg log (file, packed
+// trace or stdin)
+static int events( std::map<std::string, docopt::value>& args )
+{
+	atop::events::EventStore store;
+	atop::events::Event e;
+	auto ingest = [&store, &e]( std::istream& is ) {
+		std::string line;
+		while( std::getline( is, line ) )
+			if( atop::events::parse_dmesg_line( line, e ) )
+				store.append( e );
+	};
+
+	if( args["<dmesg>"] )
+	{
+		std::ifstream is{ args["<dmesg>"].asString(), std::ios::binary };
+		if( !is )
+			atop::logger::log_and_exit(
+			    fmt::format( "Could not open log '{0}'", args["<dmesg>"].asString() ) );
+
+		if( atop::trace::is_trace( is ) )
+			atop::trace::Reader( is ).read( [&store, &e]( std::string_view line ) {
+				if( atop::events::parse_dmesg_line( line, e ) )
+					store.append( e );
+			} );
+		else
+			ingest( is );
+	}
+	else
+		ingest( std::cin );
+
+	LOG( fmt::format( "Parsed {0} events", store.size() ) );
+
+	auto col       = atop::events::string2idColumn( args["--by"].asString() );
+	auto& names    = atop::events::interner( col );
+	auto bucket_ns = static_cast<uint64_t>( args["--window"].asLong() ) * 1000000;
+
+	atop::events::Query q;
+	if( args["--app"] )
+	{
+		atop::intern::string_id_t app;
+		if( !atop::intern::app_names().find( args["--app"].asString(), app ) )
+			return 0;
+		q.app = app;
+	}
+
+	auto totals = store.count_by( col, q );
+	std::vector<atop::intern::string_id_t> groups;
+	for( size_t id = 0; id < totals.size(); ++id )
+		if( totals[id] > 0 )
+			groups.push_back( static_cast<atop::intern::string_id_t>( id ) );
+
+	if( !args["--histogram"].asBool() )
+	{
+		fmt::print( "{0},events,duration_ms\n", args["--by"].asString() );
+		for( auto id: groups )
+		{
+			auto gq = q;
+			gq.set( col, id );
+			fmt::print( "{0},{1},{2:.3f}\n", names.name( id ), totals[id],
+			            static_cast<double>( store.sum_duration( gq ) ) / 1.0e6 );
+		}
+		return 0;
+	}
+
+	if( store.size() == 0 )
+		return 0;
+
+	// Window covering all events
+	uint64_t t0 = std::numeric_limits<uint64_t>::max(), t1 = 0;
+	store.scan( 0, [&]( atop::events::Event const& ev ) {
+		t0 = std::min( t0, ev.ts_ns );
+		t1 = std::max( t1, ev.ts_ns );
+	} );
+	q.t0_ns = t0 - t0 % bucket_ns;
+	q.t1_ns = t1 + 1;
+
+	std::vector<std::vector<uint64_t>> hists;
+	fmt::print( "window_start_ns" );
+	for( auto id: groups )
+	{
+		auto gq = q;
+		gq.set( col, id );
+		hists.push_back( store.histogram( gq, bucket_ns ) );
+		fmt::print( ",{0}", names.name( id ) );
+	}
+	fmt::print( "\n" );
+
+	for( size_t b = 0; !hists.empty() && b < hists[0].size(); ++b )
+	{
+		fmt::print( "{0}", q.t0_ns + b * bucket_ns );
+		for( auto&& h: hists )
+			fmt::print( ",{0}", h[b] );
+		fmt::print( "\n" );
+	}
+
+	return 0;
+}
+
+// Packs a text capture (file or stdin) into a compressed trace
+static int pack( std::map<std::string, docopt::value>& args )
+{
+	std::ofstream os{ args["<trace>"].asString(), std::ios::binary };
+	if( !os )
+		atop::logger::log_and_exit(
+		    fmt::format( "Could not create trace '{0}'", args["<trace>"].asString() ) );
+
+	atop::trace::Writer trace( os );
+	auto add_lines = [&trace]( std::istream& is ) {
+		std::string line;
+		while( std::getline( is, line ) )
+			trace.add( line );
+	};
+
+	if( args["<text>"] )
+	{
+		std::ifstream is{ args["<text>"].asString() };
+		if( !is )
+			atop::logger::log_and_exit(
+			    fmt::format( "Could not open log '{0}'", args["<text>"].asString() ) );
+		add_lines( is );
+	}
+	else
+		add_lines( std::cin );
+	trace.close();
+
+	fmt::print( "{0} lines: {1:.1f} MiB of text packed into {2:.1f} MiB ({3:.1f}x)\n",
+	            trace.lines(), static_cast<double>( trace.text_bytes() ) / ( 1024.0 * 1024.0 ),
+	            static_cast<double>( trace.bytes_written() ) / ( 1024.0 * 1024.0 ),
+	            static_cast<double>( trace.text_bytes() )
+	                / static_cast<double>( trace.bytes_written() ) );
+	return 0;
+}
+
+// Prints the text of a packed trace
+static int unpack( std::map<std::string, docopt::value>& args )
+{
+	std::ifstream is{ args["<trace>"].asString(), std::ios::binary };
+	if( !is )
+		atop::logger::log_and_exit(
+		    fmt::format( "Could not open trace '{0}'", args["<trace>"].asString() ) );
+
+	atop::trace::Reader trace( is );
+	trace.read( []( std::string_view line ) {
+		std::cout.write( line.data(), static_cast<std::streamsize>( line.size() ) );
+		std::cout.put( '\n' );
+	} );
+	return 0;
+}
+
+// Mirrors a local model directory to the device, pushing only changed files
+static int sync( std::map<std::string, docopt::value>& args )
+{
+	atop::check_reqs();
+
+	atop::modelsync::HashCache hashes( atop::util::cache_dir() + "/local-md5" );
+	auto blobs = atop::modelsync::plan( args["<dir>"].asString(), args["--dest"].asString(),
+	                                    hashes );
+	hashes.save();
+
+	atop::modelsync::Options opts;
+	opts.jobs    = static_cast<int>( args["--jobs"].asLong() );
+	opts.dry_run = args["--dry-run"].asBool();
+
+	auto start  = std::chrono::steady_clock::now();
+	auto report = atop::modelsync::sync( blobs, opts );
+	auto secs   = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+	fmt::print( "{0} files: {1} up to date, {2} resumed, {3} pushed ({4:.1f} MiB) in {5:.1f} s\n",
+	            blobs.size(), report.up_to_date, report.resumed, report.pushed,
+	            static_cast<double>( report.bytes_pushed ) / ( 1024.0 * 1024.0 ), secs );
+	for( auto&& f: report.failed )
+		spdlog::error( fmt::format( "Hash mismatch after sync: {0}", f ) );
+
+	return report.failed.empty() ? 0 : 1;
+}
+
+// Samples the device headlessly and serves the data to viewers (atop
+// --connect or atopctl watch)
+static int serve( std::map<std::string, docopt::value>& args )
+{
+	using namespace std::chrono_literals;
+
+	// Enables the drivers' logging like the local viewer does; it stays
+	// enabled when the collector is killed
+	std::vector<std::string> enable_logging;
+	for( auto&& kv: atop::debugfs_knobs )
+		enable_logging.push_back(
+		    fmt::format( "echo {0} >> {1}", kv.first == "gpu" ? 6 : 1, kv.second ) );
+	auto device = atop::probe_device( enable_logging );
+
+	atop::collector::Server server( args["--address"].asString() );
+	spdlog::info( fmt::format( "Serving on {0}", args["--address"].asString() ) );
+
+	std::unique_ptr<atop::metrics::Exporter> exporter;
+	if( args["--metrics"] )
+	{
+		exporter = std::make_unique<atop::metrics::Exporter>( args["--metrics"].asString(),
+		                                                      device.serial );
+		spdlog::info( fmt::format( "Serving metrics on {0}", args["--metrics"].asString() ) );
+	}
+
+	atop::IoctlDmesgStreamer dmesg;
+	atop::LogcatStreamer logcat( { "ExecutionBuilder", "tflite" } );
+	atop::CpuUtilizationStreamer cpu;
+
+	// Sources run on different workers; new strings have to be published
+	// before or along with the first events referencing them
+	std::mutex publish_mtx;
+	std::vector<size_t> known_strings;
+	size_t events_sent = 0;
+	auto publish       = [&]( atop::protocol::Update& u ) {
+		std::lock_guard<std::mutex> lock( publish_mtx );
+		events_sent = atop::protocol::add_events( u, dmesg.events(), events_sent, known_strings );
+		if( !u.empty() )
+			server.publish( u );
+		if( exporter )
+			exporter->update( u, dmesg.events() );
+	};
+
+	// Same policy and normalization as the local viewer
+	atop::scheduler::Scheduler sampler;
+	atop::add_dmesg_source( sampler, dmesg, [&]( std::map<std::string, int>& counts ) {
+		atop::protocol::Update u;
+		u.interactions    = counts;
+		auto const& lines = dmesg.get_data()[PROBE_IDX( dmesg.utilization_probe )];
+		u.log_lines.assign( lines.rbegin(), lines.rend() );
+		publish( u );
+	} );
+
+	sampler.add( "logcat", 1s, [&]( auto ) {
+		atop::protocol::Update u;
+		for( auto&& kv: logcat.more() )
+			u.log_lines.insert( u.log_lines.end(), kv.second.rbegin(), kv.second.rend() );
+		publish( u );
+	} );
+
+	sampler.add( "cpu", 1s, [&]( auto ) {
+		atop::protocol::Update u;
+		u.cpu = cpu.utilizations();
+		publish( u );
+	} );
+	sampler.start();
+
+	// Runs until killed
+	for( ;; )
+	{
+		std::this_thread::sleep_for( 10s );
+		LOG( fmt::format( "{0} viewers, {1} events", server.subscribers(),
+		                  server.state().events().size() ) );
+	}
+}
+
+// Prints the data of a collector once per second
+static int watch( std::map<std::string, docopt::value>& args )
+{
+	using namespace std::chrono_literals;
+
+	atop::collector::Client client( args["--address"].asString() );
+	while( client.connected() )
+	{
+		std::this_thread::sleep_for( 1s );
+
+		std::string line = fmt::format( "events {0}", client.state().events().size() );
+		for( auto&& kv: client.state().interactions() )
+			line += fmt::format( " | {0} {1}", kv.first, kv.second );
+		for( auto&& kv: client.state().cpu() )
+			line += fmt::format( " | {0} {1:.1f}%", kv.first, kv.second );
+		fmt::print( "{0}\n", line );
+	}
+
+	spdlog::error( "Collector closed the connection" );
+	return 1;
+}
+
+// Exports a captured dmesg log (file, packed trace or stdin) or a live
+// session of a collector as a Chrome trace for Perfetto
+static int timeline( std::map<std::string, docopt::value>& args )
+{
+	using namespace std::chrono_literals;
+
+	std::ofstream os{ args["<json>"].asString() };
+	if( !os )
+		atop::logger::log_and_exit(
+		    fmt::format( "Could not create timeline '{0}'", args["<json>"].asString() ) );
+	atop::timeline::Writer writer( os );
+
+	if( !args["--live"].asBool() )
+	{
+		auto add_line = [&writer]( std::string_view line ) { writer.add_line( line ); };
+		std::string line;
+		if( args["<dmesg>"] )
+		{
+			std::ifstream is{ args["<dmesg>"].asString(), std::ios::binary };
+			if( !is )
+				atop::logger::log_and_exit(
+				    fmt::format( "Could not open log '{0}'", args["<dmesg>"].asString() ) );
+
+			if( atop::trace::is_trace( is ) )
+				atop::trace::Reader( is ).read( add_line );
+			else
+				while( std::getline( is, line ) )
+					add_line( line );
+		}
+		else
+			while( std::getline( std::cin, line ) )
+				add_line( line );
+
+		writer.close();
+		LOG( fmt::format( "Wrote {0} trace events", writer.written() ) );
+		return 0;
+	}
+
+	// Events are read from the mirrored store, which translates their ids.
+	// TIME lines and CPU utilizations are taken from the updates as they
+	// arrive; the latter carry no device timestamp.
+	using clock = std::chrono::steady_clock;
+	struct CpuSample
+	{
+		clock::time_point received;
+		std::map<std::string, double> utils;
+	};
+	std::mutex pending_mtx;
+	std::vector<atop::timeline::TimedCall> calls;
+	std::vector<CpuSample> cpu_samples;
+	atop::collector::Client client(
+	    args["--address"].asString(), [&]( atop::protocol::Update const& u ) {
+		    std::lock_guard<std::mutex> lock( pending_mtx );
+		    atop::timeline::TimedCall c;
+		    for( auto&& line: u.log_lines )
+			    if( atop::timeline::parse_time_line( line, c ) )
+				    calls.push_back( c );
+		    if( u.cpu )
+			    cpu_samples.push_back( { clock::now(), *u.cpu } );
+	    } );
+
+	// Device clock minus host clock; events reach the host late, so the
+	// largest difference seen is the closest estimate
+	std::optional<int64_t> offset_ns;
+	auto host_ns = []( clock::time_point t ) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( t.time_since_epoch() )
+		    .count();
+	};
+
+	size_t next_event = 0;
+	auto end          = clock::now() + std::chrono::seconds( args["--duration"].asLong() );
+	while( client.connected() && clock::now() < end )
+	{
+		std::this_thread::sleep_for( 100ms );
+
+		auto now   = host_ns( clock::now() );
+		next_event = client.state().events().scan(
+		    next_event, [&writer, &offset_ns, now]( atop::events::Event const& e ) {
+			    auto offset = static_cast<int64_t>( e.ts_ns ) - now;
+			    offset_ns   = std::max( offset_ns.value_or( offset ), offset );
+			    writer.add( e );
+		    } );
+
+		std::lock_guard<std::mutex> lock( pending_mtx );
+		for( auto&& c: calls )
+			writer.add( c );
+		calls.clear();
+
+		// Utilizations before the first event can't be placed yet
+		if( !offset_ns )
+			continue;
+		for( auto&& sample: cpu_samples )
+			writer.add_cpu( static_cast<uint64_t>(
+			                    std::max<int64_t>( 0, host_ns( sample.received ) + *offset_ns ) ),
+			                sample.utils );
+		cpu_samples.clear();
+	}
+
+	if( !client.connected() )
+		spdlog::error( "Collector closed the connection" );
+	writer.close();
+	LOG( fmt::format( "Wrote {0} trace events", writer.written() ) );
+	return 0;
+}
+
+// Prints the driver messages buffered in ftrace as dmesg lines
+static int ftrace( std::map<std::string, docopt::value>& args )
+{
+	auto tracefs = args["<tracefs>"] ? args["<tracefs>"].asString() : "/sys/kernel/tracing";
+	auto n = atop::ftrace::read_messages(
+	    tracefs, []( atop::util::nanoseconds_t ts_ns, std::string_view message ) {
+		    fmt::print( "{0}\n", atop::ftrace::dmesg_line( ts_ns, message ) );
+	    } );
+	LOG( fmt::format( "Read {0} messages", n ) );
+	return 0;
+}
+
+// Prints a captured dmesg log (file or packed trace) and logcat log as a
+// single dmesg log. Wall-clock logcat times are moved to the dmesg clock
+// with the atop-clock lines seen so far, or the first one before them.
+static int merge( std::map<std::string, docopt::value>& args )
+{
+	std::vector<std::vector<atop::clocks::TimedLine>> sources( 2 );
+	std::vector<std::pair<atop::util::nanoseconds_t, atop::util::nanoseconds_t>> pairs;
+	auto add_dmesg = [&sources, &pairs]( std::string_view line ) {
+		atop::util::nanoseconds_t ts, logcat_ns;
+		size_t pos = 0;
+		if( atop::clocks::parse_sync_line( line, ts, logcat_ns ) )
+			pairs.emplace_back( logcat_ns, ts );
+		else if( atop::util::parse_dmesg_ts( line, ts, pos ) )
+			sources[0].push_back( { ts, std::string( line.substr( std::min(
+			                                pos + 1, line.size() ) ) ) } );
+	};
+
+	std::ifstream dmesg{ args["<dmesg>"].asString(), std::ios::binary };
+	if( !dmesg )
+		atop::logger::log_and_exit(
+		    fmt::format( "Could not open log '{0}'", args["<dmesg>"].asString() ) );
+	std::string line;
+	if( atop::trace::is_trace( dmesg ) )
+		atop::trace::Reader( dmesg ).read( add_dmesg );
+	else
+		while( std::getline( dmesg, line ) )
+			add_dmesg( line );
+
+	std::ifstream logcat{ args["<logcat>"].asString() };
+	if( !logcat )
+		atop::logger::log_and_exit(
+		    fmt::format( "Could not open log '{0}'", args["<logcat>"].asString() ) );
+
+	std::optional<int64_t> fixed_offset;
+	if( args["--clock-offset"] )
+	{
+		std::string_view s = args["--clock-offset"].asString();
+		bool negative      = !s.empty() && s[0] == '-';
+		auto ns = static_cast<int64_t>(
+		    atop::util::decimal2ns( s.substr( negative ? 1 : 0 ), atop::util::ns_per_s ) );
+		fixed_offset = negative ? -ns : ns;
+	}
+
+	std::sort( pairs.begin(), pairs.end() );
+	atop::clocks::OffsetEstimator estimator;
+	size_t next_pair = 0;
+	while( std::getline( logcat, line ) )
+	{
+		atop::util::nanoseconds_t ts;
+		size_t pos = 0;
+		if( !atop::clocks::parse_monotonic_ts( line, ts, pos ) )
+		{
+			if( !atop::clocks::parse_logcat_ts( line, ts, pos ) )
+				continue;
+
+			if( fixed_offset )
+				ts = static_cast<atop::util::nanoseconds_t>(
+				    std::max<int64_t>( 0, static_cast<int64_t>( ts ) + *fixed_offset ) );
+			else
+			{
+				if( pairs.empty() )
+					atop::logger::log_and_exit( "No atop-clock lines in the dmesg log; pass "
+					                            "--clock-offset or use logcat -v monotonic" );
+				while( next_pair < pairs.size()
+				       && ( next_pair == 0 || pairs[next_pair].first <= ts ) )
+				{
+					estimator.add( pairs[next_pair].second, pairs[next_pair].first );
+					++next_pair;
+				}
+				ts = estimator.to_reference( ts );
+			}
+		}
+
+		while( pos < line.size() && line[pos] == ' ' )
+			++pos;
+		sources[1].push_back( { ts, line.substr( pos ) } );
+	}
+
+	atop::clocks::merge( sources, []( size_t, atop::clocks::TimedLine const& l ) {
+		fmt::print( "{0}\n", atop::ftrace::dmesg_line( l.ts_ns, l.text ) );
+	} );
+	LOG( fmt::format( "Merged {0} dmesg and {1} logcat lines using {2} clock pairs",
+	                  sources[0].size(), sources[1].size(), pairs.size() ) );
+	return 0;
+}
+
+int main( int argc, const char** argv )
+{
+	std::map<std::string, docopt::value> args
+	    = docopt::docopt( USAGE, { std::next( argv ), std::next( argv, argc ) },
+	                      true /* show if help is requested */, VERSION_STRING );
+
+	VERBOSE = args["--verbose"].asBool();
+
+	if( args["classify"].asBool() )
+		return classify( args );
+	else if( args["alp"].asBool() )
+		return alp( args );
+	else if( args["loadgen"].asBool() )
+		return loadgen( args );
+	else if( args["events"].asBool() )
+		return events( args );
+	else if( args["timeline"].asBool() )
+		return timeline( args );
+	else if( args["ftrace"].asBool() )
+		return ftrace( args );
+	else if( args["merge"].asBool() )
+		return merge( args );
+	else if( args["sync"].asBool() )
+		return sync( args );
+	else if( args["pack"].asBool() )
+		return pack( args );
+	else if( args["unpack"].asBool() )
+		return unpack( args );
+	else if( args["serve"].asBool() )
+		return serve( args );
+	else if( args["watch"].asBool() )
+		return watch( args );
+
+	return 0;
+}
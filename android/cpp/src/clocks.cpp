@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "clocks.h"
+#include "util.h"
+
+// Two-digit number at s[pos] followed by sep (unless sep is '\0')
+static bool two_digits( std::string_view s, size_t& pos, char sep, uint64_t& out )
+{
+	if( pos + 2 > s.size() || s[pos] < '0' || s[pos] > '9' || s[pos + 1] < '0'
+	    || s[pos + 1] > '9' )
+		return false;
+	out = static_cast<uint64_t>( ( s[pos] - '0' ) * 10 + ( s[pos + 1] - '0' ) );
+	pos += 2;
+	if( sep == '\0' )
+		return true;
+	if( pos == s.size() || s[pos] != sep )
+		return false;
+	++pos;
+	return true;
+}
+
+bool atop::clocks::parse_logcat_ts( std::string_view line, util::nanoseconds_t& ts, size_t& pos )
+{
+	// Days before each month of a leap year, so that 02-29 parses
+	static constexpr std::array<uint64_t, 12> days_before
+	    = { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 };
+
+	size_t i = 0;
+	while( i < line.size() && line[i] == ' ' )
+		++i;
+
+	uint64_t month, day, hours, minutes;
+	util::nanoseconds_t seconds_ns;
+	if( !two_digits( line, i, '-', month ) || !two_digits( line, i, ' ', day )
+	    || !two_digits( line, i, ':', hours ) || !two_digits( line, i, ':', minutes )
+	    || !util::parse_decimal_ns( line, i, util::ns_per_s, seconds_ns ) )
+		return false;
+	if( month < 1 || month > 12 || day < 1 || day > 31 || hours > 23 || minutes > 59 )
+		return false;
+
+	auto minutes_of_year = ( ( days_before[month - 1] + day - 1 ) * 24 + hours ) * 60 + minutes;
+	ts                   = minutes_of_year * 60 * util::ns_per_s + seconds_ns;
+	pos                  = i;
+	return true;
+}
+
+bool atop::clocks::parse_monotonic_ts( std::string_view line, util::nanoseconds_t& ts,
+                                       size_t& pos )
+{
+	size_t i = 0;
+	while( i < line.size() && line[i] == ' ' )
+		++i;
+
+	// Requires the fraction, so that dates don't pass for seconds
+	auto start = i;
+	if( !util::parse_decimal_ns( line, i, util::ns_per_s, ts )
+	    || line.substr( start, i - start ).find( '.' ) == std::string_view::npos
+	    || ( i < line.size() && line[i] != ' ' ) )
+		return false;
+
+	pos = i;
+	return true;
+}
+
+bool atop::clocks::parse_sync_line( std::string_view line, util::nanoseconds_t& dmesg_ns,
+                                    util::nanoseconds_t& logcat_ns )
+{
+	size_t i = 0;
+	if( !util::parse_dmesg_ts( line, dmesg_ns, i ) )
+		return false;
+	auto marker = line.find( sync_marker, i );
+	if( marker == std::string_view::npos )
+		return false;
+
+	size_t j = 0;
+	return parse_logcat_ts( line.substr( marker + sync_marker.size() ), logcat_ns, j );
+}
+
+atop::clocks::OffsetEstimator::OffsetEstimator( size_t window_ )
+    : window( std::max<size_t>( 1, window_ ) )
+    , samples()
+{
+}
+
+void atop::clocks::OffsetEstimator::add( util::nanoseconds_t reference_ns,
+                                         util::nanoseconds_t other_ns )
+{
+	this->samples.push_back( static_cast<int64_t>( reference_ns )
+	                         - static_cast<int64_t>( other_ns ) );
+	if( this->samples.size() > this->window )
+		this->samples.pop_front();
+}
+
+std::optional<int64_t> atop::clocks::OffsetEstimator::offset() const
+{
+	if( this->samples.empty() )
+		return std::nullopt;
+	return *std::min_element( this->samples.begin(), this->samples.end() );
+}
+
+atop::util::nanoseconds_t atop::clocks::OffsetEstimator::to_reference(
+    util::nanoseconds_t other_ns ) const
+{
+	auto o = this->offset();
+	if( !o )
+		throw std::runtime_error( "No clock pairs to convert timestamps with" );
+
+	// Times before the reference clock's epoch are clamped to it
+	auto ts = static_cast<int64_t>( other_ns ) + *o;
+	return ts < 0 ? 0 : static_cast<util::nanoseconds_t>( ts );
+}
+
+void atop::clocks::merge( std::vector<std::vector<TimedLine>>& sources,
+                          std::function<void( size_t, TimedLine const& )> const& fn )
+{
+	auto by_ts = []( TimedLine const& a, TimedLine const& b ) { return a.ts_ns < b.ts_ns; };
+	for( auto& s: sources )
+		if( !std::is_sorted( s.begin(), s.end(), by_ts ) )
+			std::stable_sort( s.begin(), s.end(), by_ts );
+
+	// (timestamp, source, line) of the next line of each source
+	using entry_t = std::tuple<util::nanoseconds_t, size_t, size_t>;
+	std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> queue;
+	for( size_t s = 0; s < sources.size(); ++s )
+		if( !sources[s].empty() )
+			queue.emplace( sources[s][0].ts_ns, s, 0 );
+
+	while( !queue.empty() )
+	{
+		auto [ts, s, i] = queue.top();
+		queue.pop();
+		fn( s, sources[s][i] );
+		if( ++i < sources[s].size() )
+			queue.emplace( sources[s][i].ts_ns, s, i );
+	}
+}
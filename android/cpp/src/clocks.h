@@ -0,0 +1,83 @@
+#ifndef CLOCKS_H_IN
+#define CLOCKS_H_IN
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace clocks
+{
+// Alignment of the dmesg and logcat clocks
+//
+// dmesg stamps lines with the kernel's clock (seconds since boot), while
+// logcat by default prints the device's local wall-clock time as
+// "MM-DD hh:mm:ss.mmm". Paired samples relate the two: writing
+//
+//     echo "atop-clock $(date +'%m-%d %T.%N')" > /dev/kmsg
+//
+// on the device logs the wall-clock time read by date with the dmesg
+// timestamp of the write, which can only be later. The smallest
+// difference of recent pairs is therefore the best estimate of the
+// offset. Both sides are read on the device in its time zone, so no
+// time zone conversion is needed. Logs written with "logcat -v
+// monotonic" already carry seconds since boot and need no offset.
+
+// Logcat time "MM-DD hh:mm:ss.mmm" as nanoseconds since the start of its
+// (leap) year; on success pos points past the time
+bool parse_logcat_ts( std::string_view line, util::nanoseconds_t& ts, size_t& pos );
+
+// Leading "<seconds>.<fraction>" of "logcat -v monotonic" lines
+bool parse_monotonic_ts( std::string_view line, util::nanoseconds_t& ts, size_t& pos );
+
+constexpr std::string_view sync_marker = "atop-clock ";
+
+// dmesg line of a paired sample as written above
+bool parse_sync_line( std::string_view line, util::nanoseconds_t& dmesg_ns,
+                      util::nanoseconds_t& logcat_ns );
+
+// Offset of a clock from a reference clock by the minimum filter over the
+// latest window pairs
+class OffsetEstimator
+{
+  public:
+	explicit OffsetEstimator( size_t window = 16 );
+
+	// reference_ns has to be read no earlier than other_ns
+	void add( util::nanoseconds_t reference_ns, util::nanoseconds_t other_ns );
+
+	// Reference minus other clock; none before the first pair
+	std::optional<int64_t> offset() const;
+
+	// other_ns on the reference clock; throws before the first pair
+	util::nanoseconds_t to_reference( util::nanoseconds_t other_ns ) const;
+
+  private:
+	size_t window;
+	std::deque<int64_t> samples;
+};
+
+struct TimedLine
+{
+	util::nanoseconds_t ts_ns;
+	std::string text;
+};
+
+// Calls fn for the lines of all sources in timestamp order, with the index
+// of their source. Sources are sorted first; lines with equal timestamps
+// keep their order within a source and come in the order of sources.
+void merge( std::vector<std::vector<TimedLine>>& sources,
+            std::function<void( size_t, TimedLine const& )> const& fn );
+
+} // namespace clocks
+} // namespace atop
+
+#endif // CLOCKS_H_IN
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "cmdqueue.h"
+#include "logger.h"
+
+atop::cmdqueue::CommandQueue::CommandQueue( std::chrono::milliseconds timeout_ )
+    : timeout( timeout_ )
+    , mtx()
+    , avail()
+    , queued()
+    , finished()
+    , running( 0 )
+    , stopping( false )
+    , worker( [this]() { this->work(); } )
+{
+}
+
+atop::cmdqueue::CommandQueue::~CommandQueue() { this->stop(); }
+
+void atop::cmdqueue::CommandQueue::push( std::string what, std::string cmd, done_fn_t done )
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		if( this->stopping )
+			throw std::runtime_error(
+			    fmt::format( "Command queue stopped; cannot run '{0}'", what ) );
+		this->queued.push_back(
+		    Command{ std::move( what ), std::move( cmd ), std::move( done ), {} } );
+	}
+	this->avail.notify_one();
+}
+
+size_t atop::cmdqueue::CommandQueue::poll()
+{
+	std::deque<Command> done;
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		done.swap( this->finished );
+	}
+
+	for( auto&& c: done )
+		if( c.done )
+			c.done( c.result );
+
+	return done.size();
+}
+
+size_t atop::cmdqueue::CommandQueue::pending() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return this->queued.size() + this->running;
+}
+
+void atop::cmdqueue::CommandQueue::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		this->stopping = true;
+	}
+	this->avail.notify_one();
+
+	if( this->worker.joinable() )
+		this->worker.join();
+}
+
+void atop::cmdqueue::CommandQueue::work()
+{
+	std::unique_lock<std::mutex> lock( this->mtx );
+	for( ;; )
+	{
+		this->avail.wait( lock, [this]() { return this->stopping || !this->queued.empty(); } );
+		if( this->queued.empty() )
+			return;
+
+		auto c = std::move( this->queued.front() );
+		this->queued.pop_front();
+		this->running++;
+		lock.unlock();
+
+		atop::logger::verbose_info( fmt::format( "Running '{0}': {1}", c.what, c.cmd ) );
+		auto t0 = std::chrono::steady_clock::now();
+		try
+		{
+			c.result = atop::subprocess::default_loop().run( c.cmd, this->timeout ).get();
+		}
+		catch( std::exception const& e )
+		{
+			c.result.status = -1;
+			c.result.out    = e.what();
+		}
+
+		if( !c.result.ok() )
+			atop::logger::warn( fmt::format( "'{0}' failed{1} with status {2}", c.what,
+			                                 c.result.timed_out ? " (timeout)" : "",
+			                                 c.result.status ) );
+		atop::logger::verbose_info(
+		    fmt::format( "'{0}' took {1:.1f} ms", c.what,
+		                 std::chrono::duration<double, std::milli>(
+		                     std::chrono::steady_clock::now() - t0 )
+		                     .count() ) );
+
+		lock.lock();
+		this->running--;
+		this->finished.push_back( std::move( c ) );
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef CMDQUEUE_H_IN
+#define CMDQUEUE_H_IN
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "subprocess.h"
+
+namespace atop
+{
+namespace cmdqueue
+{
+// Device commands issued by the UI
+//
+// Commands are run one after another, in the order they were pushed, by a
+// background worker so that the render loop never waits for adb. Their
+// completion callbacks are not called by the worker but by poll(), which
+// the render loop calls once per frame; callbacks may therefore update UI
+// state without synchronisation. The UI applies the expected outcome of a
+// command right away and reverts it in the callback if the command fails.
+class CommandQueue
+{
+  public:
+	using done_fn_t = std::function<void( subprocess::Result const& )>;
+
+	explicit CommandQueue( std::chrono::milliseconds timeout = std::chrono::seconds( 10 ) );
+	~CommandQueue();
+	CommandQueue( CommandQueue const& ) = delete;
+	CommandQueue( CommandQueue&& )      = delete;
+
+	// what describes the command in logs
+	void push( std::string what, std::string cmd, done_fn_t done = nullptr );
+
+	// Calls the callbacks of finished commands; returns their number
+	size_t poll();
+
+	// Queued and running commands
+	size_t pending() const;
+
+	// Runs the queued commands and stops the worker; callbacks of
+	// commands finished afterwards are still delivered by poll()
+	void stop();
+
+  private:
+	struct Command
+	{
+		std::string what;
+		std::string cmd;
+		done_fn_t done;
+		subprocess::Result result;
+	};
+
+	void work();
+
+	std::chrono::milliseconds timeout;
+
+	mutable std::mutex mtx;
+	std::condition_variable avail;
+	std::deque<Command> queued;
+	std::deque<Command> finished;
+	size_t running;
+	bool stopping;
+
+	std::thread worker;
+};
+
+} // namespace cmdqueue
+} // namespace atop
+
+#endif // CMDQUEUE_H_IN
@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "collector.h"
+#include "logger.h"
+#include "selfprof.h"
+
+static std::runtime_error sys_error( std::string const& what )
+{
+	return std::runtime_error( fmt::format( "{0}: {1}", what, std::strerror( errno ) ) );
+}
+
+atop::collector::Address atop::collector::parse_address( std::string const& addr )
+{
+	constexpr std::string_view unix_prefix = "unix:";
+	if( addr.compare( 0, unix_prefix.size(), unix_prefix ) == 0 )
+	{
+		auto path = addr.substr( unix_prefix.size() );
+		if( path.empty() || path.size() >= sizeof( sockaddr_un::sun_path ) )
+			throw std::runtime_error( fmt::format( "Invalid socket path in '{0}'", addr ) );
+		return Address{ true, path, 0 };
+	}
+
+	auto colon = addr.rfind( ':' );
+	auto host  = colon == std::string::npos ? std::string( "127.0.0.1" ) : addr.substr( 0, colon );
+	auto port  = colon == std::string::npos ? addr : addr.substr( colon + 1 );
+
+	int p    = 0;
+	auto res = std::from_chars( port.data(), port.data() + port.size(), p );
+	if( res.ec != std::errc() || res.ptr != port.data() + port.size() || p < 1 || p > 65535
+	    || host.empty() )
+		throw std::runtime_error( fmt::format( "Invalid collector address '{0}'", addr ) );
+
+	return Address{ false, host, static_cast<uint16_t>( p ) };
+}
+
+int atop::collector::open_socket( Address const& a, bool listen )
+{
+	if( a.unix_socket )
+	{
+		sockaddr_un sa{};
+		sa.sun_family = AF_UNIX;
+		std::strncpy( sa.sun_path, a.host.c_str(), sizeof( sa.sun_path ) - 1 );
+
+		int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+		if( fd < 0 )
+			throw sys_error( "socket" );
+
+		auto sap = reinterpret_cast<sockaddr const*>( &sa );
+		if( listen )
+			unlink( a.host.c_str() );
+		if( ( listen ? bind( fd, sap, sizeof( sa ) ) : connect( fd, sap, sizeof( sa ) ) ) < 0 )
+		{
+			auto e = sys_error( fmt::format( "Could not {0} '{1}'",
+			                                 listen ? "listen on" : "connect to", a.host ) );
+			close( fd );
+			throw e;
+		}
+		return fd;
+	}
+
+	addrinfo hints{};
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = listen ? AI_PASSIVE : 0;
+
+	addrinfo* infos = nullptr;
+	auto port       = std::to_string( a.port );
+	if( int err = getaddrinfo( a.host.c_str(), port.c_str(), &hints, &infos ); err != 0 )
+		throw std::runtime_error(
+		    fmt::format( "Could not resolve '{0}': {1}", a.host, gai_strerror( err ) ) );
+
+	int fd = -1;
+	for( auto ai = infos; ai != nullptr && fd < 0; ai = ai->ai_next )
+	{
+		fd = socket( ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol );
+		if( fd < 0 )
+			continue;
+
+		int one = 1;
+		if( listen )
+			setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+		else
+			setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+		if( ( listen ? bind( fd, ai->ai_addr, ai->ai_addrlen )
+		             : connect( fd, ai->ai_addr, ai->ai_addrlen ) )
+		    < 0 )
+		{
+			close( fd );
+			fd = -1;
+		}
+	}
+	auto e = sys_error( fmt::format( "Could not {0} {1}:{2}", listen ? "listen on" : "connect to",
+	                                 a.host, a.port ) );
+	freeaddrinfo( infos );
+	if( fd < 0 )
+		throw e;
+	return fd;
+}
+
+atop::collector::State::State()
+    : mtx()
+    , to_local()
+    , to_wire()
+    , store()
+    , latest_event_ns( 0 )
+    , latest_interactions()
+    , latest_cpu()
+    , log()
+{
+}
+
+void atop::collector::State::apply( protocol::Update const& u )
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	if( u.snapshot )
+	{
+		for( auto& m: this->to_local )
+			m.clear();
+		for( auto& m: this->to_wire )
+			m.clear();
+		this->store.clear();
+		this->latest_event_ns = 0;
+		this->latest_interactions.clear();
+		this->latest_cpu.clear();
+		this->log.clear();
+	}
+
+	for( auto&& s: u.strings )
+	{
+		auto col    = static_cast<size_t>( s.col );
+		auto& local = this->to_local[col];
+		if( local.size() <= s.id )
+			local.resize( size_t{ s.id } + 1, events::none_id );
+
+		auto id                = events::interner( s.col ).intern( s.name );
+		local[s.id]            = id;
+		this->to_wire[col][id] = s.id;
+	}
+
+	auto translate = [this]( events::IdColumns col, intern::string_id_t id ) {
+		if( id == events::none_id )
+			return id;
+		auto const& local = this->to_local[static_cast<size_t>( col )];
+		if( id >= local.size() || local[id] == events::none_id )
+			throw std::runtime_error( "Event references a string that wasn't sent" );
+		return local[id];
+	};
+
+	std::vector<events::Event> batch;
+	batch.reserve( u.events.size() );
+	for( auto e: u.events )
+	{
+		e.app = translate( events::IdColumns::app, e.app );
+		e.dev = translate( events::IdColumns::dev, e.dev );
+		e.cmd = translate( events::IdColumns::cmd, e.cmd );
+		batch.push_back( e );
+		this->latest_event_ns = std::max( this->latest_event_ns, e.ts_ns );
+	}
+	this->store.append( batch );
+	if( this->latest_event_ns > events::live_retention_ns )
+		this->store.evict_before( this->latest_event_ns - events::live_retention_ns );
+
+	if( u.interactions )
+		this->latest_interactions = *u.interactions;
+	if( u.cpu )
+		this->latest_cpu = *u.cpu;
+
+	for( auto&& line: u.log_lines )
+		this->log.push_back( line );
+	while( this->log.size() > log_capacity )
+		this->log.pop_front();
+}
+
+std::vector<atop::protocol::Update> atop::collector::State::snapshot( size_t max_events ) const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	std::vector<protocol::Update> updates( 1 );
+	auto& u    = updates[0];
+	u.snapshot = true;
+
+	for( auto col: { events::IdColumns::app, events::IdColumns::dev, events::IdColumns::cmd } )
+		for( auto&& [local, wire]: this->to_wire[static_cast<size_t>( col )] )
+			u.strings.push_back( protocol::NewString{
+			    col, wire, std::string( events::interner( col ).name( local ) ) } );
+
+	auto translate = [this]( events::IdColumns col, intern::string_id_t id ) {
+		auto const& wire = this->to_wire[static_cast<size_t>( col )];
+		auto it          = wire.find( id );
+		return it == wire.end() ? events::none_id : it->second;
+	};
+
+	u.interactions = this->latest_interactions;
+	u.cpu          = this->latest_cpu;
+	u.log_lines.assign( this->log.begin(), this->log.end() );
+
+	this->store.scan( 0, [&]( events::Event const& e ) {
+		if( updates.back().events.size() >= std::max<size_t>( 1, max_events ) )
+			updates.emplace_back();
+		auto w = e;
+		w.app  = translate( events::IdColumns::app, e.app );
+		w.dev  = translate( events::IdColumns::dev, e.dev );
+		w.cmd  = translate( events::IdColumns::cmd, e.cmd );
+		updates.back().events.push_back( w );
+	} );
+	return updates;
+}
+
+std::map<std::string, int> atop::collector::State::interactions() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return this->latest_interactions;
+}
+
+std::map<std::string, double> atop::collector::State::cpu() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return this->latest_cpu;
+}
+
+std::vector<std::string> atop::collector::State::log_lines() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return std::vector<std::string>( this->log.begin(), this->log.end() );
+}
+
+atop::collector::Server::Server( std::string const& addr )
+    : listen_fd( -1 )
+    , wake_fd( -1 )
+    , unix_path()
+    , mtx()
+    , mirror()
+    , subs()
+    , stopping( false )
+    , thread()
+{
+	auto a          = parse_address( addr );
+	this->listen_fd = open_socket( a, true );
+	if( a.unix_socket )
+		this->unix_path = a.host;
+
+	if( listen( this->listen_fd, 16 ) < 0 )
+	{
+		auto e = sys_error( fmt::format( "Could not listen on '{0}'", addr ) );
+		close( this->listen_fd );
+		throw e;
+	}
+	fcntl( this->listen_fd, F_SETFL, fcntl( this->listen_fd, F_GETFL ) | O_NONBLOCK );
+
+	this->wake_fd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if( this->wake_fd < 0 )
+	{
+		auto e = sys_error( "eventfd" );
+		close( this->listen_fd );
+		throw e;
+	}
+
+	this->thread = std::thread( [this]() { this->serve(); } );
+}
+
+atop::collector::Server::~Server()
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		this->stopping = true;
+	}
+	this->wake();
+	this->thread.join();
+
+	for( auto&& s: this->subs )
+		close( s.fd );
+	close( this->wake_fd );
+	close( this->listen_fd );
+	if( !this->unix_path.empty() )
+		unlink( this->unix_path.c_str() );
+}
+
+void atop::collector::Server::wake()
+{
+	uint64_t one = 1;
+	if( write( this->wake_fd, &one, sizeof( one ) ) < 0 && errno != EAGAIN )
+		atop::logger::warn( fmt::format( "Could not wake collector: {0}", std::strerror( errno ) ) );
+}
+
+void atop::collector::Server::publish( protocol::Update const& delta )
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		this->mirror.apply( delta );
+		if( this->subs.empty() )
+			return;
+
+		auto bytes = protocol::encode( delta );
+		for( auto&& s: this->subs )
+		{
+			if( s.dropped )
+				continue;
+
+			if( s.out.size() - s.sent + bytes.size() > max_backlog )
+			{
+				atop::logger::warn( "Viewer fell too far behind; disconnecting it" );
+				shutdown( s.fd, SHUT_RDWR );
+				s.dropped = true;
+				continue;
+			}
+			s.out += bytes;
+		}
+	}
+	this->wake();
+}
+
+size_t atop::collector::Server::subscribers() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return this->subs.size();
+}
+
+void atop::collector::Server::accept_subscriber()
+{
+	int fd = accept4( this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK );
+	if( fd < 0 )
+		return;
+
+	std::lock_guard<std::mutex> lock( this->mtx );
+	auto out = protocol::encode_hello();
+	for( auto&& u: this->mirror.snapshot() )
+		out += protocol::encode( u );
+	this->subs.push_back( Subscriber{ fd, std::move( out ), 0, false } );
+	atop::logger::verbose_info(
+	    fmt::format( "Viewer attached; {0} viewer(s) connected", this->subs.size() ) );
+}
+
+void atop::collector::Server::serve()
+{
+	std::array<char, 4096> discard;
+	std::vector<pollfd> fds;
+	for( ;; )
+	{
+		fds.clear();
+		fds.push_back( pollfd{ this->listen_fd, POLLIN, 0 } );
+		fds.push_back( pollfd{ this->wake_fd, POLLIN, 0 } );
+		{
+			std::lock_guard<std::mutex> lock( this->mtx );
+			if( this->stopping )
+				return;
+			for( auto&& s: this->subs )
+				fds.push_back( pollfd{
+				    s.fd, static_cast<short>( POLLIN | ( s.out.size() > s.sent ? POLLOUT : 0 ) ),
+				    0 } );
+		}
+
+		if( poll( fds.data(), fds.size(), -1 ) < 0 && errno != EINTR )
+			atop::logger::log_and_exit(
+			    fmt::format( "Collector failed: {0}", std::strerror( errno ) ) );
+
+		if( fds[1].revents & POLLIN )
+		{
+			uint64_t count;
+			while( read( this->wake_fd, &count, sizeof( count ) ) > 0 )
+				continue;
+		}
+
+		// Subscribers are only added and removed by this thread, so they
+		// still line up with fds
+		std::unique_lock<std::mutex> lock( this->mtx );
+		size_t kept = 0;
+		for( size_t i = 0; i < this->subs.size(); ++i )
+		{
+			auto& s      = this->subs[i];
+			auto revents = fds[i + 2].revents;
+			bool closed  = revents & ( POLLERR | POLLNVAL );
+
+			// Viewers don't send anything; reading detects closed sockets
+			if( !closed && ( revents & ( POLLIN | POLLHUP ) ) )
+			{
+				auto n = recv( s.fd, discard.data(), discard.size(), MSG_DONTWAIT );
+				closed = n == 0 || ( n < 0 && errno != EAGAIN );
+			}
+
+			if( !closed && ( revents & POLLOUT ) )
+			{
+				auto n = send( s.fd, s.out.data() + s.sent, s.out.size() - s.sent,
+				               MSG_DONTWAIT | MSG_NOSIGNAL );
+				if( n > 0 )
+					s.sent += static_cast<size_t>( n );
+				else if( n < 0 && errno != EAGAIN )
+					closed = true;
+
+				if( s.sent == s.out.size() )
+				{
+					s.out.clear();
+					s.sent = 0;
+				}
+				else if( s.sent > max_backlog / 4 )
+				{
+					s.out.erase( 0, s.sent );
+					s.sent = 0;
+				}
+			}
+
+			if( closed )
+			{
+				close( s.fd );
+				atop::logger::verbose_info( "Viewer detached" );
+				continue;
+			}
+			if( kept != i )
+				this->subs[kept] = std::move( s );
+			kept++;
+		}
+		this->subs.resize( kept, Subscriber{ -1, "", 0, false } );
+		lock.unlock();
+
+		if( fds[0].revents & POLLIN )
+			this->accept_subscriber();
+	}
+}
+
+atop::collector::Client::Client( std::string const& addr, update_fn_t on_update_ )
+    : fd( open_socket( parse_address( addr ), false ) )
+    , on_update( std::move( on_update_ ) )
+    , mirror()
+    , is_connected( true )
+    , bytes( 0 )
+    , thread()
+{
+	this->thread = std::thread( [this]() { this->read_loop(); } );
+}
+
+atop::collector::Client::~Client()
+{
+	// Unblocks the reading thread
+	shutdown( this->fd, SHUT_RDWR );
+	this->thread.join();
+	close( this->fd );
+}
+
+void atop::collector::Client::read_loop()
+{
+	static auto& bytes_read  = atop::selfprof::counter( "collector.bytes" );
+	static auto& decode_time = atop::selfprof::timer( "collector.decode" );
+
+	protocol::Decoder decoder;
+	protocol::Update u;
+	std::array<char, 64 * 1024> buf;
+	try
+	{
+		for( ;; )
+		{
+			auto n = recv( this->fd, buf.data(), buf.size(), 0 );
+			if( n < 0 && errno == EINTR )
+				continue;
+			if( n <= 0 )
+				break;
+
+			this->bytes += static_cast<uint64_t>( n );
+			bytes_read.add( static_cast<uint64_t>( n ) );
+			atop::selfprof::ScopedTimer decode_timer( decode_time );
+			decoder.feed( buf.data(), static_cast<size_t>( n ) );
+			while( decoder.next( u ) )
+			{
+				this->mirror.apply( u );
+				if( this->on_update )
+					this->on_update( u );
+			}
+		}
+	}
+	catch( std::exception const& e )
+	{
+		atop::logger::warn( fmt::format( "Dropping collector connection: {0}", e.what() ) );
+	}
+
+	this->is_connected = false;
+}
@@ -0,0 +1,168 @@
+#ifndef COLLECTOR_H_IN
+#define COLLECTOR_H_IN
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "events.h"
+#include "intern.h"
+#include "protocol.h"
+
+namespace atop
+{
+namespace collector
+{
+// Headless collection served to any number of viewers
+//
+// The collector samples the device and publishes each batch of new data
+// as a delta update. Deltas are encoded once and the same bytes are sent
+// to every viewer, so attaching another viewer costs a socket write per
+// update and no work on the device. A viewer attaching later first
+// receives a snapshot of the state accumulated so far; events are only
+// kept for events::live_retention_ns. Viewers that fall behind by more
+// than max_backlog bytes are disconnected.
+
+constexpr auto default_address = "127.0.0.1:7433";
+constexpr size_t max_backlog   = 16 * 1024 * 1024;
+
+// "unix:<path>", "<host>:<port>" or "<port>" (on 127.0.0.1)
+struct Address
+{
+	bool unix_socket;
+	std::string host; // or the socket path
+	uint16_t port;
+};
+
+Address parse_address( std::string const& addr );
+
+// Socket bound to (listen) or connected to (!listen) a; throws if that
+// isn't possible
+int open_socket( Address const& a, bool listen );
+
+// State of the collector as mirrored by a viewer
+//
+// Interned ids of events are translated between the ids on the wire and
+// those of the process' interners, so events() can be aggregated like the
+// store of a local streamer.
+class State
+{
+  public:
+	static constexpr size_t log_capacity = 1000;
+
+	State();
+
+	void apply( protocol::Update const& u );
+
+	// The state as a snapshot update followed by updates adding the rest
+	// of the events, each holding at most max_events events
+	std::vector<protocol::Update>
+	snapshot( size_t max_events = protocol::max_update_events ) const;
+
+	events::EventStore const& events() const { return this->store; }
+	std::map<std::string, int> interactions() const;
+	std::map<std::string, double> cpu() const;
+
+	// Last log_capacity log lines
+	std::vector<std::string> log_lines() const;
+
+  private:
+	mutable std::mutex mtx;
+
+	// Wire id to local id and back per column
+	std::array<std::vector<intern::string_id_t>, 3> to_local;
+	std::array<std::unordered_map<intern::string_id_t, intern::string_id_t>, 3> to_wire;
+
+	events::EventStore store;
+	util::nanoseconds_t latest_event_ns;
+	std::map<std::string, int> latest_interactions;
+	std::map<std::string, double> latest_cpu;
+	std::deque<std::string> log;
+};
+
+class Server
+{
+  public:
+	// Listens on addr; throws if that isn't possible
+	explicit Server( std::string const& addr );
+	~Server();
+	Server( Server const& ) = delete;
+	Server( Server&& )      = delete;
+
+	void publish( protocol::Update const& delta );
+
+	size_t subscribers() const;
+	State const& state() const { return this->mirror; }
+
+  private:
+	struct Subscriber
+	{
+		int fd;
+		std::string out;
+		size_t sent;
+
+		// Disconnected for falling behind
+		bool dropped;
+	};
+
+	void serve();
+	void accept_subscriber();
+	void wake();
+
+	int listen_fd;
+	int wake_fd;
+	std::string unix_path;
+
+	mutable std::mutex mtx;
+	State mirror;
+	std::vector<Subscriber> subs;
+	bool stopping;
+
+	std::thread thread;
+};
+
+class Client
+{
+  public:
+	using update_fn_t = std::function<void( protocol::Update const& )>;
+
+	// Connects to the collector at addr; throws if that isn't possible.
+	// on_update is called by the reading thread after each update has been
+	// applied to state().
+	explicit Client( std::string const& addr, update_fn_t on_update = nullptr );
+	~Client();
+	Client( Client const& ) = delete;
+	Client( Client&& )      = delete;
+
+	State const& state() const { return this->mirror; }
+
+	// False once the collector closed the connection or sent garbage
+	bool connected() const { return this->is_connected; }
+
+	// Encoded bytes received so far
+	uint64_t bytes_received() const { return this->bytes; }
+
+  private:
+	void read_loop();
+
+	int fd;
+	update_fn_t on_update;
+	State mirror;
+	std::atomic<bool> is_connected;
+	std::atomic<uint64_t> bytes;
+
+	std::thread thread;
+};
+
+} // namespace collector
+} // namespace atop
+
+#endif // COLLECTOR_H_IN
@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "downsample.h"
+
+std::vector<size_t> atop::downsample::lttb( double const* x, double const* y, size_t n,
+                                            size_t threshold )
+{
+	std::vector<size_t> kept;
+	if( n <= threshold || threshold < 3 )
+	{
+		kept.resize( n );
+		std::iota( kept.begin(), kept.end(), size_t{ 0 } );
+		return kept;
+	}
+
+	kept.reserve( threshold );
+	kept.push_back( 0 );
+
+	// Points 1 .. n - 2 are split into threshold - 2 buckets
+	double every = static_cast<double>( n - 2 ) / static_cast<double>( threshold - 2 );
+	auto bucket_start = [every]( size_t b ) {
+		return static_cast<size_t>( std::floor( every * static_cast<double>( b ) ) ) + 1;
+	};
+
+	size_t a = 0;
+	for( size_t b = 0; b < threshold - 2; ++b )
+	{
+		// Average of the next bucket; the last point for the last bucket
+		size_t next_start = bucket_start( b + 1 );
+		size_t next_end   = std::min( bucket_start( b + 2 ), n - 1 );
+
+		double avg_x = x[n - 1], avg_y = y[n - 1];
+		if( next_start < next_end )
+		{
+			avg_x = avg_y = 0.0;
+			for( size_t i = next_start; i < next_end; ++i )
+			{
+				avg_x += x[i];
+				avg_y += y[i];
+			}
+			avg_x /= static_cast<double>( next_end - next_start );
+			avg_y /= static_cast<double>( next_end - next_start );
+		}
+
+		size_t end       = std::min( next_start, n - 1 );
+		size_t best      = bucket_start( b );
+		double best_area = -1.0;
+		for( size_t i = bucket_start( b ); i < end; ++i )
+		{
+			// Twice the triangle's area
+			double area = std::abs( ( x[a] - avg_x ) * ( y[i] - y[a] )
+			                        - ( x[a] - x[i] ) * ( avg_y - y[a] ) );
+			if( area > best_area )
+			{
+				best_area = area;
+				best      = i;
+			}
+		}
+
+		kept.push_back( best );
+		a = best;
+	}
+
+	kept.push_back( n - 1 );
+	return kept;
+}
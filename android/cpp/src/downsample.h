@@ -0,0 +1,28 @@
+#ifndef DOWNSAMPLE_H_IN
+#define DOWNSAMPLE_H_IN
+
+#include <cstddef>
+#include <vector>
+
+namespace atop
+{
+namespace downsample
+{
+// Largest-Triangle-Three-Buckets (Steinarsson, 2013)
+//
+// Selects threshold of the n points (x[i], y[i]), x ascending, for
+// plotting. The first and last point are always kept. The points in
+// between are split into threshold - 2 buckets, and each bucket keeps the
+// point forming the largest triangle with the point kept in the previous
+// bucket and the average of the next bucket. Peaks therefore survive,
+// unlike with averaging or striding, and a chart needs no more points
+// than it has pixels. Runs in O(n).
+//
+// Returns the indices of the kept points in ascending order; all indices
+// if n <= threshold or threshold < 3.
+std::vector<size_t> lttb( double const* x, double const* y, size_t n, size_t threshold );
+
+} // namespace downsample
+} // namespace atop
+
+#endif // DOWNSAMPLE_H_IN
@@ -0,0 +1,391 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "events.h"
+#include "intern.h"
+#include "util.h"
+
+std::string_view atop::events::field( std::string_view line, std::string_view key )
+{
+	auto pos = line.find( key );
+	if( pos == std::string_view::npos )
+		return {};
+
+	auto start = pos + key.size();
+	auto end   = line.find( ')', start );
+	if( end == std::string_view::npos )
+		return {};
+
+	return line.substr( start, end - start );
+}
+
+int32_t atop::events::pid_field( std::string_view line, std::string_view key )
+{
+	auto value  = field( line, key );
+	int32_t pid = no_pid;
+	if( std::from_chars( value.data(), value.data() + value.size(), pid ).ec != std::errc() )
+		return no_pid;
+	return pid;
+}
+
+bool atop::events::parse_dmesg_line( std::string_view line, Event& out )
+{
+	constexpr std::string_view ioctl_prefix = "IOCTL ";
+	constexpr std::string_view info_prefix  = "INFO: ";
+
+	size_t i = 0;
+	if( !atop::util::parse_dmesg_ts( line, out.ts_ns, i ) )
+		return false;
+	while( i < line.size() && line[i] == ' ' )
+		++i;
+
+	auto msg        = line.substr( i );
+	out.pid         = no_pid;
+	out.tid         = no_pid;
+	out.app         = none_id;
+	out.dev         = none_id;
+	out.cmd         = none_id;
+	out.duration_ns = 0;
+
+	if( auto app = field( msg, "(app: " ); !app.empty() )
+		out.app = atop::intern::app_names().intern( app );
+
+	if( msg.substr( 0, ioctl_prefix.size() ) == ioctl_prefix )
+	{
+		out.kind = EventKinds::ioctl;
+
+		auto dev_end = msg.find( ':', ioctl_prefix.size() );
+		if( dev_end != std::string_view::npos && dev_end > ioctl_prefix.size() )
+			out.dev = atop::intern::accel_tags().intern(
+			    msg.substr( ioctl_prefix.size(), dev_end - ioctl_prefix.size() ) );
+
+		// "(cmd: <name> [<number>])"
+		auto cmd = field( msg, "(cmd: " );
+		if( auto nr = cmd.rfind( " [" ); nr != std::string_view::npos )
+			cmd = cmd.substr( 0, nr );
+		if( !cmd.empty() )
+			out.cmd = atop::intern::ioctl_cmds().intern( cmd );
+
+		// adsprpc reports the thread as pid and the process as tgid
+		out.tid = pid_field( msg, "(pid: " );
+		out.pid = pid_field( msg, "(tgid: " );
+
+		// kgsl reports the time spent in the ioctl
+		auto time = field( msg, "(time: " );
+		size_t j  = 0;
+		if( !atop::util::parse_decimal_ns( time, j, atop::util::ns_per_s, out.duration_ns ) )
+			out.duration_ns = 0;
+
+		return true;
+	}
+
+	if( msg.substr( 0, info_prefix.size() ) == info_prefix )
+	{
+		out.kind = EventKinds::info;
+
+		// The message following "(app: ...) " is used as command
+		auto app_end = msg.find( ')', info_prefix.size() );
+		if( app_end != std::string_view::npos )
+		{
+			auto what = atop::util::trimmed( msg.substr( app_end + 1 ) );
+			if( !what.empty() )
+				out.cmd = atop::intern::ioctl_cmds().intern( what );
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+atop::intern::StringInterner& atop::events::interner( IdColumns col )
+{
+	switch( col )
+	{
+		case IdColumns::app: return atop::intern::app_names();
+		case IdColumns::dev: return atop::intern::accel_tags();
+		case IdColumns::cmd: return atop::intern::ioctl_cmds();
+	}
+	throw std::runtime_error( "Unknown event column" );
+}
+
+// Query with unset members turned into masks so that every row is
+// tested the same way: ( value ^ want ) & mask == 0
+struct Filter
+{
+	uint64_t t0;
+	uint64_t t1;
+	uint32_t kind, kind_mask;
+	uint32_t app, app_mask;
+	uint32_t dev, dev_mask;
+	uint32_t cmd, cmd_mask;
+	uint32_t pid, pid_mask;
+};
+
+static Filter make_filter( atop::events::Query const& q )
+{
+	auto want = []( auto const& opt ) { return opt ? static_cast<uint32_t>( *opt ) : 0u; };
+	auto mask = []( auto const& opt ) { return opt ? ~0u : 0u; };
+	return Filter{ q.t0_ns,          q.t1_ns,          want( q.kind ), mask( q.kind ),
+		           want( q.app ),    mask( q.app ),    want( q.dev ),  mask( q.dev ),
+		           want( q.cmd ),    mask( q.cmd ),    want( q.pid ),  mask( q.pid ) };
+}
+
+struct atop::events::EventStore::Chunk
+{
+	size_t size     = 0;
+	uint64_t min_ts = std::numeric_limits<uint64_t>::max();
+	uint64_t max_ts = 0;
+
+	uint64_t ts_ns[chunk_rows];
+	int32_t pid[chunk_rows];
+	int32_t tid[chunk_rows];
+	intern::string_id_t app[chunk_rows];
+	intern::string_id_t dev[chunk_rows];
+	intern::string_id_t cmd[chunk_rows];
+	uint64_t duration_ns[chunk_rows];
+	uint8_t kind[chunk_rows];
+
+	bool full() const { return this->size == chunk_rows; }
+
+	bool overlaps( Filter const& f ) const
+	{
+		return this->size > 0 && this->max_ts >= f.t0 && this->min_ts < f.t1;
+	}
+
+	void push( Event const& e )
+	{
+		auto i               = this->size++;
+		this->ts_ns[i]       = e.ts_ns;
+		this->pid[i]         = e.pid;
+		this->tid[i]         = e.tid;
+		this->app[i]         = e.app;
+		this->dev[i]         = e.dev;
+		this->cmd[i]         = e.cmd;
+		this->duration_ns[i] = e.duration_ns;
+		this->kind[i]        = static_cast<uint8_t>( e.kind );
+		this->min_ts         = std::min( this->min_ts, e.ts_ns );
+		this->max_ts         = std::max( this->max_ts, e.ts_ns );
+	}
+
+	Event row( size_t i ) const
+	{
+		return Event{ this->ts_ns[i], this->pid[i], this->tid[i],         this->app[i],
+			          this->dev[i],   this->cmd[i], this->duration_ns[i],
+			          static_cast<EventKinds>( this->kind[i] ) };
+	}
+
+	// 1 if row i passes the filter, 0 otherwise; no branches
+	uint64_t match( size_t i, Filter const& f ) const
+	{
+		return static_cast<uint64_t>( this->ts_ns[i] >= f.t0 )
+		       & static_cast<uint64_t>( this->ts_ns[i] < f.t1 )
+		       & static_cast<uint64_t>( ( ( this->kind[i] ^ f.kind ) & f.kind_mask ) == 0 )
+		       & static_cast<uint64_t>( ( ( this->app[i] ^ f.app ) & f.app_mask ) == 0 )
+		       & static_cast<uint64_t>( ( ( this->dev[i] ^ f.dev ) & f.dev_mask ) == 0 )
+		       & static_cast<uint64_t>( ( ( this->cmd[i] ^ f.cmd ) & f.cmd_mask ) == 0 )
+		       & static_cast<uint64_t>(
+		           ( ( static_cast<uint32_t>( this->pid[i] ) ^ f.pid ) & f.pid_mask ) == 0 );
+	}
+
+	uint64_t count( Filter const& f ) const
+	{
+		uint64_t n = 0;
+		for( size_t i = 0; i < this->size; ++i )
+			n += this->match( i, f );
+		return n;
+	}
+
+	uint64_t sum_duration( Filter const& f ) const
+	{
+		uint64_t sum = 0;
+		for( size_t i = 0; i < this->size; ++i )
+			sum += this->duration_ns[i] & ( 0 - this->match( i, f ) );
+		return sum;
+	}
+
+	// Non-matching rows are counted in the last element of hist
+	void histogram( Filter const& f, util::nanoseconds_t bucket_ns,
+	                std::vector<uint64_t>& hist ) const
+	{
+		size_t trash = hist.size() - 1;
+		for( size_t i = 0; i < this->size; ++i )
+		{
+			auto bucket = ( this->ts_ns[i] - f.t0 ) / bucket_ns;
+			hist[this->match( i, f ) ? bucket : trash] += 1;
+		}
+	}
+
+	void count_by( intern::string_id_t const* ids, Filter const& f,
+	               std::vector<uint64_t>& counts ) const
+	{
+		size_t trash = counts.size() - 1;
+		for( size_t i = 0; i < this->size; ++i )
+		{
+			auto id = ids[i];
+			counts[( this->match( i, f ) && id != none_id ) ? id : trash] += 1;
+		}
+	}
+};
+
+atop::events::EventStore::EventStore()
+    : mtx()
+    , chunks()
+    , rows( 0 )
+    , first( 0 )
+{
+}
+
+atop::events::EventStore::~EventStore() = default;
+
+atop::events::EventStore::Chunk& atop::events::EventStore::writable_chunk()
+{
+	if( this->chunks.empty() || this->chunks.back()->full() )
+	{
+		// No value-initialisation: columns are written before being read
+		this->chunks.emplace_back( new Chunk );
+	}
+	return *this->chunks.back();
+}
+
+void atop::events::EventStore::append( Event const& e )
+{
+	std::unique_lock<std::shared_mutex> lock( this->mtx );
+	this->writable_chunk().push( e );
+	++this->rows;
+}
+
+void atop::events::EventStore::append( std::vector<Event> const& batch )
+{
+	std::unique_lock<std::shared_mutex> lock( this->mtx );
+	for( auto&& e: batch )
+		this->writable_chunk().push( e );
+	this->rows += batch.size();
+}
+
+void atop::events::EventStore::clear()
+{
+	std::unique_lock<std::shared_mutex> lock( this->mtx );
+	this->chunks.clear();
+	this->rows  = 0;
+	this->first = 0;
+}
+
+size_t atop::events::EventStore::evict_before( util::nanoseconds_t ts_ns )
+{
+	std::unique_lock<std::shared_mutex> lock( this->mtx );
+
+	// Only full chunks go, so that first stays a multiple of chunk_rows
+	size_t n = 0;
+	while( n < this->chunks.size() && this->chunks[n]->full() && this->chunks[n]->max_ts < ts_ns )
+		++n;
+	this->chunks.erase( this->chunks.begin(),
+	                    this->chunks.begin() + static_cast<std::ptrdiff_t>( n ) );
+
+	auto dropped = n * chunk_rows;
+	this->rows -= dropped;
+	this->first += dropped;
+	return dropped;
+}
+
+size_t atop::events::EventStore::size() const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	return this->rows;
+}
+
+size_t atop::events::EventStore::first_row() const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	return this->first;
+}
+
+template<typename Kernel>
+void atop::events::EventStore::for_chunks( Query const& q, Kernel&& kernel ) const
+{
+	auto f = make_filter( q );
+	for( auto&& c: this->chunks )
+		if( c->overlaps( f ) )
+			kernel( *c, f );
+}
+
+uint64_t atop::events::EventStore::count( Query const& q ) const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	uint64_t n = 0;
+	this->for_chunks( q, [&n]( Chunk const& c, Filter const& f ) { n += c.count( f ); } );
+	return n;
+}
+
+atop::util::nanoseconds_t atop::events::EventStore::sum_duration( Query const& q ) const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	uint64_t sum = 0;
+	this->for_chunks( q, [&sum]( Chunk const& c, Filter const& f ) { sum += c.sum_duration( f ); } );
+	return sum;
+}
+
+std::vector<uint64_t> atop::events::EventStore::histogram( Query const& q,
+                                                           util::nanoseconds_t bucket_ns ) const
+{
+	constexpr uint64_t max_buckets = 1 << 24;
+	if( bucket_ns == 0 || q.t1_ns <= q.t0_ns || q.t1_ns == Query{}.t1_ns )
+		throw std::runtime_error( "Histograms require a bounded time window and bucket size" );
+
+	auto num_buckets = ( q.t1_ns - q.t0_ns + bucket_ns - 1 ) / bucket_ns;
+	if( num_buckets > max_buckets )
+		throw std::runtime_error(
+		    fmt::format( "Histogram with {0} buckets exceeds limit of {1}", num_buckets, max_buckets ) );
+
+	std::vector<uint64_t> hist( num_buckets + 1, 0 );
+	{
+		std::shared_lock<std::shared_mutex> lock( this->mtx );
+		this->for_chunks( q, [&]( Chunk const& c, Filter const& f ) {
+			c.histogram( f, bucket_ns, hist );
+		} );
+	}
+	hist.pop_back();
+	return hist;
+}
+
+std::vector<uint64_t> atop::events::EventStore::count_by( IdColumns col, Query const& q ) const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+
+	// Ids of stored rows were interned before the rows were appended
+	std::vector<uint64_t> counts( atop::events::interner( col ).size() + 1, 0 );
+	this->for_chunks( q, [&]( Chunk const& c, Filter const& f ) {
+		switch( col )
+		{
+			case IdColumns::app: c.count_by( c.app, f, counts ); break;
+			case IdColumns::dev: c.count_by( c.dev, f, counts ); break;
+			case IdColumns::cmd: c.count_by( c.cmd, f, counts ); break;
+		}
+	} );
+	counts.pop_back();
+	return counts;
+}
+
+size_t atop::events::EventStore::scan( size_t from,
+                                       std::function<void( Event const& )> const& fn ) const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	auto end = this->first + this->rows;
+	for( size_t i = std::max( from, this->first ); i < end; ++i )
+	{
+		auto r = i - this->first;
+		fn( this->chunks[r / chunk_rows]->row( r % chunk_rows ) );
+	}
+	return std::max( from, end );
+}
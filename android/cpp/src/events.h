@@ -0,0 +1,180 @@
+#ifndef EVENTS_H_IN
+#define EVENTS_H_IN
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "intern.h"
+#include "util.h"
+
+namespace atop
+{
+namespace events
+{
+// Columnar store of parsed driver events
+//
+// Dmesg lines are parsed once into rows of
+//
+//     timestamp (ns since boot), pid, tid, app, device, cmd, duration
+//
+// where app, device and cmd are ids of intern::app_names(),
+// intern::accel_tags() and intern::ioctl_cmds(). Rows are stored column
+// by column (struct of arrays) in fixed-size chunks so that the
+// aggregation kernels below are branch-free loops over contiguous
+// arrays which the compiler can vectorise. Each chunk also keeps the
+// minimum and maximum timestamp of its rows so that time-window queries
+// skip chunks outside of the window.
+
+enum class EventKinds : uint8_t
+{
+	ioctl,
+	info
+};
+
+// Events kept by live stores (a dmesg streamer or a collector's mirror)
+// before the newest one; covers the 20 s windows of the views
+constexpr util::nanoseconds_t live_retention_ns = 60 * util::ns_per_s;
+
+// Value of pid/tid/app/dev/cmd columns if a line doesn't report them
+constexpr int32_t no_pid              = -1;
+constexpr intern::string_id_t none_id = std::numeric_limits<intern::string_id_t>::max();
+
+struct Event
+{
+	util::nanoseconds_t ts_ns;
+	int32_t pid; // process (tgid)
+	int32_t tid; // thread
+	intern::string_id_t app;
+	intern::string_id_t dev;
+	intern::string_id_t cmd;
+	util::nanoseconds_t duration_ns;
+	EventKinds kind;
+};
+
+// Parses "[ 3633.459327] IOCTL <dev>: ... (app: ..) (cmd: .. [..]) ..." and
+// "[ 3633.459327] INFO: (app: ..) <message>" lines as written by the
+// instrumented kgsl and adsprpc drivers. Returns false for any other line.
+bool parse_dmesg_line( std::string_view line, Event& out );
+
+// Value of "(<key>: <value>)" in line, with key including "(" and ": ";
+// empty if key is not present
+std::string_view field( std::string_view line, std::string_view key );
+
+// Value of field( line, key ) as pid; no_pid if it is missing or not a number
+int32_t pid_field( std::string_view line, std::string_view key );
+
+// Interned columns that can be grouped by
+enum class IdColumns : int
+{
+	app,
+	dev,
+	cmd
+};
+
+std::map<std::string, IdColumns> const id_columns_table
+    = { { "app", IdColumns::app }, { "dev", IdColumns::dev }, { "cmd", IdColumns::cmd } };
+
+inline IdColumns string2idColumn( std::string const& col )
+{
+	auto it = id_columns_table.find( col );
+	if( it != id_columns_table.end() )
+		return it->second;
+	else
+		throw std::runtime_error( "Event column " + col + " not defined" );
+}
+
+// Interner holding the names of a column's ids
+intern::StringInterner& interner( IdColumns col );
+
+// Filter of aggregation queries; unset members match everything
+struct Query
+{
+	// Half-open time window [t0_ns, t1_ns)
+	util::nanoseconds_t t0_ns = 0;
+	util::nanoseconds_t t1_ns = std::numeric_limits<util::nanoseconds_t>::max();
+
+	std::optional<EventKinds> kind{};
+	std::optional<intern::string_id_t> app{};
+	std::optional<intern::string_id_t> dev{};
+	std::optional<intern::string_id_t> cmd{};
+	std::optional<int32_t> pid{};
+
+	void set( IdColumns col, intern::string_id_t id )
+	{
+		switch( col )
+		{
+			case IdColumns::app: this->app = id; break;
+			case IdColumns::dev: this->dev = id; break;
+			case IdColumns::cmd: this->cmd = id; break;
+		}
+	}
+};
+
+class EventStore
+{
+  public:
+	static constexpr size_t chunk_rows = 4096;
+
+	EventStore();
+	~EventStore();
+	EventStore( EventStore const& ) = delete;
+	EventStore( EventStore&& )      = delete;
+
+	void append( Event const& e );
+	void append( std::vector<Event> const& batch );
+	void clear();
+
+	// Drops the oldest full chunks whose rows are all older than ts_ns.
+	// Returns the number of rows dropped.
+	size_t evict_before( util::nanoseconds_t ts_ns );
+
+	// Rows currently stored
+	size_t size() const;
+
+	// Index of the oldest stored row; rows keep their index when older
+	// ones are evicted
+	size_t first_row() const;
+
+	// Number of matching rows and sum of their durations
+	uint64_t count( Query const& q ) const;
+	util::nanoseconds_t sum_duration( Query const& q ) const;
+
+	// Matching rows per bucket of bucket_ns starting at q.t0_ns; the
+	// window has to be bounded
+	std::vector<uint64_t> histogram( Query const& q, util::nanoseconds_t bucket_ns ) const;
+
+	// Matching rows per id of the given column; rows without a value
+	// (none_id) are not counted
+	std::vector<uint64_t> count_by( IdColumns col, Query const& q ) const;
+
+	// Calls fn for every stored row starting at index from in insertion
+	// order. Returns the index one past the last row.
+	size_t scan( size_t from, std::function<void( Event const& )> const& fn ) const;
+
+  private:
+	struct Chunk;
+
+	// Calls kernel( chunk, filter ) for each chunk overlapping q's window
+	template<typename Kernel> void for_chunks( Query const& q, Kernel&& kernel ) const;
+
+	Chunk& writable_chunk();
+
+	mutable std::shared_mutex mtx;
+	std::vector<std::unique_ptr<Chunk>> chunks;
+	size_t rows;
+	size_t first;
+};
+
+} // namespace events
+} // namespace atop
+
+#endif // EVENTS_H_IN
@@ -3,6 +3,13 @@
 #include <map>
 #include <thread>
 
+template<typename Data_t>
+atop::fifo::FIFO<Data_t>::FIFO( std::string const& name )
+    : depth( selfprof::gauge( "fifo." + name + ".depth" ) )
+    , wait( selfprof::timer( "fifo." + name + ".wait" ) )
+{
+}
+
 template<typename Data_t> void atop::fifo::FIFO<Data_t>::push_data( Data_t const& more )
 {
 	while( this->data.size() > this->max_data_sz )
@@ -10,7 +17,8 @@ template<typename Data_t> void atop::fifo::FIFO<Data_t>::push_data( Data_t const
 
 	std::unique_lock<std::mutex> lock( this->mtx );
 
-	this->data.push( more );
+	this->data.emplace( more, std::chrono::steady_clock::now() );
+	this->depth.set( static_cast<int64_t>( this->data.size() ) );
 
 	lock.unlock();
 }
@@ -19,22 +27,30 @@ template<typename Data_t> Data_t atop::fifo::FIFO<Data_t>::pop_data()
 {
 	std::unique_lock<std::mutex> lock( this->mtx );
 
-	Data_t ret = this->data.front();
+	Data_t ret = std::move( this->data.front().first );
+	this->wait.record( static_cast<util::nanoseconds_t>(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now()
+	                                                          - this->data.front().second )
+	        .count() ) );
 
 	this->data.pop();
+	this->depth.set( static_cast<int64_t>( this->data.size() ) );
 
 	return ret;
 }
 
 // Instantiations
 using ti1 = std::map<std::string, int>;
+template atop::fifo::FIFO<ti1>::FIFO( std::string const& name );
 template ti1 atop::fifo::FIFO<ti1>::pop_data();
 template void atop::fifo::FIFO<ti1>::push_data( ti1 const& more );
 
 using ti2 = std::map<std::string, double>;
+template atop::fifo::FIFO<ti2>::FIFO( std::string const& name );
 template ti2 atop::fifo::FIFO<ti2>::pop_data();
 template void atop::fifo::FIFO<ti2>::push_data( ti2 const& more );
 
 using ti3 = std::map<std::string, std::vector<std::string>>;
+template atop::fifo::FIFO<ti3>::FIFO( std::string const& name );
 template ti3 atop::fifo::FIFO<ti3>::pop_data();
 template void atop::fifo::FIFO<ti3>::push_data( ti3 const& more );
\ No newline at end of file
@@ -1,17 +1,26 @@
 #ifndef FIFO_H_IN
 #define FIFO_H_IN
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <queue>
+#include <string>
 #include <thread>
+#include <utility>
+
+#include "selfprof.h"
 
 namespace atop
 {
 namespace fifo
 {
+// Queue depth and the time elements spend queued are reported as the
+// self-profiling metrics fifo.<name>.depth and fifo.<name>.wait
 template<typename Data_t> class FIFO
 {
   public:
-	FIFO()  = default;
+	explicit FIFO( std::string const& name );
 	~FIFO() = default;
 
 	void push_data( Data_t const& );
@@ -20,10 +29,86 @@ template<typename Data_t> class FIFO
 
   private:
 	std::mutex mtx{};
-	std::queue<Data_t> data{};
+	std::queue<std::pair<Data_t, std::chrono::steady_clock::time_point>> data{};
 
 	// block if queue reaches this many elements
 	size_t max_data_sz = 10;
+
+	selfprof::Gauge& depth;
+	selfprof::Timer& wait;
+};
+
+// Blocking, bounded multi-producer/multi-consumer queue used to chain
+// pipeline stages. Producers block while the queue is full which bounds
+// the memory held in flight. Once closed, pop() drains the remaining
+// elements and then returns false.
+//
+// Unlike FIFO this is defined in the header since it is instantiated with
+// stage-specific batch types.
+template<typename Data_t> class BoundedQueue
+{
+  public:
+	explicit BoundedQueue( size_t max_sz )
+	    : capacity( max_sz )
+	{
+	}
+	~BoundedQueue()                     = default;
+	BoundedQueue( BoundedQueue const& ) = delete;
+	BoundedQueue( BoundedQueue&& )      = delete;
+
+	// Returns false if the queue was closed
+	bool push( Data_t&& more )
+	{
+		std::unique_lock<std::mutex> lock( this->mtx );
+		this->not_full.wait(
+		    lock, [this] { return this->closed || this->data.size() < this->capacity; } );
+		if( this->closed )
+			return false;
+
+		this->data.push( std::move( more ) );
+		lock.unlock();
+		this->not_empty.notify_one();
+		return true;
+	}
+
+	// Returns false once the queue is closed and drained
+	bool pop( Data_t& out )
+	{
+		std::unique_lock<std::mutex> lock( this->mtx );
+		this->not_empty.wait( lock, [this] { return this->closed || !this->data.empty(); } );
+		if( this->data.empty() )
+			return false;
+
+		out = std::move( this->data.front() );
+		this->data.pop();
+		lock.unlock();
+		this->not_full.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock( this->mtx );
+			this->closed = true;
+		}
+		this->not_full.notify_all();
+		this->not_empty.notify_all();
+	}
+
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		return this->data.size();
+	}
+
+  private:
+	std::mutex mtx{};
+	std::condition_variable not_full{};
+	std::condition_variable not_empty{};
+	std::queue<Data_t> data{};
+	size_t capacity;
+	bool closed = false;
 };
 
 } // namespace fifo
@@ -0,0 +1,611 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/printf.h>
+
+#include "ftrace.h"
+#include "util.h"
+
+namespace
+{
+constexpr uint32_t type_padding     = 29;
+constexpr uint32_t type_time_extend = 30;
+constexpr uint32_t type_time_stamp  = 31;
+constexpr uint32_t ts_shift         = 27;
+
+// Flags in the high bits of a page's commit
+constexpr uint64_t missed_events = 1ULL << 31;
+constexpr uint64_t commit_mask   = ( 1ULL << 30 ) - 1;
+
+// Little endian integer of size bytes at data[pos]
+uint64_t load( std::string_view data, size_t pos, size_t size )
+{
+	if( size > 8 || pos > data.size() || size > data.size() - pos )
+		throw std::runtime_error( "Corrupt ftrace record" );
+	uint64_t v = 0;
+	for( size_t i = 0; i < size; ++i )
+		v |= uint64_t{ static_cast<unsigned char>( data[pos + i] ) } << ( 8 * i );
+	return v;
+}
+
+using atop::util::trimmed;
+
+uint32_t number( std::string_view s )
+{
+	uint32_t n = 0;
+	s          = trimmed( s );
+	if( std::from_chars( s.data(), s.data() + s.size(), n ).ec != std::errc() )
+		throw std::runtime_error( fmt::format( "Malformed ftrace format number '{0}'", s ) );
+	return n;
+}
+
+// "field:<declaration>;\toffset:<n>;\tsize:<n>;\tsigned:<n>;"
+atop::ftrace::Field parse_field( std::string_view line )
+{
+	std::vector<std::string_view> parts;
+	for( size_t pos = 0, end; pos < line.size(); pos = end + 1 )
+	{
+		end = line.find( ';', pos );
+		if( end == std::string_view::npos )
+			end = line.size();
+		if( auto part = trimmed( line.substr( pos, end - pos ) ); !part.empty() )
+			parts.push_back( part );
+	}
+
+	auto value = [&parts]( std::string_view key ) {
+		for( auto p: parts )
+			if( p.substr( 0, key.size() ) == key )
+				return p.substr( key.size() );
+		throw std::runtime_error( fmt::format( "ftrace field lacks '{0}'", key ) );
+	};
+
+	atop::ftrace::Field f;
+	auto decl   = trimmed( value( "field:" ) );
+	f.data_loc  = decl.substr( 0, 11 ) == "__data_loc ";
+	f.rel_loc   = decl.substr( 0, 10 ) == "__rel_loc ";
+	f.data_loc  = f.data_loc || f.rel_loc;
+	f.offset    = number( value( "offset:" ) );
+	f.size      = number( value( "size:" ) );
+	f.is_signed = number( value( "signed:" ) ) != 0;
+
+	// The name is the last identifier, e.g. of "char prev_comm[16]"
+	auto name = decl;
+	if( auto bracket = name.find( '[' ); bracket != std::string_view::npos && !f.data_loc )
+		name = trimmed( name.substr( 0, bracket ) );
+	auto start = name.find_last_of( " *" );
+	name       = start == std::string_view::npos ? name : name.substr( start + 1 );
+	if( name.empty() )
+		throw std::runtime_error( fmt::format( "Malformed ftrace field '{0}'", line ) );
+
+	f.name = std::string( name );
+	f.type = std::string( trimmed( decl.substr( 0, decl.rfind( name ) ) ) );
+	return f;
+}
+
+std::vector<std::string_view> lines( std::string_view text )
+{
+	std::vector<std::string_view> out;
+	for( size_t pos = 0, end; pos < text.size(); pos = end + 1 )
+	{
+		end = text.find( '\n', pos );
+		if( end == std::string_view::npos )
+			end = text.size();
+		out.push_back( text.substr( pos, end - pos ) );
+	}
+	return out;
+}
+
+std::string read_file( std::string const& path )
+{
+	std::ifstream is{ path, std::ios::binary };
+	if( !is )
+		throw std::runtime_error( fmt::format( "Could not read '{0}'", path ) );
+	std::ostringstream ss;
+	ss << is.rdbuf();
+	return ss.str();
+}
+
+// Closes its file descriptor
+struct Fd
+{
+	explicit Fd( int fd_ )
+	    : fd( fd_ )
+	{
+	}
+	Fd( Fd&& other ) noexcept
+	    : fd( other.fd )
+	{
+		other.fd = -1;
+	}
+	Fd( Fd const& ) = delete;
+	~Fd()
+	{
+		if( this->fd >= 0 )
+			close( this->fd );
+	}
+
+	int fd;
+};
+} // namespace
+
+atop::ftrace::Field const* atop::ftrace::Format::field( std::string_view field_name ) const
+{
+	for( auto&& f: this->fields )
+		if( f.name == field_name )
+			return &f;
+	return nullptr;
+}
+
+atop::ftrace::Format atop::ftrace::parse_format( std::string_view text )
+{
+	Format format;
+	bool has_id = false;
+	for( auto line: lines( text ) )
+	{
+		line = trimmed( line );
+		if( line.substr( 0, 5 ) == "name:" )
+			format.name = std::string( trimmed( line.substr( 5 ) ) );
+		else if( line.substr( 0, 3 ) == "ID:" )
+		{
+			auto id = number( line.substr( 3 ) );
+			if( id > std::numeric_limits<uint16_t>::max() )
+				throw std::runtime_error( fmt::format( "ftrace event id {0} out of range", id ) );
+			format.id = static_cast<uint16_t>( id );
+			has_id    = true;
+		}
+		else if( line.substr( 0, 6 ) == "field:" )
+			format.fields.push_back( parse_field( line ) );
+	}
+
+	if( format.name.empty() || !has_id )
+		throw std::runtime_error( "ftrace event format lacks name or ID" );
+	return format;
+}
+
+atop::ftrace::PageLayout atop::ftrace::parse_header_page( std::string_view text )
+{
+	Format header;
+	for( auto line: lines( text ) )
+		if( line = trimmed( line ); line.substr( 0, 6 ) == "field:" )
+			header.fields.push_back( parse_field( line ) );
+
+	auto const* commit = header.field( "commit" );
+	auto const* data   = header.field( "data" );
+	if( !commit || !data || commit->size > 8 )
+		throw std::runtime_error( "ftrace header_page lacks commit or data" );
+
+	PageLayout layout;
+	layout.commit_offset = commit->offset;
+	layout.commit_size   = commit->size;
+	layout.data_offset   = data->offset;
+	layout.page_size     = data->offset + data->size;
+	return layout;
+}
+
+std::unordered_map<uint64_t, std::string>
+atop::ftrace::parse_printk_formats( std::string_view text )
+{
+	// 0xffffffffc0a1b2c3 : "IOCTL %s: (channel: %s) ...\n"
+	std::unordered_map<uint64_t, std::string> formats;
+	for( auto line: lines( text ) )
+	{
+		auto sep = line.find( " : \"" );
+		if( line.substr( 0, 2 ) != "0x" || sep == std::string_view::npos || line.back() != '"' )
+			continue;
+
+		uint64_t addr = 0;
+		if( std::from_chars( line.data() + 2, line.data() + sep, addr, 16 ).ec != std::errc() )
+			continue;
+
+		std::string fmt;
+		auto quoted = line.substr( sep + 4, line.size() - sep - 5 );
+		for( size_t i = 0; i < quoted.size(); ++i )
+		{
+			if( quoted[i] != '\\' || i + 1 == quoted.size() )
+			{
+				fmt += quoted[i];
+				continue;
+			}
+			switch( quoted[++i] )
+			{
+				case 'n': fmt += '\n'; break;
+				case 't': fmt += '\t'; break;
+				default: fmt += quoted[i];
+			}
+		}
+		formats[addr] = std::move( fmt );
+	}
+	return formats;
+}
+
+uint16_t atop::ftrace::Record::type() const
+{
+	return static_cast<uint16_t>( load( this->data, 0, 2 ) );
+}
+
+int64_t atop::ftrace::integer( Record const& r, Field const& f )
+{
+	auto v = load( r.data, f.offset, f.size );
+	if( f.is_signed && f.size > 0 && f.size < 8 && ( v >> ( 8 * f.size - 1 ) ) & 1 )
+		v |= ~uint64_t{ 0 } << ( 8 * f.size );
+	return static_cast<int64_t>( v );
+}
+
+std::string_view atop::ftrace::string( Record const& r, Field const& f )
+{
+	size_t offset = f.offset;
+	size_t length = f.size == 0 && f.offset <= r.data.size() ? r.data.size() - f.offset : f.size;
+	if( f.data_loc )
+	{
+		auto loc = load( r.data, f.offset, 4 );
+		offset   = ( loc & 0xffff ) + ( f.rel_loc ? f.offset + f.size : 0 );
+		length   = loc >> 16;
+	}
+	if( offset > r.data.size() || length > r.data.size() - offset )
+		throw std::runtime_error( fmt::format( "ftrace field {0} outside of record", f.name ) );
+
+	auto s = r.data.substr( offset, length );
+	return s.substr( 0, s.find( '\0' ) );
+}
+
+bool atop::ftrace::decode_page( std::string_view page, PageLayout const& layout, uint32_t cpu,
+                                std::function<void( Record const& )> const& fn )
+{
+	if( page.size() < layout.data_offset )
+		throw std::runtime_error( "Truncated ftrace page" );
+
+	auto ts     = load( page, 0, 8 );
+	auto commit = load( page, layout.commit_offset, layout.commit_size );
+	auto end    = layout.data_offset + ( commit & commit_mask );
+	if( end > page.size() )
+		throw std::runtime_error( "Corrupt ftrace page" );
+
+	Record r{ 0, cpu, {} };
+	for( size_t pos = layout.data_offset; pos + 4 <= end; )
+	{
+		auto header   = static_cast<uint32_t>( load( page, pos, 4 ) );
+		auto type_len = header & 0x1f;
+		auto delta    = uint64_t{ header >> 5 };
+
+		size_t data_pos = pos + 4, length = 0;
+		switch( type_len )
+		{
+			case type_padding:
+				// Rest of the page, or a discarded record with its length
+				if( delta == 0 )
+					return ( commit & missed_events ) != 0;
+				pos += 4 + load( page, pos + 4, 4 );
+				continue;
+			case type_time_extend:
+				ts += ( load( page, pos + 4, 4 ) << ts_shift ) + delta;
+				pos += 8;
+				continue;
+			case type_time_stamp:
+			{
+				// The lower 59 bits of the absolute time
+				auto abs = ( load( page, pos + 4, 4 ) << ts_shift ) | delta;
+				ts       = abs | ( ts & ~( ( 1ULL << 59 ) - 1 ) );
+				pos += 8;
+				continue;
+			}
+			case 0:
+			{
+				auto array = load( page, pos + 4, 4 );
+				if( array < 4 )
+					throw std::runtime_error( "Corrupt ftrace record" );
+				data_pos = pos + 8;
+				length   = ( array - 4 + 3 ) & ~size_t{ 3 };
+				break;
+			}
+			default: length = type_len * 4;
+		}
+
+		if( data_pos + length > end )
+			throw std::runtime_error( "Corrupt ftrace record" );
+		ts += delta;
+		r.ts_ns = ts;
+		r.data  = page.substr( data_pos, length );
+		fn( r );
+		pos = data_pos + length;
+	}
+	return ( commit & missed_events ) != 0;
+}
+
+atop::ftrace::CpuStream::CpuStream( int fd_, uint32_t cpu_, PageLayout const& layout_ )
+    : fd( fd_ )
+    , cpu( cpu_ )
+    , layout( layout_ )
+    , page()
+    , records()
+    , pos( 0 )
+    , pages_read( 0 )
+    , lost( 0 )
+{
+}
+
+bool atop::ftrace::CpuStream::read_page()
+{
+	this->page.resize( this->layout.page_size );
+	size_t n = 0;
+	while( n < this->page.size() )
+	{
+		auto r = read( this->fd, this->page.data() + n, this->page.size() - n );
+		if( r < 0 && errno == EINTR )
+			continue;
+		if( r <= 0 )
+			break;
+		n += static_cast<size_t>( r );
+	}
+	if( n < this->layout.data_offset )
+		return false;
+
+	this->page.resize( n );
+	this->records.clear();
+	this->pos = 0;
+	this->pages_read++;
+	if( decode_page( this->page, this->layout, this->cpu,
+	                 [this]( Record const& r ) { this->records.push_back( r ); } ) )
+		this->lost++;
+	return true;
+}
+
+bool atop::ftrace::CpuStream::next( Record& out )
+{
+	while( this->pos == this->records.size() )
+		if( !this->read_page() )
+			return false;
+	out = this->records[this->pos++];
+	return true;
+}
+
+void atop::ftrace::merge( std::vector<CpuStream*> const& streams,
+                          std::function<void( Record const& )> const& fn )
+{
+	std::vector<Record> heads( streams.size() );
+	using entry_t = std::pair<util::nanoseconds_t, size_t>;
+	std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> queue;
+	for( size_t i = 0; i < streams.size(); ++i )
+		if( streams[i]->next( heads[i] ) )
+			queue.emplace( heads[i].ts_ns, i );
+
+	while( !queue.empty() )
+	{
+		auto i = queue.top().second;
+		queue.pop();
+		fn( heads[i] );
+		if( streams[i]->next( heads[i] ) )
+			queue.emplace( heads[i].ts_ns, i );
+	}
+}
+
+static atop::ftrace::Field required_field( atop::ftrace::Format const& format, char const* name )
+{
+	auto const* f = format.field( name );
+	if( !f )
+		throw std::runtime_error(
+		    fmt::format( "ftrace event {0} lacks field {1}", format.name, name ) );
+	return *f;
+}
+
+atop::ftrace::Messages::Messages( Format const& print, Format const& bprint,
+                                  std::unordered_map<uint64_t, std::string> printk_formats )
+    : print_id( print.id )
+    , print_buf( required_field( print, "buf" ) )
+    , bprint_id( bprint.id )
+    , bprint_fmt( required_field( bprint, "fmt" ) )
+    , bprint_buf( required_field( bprint, "buf" ) )
+    , formats( std::move( printk_formats ) )
+{
+}
+
+bool atop::ftrace::Messages::message( Record const& r, std::string& out ) const
+{
+	auto type = r.type();
+	if( type == this->print_id )
+		out = std::string( string( r, this->print_buf ) );
+	else if( type == this->bprint_id )
+	{
+		auto it = this->formats.find( static_cast<uint64_t>( integer( r, this->bprint_fmt ) ) );
+		if( it == this->formats.end() || this->bprint_buf.offset > r.data.size() )
+			return false;
+		out = format_binary( it->second, r.data.substr( this->bprint_buf.offset ) );
+	}
+	else
+		return false;
+
+	while( !out.empty() && out.back() == '\n' )
+		out.pop_back();
+	return true;
+}
+
+std::string atop::ftrace::format_binary( std::string_view fmt, std::string_view args )
+{
+	// vbin_printf() aligns arguments to their size, at most 4 bytes
+	size_t a  = 0;
+	auto take = [&args, &a]( size_t size, uint64_t& v ) {
+		a = ( a + std::min<size_t>( size, 4 ) - 1 ) / std::min<size_t>( size, 4 )
+		    * std::min<size_t>( size, 4 );
+		if( a > args.size() || size > args.size() - a )
+			return false;
+		v = load( args, a, size );
+		a += size;
+		return true;
+	};
+	auto take_string = [&args, &a]( std::string& s ) {
+		auto nul = args.find( '\0', a );
+		if( a > args.size() || nul == std::string_view::npos )
+			return false;
+		s = std::string( args.substr( a, nul - a ) );
+		a = nul + 1;
+		return true;
+	};
+
+	std::string out;
+	for( size_t i = 0; i < fmt.size(); ++i )
+	{
+		if( fmt[i] != '%' || i + 1 == fmt.size() )
+		{
+			out += fmt[i];
+			continue;
+		}
+		if( fmt[i + 1] == '%' )
+		{
+			out += '%';
+			++i;
+			continue;
+		}
+
+		// Flags, width, precision and length of the conversion; '*' takes
+		// an int argument
+		std::string spec = "%";
+		size_t start     = i;
+		size_t j         = i + 1;
+		for( ; j < fmt.size() && std::strchr( "-+ #0", fmt[j] ); ++j )
+			spec += fmt[j];
+		for( ; j < fmt.size() && ( std::isdigit( static_cast<unsigned char>( fmt[j] ) )
+		                           || fmt[j] == '.' || fmt[j] == '*' );
+		     ++j )
+		{
+			uint64_t n;
+			if( fmt[j] != '*' )
+				spec += fmt[j];
+			else if( take( 4, n ) )
+				spec += std::to_string( static_cast<int32_t>( n ) );
+			else
+				return out;
+		}
+		size_t size = 4;
+		for( ; j < fmt.size() && std::strchr( "hlLzjt", fmt[j] ); ++j )
+		{
+			spec += fmt[j];
+			size = fmt[j] == 'h' ? std::max<size_t>( 1, size / 2 ) : 8;
+		}
+		if( j == fmt.size() )
+			return out;
+
+		auto conv = fmt[j];
+		i         = j;
+		uint64_t v;
+		std::string s;
+		switch( conv )
+		{
+			case 'c':
+				if( !take( 1, v ) )
+					return out;
+				out += static_cast<char>( v );
+				break;
+			case 's':
+				if( !take_string( s ) )
+					return out;
+				out += fmt::sprintf( spec + 's', s );
+				break;
+			case 'p':
+			{
+				// Extensions other than symbols are rendered by the kernel
+				auto is_alnum = []( char c ) {
+					return std::isalnum( static_cast<unsigned char>( c ) ) != 0;
+				};
+				auto ext = i + 1 < fmt.size() ? fmt[i + 1] : '\0';
+				while( i + 1 < fmt.size() && is_alnum( fmt[i + 1] ) )
+					++i;
+				if( is_alnum( ext ) && !std::strchr( "SsFfxKe", ext ) )
+				{
+					if( !take_string( s ) )
+						return out;
+					out += s;
+				}
+				else if( take( 8, v ) )
+					out += fmt::format( "{0:#x}", v );
+				else
+					return out;
+				break;
+			}
+			case 'd':
+			case 'i':
+				if( !take( size, v ) )
+					return out;
+				if( size < 8 && ( v >> ( 8 * size - 1 ) ) & 1 )
+					v |= ~uint64_t{ 0 } << ( 8 * size );
+				out += fmt::sprintf( spec + conv, static_cast<int64_t>( v ) );
+				break;
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+				if( !take( size, v ) )
+					return out;
+				out += fmt::sprintf( spec + conv, v );
+				break;
+			default:
+				// Unknown conversions are copied
+				out += fmt.substr( start, j - start + 1 );
+		}
+	}
+	return out;
+}
+
+uint64_t atop::ftrace::read_messages(
+    std::string const& tracefs,
+    std::function<void( util::nanoseconds_t, std::string_view )> const& fn )
+{
+	auto layout = parse_header_page( read_file( tracefs + "/events/header_page" ) );
+	Messages messages( parse_format( read_file( tracefs + "/events/ftrace/print/format" ) ),
+	                   parse_format( read_file( tracefs + "/events/ftrace/bprint/format" ) ),
+	                   std::filesystem::exists( tracefs + "/printk_formats" )
+	                       ? parse_printk_formats( read_file( tracefs + "/printk_formats" ) )
+	                       : std::unordered_map<uint64_t, std::string>{} );
+
+	// Non-blocking, so reading stops once the buffers are drained
+	std::vector<Fd> fds;
+	std::vector<CpuStream> streams;
+	for( uint32_t cpu = 0;; ++cpu )
+	{
+		auto path = fmt::format( "{0}/per_cpu/cpu{1}/trace_pipe_raw", tracefs, cpu );
+		if( !std::filesystem::exists( path ) )
+			break;
+		fds.emplace_back( open( path.c_str(), O_RDONLY | O_NONBLOCK ) );
+		if( fds.back().fd < 0 )
+			throw std::runtime_error( fmt::format( "Could not open '{0}': {1}", path,
+			                                       std::strerror( errno ) ) );
+	}
+	streams.reserve( fds.size() );
+	std::vector<CpuStream*> stream_ptrs;
+	for( size_t cpu = 0; cpu < fds.size(); ++cpu )
+	{
+		streams.emplace_back( fds[cpu].fd, static_cast<uint32_t>( cpu ), layout );
+		stream_ptrs.push_back( &streams.back() );
+	}
+
+	uint64_t n = 0;
+	std::string msg;
+	merge( stream_ptrs, [&]( Record const& r ) {
+		if( messages.message( r, msg ) )
+		{
+			fn( r.ts_ns, msg );
+			n++;
+		}
+	} );
+	return n;
+}
+
+std::string atop::ftrace::dmesg_line( util::nanoseconds_t ts_ns, std::string_view message )
+{
+	return fmt::format( "[{0:5}.{1:06}] {2}", ts_ns / util::ns_per_s,
+	                    ts_ns % util::ns_per_s / util::ns_per_us, message );
+}
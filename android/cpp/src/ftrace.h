@@ -0,0 +1,175 @@
+#ifndef FTRACE_H_IN
+#define FTRACE_H_IN
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace ftrace
+{
+// Reader of the binary ftrace ring buffer (per_cpu/cpu<N>/trace_pipe_raw)
+//
+// The drivers log with trace_printk() instead of printk when built with
+// ATOP_TRACE_PRINTK. The kernel then only stores a pointer to the format
+// and the binary arguments in a bprint event, so the formatting is done
+// here. trace_marker writes and constant strings arrive as print events.
+//
+// Pages are laid out as described by events/header_page:
+//
+//     page   := <u64 timestamp> <commit> record*
+//     record := <u32 type_len:5 time_delta:27> [<u32 array>] payload
+//
+// where the low bits of commit are the bytes of records and the high
+// bits flag lost events. type_len 1-28 is a record of type_len * 4 bytes
+// of payload, 0 one whose length is in array, 29 padding, 30 a time
+// extension of time_delta + (array << 27) and 31 an absolute timestamp.
+// Payloads start with common_type, the event's id, and are decoded with
+// the fields of events/<system>/<event>/format. Records of a CPU are in
+// timestamp order; those of all CPUs are merged by timestamp.
+
+struct Field
+{
+	std::string name;
+	std::string type;
+	uint32_t offset;
+	uint32_t size;
+	bool is_signed;
+
+	// __data_loc: a u32 of (length << 16 | offset) pointing at the data;
+	// the offset of __rel_loc is relative to the end of the field
+	bool data_loc;
+	bool rel_loc;
+};
+
+struct Format
+{
+	std::string name;
+	uint16_t id;
+	std::vector<Field> fields;
+
+	// nullptr if the event has no such field
+	Field const* field( std::string_view name ) const;
+};
+
+// events/<system>/<event>/format; throws if malformed
+Format parse_format( std::string_view text );
+
+struct PageLayout
+{
+	uint32_t commit_offset = 8;
+	uint32_t commit_size   = 8;
+	uint32_t data_offset   = 16;
+	uint32_t page_size     = 4096;
+};
+
+// events/header_page; throws if malformed
+PageLayout parse_header_page( std::string_view text );
+
+// Formats of trace_printk() calls by address, from printk_formats
+std::unordered_map<uint64_t, std::string> parse_printk_formats( std::string_view text );
+
+struct Record
+{
+	util::nanoseconds_t ts_ns;
+	uint32_t cpu;
+
+	// Payload, starting with common_type
+	std::string_view data;
+
+	uint16_t type() const;
+};
+
+// Integer value of a field of at most 8 bytes, sign extended
+int64_t integer( Record const& r, Field const& f );
+
+// Characters of a string field up to its first NUL
+std::string_view string( Record const& r, Field const& f );
+
+// Calls fn for each record of a page; throws if the page is
+// malformed. Returns whether the kernel dropped events before the page.
+bool decode_page( std::string_view page, PageLayout const& layout, uint32_t cpu,
+                  std::function<void( Record const& )> const& fn );
+
+// Pages of one CPU read from a file descriptor
+class CpuStream
+{
+  public:
+	// Doesn't take ownership of fd, which may be non-blocking
+	CpuStream( int fd, uint32_t cpu, PageLayout const& layout );
+
+	// False once the file ends or no page is available; records point
+	// into the current page and stay valid until the next call
+	bool next( Record& out );
+
+	uint64_t pages() const { return this->pages_read; }
+	uint64_t lost_pages() const { return this->lost; }
+
+  private:
+	bool read_page();
+
+	int fd;
+	uint32_t cpu;
+	PageLayout layout;
+
+	std::string page;
+	std::vector<Record> records;
+	size_t pos;
+
+	uint64_t pages_read;
+	uint64_t lost;
+};
+
+// Calls fn for the records of all streams in timestamp order until all of
+// them are exhausted
+void merge( std::vector<CpuStream*> const& streams,
+            std::function<void( Record const& )> const& fn );
+
+// Renders the messages of print and bprint events
+class Messages
+{
+  public:
+	// Formats of the print and bprint events and printk_formats
+	Messages( Format const& print, Format const& bprint,
+	          std::unordered_map<uint64_t, std::string> printk_formats );
+
+	// Message without trailing newline; false for records of other events
+	// and bprint records with an unknown format
+	bool message( Record const& r, std::string& out ) const;
+
+  private:
+	uint16_t print_id;
+	Field print_buf;
+	uint16_t bprint_id;
+	Field bprint_fmt;
+	Field bprint_buf;
+	std::unordered_map<uint64_t, std::string> formats;
+};
+
+// Formats the arguments of a bprint event packed by the kernel's
+// vbin_printf() for a 64-bit kernel; stops at the end of args
+std::string format_binary( std::string_view fmt, std::string_view args );
+
+// Reads the buffered records of a tracefs directory (or a copy of its
+// events/, printk_formats and per_cpu/cpu<N>/trace_pipe_raw files) and
+// calls fn with the timestamp and message of each print and bprint
+// record. Returns the number of messages; throws if the directory
+// can't be read.
+uint64_t read_messages( std::string const& tracefs,
+                        std::function<void( util::nanoseconds_t, std::string_view )> const& fn );
+
+// A message as dmesg line "[<seconds>.<microseconds>] <message>"
+std::string dmesg_line( util::nanoseconds_t ts_ns, std::string_view message );
+
+} // namespace ftrace
+} // namespace atop
+
+#endif // FTRACE_H_IN
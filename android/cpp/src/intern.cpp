@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "intern.h"
+
+atop::intern::string_id_t atop::intern::StringInterner::intern( std::string_view str )
+{
+	{
+		std::shared_lock<std::shared_mutex> lock( this->mtx );
+		if( auto it{ this->ids.find( str ) }; it != std::end( this->ids ) )
+			return it->second;
+	}
+
+	std::unique_lock<std::shared_mutex> lock( this->mtx );
+
+	// Another thread might have inserted str in the meantime
+	if( auto it{ this->ids.find( str ) }; it != std::end( this->ids ) )
+		return it->second;
+
+	auto id = static_cast<string_id_t>( this->names.size() );
+	this->names.emplace_back( str );
+	this->ids.emplace( this->names.back(), id );
+	return id;
+}
+
+bool atop::intern::StringInterner::find( std::string_view str, string_id_t& id ) const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	if( auto it{ this->ids.find( str ) }; it != std::end( this->ids ) )
+	{
+		id = it->second;
+		return true;
+	}
+	return false;
+}
+
+std::string_view atop::intern::StringInterner::name( string_id_t id ) const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	if( id >= this->names.size() )
+		throw std::out_of_range( "Unknown string id" );
+	return this->names[id];
+}
+
+size_t atop::intern::StringInterner::size() const
+{
+	std::shared_lock<std::shared_mutex> lock( this->mtx );
+	return this->names.size();
+}
+
+atop::intern::StringInterner& atop::intern::app_names()
+{
+	static StringInterner interner;
+	return interner;
+}
+
+atop::intern::StringInterner& atop::intern::ioctl_cmds()
+{
+	static StringInterner interner;
+	return interner;
+}
+
+atop::intern::StringInterner& atop::intern::accel_tags()
+{
+	static StringInterner interner;
+	return interner;
+}
+
+atop::intern::FlatCounter::FlatCounter( size_t initial_capacity )
+    : keys()
+    , counts()
+    , occupied()
+    , used( 0 )
+{
+	// Capacity has to be a power of two for the slot mask
+	size_t cap = 16;
+	while( cap < initial_capacity )
+		cap <<= 1;
+
+	this->keys.resize( cap );
+	this->counts.resize( cap );
+	this->occupied.resize( cap, 0 );
+}
+
+// First slot that either holds key or is free
+size_t atop::intern::FlatCounter::slot( uint64_t key ) const
+{
+	// Fibonacci hashing spreads the packed (hi, lo) ids over the table
+	size_t mask = this->keys.size() - 1;
+	size_t i    = static_cast<size_t>( ( key * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+	while( this->occupied[i] && this->keys[i] != key )
+		i = ( i + 1 ) & mask;
+	return i;
+}
+
+void atop::intern::FlatCounter::grow()
+{
+	std::vector<uint64_t> old_keys( this->keys.size() * 2 );
+	std::vector<int64_t> old_counts( this->counts.size() * 2 );
+	std::vector<uint8_t> old_occupied( this->occupied.size() * 2, 0 );
+	old_keys.swap( this->keys );
+	old_counts.swap( this->counts );
+	old_occupied.swap( this->occupied );
+
+	for( size_t i = 0; i < old_keys.size(); ++i )
+	{
+		if( !old_occupied[i] )
+			continue;
+		auto s            = this->slot( old_keys[i] );
+		this->keys[s]     = old_keys[i];
+		this->counts[s]   = old_counts[i];
+		this->occupied[s] = 1;
+	}
+}
+
+void atop::intern::FlatCounter::increment( uint64_t key, int64_t by )
+{
+	auto s = this->slot( key );
+	if( !this->occupied[s] )
+	{
+		// Keep load factor below 0.75
+		if( ( this->used + 1 ) * 4 > this->keys.size() * 3 )
+		{
+			this->grow();
+			s = this->slot( key );
+		}
+
+		this->occupied[s] = 1;
+		this->keys[s]     = key;
+		this->counts[s]   = 0;
+		++this->used;
+	}
+
+	this->counts[s] += by;
+}
+
+int64_t atop::intern::FlatCounter::get( uint64_t key ) const
+{
+	auto s = this->slot( key );
+	return this->occupied[s] ? this->counts[s] : 0;
+}
+
+void atop::intern::FlatCounter::clear()
+{
+	std::fill( this->occupied.begin(), this->occupied.end(), 0 );
+	this->used = 0;
+}
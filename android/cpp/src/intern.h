@@ -0,0 +1,100 @@
+#ifndef INTERN_H_IN
+#define INTERN_H_IN
+
+#include <cstdint>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace atop
+{
+namespace intern
+{
+using string_id_t = uint32_t;
+
+// Thread-safe string interner
+//
+// Maps strings (app names, ioctl commands, accelerator tags, ...) to
+// dense, stable ids starting at 0 so that hot paths can key tables by
+// integers instead of copying and comparing strings. Lookups of known
+// strings take a shared lock and do not allocate.
+class StringInterner
+{
+  public:
+	StringInterner()                        = default;
+	~StringInterner()                       = default;
+	StringInterner( StringInterner const& ) = delete;
+	StringInterner( StringInterner&& )      = delete;
+
+	string_id_t intern( std::string_view str );
+
+	// Returns false if str has not been interned yet
+	bool find( std::string_view str, string_id_t& id ) const;
+
+	// Valid for the lifetime of the interner
+	std::string_view name( string_id_t id ) const;
+
+	size_t size() const;
+
+  private:
+	mutable std::shared_mutex mtx{};
+
+	// std::deque never relocates elements so the views in ids stay valid
+	std::deque<std::string> names{};
+	std::unordered_map<std::string_view, string_id_t> ids{};
+};
+
+// Process-wide interners per string domain
+StringInterner& app_names();
+StringInterner& ioctl_cmds();
+StringInterner& accel_tags();
+
+inline uint64_t pack( string_id_t hi, string_id_t lo )
+{
+	return ( static_cast<uint64_t>( hi ) << 32 ) | lo;
+}
+inline string_id_t unpack_hi( uint64_t key ) { return static_cast<string_id_t>( key >> 32 ); }
+inline string_id_t unpack_lo( uint64_t key ) { return static_cast<string_id_t>( key ); }
+
+// Open-addressing (linear probing) hash table from 64-bit keys to counts
+//
+// Once the table has grown to its working size, increment() and clear()
+// don't allocate. Not thread-safe.
+class FlatCounter
+{
+  public:
+	explicit FlatCounter( size_t initial_capacity = 64 );
+
+	void increment( uint64_t key, int64_t by = 1 );
+	int64_t get( uint64_t key ) const;
+
+	// Removes all entries but keeps the capacity
+	void clear();
+
+	size_t size() const { return this->used; }
+	bool empty() const { return this->used == 0; }
+
+	template<typename Fn> void for_each( Fn&& fn ) const
+	{
+		for( size_t i = 0; i < this->keys.size(); ++i )
+			if( this->occupied[i] )
+				fn( this->keys[i], this->counts[i] );
+	}
+
+  private:
+	size_t slot( uint64_t key ) const;
+	void grow();
+
+	std::vector<uint64_t> keys;
+	std::vector<int64_t> counts;
+	std::vector<uint8_t> occupied;
+	size_t used;
+};
+
+} // namespace intern
+} // namespace atop
+
+#endif // INTERN_H_IN
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "ctpl.h"
+#include "loadgen.h"
+#include "logger.h"
+#include "util.h"
+
+std::vector<atop::loadgen::WeightedModel> atop::loadgen::parse_models_cfg( std::istream& is )
+{
+	std::vector<WeightedModel> models;
+	std::string line;
+	while( std::getline( is, line ) )
+	{
+		atop::util::trim( line );
+		if( line.empty() || line[0] == '#' )
+			continue;
+
+		std::istringstream ss{ line };
+		WeightedModel m{ "", 1.0 };
+		ss >> m.path;
+		if( !( ss >> m.weight ) )
+			m.weight = 1.0;
+
+		if( m.weight < 0.0 )
+			throw std::runtime_error(
+			    fmt::format( "Negative weight for model '{0}' in models config", m.path ) );
+		models.push_back( m );
+	}
+
+	return models;
+}
+
+std::vector<atop::loadgen::WeightedModel>
+atop::loadgen::parse_models_cfg( std::string const& path )
+{
+	std::ifstream is{ path };
+	if( !is )
+		throw std::runtime_error( fmt::format( "Could not open models config '{0}'", path ) );
+	return parse_models_cfg( is );
+}
+
+static std::chrono::nanoseconds seconds2ns( double s )
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	    std::chrono::duration<double>( s ) );
+}
+
+atop::loadgen::PoissonArrivals::PoissonArrivals( double rate_per_s, uint64_t seed )
+    : gen( seed )
+    , gap_s( rate_per_s )
+{
+	if( rate_per_s <= 0.0 )
+		throw std::runtime_error( "Arrival rate has to be positive" );
+}
+
+std::optional<std::chrono::nanoseconds> atop::loadgen::PoissonArrivals::next_gap()
+{
+	return seconds2ns( this->gap_s( this->gen ) );
+}
+
+atop::loadgen::BurstyArrivals::BurstyArrivals( double rate_per_s, double mean_on_s,
+                                               double mean_off_s, uint64_t seed )
+    : gen( seed )
+    , gap_s( rate_per_s )
+    , on_s( 1.0 / mean_on_s )
+    , off_s( 1.0 / mean_off_s )
+    , on_left_s( 0.0 )
+{
+	if( rate_per_s <= 0.0 || mean_on_s <= 0.0 || mean_off_s <= 0.0 )
+		throw std::runtime_error( "Bursty arrival parameters have to be positive" );
+
+	this->on_left_s = this->on_s( this->gen );
+}
+
+std::optional<std::chrono::nanoseconds> atop::loadgen::BurstyArrivals::next_gap()
+{
+	// Skip over "off" periods until the next arrival falls into an "on"
+	// period. Exponential gaps are memoryless so the residual gap can
+	// simply be redrawn at the start of each "on" period.
+	double gap = 0.0;
+	for( ;; )
+	{
+		double candidate = this->gap_s( this->gen );
+		if( candidate <= this->on_left_s )
+		{
+			this->on_left_s -= candidate;
+			return seconds2ns( gap + candidate );
+		}
+
+		gap += this->on_left_s + this->off_s( this->gen );
+		this->on_left_s = this->on_s( this->gen );
+	}
+}
+
+atop::loadgen::TraceArrivals::TraceArrivals( std::istream& is )
+    : offsets_ns()
+    , next( 0 )
+    , prev_ns( 0 )
+{
+	std::string line;
+	while( std::getline( is, line ) )
+	{
+		atop::util::trim( line );
+		if( line.empty() || line[0] == '#' )
+			continue;
+		this->offsets_ns.push_back( atop::util::decimal2ns( line, atop::util::ns_per_s ) );
+	}
+
+	if( !std::is_sorted( this->offsets_ns.begin(), this->offsets_ns.end() ) )
+		throw std::runtime_error( "Arrival trace offsets have to be ascending" );
+}
+
+std::optional<std::chrono::nanoseconds> atop::loadgen::TraceArrivals::next_gap()
+{
+	if( this->next >= this->offsets_ns.size() )
+		return std::nullopt;
+
+	auto offset   = this->offsets_ns[this->next++];
+	auto gap      = offset - this->prev_ns;
+	this->prev_ns = offset;
+	return std::chrono::nanoseconds( static_cast<int64_t>( gap ) );
+}
+
+std::vector<atop::loadgen::Request> atop::loadgen::run( std::vector<WeightedModel> const& models,
+                                                        ArrivalProcess& arrivals,
+                                                        runner_t const& runner,
+                                                        Options const& opts )
+{
+	if( models.empty() )
+		throw std::runtime_error( "Load generator requires at least one model" );
+	if( opts.concurrency < 1 )
+		throw std::runtime_error( "Load generator requires at least one execution slot" );
+
+	std::vector<double> weights;
+	weights.reserve( models.size() );
+	for( auto&& m: models )
+		weights.push_back( m.weight );
+	std::mt19937_64 gen( opts.seed );
+	std::discrete_distribution<size_t> pick( weights.begin(), weights.end() );
+
+	// Requests are only appended by the dispatcher; std::deque keeps
+	// references of earlier elements valid for the workers
+	std::deque<Request> requests;
+	ctpl::thread_pool pool( opts.concurrency );
+
+	using clock = std::chrono::steady_clock;
+	auto t0     = clock::now();
+	auto since_start
+	    = [t0]( clock::time_point tp ) { return ( tp - t0 ) / std::chrono::nanoseconds( 1 ); };
+
+	auto arrival = t0;
+	while( opts.max_requests == 0 || requests.size() < opts.max_requests )
+	{
+		auto gap = arrivals.next_gap();
+		if( !gap )
+			break;
+
+		arrival += *gap;
+		if( arrival - t0 > opts.duration )
+			break;
+
+		std::this_thread::sleep_until( arrival );
+
+		requests.push_back( Request{ requests.size(), models[pick( gen )].path,
+		                             since_start( arrival ), 0, 0, false } );
+		Request& r = requests.back();
+		pool.push( [&r, &runner, &since_start]( int ) {
+			r.start_ns = since_start( clock::now() );
+			try
+			{
+				r.ok = runner( r.model );
+			}
+			catch( std::exception const& e )
+			{
+				atop::logger::warn( fmt::format( "Request {0} failed: {1}", r.id, e.what() ) );
+				r.ok = false;
+			}
+			r.end_ns = since_start( clock::now() );
+		} );
+	}
+
+	atop::logger::verbose_info(
+	    fmt::format( "Issued {0} requests; waiting for outstanding ones", requests.size() ) );
+
+	// Wait for all queued requests to finish
+	pool.stop( true );
+
+	return std::vector<Request>( requests.begin(), requests.end() );
+}
+
+atop::loadgen::LatencySummary atop::loadgen::summarize( std::vector<int64_t> latencies_ns )
+{
+	LatencySummary s;
+	s.count = latencies_ns.size();
+	if( latencies_ns.empty() )
+		return s;
+
+	std::sort( latencies_ns.begin(), latencies_ns.end() );
+	auto ms = []( int64_t ns ) { return static_cast<double>( ns ) / 1.0e6; };
+
+	// Nearest-rank percentile
+	auto pct = [&]( double p ) {
+		auto rank = static_cast<size_t>( std::ceil( p / 100.0 * static_cast<double>( s.count ) ) );
+		return ms( latencies_ns[std::min( s.count, std::max<size_t>( rank, 1 ) ) - 1] );
+	};
+
+	s.mean = ms( std::accumulate( latencies_ns.begin(), latencies_ns.end(), int64_t{ 0 } ) )
+	         / static_cast<double>( s.count );
+	s.p50  = pct( 50.0 );
+	s.p90  = pct( 90.0 );
+	s.p99  = pct( 99.0 );
+	s.p999 = pct( 99.9 );
+	s.max  = ms( latencies_ns.back() );
+	return s;
+}
+
+void atop::loadgen::write_csv( std::ostream& os, std::vector<Request> const& requests )
+{
+	os << "id,model,arrival_ns,start_ns,end_ns,queueing_ns,service_ns,ok\n";
+	for( auto&& r: requests )
+		os << fmt::format( "{0},{1},{2},{3},{4},{5},{6},{7}\n", r.id, r.model, r.arrival_ns,
+		                   r.start_ns, r.end_ns, r.queueing_ns(), r.service_ns(),
+		                   r.ok ? 1 : 0 );
+}
@@ -0,0 +1,174 @@
+#ifndef LOADGEN_H_IN
+#define LOADGEN_H_IN
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace loadgen
+{
+// Open-loop load generator
+//
+// Requests arrive according to an arrival process independently of
+// whether earlier requests completed (unlike the closed burst of
+// run_benchmark). Each request waits for one of a fixed number of
+// execution slots, so its latency splits into
+//
+//     queueing = start - arrival
+//     service  = end - start
+//
+// Arrival times are the *scheduled* times, hence a slow dispatcher or
+// saturated device shows up as queueing latency instead of silently
+// lowering the offered load.
+
+struct WeightedModel
+{
+	std::string path;
+	double weight;
+};
+
+// Reads "<model path> [<weight>]" lines; weight defaults to 1.
+// Empty lines and lines starting with '#' are ignored.
+std::vector<WeightedModel> parse_models_cfg( std::istream& is );
+std::vector<WeightedModel> parse_models_cfg( std::string const& path );
+
+enum class ArrivalProcesses : int
+{
+	poisson,
+	bursty,
+	trace
+};
+
+std::map<std::string, ArrivalProcesses> const arrival_processes_table
+    = { { "poisson", ArrivalProcesses::poisson },
+        { "bursty", ArrivalProcesses::bursty },
+        { "trace", ArrivalProcesses::trace } };
+
+inline ArrivalProcesses string2arrivalProcess( std::string const& ap )
+{
+	auto it = arrival_processes_table.find( ap );
+	if( it != arrival_processes_table.end() )
+		return it->second;
+	else
+		throw std::runtime_error( "Arrival process " + ap + " not defined" );
+}
+
+class ArrivalProcess
+{
+  public:
+	virtual ~ArrivalProcess() = default;
+
+	// Time between the previous and the next arrival; empty once the
+	// process is exhausted
+	virtual std::optional<std::chrono::nanoseconds> next_gap() = 0;
+};
+
+// Exponentially distributed inter-arrival times
+class PoissonArrivals : public ArrivalProcess
+{
+  public:
+	explicit PoissonArrivals( double rate_per_s, uint64_t seed = std::random_device()() );
+	std::optional<std::chrono::nanoseconds> next_gap() override;
+
+  private:
+	std::mt19937_64 gen;
+	std::exponential_distribution<double> gap_s;
+};
+
+// Two-state Markov-modulated Poisson process: Poisson arrivals at
+// rate_per_s during "on" periods, none during "off" periods. Period
+// lengths are exponentially distributed with the given means.
+class BurstyArrivals : public ArrivalProcess
+{
+  public:
+	BurstyArrivals( double rate_per_s, double mean_on_s, double mean_off_s,
+	                uint64_t seed = std::random_device()() );
+	std::optional<std::chrono::nanoseconds> next_gap() override;
+
+  private:
+	std::mt19937_64 gen;
+	std::exponential_distribution<double> gap_s;
+	std::exponential_distribution<double> on_s;
+	std::exponential_distribution<double> off_s;
+
+	// Time left in the current "on" period
+	double on_left_s;
+};
+
+// Replays arrival offsets (seconds since start, one per line, ascending)
+class TraceArrivals : public ArrivalProcess
+{
+  public:
+	explicit TraceArrivals( std::istream& is );
+	std::optional<std::chrono::nanoseconds> next_gap() override;
+
+  private:
+	std::vector<util::nanoseconds_t> offsets_ns;
+	size_t next;
+	util::nanoseconds_t prev_ns;
+};
+
+struct Request
+{
+	uint64_t id;
+	std::string model;
+
+	// Nanoseconds since the start of the run
+	int64_t arrival_ns;
+	int64_t start_ns;
+	int64_t end_ns;
+
+	bool ok;
+
+	int64_t queueing_ns() const { return this->start_ns - this->arrival_ns; }
+	int64_t service_ns() const { return this->end_ns - this->start_ns; }
+	int64_t latency_ns() const { return this->end_ns - this->arrival_ns; }
+};
+
+struct Options
+{
+	std::chrono::nanoseconds duration = std::chrono::seconds( 60 );
+	uint64_t max_requests             = 0; // 0: unlimited
+	int concurrency                   = 1; // execution slots
+	uint64_t seed                     = std::random_device()();
+};
+
+// Executes one inference job; returns whether it succeeded
+using runner_t = std::function<bool( std::string const& model )>;
+
+std::vector<Request> run( std::vector<WeightedModel> const& models, ArrivalProcess& arrivals,
+                          runner_t const& runner, Options const& opts );
+
+struct LatencySummary
+{
+	size_t count = 0;
+
+	// Milliseconds
+	double mean = 0.0;
+	double p50  = 0.0;
+	double p90  = 0.0;
+	double p99  = 0.0;
+	double p999 = 0.0;
+	double max  = 0.0;
+};
+
+LatencySummary summarize( std::vector<int64_t> latencies_ns );
+
+void write_csv( std::ostream& os, std::vector<Request> const& requests );
+
+} // namespace loadgen
+} // namespace atop
+
+#endif // LOADGEN_H_IN
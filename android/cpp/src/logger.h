@@ -3,6 +3,8 @@
 
 #include <spdlog/spdlog.h>
 
+extern bool VERBOSE;
+
 namespace atop
 {
 namespace logger
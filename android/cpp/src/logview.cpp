@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+#include "events.h"
+#include "logview.h"
+
+atop::intern::StringInterner& atop::logview::sources()
+{
+	static intern::StringInterner interner;
+	return interner;
+}
+
+atop::logview::LogBuffer::LogBuffer( size_t capacity_bytes )
+    : max_chunks( std::max( size_t{ 2 }, capacity_bytes / chunk_bytes ) )
+    , chunks()
+    , first_chunk( 0 )
+    , lines()
+    , first_line( 0 )
+{
+}
+
+void atop::logview::LogBuffer::add( std::string_view source, std::string_view line )
+{
+	// The newline keeps empty lines from taking no space in the ring
+	line = line.substr( 0, chunk_bytes - 1 );
+	if( this->chunks.empty() || this->chunks.back().size() + line.size() + 1 > chunk_bytes )
+	{
+		if( this->chunks.size() == this->max_chunks )
+			this->evict_chunk();
+		this->chunks.emplace_back();
+		this->chunks.back().reserve( chunk_bytes );
+	}
+
+	auto& chunk = this->chunks.back();
+	Line l{ this->first_chunk + this->chunks.size() - 1, static_cast<uint32_t>( chunk.size() ),
+		    static_cast<uint32_t>( line.size() ),
+		    { sources().intern( source ), events::none_id, events::none_id, events::none_id } };
+	chunk.append( line );
+	chunk.push_back( '\n' );
+
+	events::Event e;
+	if( events::parse_dmesg_line( line, e ) )
+	{
+		l.info.app = e.app;
+		l.info.dev = e.dev;
+		l.info.cmd = e.cmd;
+	}
+	this->lines.push_back( l );
+}
+
+void atop::logview::LogBuffer::evict_chunk()
+{
+	while( !this->lines.empty() && this->lines.front().chunk == this->first_chunk )
+	{
+		this->lines.pop_front();
+		this->first_line++;
+	}
+	this->chunks.pop_front();
+	this->first_chunk++;
+}
+
+void atop::logview::LogBuffer::clear()
+{
+	this->first_line += this->lines.size();
+	this->first_chunk += this->chunks.size();
+	this->lines.clear();
+	this->chunks.clear();
+}
+
+std::string_view atop::logview::LogBuffer::text( uint64_t seq ) const
+{
+	auto const& l = this->lines[seq - this->first_line];
+	return std::string_view( this->chunks[l.chunk - this->first_chunk] )
+	    .substr( l.offset, l.length );
+}
+
+atop::logview::LineInfo const& atop::logview::LogBuffer::info( uint64_t seq ) const
+{
+	return this->lines[seq - this->first_line].info;
+}
+
+size_t atop::logview::LogBuffer::bytes() const
+{
+	size_t total = 0;
+	for( auto&& c: this->chunks )
+		total += c.size();
+	return total;
+}
+
+void atop::logview::Filter::set_text( std::string_view text )
+{
+	this->filter_text = std::string( text );
+	this->include.clear();
+	this->exclude.clear();
+
+	while( !text.empty() )
+	{
+		auto comma = text.find( ',' );
+		auto term  = text.substr( 0, comma );
+		text       = comma == std::string_view::npos ? std::string_view{} : text.substr( comma + 1 );
+
+		while( !term.empty() && term.front() == ' ' )
+			term.remove_prefix( 1 );
+		while( !term.empty() && term.back() == ' ' )
+			term.remove_suffix( 1 );
+
+		if( term.size() > 1 && term.front() == '-' )
+			this->exclude.emplace_back( term.substr( 1 ) );
+		else if( !term.empty() && term != "-" )
+			this->include.emplace_back( term );
+	}
+}
+
+bool atop::logview::Filter::active() const
+{
+	return !this->include.empty() || !this->exclude.empty() || this->source || this->app
+	       || this->dev || this->cmd;
+}
+
+bool atop::logview::Filter::pass( std::string_view line, LineInfo const& info ) const
+{
+	// Ids first as they are cheaper than searching the text
+	if( ( this->source && *this->source != info.source ) || ( this->app && *this->app != info.app )
+	    || ( this->dev && *this->dev != info.dev ) || ( this->cmd && *this->cmd != info.cmd ) )
+		return false;
+
+	for( auto&& term: this->exclude )
+		if( line.find( term ) != std::string_view::npos )
+			return false;
+
+	if( this->include.empty() )
+		return true;
+	return std::any_of( this->include.begin(), this->include.end(), [line]( auto const& term ) {
+		return line.find( term ) != std::string_view::npos;
+	} );
+}
+
+bool atop::logview::Filter::operator==( Filter const& other ) const
+{
+	return this->include == other.include && this->exclude == other.exclude
+	       && this->source == other.source && this->app == other.app && this->dev == other.dev
+	       && this->cmd == other.cmd;
+}
+
+atop::logview::View::View()
+    : applied()
+    , matches()
+    , next( 0 )
+{
+}
+
+void atop::logview::View::update( LogBuffer const& buf, Filter const& filter )
+{
+	if( filter != this->applied )
+	{
+		this->applied = filter;
+		this->matches.clear();
+		this->next = buf.first();
+	}
+
+	while( !this->matches.empty() && this->matches.front() < buf.first() )
+		this->matches.pop_front();
+
+	for( auto seq = std::max( this->next, buf.first() ); seq < buf.end(); ++seq )
+		if( this->applied.pass( buf.text( seq ), buf.info( seq ) ) )
+			this->matches.push_back( seq );
+	this->next = buf.end();
+}
@@ -0,0 +1,135 @@
+#ifndef LOGVIEW_H_IN
+#define LOGVIEW_H_IN
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "intern.h"
+
+namespace atop
+{
+namespace logview
+{
+// Bounded log of streamed dmesg and logcat lines with filtered views
+//
+// Lines are copied into fixed-size chunks of a ring; once the ring is
+// full the oldest chunk and its lines are dropped, so memory stays at
+// the capacity however long the session. Lines get consecutive sequence
+// numbers that stay valid across evictions and clear(). A View keeps the
+// sequence numbers of the lines passing its filter and on update() only
+// evaluates the filter on lines added since, so frame time doesn't grow
+// with the log.
+
+// Structured columns of a line: the probe or logcat tag it was streamed
+// by (ids of sources()) and, for driver lines, the app, device and cmd as
+// ids of the interners of events::IdColumns; none_id if not reported
+struct LineInfo
+{
+	intern::string_id_t source;
+	intern::string_id_t app;
+	intern::string_id_t dev;
+	intern::string_id_t cmd;
+};
+
+intern::StringInterner& sources();
+
+class LogBuffer
+{
+  public:
+	static constexpr size_t chunk_bytes = 64 * 1024;
+
+	// At least two chunks are kept
+	explicit LogBuffer( size_t capacity_bytes = 16 * 1024 * 1024 );
+
+	// Line without trailing newline; lines longer than a chunk are
+	// truncated
+	void add( std::string_view source, std::string_view line );
+
+	// Drops all lines; sequence numbers continue
+	void clear();
+
+	// Retained lines are [first(), end())
+	uint64_t first() const { return this->first_line; }
+	uint64_t end() const { return this->first_line + this->lines.size(); }
+
+	// Valid until the line is evicted
+	std::string_view text( uint64_t seq ) const;
+	LineInfo const& info( uint64_t seq ) const;
+
+	size_t bytes() const;
+
+  private:
+	struct Line
+	{
+		uint64_t chunk;
+		uint32_t offset;
+		uint32_t length;
+		LineInfo info;
+	};
+
+	void evict_chunk();
+
+	size_t max_chunks;
+
+	// Chunks are reserved up front and never reallocated, so views of
+	// their lines stay valid
+	std::deque<std::string> chunks;
+	uint64_t first_chunk;
+	std::deque<Line> lines;
+	uint64_t first_line;
+};
+
+// Lines passing all set members. text holds comma separated terms of
+// which a line has to contain one, or none of those starting with '-'.
+class Filter
+{
+  public:
+	Filter() = default;
+
+	void set_text( std::string_view text );
+	std::string const& text() const { return this->filter_text; }
+
+	std::optional<intern::string_id_t> source{};
+	std::optional<intern::string_id_t> app{};
+	std::optional<intern::string_id_t> dev{};
+	std::optional<intern::string_id_t> cmd{};
+
+	bool active() const;
+	bool pass( std::string_view line, LineInfo const& info ) const;
+
+	bool operator==( Filter const& other ) const;
+	bool operator!=( Filter const& other ) const { return !( *this == other ); }
+
+  private:
+	std::string filter_text{};
+	std::vector<std::string> include{};
+	std::vector<std::string> exclude{};
+};
+
+class View
+{
+  public:
+	View();
+
+	// Filters the lines added since the last update; all retained lines
+	// if filter changed
+	void update( LogBuffer const& buf, Filter const& filter );
+
+	// Matching lines still retained, in order
+	size_t size() const { return this->matches.size(); }
+	uint64_t operator[]( size_t i ) const { return this->matches[i]; }
+
+  private:
+	Filter applied;
+	std::deque<uint64_t> matches;
+	uint64_t next;
+};
+
+} // namespace logview
+} // namespace atop
+
+#endif // LOGVIEW_H_IN
@@ -1,14 +1,20 @@
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdlib>
+#include <deque>
+#include <fstream>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <memory>
+#include <optional>
 #include <queue>
-#include <sstream>
+#include <set>
 #include <thread>
+#include <tuple>
 #include <utility>
 
 #include <SFML/Graphics/CircleShape.hpp>
@@ -22,8 +28,16 @@
 #include <spdlog/spdlog.h>
 
 #include "atop.h"
+#include "cmdqueue.h"
+#include "collector.h"
+#include "downsample.h"
 #include "fifo.h"
 #include "logger.h"
+#include "logview.h"
+#include "rollup.h"
+#include "scheduler.h"
+#include "selfprof.h"
+#include "stats.h"
 
 static auto vector_getter = []( void* vec, int idx, const char** out_text ) {
 	auto& vector = *static_cast<std::vector<std::string>*>( vec );
@@ -67,94 +81,91 @@ std::vector<std::string> unzip_imgui_models( std::vector<std::pair<std::string,
 	return res;
 }
 
-static std::string adb_getprop( std::string_view prop )
-{
-	auto output = atop::check_console_output( fmt::format( "adb shell getprop {0}", prop ) );
-	if( output.size() > 0 )
-		return output[0];
-	else
-		return "";
-}
-
 static void adb_setprop( std::string_view prop, std::string prop_val )
 {
 	atop::check_console_output( fmt::format( "adb shell setprop {0} {1}", prop, prop_val ) );
 }
 
-static void enable_dsp_log()
+// Command writing val to the given atop::debugfs_knobs
+static std::string write_knobs_cmd( int val, std::vector<std::string> const& knobs )
 {
-	atop::check_console_output( R"(adb shell "echo 1 >> /sys/kernel/debug/adsprpc/global")" );
-}
-static void enable_gpu_log()
-{
-	atop::check_console_output(
-	    R"(adb shell "echo 6 >> /sys/kernel/debug/kgsl/kgsl-3d0/log_level_perf")" );
-}
-static void enable_cam_log()
-{
-	atop::check_console_output(
-	    R"(adb shell "echo 1 >> /sys/kernel/debug/camera_sync/logging_enabled")" );
-	atop::check_console_output(
-	    R"(adb shell "echo 1 >> /sys/kernel/debug/cam_sensor/logging_enabled")" );
-}
-static void disable_dsp_log()
-{
-	atop::check_console_output( R"(adb shell "echo 0 >> /sys/kernel/debug/adsprpc/global")" );
-}
-static void disable_gpu_log()
-{
-	atop::check_console_output(
-	    R"(adb shell "echo 0 >> /sys/kernel/debug/kgsl/kgsl-3d0/log_level_perf")" );
-}
-static void disable_cam_log()
-{
-	atop::check_console_output(
-	    R"(adb shell "echo 0 >> /sys/kernel/debug/camera_sync/logging_enabled")" );
-	atop::check_console_output(
-	    R"(adb shell "echo 0 >> /sys/kernel/debug/cam_sensor/logging_enabled")" );
+	std::string cmd;
+	for( auto&& knob: knobs )
+		cmd += fmt::format( "{0}echo {1} >> {2}", cmd.empty() ? "" : "; ", val,
+		                    atop::debugfs_knobs.at( knob ) );
+	return cmd;
 }
 
+static std::vector<std::string> const cam_knobs = { "camera_sync", "cam_sensor" };
+
+static std::string const enable_dsp_log_cmd  = write_knobs_cmd( 1, { "dsp" } );
+static std::string const enable_gpu_log_cmd  = write_knobs_cmd( 6, { "gpu" } );
+static std::string const enable_cam_log_cmd  = write_knobs_cmd( 1, cam_knobs );
+static std::string const disable_dsp_log_cmd = write_knobs_cmd( 0, { "dsp" } );
+static std::string const disable_gpu_log_cmd = write_knobs_cmd( 0, { "gpu" } );
+static std::string const disable_cam_log_cmd = write_knobs_cmd( 0, cam_knobs );
+
 // Potentially useful debugging props:
 //      vendor.fastrpc.debug.trace
 //      vendor.fastrpc.perf.kernel
 //      vendor.fastrpc.perf.adsp
-static void enable_kernel_logging()
-{
-	LOG( "Enabling kernel logging" );
-
-	enable_dsp_log();
-	enable_cam_log();
-	enable_gpu_log();
-}
+//
+// Kernel logging is enabled by the startup probe (see probe_device())
+static std::vector<std::string> const enable_kernel_logging_cmds
+    = { enable_dsp_log_cmd, enable_cam_log_cmd, enable_gpu_log_cmd };
 
 static void disable_kernel_logging()
 {
 	LOG( "Disabling kernel logging" );
 
-	disable_dsp_log();
-	disable_cam_log();
-	disable_gpu_log();
+	atop::check_adb_shell_output( fmt::format( "{0}; {1}; {2}", disable_dsp_log_cmd,
+	                                           disable_cam_log_cmd, disable_gpu_log_cmd ) );
 }
 
-static void toggle_driver_logging()
+static std::string set_driver_logging_cmd( bool enabled )
 {
-	std::string prop = "debug.nn.vlog";
-	auto output      = adb_getprop( prop );
-	int prop_val     = 0;
-	if( !output.empty() )
-		prop_val = std::stoi( output );
-
-	// Toggle
-	int new_val = 1 - prop_val;
-	LOG( fmt::format( "Setting {0} from {1} to {2}", prop, prop_val, new_val ) );
-	adb_setprop( prop, std::to_string( new_val ) );
-
-	// if(new_val == 1)
-	//     enable_kernel_logging();
-	// else
-	//     disable_kernel_logging();
+	return fmt::format( "adb shell setprop debug.nn.vlog {0}", enabled ? 1 : 0 );
 }
 
+// Errors of background device commands, shown for a few seconds in the
+// top right corner
+struct Toasts
+{
+	static constexpr auto duration = std::chrono::seconds( 5 );
+
+	struct Toast
+	{
+		std::string msg;
+		std::chrono::steady_clock::time_point expires;
+	};
+	std::deque<Toast> toasts;
+
+	void Add( std::string msg )
+	{
+		toasts.push_back( Toast{ std::move( msg ), std::chrono::steady_clock::now() + duration } );
+	}
+
+	void Draw()
+	{
+		auto now = std::chrono::steady_clock::now();
+		while( !toasts.empty() && toasts.front().expires < now )
+			toasts.pop_front();
+
+		for( size_t i = 0; i < toasts.size(); ++i )
+		{
+			ImGui::SetNextWindowPos(
+			    ImVec2( ImGui::GetIO().DisplaySize.x - 10.0f,
+			            10.0f + static_cast<float>( i ) * 3.0f * ImGui::GetFrameHeight() ),
+			    0, ImVec2( 1.0f, 0.0f ) );
+			ImGui::Begin( fmt::format( "##toast{0}", i ).c_str(), nullptr,
+			              ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize
+			                  | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_AlwaysAutoResize );
+			ImGui::TextColored( ImVec4( 1.0f, 0.4f, 0.4f, 1.0f ), "%s", toasts[i].msg.c_str() );
+			ImGui::End();
+		}
+	}
+};
+
 // Until is_ready() is in the C++ standard use this to check
 // whether a std::future result is ready
 template<typename R> bool is_ready( std::future<R> const& f )
@@ -164,6 +175,42 @@ template<typename R> bool is_ready( std::future<R> const& f )
 
 using namespace std::chrono_literals;
 
+// Device discovery and the streamers' initial reads, which run in the
+// background while the UI is already drawn. A viewer of a collector has
+// neither device nor streamers.
+struct Startup
+{
+	atop::DeviceInfo device{};
+	std::unique_ptr<atop::IoctlDmesgStreamer> ioctl{};
+	std::unique_ptr<atop::LogcatStreamer> logcat{};
+	std::unique_ptr<atop::CpuUtilizationStreamer> cpu{};
+};
+
+static Startup start_up( bool sim, bool remote )
+{
+	Startup s;
+	if( remote )
+		return s;
+
+	if( !sim )
+		s.device = atop::probe_device( enable_kernel_logging_cmds );
+
+	// Reading the full dmesg log and /proc/stat are independent round trips
+	auto ioctl_f = std::async( std::launch::async,
+	                           []() { return std::make_unique<atop::IoctlDmesgStreamer>(); } );
+	auto cpu_f   = std::async( std::launch::async,
+	                           []() { return std::make_unique<atop::CpuUtilizationStreamer>(); } );
+
+	// TODO: use enum instead of raw strings; ideally a header-only
+	// solution that generates strings from enums
+	s.logcat = std::make_unique<atop::LogcatStreamer>(
+	    std::initializer_list<std::string>{ "ExecutionBuilder", "tflite" } );
+
+	s.ioctl = ioctl_f.get();
+	s.cpu   = cpu_f.get();
+	return s;
+}
+
 static constexpr auto USAGE =
     R"(atop - accelerator viewer
 	  Usage:
@@ -173,6 +220,9 @@ static constexpr auto USAGE =
 	  		-h, --help        Show usage
 			-v, --verbose     Verbose outputs [default: false]
 			-s, --sim         Run without device [default: false]
+			-c, --connect=<addr>  Show the data of a collector (atopctl serve) instead
+			                  of a device: unix:<path>, <host>:<port> or <port>
+			--self-dump=<file>  Write atop's own timers and counters as JSON on exit
 			-V, --version     Show version
 		)";
 
@@ -180,39 +230,42 @@ static constexpr auto VERSION_STRING = "atop - Version 0.1";
 
 bool VERBOSE{ false };
 
-// From ImGui Log example
-struct Log
+// Combo of "all" and the names of an interner; sets id to the selection
+static void IdFilterCombo( char const* label, atop::intern::StringInterner const& names,
+                           std::optional<atop::intern::string_id_t>& id )
 {
-	ImGuiTextBuffer Buf;
-	ImGuiTextFilter Filter;
-	ImVector<int> LineOffsets; // Index to lines offset. We maintain this with
-	// AddLog() calls.
-	bool AutoScroll; // Keep scrolling if already at the bottom.
+	std::vector<std::string> items = { "all" };
+	for( atop::intern::string_id_t i = 0; i < names.size(); ++i )
+		items.emplace_back( names.name( i ) );
 
-	Log()
+	int sel = id ? static_cast<int>( *id ) + 1 : 0;
+	ImGui::PushItemWidth( 150.0f );
+	if( ComboBox( label, &sel, items ) )
 	{
-		AutoScroll = true;
-		Clear();
+		if( sel > 0 )
+			id = static_cast<atop::intern::string_id_t>( sel - 1 );
+		else
+			id.reset();
 	}
+	ImGui::PopItemWidth();
+}
 
-	void Clear()
-	{
-		Buf.clear();
-		LineOffsets.clear();
-		LineOffsets.push_back( 0 );
-	}
+// Streamed lines in a bounded buffer (see atop::logview); filtered views
+// are updated with the lines added since the previous frame and only the
+// visible lines are drawn
+struct Log
+{
+	atop::logview::LogBuffer Buf;
+	atop::logview::View View;
+	atop::logview::Filter Filter;
+	ImGuiTextFilter TextFilter;
+	bool AutoScroll; // Keep scrolling if already at the bottom.
 
-	void AddLog( const char* fmt, ... ) IM_FMTARGS( 2 )
-	{
-		int old_size = Buf.size();
-		va_list args;
-		va_start( args, fmt );
-		Buf.appendfv( fmt, args );
-		va_end( args );
-		for( int new_size = Buf.size(); old_size < new_size; old_size++ )
-			if( Buf[old_size] == '\n' )
-				LineOffsets.push_back( old_size + 1 );
-	}
+	Log() { AutoScroll = true; }
+
+	void Clear() { Buf.clear(); }
+
+	void AddLog( std::string_view source, std::string_view line ) { Buf.add( source, line ); }
 
 	void Draw( const char* title, bool* p_open = NULL )
 	{
@@ -237,7 +290,16 @@ struct Log
 		ImGui::SameLine();
 		bool copy = ImGui::Button( "Copy" );
 		ImGui::SameLine();
-		Filter.Draw( "Filter", -150.0f );
+		if( TextFilter.Draw( "Filter", -150.0f ) )
+			Filter.set_text( TextFilter.InputBuf );
+
+		IdFilterCombo( "Probe", atop::logview::sources(), Filter.source );
+		ImGui::SameLine();
+		IdFilterCombo( "App", atop::intern::app_names(), Filter.app );
+		ImGui::SameLine();
+		IdFilterCombo( "Device", atop::intern::accel_tags(), Filter.dev );
+		ImGui::SameLine();
+		IdFilterCombo( "Cmd", atop::intern::ioctl_cmds(), Filter.cmd );
 
 		ImGui::Separator();
 		ImGui::BeginChild( "scrolling", ImVec2( 0, 0 ), false,
@@ -248,38 +310,20 @@ struct Log
 		if( copy )
 			ImGui::LogToClipboard();
 
+		View.update( Buf, Filter );
+
 		ImGui::PushStyleVar( ImGuiStyleVar_ItemSpacing, ImVec2( 0, 0 ) );
-		const char* buf     = Buf.begin();
-		const char* buf_end = Buf.end();
-		if( Filter.IsActive() )
+		ImGuiListClipper clipper;
+		clipper.Begin( static_cast<int>( View.size() ) );
+		while( clipper.Step() )
 		{
-			for( int line_no = 0; line_no < LineOffsets.Size; line_no++ )
+			for( int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ )
 			{
-				const char* line_start = buf + LineOffsets[line_no];
-				const char* line_end   = ( line_no + 1 < LineOffsets.Size )
-				                           ? ( buf + LineOffsets[line_no + 1] - 1 )
-				                           : buf_end;
-				if( Filter.PassFilter( line_start, line_end ) )
-					ImGui::TextUnformatted( line_start, line_end );
+				auto line = Buf.text( View[static_cast<size_t>( i )] );
+				ImGui::TextUnformatted( line.data(), line.data() + line.size() );
 			}
 		}
-		else
-		{
-			ImGuiListClipper clipper;
-			clipper.Begin( LineOffsets.Size );
-			while( clipper.Step() )
-			{
-				for( int line_no = clipper.DisplayStart; line_no < clipper.DisplayEnd; line_no++ )
-				{
-					const char* line_start = buf + LineOffsets[line_no];
-					const char* line_end   = ( line_no + 1 < LineOffsets.Size )
-					                           ? ( buf + LineOffsets[line_no + 1] - 1 )
-					                           : buf_end;
-					ImGui::TextUnformatted( line_start, line_end );
-				}
-			}
-			clipper.End();
-		}
+		clipper.End();
 		ImGui::PopStyleVar();
 
 		if( AutoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY() )
@@ -290,45 +334,131 @@ struct Log
 	}
 };
 
+// Timers and counters of atop's own pipeline stages (see atop::selfprof)
+static void ShowSelfProfile( bool* popen )
+{
+	if( !*popen )
+		return;
+
+	ImGui::Begin( "Self", popen );
+	auto metrics = atop::selfprof::snapshot();
+	ImGui::Columns( 5, "self" );
+	for( auto&& header: { "metric", "count", "mean (ms)", "max (ms)", "last (ms)" } )
+	{
+		ImGui::TextUnformatted( header );
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+
+	for( auto&& m: metrics )
+	{
+		ImGui::TextUnformatted( m.name.c_str() );
+		ImGui::NextColumn();
+		if( m.kind != atop::selfprof::Kinds::timer )
+		{
+			ImGui::TextUnformatted( fmt::format( "{0}", m.value ).c_str() );
+			ImGui::NextColumn();
+			for( int i = 0; i < 3; ++i )
+			{
+				ImGui::TextUnformatted( "-" );
+				ImGui::NextColumn();
+			}
+			continue;
+		}
+
+		auto mean_ms = m.count > 0 ? atop::util::ns2ms( m.total_ns ) / static_cast<double>( m.count )
+		                           : 0.0;
+		for( auto&& cell: { fmt::format( "{0}", m.count ), fmt::format( "{0:.3f}", mean_ms ),
+		                    fmt::format( "{0:.3f}", atop::util::ns2ms( m.max_ns ) ),
+		                    fmt::format( "{0:.3f}", atop::util::ns2ms( m.last_ns ) ) } )
+		{
+			ImGui::TextUnformatted( cell.c_str() );
+			ImGui::NextColumn();
+		}
+	}
+	ImGui::Columns( 1 );
+
+	if( ImGui::Button( "Copy JSON" ) )
+		ImGui::SetClipboardText( atop::selfprof::to_json( metrics ).c_str() );
+
+	ImGui::End();
+}
+
 // TODO: num_runs could be passed using BenchmarkInfo struct
 static void ShowBenchmarkSummary( bool* popen, atop::BenchmarkStats& stats, int num_runs,
                                   std::string const& fr )
 {
 	ImGui::Begin( "Benchmark Summary", popen );
-	for( auto&& p: stats.stats )
+	ImGui::Columns( 7, "phases" );
+	for( auto&& header: { "phase", "n", "mean (ms)", "std", "p50", "p90", "max" } )
+	{
+		ImGui::TextUnformatted( header );
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+
+	for( auto&& p: atop::benchmark_phases_table )
 	{
-		if( ( fr == "tflite" || fr == "tflite_app" ) && p.first == "offload" )
+		auto const& s = stats[p.second];
+		if( s.empty() )
+			continue;
+
+		ImGui::TextUnformatted( p.first.c_str() );
+		ImGui::NextColumn();
+
+		// tflite offload is sampled per streamed batch of driver logs while
+		// the benchmark tool reports per-run averages, so its total is
+		// spread over the runs instead
+		if( ( fr == "tflite" || fr == "tflite_app" ) && p.second == atop::BenchmarkPhases::offload )
 		{
+			ImGui::TextUnformatted( fmt::format( "{0}", num_runs ).c_str() );
+			ImGui::NextColumn();
 			ImGui::TextUnformatted(
-			    fmt::format( "{0}: {1} ms", p.first,
-			                 p.second / static_cast<double>( num_runs ) / 1.0e6 )
-			        .c_str() );
+			    fmt::format( "{0:.3f}", atop::util::ns2ms( s.sum() ) / num_runs ).c_str() );
+			ImGui::NextColumn();
+			for( int i = 0; i < 4; ++i )
+			{
+				ImGui::TextUnformatted( "-" );
+				ImGui::NextColumn();
+			}
+			continue;
+		}
+
+		ImGui::TextUnformatted( fmt::format( "{0}", s.count() ).c_str() );
+		ImGui::NextColumn();
+
+		auto ms = []( double ns ) { return ns / static_cast<double>( atop::util::ns_per_ms ); };
+		for( auto&& v: { ms( s.mean() ), ms( s.stddev() ),
+		                 atop::util::ns2ms( s.percentile( 50.0 ) ),
+		                 atop::util::ns2ms( s.percentile( 90.0 ) ), atop::util::ns2ms( s.max() ) } )
+		{
+			ImGui::TextUnformatted( fmt::format( "{0:.3f}", v ).c_str() );
+			ImGui::NextColumn();
 		}
-		else
-			ImGui::TextUnformatted(
-			    fmt::format( "{0}: {1} ms", p.first, static_cast<double>( p.second ) / 1.0e3 )
-			        .c_str() );
 	}
+	ImGui::Columns( 1 );
 
 	if( ImGui::Button( "Clear" ) )
-		stats.stats.clear();
+		stats.clear();
 
 	ImGui::End();
 }
 
-static void ShowIoctlBreakdown( std::map<std::string, std::map<std::string, int>>& breakdown,
-                                int num_runs )
+static void ShowIoctlBreakdown( atop::IoctlBreakdown& breakdown, int num_runs )
 {
 	ImGui::Begin( "Breakdown" );
-	for( auto&& p: breakdown )
+	auto const& rows = breakdown.rows();
+	for( size_t i = 0; i < rows.size(); ++i )
 	{
-		ImGui::TextUnformatted( fmt::format( "{0}: ", p.first ).c_str() );
-		for( auto&& cmd_p: p.second )
-		{
-			ImGui::TextUnformatted( fmt::format( "\t{0}: {1}", cmd_p.first,
-			                                     static_cast<float>( cmd_p.second ) / num_runs )
-			                            .c_str() );
-		}
+		if( i == 0 || rows[i].app != rows[i - 1].app )
+			ImGui::TextUnformatted(
+			    fmt::format( "{0}: ", atop::intern::app_names().name( rows[i].app ) ).c_str() );
+
+		ImGui::TextUnformatted( fmt::format( "\t{0}: {1}",
+		                                     atop::intern::ioctl_cmds().name( rows[i].cmd ),
+		                                     static_cast<float>( rows[i].count )
+		                                         / static_cast<float>( num_runs ) )
+		                            .c_str() );
 	}
 
 	if( ImGui::Button( "Clear" ) )
@@ -337,20 +467,131 @@ static void ShowIoctlBreakdown( std::map<std::string, std::map<std::string, int>
 	ImGui::End();
 }
 
+// Line (or filled area) chart of y over x in [x0, x1], full width of the
+// window. Points are reduced to one per pixel with LTTB, so charts of long
+// series keep their peaks and draw a bounded number of segments.
+static void LineChart( std::string const& label, std::vector<double> const& x,
+                       std::vector<double> const& y, double x0, double x1, bool area,
+                       char const* unit )
+{
+	constexpr float height = 80.0f;
+	auto origin            = ImGui::GetCursorScreenPos();
+	auto width             = std::max( 1.0f, ImGui::GetContentRegionAvail().x );
+	ImGui::Dummy( ImVec2( width, height ) );
+
+	auto* draw  = ImGui::GetWindowDrawList();
+	auto bottom = origin.y + height;
+	draw->AddRectFilled( origin, ImVec2( origin.x + width, bottom ),
+	                     ImGui::GetColorU32( ImGuiCol_FrameBg ) );
+	if( y.empty() )
+		return;
+
+	double y_max = *std::max_element( y.begin(), y.end() );
+	auto kept = atop::downsample::lttb( x.data(), y.data(), x.size(), static_cast<size_t>( width ) );
+
+	std::vector<ImVec2> points;
+	points.reserve( kept.size() );
+	for( auto i: kept )
+	{
+		auto fx = x1 > x0 ? ( x[i] - x0 ) / ( x1 - x0 ) : 1.0;
+		auto fy = y_max > 0.0 ? y[i] / y_max : 0.0;
+		points.emplace_back( origin.x + static_cast<float>( fx ) * width,
+		                     bottom - static_cast<float>( fy ) * ( height - 2.0f ) );
+	}
+
+	if( area )
+	{
+		auto fill = ImGui::GetColorU32( ImGuiCol_PlotHistogram, 0.35f );
+		for( size_t i = 1; i < points.size(); ++i )
+			draw->AddQuadFilled( points[i - 1], points[i], ImVec2( points[i].x, bottom ),
+			                     ImVec2( points[i - 1].x, bottom ), fill );
+	}
+	draw->AddPolyline( points.data(), static_cast<int>( points.size() ),
+	                   ImGui::GetColorU32( ImGuiCol_PlotLines ), false, 1.5f );
+
+	draw->AddText( ImVec2( origin.x + 4.0f, origin.y + 2.0f ), ImGui::GetColorU32( ImGuiCol_Text ),
+	               fmt::format( "{0}: {1:.1f} {3} (max {2:.1f})", label, y.back(), y_max, unit )
+	                   .c_str() );
+}
+
+// Busy fraction and mean IOCTL duration per device, fed to history from
+// the events added to a store since the previous call
+struct DeviceLoad
+{
+	size_t next_event                   = 0;
+	atop::util::nanoseconds_t newest_ns = 0;
+	std::set<atop::intern::string_id_t> seen{};
+};
+
+static void record_device_load( DeviceLoad& load, atop::events::EventStore const& store,
+                                atop::rollup::Store& history, atop::util::nanoseconds_t now_ns )
+{
+	// Count and sum of durations by device
+	std::map<atop::intern::string_id_t, std::pair<uint64_t, atop::util::nanoseconds_t>> devs;
+	auto prev_newest_ns = load.newest_ns;
+	load.next_event     = store.scan( load.next_event, [&]( atop::events::Event const& e ) {
+		load.newest_ns = std::max( load.newest_ns, e.ts_ns );
+		if( e.kind != atop::events::EventKinds::ioctl || e.dev == atop::events::none_id )
+			return;
+		auto& d = devs[e.dev];
+		d.first++;
+		d.second += e.duration_ns;
+	} );
+
+	for( auto&& kv: devs )
+		load.seen.insert( kv.first );
+
+	// The first batch (e.g. the backlog of dmesg) only sets the start of
+	// the device clock
+	if( prev_newest_ns == 0 || load.newest_ns <= prev_newest_ns )
+		return;
+
+	auto interval_ns = static_cast<double>( load.newest_ns - prev_newest_ns );
+	for( auto dev: load.seen )
+	{
+		auto name = std::string( atop::intern::accel_tags().name( dev ) );
+		auto it   = devs.find( dev );
+		if( it == devs.end() )
+		{
+			history.add( "busy/" + name, now_ns, 0.0 );
+			continue;
+		}
+
+		auto [count, busy_ns] = it->second;
+		history.add( "busy/" + name, now_ns,
+		             std::min( 100.0, 100.0 * static_cast<double>( busy_ns ) / interval_ns ) );
+		history.add( "latency/" + name, now_ns,
+		             atop::util::ns2ms( busy_ns ) / static_cast<double>( count ) );
+	}
+}
+
 int main( int argc, const char** argv )
 {
+	auto start_time = std::chrono::steady_clock::now();
+	auto ms_since_start
+	    = [start_time]() { return std::chrono::duration<double, std::milli>(
+		                              std::chrono::steady_clock::now() - start_time )
+		                       .count(); };
+	auto ns_since_start = [start_time]() {
+		return static_cast<atop::util::nanoseconds_t>(
+		    std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now()
+		                                                          - start_time )
+		        .count() );
+	};
+
 	std::map<std::string, docopt::value> args
 	    = docopt::docopt( USAGE, { std::next( argv ), std::next( argv, argc ) },
 	                      true /* show if help is requested */, VERSION_STRING );
 
-	VERBOSE        = args["--verbose"].asBool();
-	const bool sim = args["--sim"].asBool();
-
-	if( !sim )
-		atop::check_reqs();
+	VERBOSE           = args["--verbose"].asBool();
+	const bool remote = static_cast<bool>( args["--connect"] );
+	const bool sim    = args["--sim"].asBool() || remote;
 
 	atop::logger::verbose_info( "Starting atop" );
 
+	// The UI shows up while the device is probed
+	auto startup_f = std::async( std::launch::async, start_up, sim, remote );
+
 	sf::RenderWindow window( sf::VideoMode( sf::VideoMode::getDesktopMode().width,
 	                                        sf::VideoMode::getDesktopMode().height ),
 	                         "atop - accelerator viewer" );
@@ -375,37 +616,33 @@ int main( int argc, const char** argv )
 
 	// TODO: is models + selected_models a better structure than the
 	// embedded boolean?
-	static std::vector<std::pair<std::string, bool>> models{
-	    imgui_models_vec( atop::get_models_on_device(
-	        atop::string2framework( frameworks[static_cast<size_t>( sel_framework )] ) ) ) };
+	// Filled once the device has been probed
+	static std::vector<std::pair<std::string, bool>> models{};
 
 	int num_procs       = 1;
 	int num_runs        = 1;
 	int num_cpu_threads = 4;
 	int num_warmup_runs = 0;
 
-	static bool utilization_paused = false;
+	static std::atomic<bool> utilization_paused = false;
 	static bool cpu_fallback       = false;
 	static bool fixed_scale        = true;
 	static bool show_log_b         = false;
 	static bool bench_summary_cb   = true;
+	static bool self_win_b         = false;
 
 	static atop::BenchmarkStats bench_summary;
-	static std::map<std::string, std::map<std::string, int>> ioctl_breakdown;
-
-	atop::IoctlDmesgStreamer streamer;
+	static atop::IoctlBreakdown ioctl_breakdown;
 
-	// TODO: use enum instead of raw strings; ideally a header-only
-	// solution that generates strings from enums
-	atop::LogcatStreamer logcat_streamer{ "ExecutionBuilder", "tflite" };
-
-	atop::CpuUtilizationStreamer cpu_streamer;
-
-	auto data = streamer.get_interactions();
 	std::map<std::string, double> cpu_data;
 	atop::logcat_out_t logcat_data;
 
-	static std::map<std::string, int> max_interactions{};
+	// Utilizations of the session; the fixed scale of a label is its
+	// maximum of the last scale_window_ns
+	static atop::rollup::Store history;
+	constexpr atop::util::nanoseconds_t scale_window_ns = 600 * atop::util::ns_per_s;
+	static int history_span                             = 1;
+	static DeviceLoad device_load;
 
 	static Log log;
 
@@ -428,56 +665,210 @@ int main( int argc, const char** argv )
 		bool gpu;
 		bool cam;
 	} log_status
-	    = { true, true, true }; // All enabled since we call enable_kernel_logging() on startup
+	    = { true, true, true }; // All enabled by the startup probe
 
 	static std::atomic<bool> exiting = false;
 
-	std::string old_driver_logging_prop = adb_getprop( "debug.nn.vlog" );
-	static bool driver_logging          = atop::util::string2bool( old_driver_logging_prop );
-
 	sf::Clock deltaClock;
 
-	enable_kernel_logging();
-
-	atop::logger::verbose_info( "Finished initialization" );
+	std::optional<double> first_frame_ms;
+	auto frame_displayed = [&]() {
+		if( first_frame_ms )
+			return;
+		first_frame_ms = ms_since_start();
+		spdlog::info( fmt::format( "Time to first frame: {0:.1f} ms", *first_frame_ms ) );
+	};
 
-	atop::fifo::FIFO<std::map<std::string, int>> ioctl_dmesg_fifo;
-	auto stream_ioctl_dmesg = [&]() {
-		while( !exiting )
+	while( window.isOpen() && !is_ready( startup_f ) )
+	{
+		sf::Event event;
+		while( window.pollEvent( event ) )
 		{
-			ioctl_dmesg_fifo.push_data( streamer.interactions( true /* check full log */ ) );
+			ImGui::SFML::ProcessEvent( event );
 
-			// As long as refresh rate is higher than stream latency
-			std::this_thread::sleep_for( 2s );
+			if( event.type == sf::Event::Closed )
+			{
+				atop::logger::verbose_info( "Window close requested...exiting" );
+				window.close();
+				exiting = true;
+			}
 		}
-	};
-	std::thread streamer_th{ stream_ioctl_dmesg };
 
-	atop::fifo::FIFO<atop::logcat_out_t> logcat_fifo;
-	auto stream_logcat = [&]() {
-		while( !exiting )
+		ImGui::SFML::Update( window, deltaClock.restart() );
+
+		ImGui::Begin( "Starting" );
+		ImGui::TextUnformatted(
+		    fmt::format( "Probing device... {0:.1f} s", ms_since_start() / 1000.0 ).c_str() );
+		ImGui::End();
+
+		window.clear();
+		ImGui::SFML::Render( window );
+		window.display();
+		frame_displayed();
+	}
+
+	auto startup           = startup_f.get();
+	double device_ready_ms = ms_since_start();
+	auto* streamer         = startup.ioctl.get();
+	auto* logcat_streamer  = startup.logcat.get();
+	auto* cpu_streamer     = startup.cpu.get();
+	auto data = streamer ? streamer->get_interactions() : std::map<std::string, int>{};
+
+	if( !sim )
+		models = imgui_models_vec( atop::get_models_on_device(
+		    startup.device,
+		    atop::string2framework( frameworks[static_cast<size_t>( sel_framework )] ) ) );
+
+	// Logging toggles are only offered for the knobs the device has
+	auto const& knobs = startup.device.knobs;
+	std::vector<std::string> device_cam_knobs;
+	std::copy_if( cam_knobs.begin(), cam_knobs.end(), std::back_inserter( device_cam_knobs ),
+	              [&knobs]( std::string const& k ) { return knobs.count( k ) > 0; } );
+	auto const enable_device_cam_log_cmd  = write_knobs_cmd( 1, device_cam_knobs );
+	auto const disable_device_cam_log_cmd = write_knobs_cmd( 0, device_cam_knobs );
+
+	std::string old_driver_logging_prop = startup.device.nn_vlog;
+	static bool driver_logging          = atop::util::string2bool( old_driver_logging_prop );
+
+	atop::logger::verbose_info(
+	    fmt::format( "Finished initialization; device ready after {0:.1f} ms", device_ready_ms ) );
+
+	// One scheduler samples all streams on a common time grid. Paused
+	// streams aren't sampled so that producers never wait on full FIFOs and
+	// stopping the scheduler doesn't block on them.
+	atop::scheduler::Scheduler sampler;
+
+	// dmesg is polled faster while drivers log and backs off while they
+	// are quiet. Interactions are reported per 2 s regardless of the period.
+	static std::atomic<bool> adaptive_dmesg = true;
+	std::atomic<double> dmesg_fill          = 0.0;
+	std::atomic<size_t> dmesg_gaps          = 0;
+	atop::fifo::FIFO<std::map<std::string, int>> ioctl_dmesg_fifo( "ioctl" );
+	atop::fifo::FIFO<atop::logcat_out_t> logcat_fifo( "logcat" );
+	atop::fifo::FIFO<std::map<std::string, double>> cpu_fifo( "cpu" );
+
+	// A viewer of a collector is fed by the collector's updates instead.
+	// Log lines of both drivers and logcat arrive in one stream.
+	std::unique_ptr<atop::collector::Client> collector;
+	if( remote )
+	{
+		try
 		{
-			logcat_fifo.push_data( logcat_streamer.more() );
-			std::this_thread::sleep_for( 1s );
+			collector = std::make_unique<atop::collector::Client>(
+			    args["--connect"].asString(), [&]( atop::protocol::Update const& u ) {
+				    if( utilization_paused || exiting )
+					    return;
+				    if( u.interactions )
+					    ioctl_dmesg_fifo.push_data( *u.interactions );
+				    if( u.cpu )
+					    cpu_fifo.push_data( *u.cpu );
+				    if( !u.log_lines.empty() )
+					    logcat_fifo.push_data( { { "collector", u.log_lines } } );
+			    } );
 		}
-	};
-	std::thread logcat_th{ stream_logcat };
-
-	atop::fifo::FIFO<std::map<std::string, double>> cpu_fifo;
-	auto stream_cpu = [&]() {
-		while( !exiting )
+		catch( std::exception const& e )
 		{
-			cpu_fifo.push_data( cpu_streamer.utilizations() );
-			std::this_thread::sleep_for( 1s );
+			atop::logger::log_and_exit( e.what() );
 		}
+	}
+	else
+	{
+		atop::add_dmesg_source(
+		    sampler, *streamer,
+		    [&]( std::map<std::string, int>& counts ) {
+			    dmesg_fill = streamer->ring_fill();
+			    dmesg_gaps = streamer->coverage_gaps();
+			    ioctl_dmesg_fifo.push_data( counts );
+		    },
+		    [&]() -> bool { return utilization_paused; }, []() -> bool { return adaptive_dmesg; } );
+
+		sampler.add( "logcat", 1s, [&]( auto ) {
+			if( !utilization_paused )
+				logcat_fifo.push_data( logcat_streamer->more() );
+		} );
+
+		sampler.add( "cpu", 1s, [&]( auto ) {
+			if( !utilization_paused )
+				cpu_fifo.push_data( cpu_streamer->utilizations() );
+		} );
+		sampler.start();
+	}
+
+	// adb commands triggered by the UI run in the background. Controls show
+	// the expected state right away and revert it if the command fails.
+	atop::cmdqueue::CommandQueue device_cmds;
+	static Toasts toasts;
+	auto toggle_knob_log = [&]( std::string const& name, bool& status,
+	                            std::string const& enable_cmd, std::string const& disable_cmd ) {
+		bool enable = !status;
+		status      = enable;
+
+		auto what = fmt::format( "{0} {1} logging", enable ? "Enable" : "Disable", name );
+		auto cmd  = fmt::format( "adb shell \"{0}\"", enable ? enable_cmd : disable_cmd );
+		device_cmds.push( what, cmd, [&status, enable, what]( atop::subprocess::Result const& r ) {
+			if( r.ok() )
+				return;
+			status = !enable;
+			toasts.Add( fmt::format( "{0} failed", what ) );
+		} );
 	};
-	std::thread cpu_th{ stream_cpu };
+
+	// Render loop work per frame, i.e. without waiting for the frame rate
+	// limit, over the last frame_window frames
+	constexpr auto frame_budget_ns = atop::util::ns_per_s / 60;
+	constexpr size_t frame_window  = 600;
+	std::deque<atop::util::nanoseconds_t> frame_ns;
+	atop::stats::Samples frame_stats;
+	std::deque<atop::util::nanoseconds_t> frame_cpu_ns;
+	auto& frame_time     = atop::selfprof::timer( "ui.frame" );
+	auto& frame_cpu_time = atop::selfprof::timer( "ui.frame_cpu" );
+	atop::stats::Samples frame_cpu_stats;
+	uint64_t frames      = 0;
+	uint64_t slow_frames = 0;
+	std::string frame_text;
+
+	// Frames are only drawn after a change, i.e. input, new data or
+	// finished commands, plus a few more for ImGui to settle hover and
+	// layout. Otherwise the UI is refreshed every idle_period (stream
+	// latency, toasts, running benchmarks) and the loop sleeps for a frame
+	// of the 60 fps limit at a time, each counted as skipped.
+	constexpr int settle_frames = 3;
+	constexpr auto idle_period  = std::chrono::milliseconds( 250 );
+	constexpr auto idle_sleep   = std::chrono::microseconds( 1000000 / 60 );
+	int frames_to_draw          = settle_frames;
+	auto last_frame             = std::chrono::steady_clock::now();
+	uint64_t skipped_frames     = 0;
+	auto last_stats             = last_frame - std::chrono::seconds( 1 );
+
+	// Utilization bars and history charts, rebuilt when their data changed
+	struct Bar
+	{
+		std::string text;
+		float fraction;
+	};
+	std::vector<Bar> bars;
+	bool bars_fixed_scale = !fixed_scale;
+
+	struct Chart
+	{
+		std::string label;
+		std::vector<double> x;
+		std::vector<double> y;
+	};
+	std::vector<Chart> charts;
+	int charts_span    = -1;
+	float charts_width = 0.0f;
 
 	while( window.isOpen() )
 	{
+		auto frame_start = std::chrono::steady_clock::now();
+		auto cpu_start   = atop::util::thread_cpu_ns();
+		bool changed     = device_cmds.poll() > 0;
+
 		sf::Event event;
 		while( window.pollEvent( event ) )
 		{
+			changed = true;
 			ImGui::SFML::ProcessEvent( event );
 
 			if( event.type == sf::Event::Closed )
@@ -492,6 +883,9 @@ int main( int argc, const char** argv )
 		{
 			data                    = ioctl_dmesg_fifo.pop_data();
 			data_got_consumed.ioctl = false;
+			for( auto&& kv: data )
+				history.add( "rate/" + kv.first, ns_since_start(), kv.second );
+			changed = true;
 		}
 
 		if( !utilization_paused && cpu_fifo.data_avail() )
@@ -499,26 +893,59 @@ int main( int argc, const char** argv )
 			// TODO: measure stream CPU latency
 			cpu_data              = cpu_fifo.pop_data();
 			data_got_consumed.cpu = false;
+			for( auto&& kv: cpu_data )
+				history.add( "cpu/" + kv.first, ns_since_start(), kv.second );
+			changed = true;
 		}
 
 		if( !utilization_paused && logcat_fifo.data_avail() )
 		{
 			logcat_data              = logcat_fifo.pop_data();
 			data_got_consumed.logcat = false;
+			changed                  = true;
 		}
 
+		if( !benchmark_futures_q.empty()
+		    && is_ready<atop::shell_out_t>( benchmark_futures_q.front() ) )
+			changed = true;
+
+		if( changed )
+			frames_to_draw = settle_frames;
+		if( frames_to_draw == 0 && frame_start - last_frame < idle_period && window.isOpen() )
+		{
+			skipped_frames++;
+			std::this_thread::sleep_for( idle_sleep );
+			continue;
+		}
+		frames_to_draw = std::max( 0, frames_to_draw - 1 );
+		last_frame     = frame_start;
+
 		ImGui::SFML::Update( window, deltaClock.restart() );
 
 		ImGui::SetNextWindowPos( ImVec2( 0.0f, ImGui::GetIO().DisplaySize.y ), 0,
 		                         ImVec2( 0.0f, 1.0f ) );
-		ImGui::SetNextWindowSize( ImVec2( 550.0f, 100.0f ), 0 );
+		ImGui::SetNextWindowSize( ImVec2( 550.0f, 190.0f ), 0 );
 		ImGui::Begin( "Stream latency", &timer_win_b,
 		              ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse
 		                  | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoBringToFrontOnFocus
 		                  | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_MenuBar );
-		std::string latency_text = fmt::format(
-		    "Stream latency: {0} s", streamer.get_duration() / static_cast<float>( 1.0e3 ) );
+		std::string latency_text
+		    = collector ? fmt::format( "Collector: {0}, {1:.1f} MiB received",
+		                               collector->connected() ? "connected" : "disconnected",
+		                               static_cast<double>( collector->bytes_received() )
+		                                   / ( 1024.0 * 1024.0 ) )
+		                : fmt::format( "Stream latency: {0} s",
+		                               atop::util::ns2s( streamer->get_duration() ) );
 		ImGui::TextUnformatted( latency_text.c_str() );
+		ImGui::TextUnformatted(
+		    fmt::format( "Startup: first frame {0:.0f} ms, device ready {1:.0f} ms",
+		                 first_frame_ms.value_or( device_ready_ms ), device_ready_ms )
+		        .c_str() );
+		if( !frame_text.empty() )
+			ImGui::TextUnformatted( frame_text.c_str() );
+		if( device_cmds.pending() > 0 )
+			ImGui::TextUnformatted(
+			    fmt::format( "Device commands pending: {0}", device_cmds.pending() ).c_str() );
 		ImGui::End();
 
 		/* Options window */
@@ -548,111 +975,195 @@ int main( int argc, const char** argv )
 		{
 			atop::logger::verbose_info(
 			    fmt::format( "{0} data stream", ( utilization_paused ) ? "Resumed" : "Paused" ) );
-			utilization_paused ^= true;
+			utilization_paused = !utilization_paused;
+		}
+
+		if( !collector && ImGui::CollapsingHeader( "Sampling" ) )
+		{
+			bool adaptive = adaptive_dmesg;
+			if( ImGui::Checkbox( "Adaptive dmesg polling", &adaptive ) )
+				adaptive_dmesg = adaptive;
+			ImGui::SameLine();
+			ImGui::TextUnformatted( fmt::format( "(ring fill {0:.0f}%, coverage gaps {1})",
+			                                     100.0 * dmesg_fill, dmesg_gaps )
+			                            .c_str() );
+
+			auto sources = sampler.stats();
+			for( size_t i = 0; i < sources.size(); ++i )
+			{
+				auto const& src = sources[i];
+				int period_ms   = static_cast<int>(
+				    std::chrono::duration_cast<std::chrono::milliseconds>( src.period ).count() );
+
+				ImGui::PushID( static_cast<int>( i ) );
+				ImGui::PushItemWidth( 100.0f );
+				if( ImGui::InputInt( src.name.c_str(), &period_ms, 100, 1000 ) && period_ms >= 100 )
+					sampler.set_period( i, std::chrono::milliseconds( period_ms ) );
+				ImGui::PopItemWidth();
+				ImGui::SameLine();
+
+				std::string info = "(ms)";
+				if( !src.jitter.empty() )
+					info += fmt::format(
+					    " runs {0}, overruns {1}, jitter p50 {2:.2f} ms, max {3:.2f} ms", src.runs,
+					    src.overruns, atop::util::ns2ms( src.jitter.percentile( 50.0 ) ),
+					    atop::util::ns2ms( src.jitter.max() ) );
+				ImGui::TextUnformatted( info.c_str() );
+				ImGui::PopID();
+			}
 		}
 
 		ImGui::End();
 
+		if( collector && !data_got_consumed.ioctl )
+			record_device_load( device_load, collector->state().events(), history,
+			                    ns_since_start() );
+
+		if( streamer && streamer->is_data_fresh && !data_got_consumed.ioctl )
+			record_device_load( device_load, streamer->events(), history, ns_since_start() );
+
 		/* Utilization window */
 		ImGui::Begin( "Utilization" );
 
-		auto win_size  = ImGui::GetWindowSize();
-		auto win_width = win_size.x;
-		// auto win_height = win_size.y;
-		std::vector<int> interactions;
-		interactions.reserve( data.size() );
-		std::vector<std::string> labels;
-		labels.reserve( data.size() );
-
-		if( data.size() || cpu_data.size() )
+		// Bars and their text are rebuilt when the data or the scale changed
+		if( !data_got_consumed.ioctl || !data_got_consumed.cpu || bars_fixed_scale != fixed_scale )
 		{
-			for( auto& p: data )
-			{
-				labels.push_back( p.first );
-				interactions.push_back( p.second );
-			}
-
+			// Current values with the history series of their fixed scale
+			std::vector<std::tuple<std::string, std::string, double>> values;
+			for( auto&& kv: data )
+				values.emplace_back( kv.first, "rate/" + kv.first, kv.second );
 			// TODO: separate discrete cpu stream vs. floating
 			for( auto&& kv: cpu_data )
-			{
-				labels.push_back( kv.first );
-				interactions.push_back( static_cast<int>( kv.second ) );
-			}
+				values.emplace_back( kv.first, "cpu/" + kv.first, kv.second );
 
-			auto cur_max = std::max_element( std::begin( interactions ), std::end( interactions ) );
-			auto max_label_sz
-			    = std::max_element( std::begin( labels ), std::end( labels ),
-			                        [&]( std::string const& s1, std::string const& s2 ) {
-				                        return s1.size() < s2.size();
-			                        } )
-			          ->size();
+			double cur_max = 0.0;
+			for( auto&& v: values )
+				cur_max = std::max( cur_max, std::get<2>( v ) );
 
-			for( size_t i = 0; i < interactions.size(); ++i )
+			bars.clear();
+			auto scale_now = ns_since_start();
+			for( auto&& [label, key, value]: values )
 			{
-				double scale   = 0.0;
-				auto cur_label = labels[i];
+				double max_ = cur_max;
 				if( fixed_scale )
 				{
-					auto it = max_interactions.find( cur_label );
-					if( it == max_interactions.end() )
-						max_interactions[cur_label] = interactions[i];
-					int max_ = std::max( max_interactions[cur_label], interactions[i] );
+					max_ = value;
+					if( auto series = history.find( key ) )
+					{
+						auto recent = series->summary(
+						    scale_now - std::min( scale_now, scale_window_ns ), scale_now );
+						max_ = std::max( max_, recent.max );
+					}
+				}
 
-					scale = static_cast<double>( interactions[i] ) / static_cast<double>( max_ );
+				bars.push_back( { fmt::format( "{0} {1:.0f}", label, value ),
+				                  static_cast<float>( max_ > 0.0 ? value / max_ : 0.0 ) } );
+			}
+			bars_fixed_scale = fixed_scale;
+		}
 
-					max_interactions[cur_label] = max_;
-				}
-				else
+		for( auto&& bar: bars )
+			ImGui::ProgressBar( bar.fraction, ImVec2( -1.0f, 0.0f ), bar.text.c_str() );
+
+		ImGui::End();
+
+		/* History window */
+		ImGui::Begin( "History" );
+		static constexpr std::array<std::pair<char const*, uint64_t>, 5> spans
+		    = { { { "1 min", 60 }, { "10 min", 600 }, { "1 h", 3600 }, { "6 h", 21600 },
+		          { "24 h", 86400 } } };
+		for( size_t i = 0; i < spans.size(); ++i )
+		{
+			if( i > 0 )
+				ImGui::SameLine();
+			ImGui::RadioButton( spans[i].first, &history_span, static_cast<int>( i ) );
+		}
+
+		struct ChartGroup
+		{
+			char const* prefix;
+			char const* title;
+			char const* unit;
+			bool area;
+		};
+		static constexpr std::array<ChartGroup, 4> chart_groups
+		    = { { { "rate/", "Interaction rate", "/2 s", true },
+		          { "busy/", "Busy", "%", true },
+		          { "cpu/", "CPU utilization", "%", false },
+		          { "latency/", "Offload latency", "ms", false } } };
+
+		// Bucket means of a few points per pixel, so long spans read coarse
+		// buckets instead of all samples; LTTB reduces them to the width.
+		// Queried again only once samples were added or the span or width
+		// changed.
+		auto span_ns    = spans[static_cast<size_t>( history_span )].second * atop::util::ns_per_s;
+		auto plot_width = ImGui::GetContentRegionAvail().x;
+		if( !data_got_consumed.ioctl || !data_got_consumed.cpu || charts_span != history_span
+		    || charts_width != plot_width )
+		{
+			auto history_now = ns_since_start();
+			auto now_s       = static_cast<double>( history_now ) / 1.0e9;
+			auto plot_points = static_cast<size_t>( std::max( 16.0f, plot_width * 4.0f ) );
+
+			charts.clear();
+			for( auto&& label: history.labels() )
+			{
+				auto range = history.find( label )->query(
+				    history_now - std::min( history_now, span_ns ), history_now, plot_points );
+
+				// Seconds relative to now
+				Chart chart{ label, {}, {} };
+				chart.x.reserve( range.buckets.size() );
+				chart.y.reserve( range.buckets.size() );
+				for( auto&& b: range.buckets )
 				{
-					scale
-					    = static_cast<double>( interactions[i] ) / static_cast<double>( *cur_max );
+					chart.x.push_back( static_cast<double>( b.t0_ns ) / 1.0e9 - now_s );
+					chart.y.push_back( b.mean() );
 				}
-
-				auto num_ticks = ( static_cast<double>( win_width ) * scale / font_scale_factor )
-				                 / 8.0; // TODO: handle scaling
-				if( num_ticks > 0.0 )
-					num_ticks = std::max( 1.0, std::floor( num_ticks ) );
-
-				std::stringstream bar_padding{ "" };
-				auto label_sz = cur_label.size();
-				for( size_t j = 0; j < max_label_sz - label_sz; ++j )
-					bar_padding << ' ';
-
-				std::stringstream ss;
-				for( int j = 0; j < static_cast<int>( num_ticks ); ++j )
-					ss << '#';
-				ImGui::TextUnformatted(
-				    fmt::format( "{0}{1}| {2}", cur_label, bar_padding.str(), ss.str() ).c_str() );
+				charts.push_back( std::move( chart ) );
 			}
+			charts_span  = history_span;
+			charts_width = plot_width;
 		}
 
+		auto span_s = static_cast<double>( span_ns ) / 1.0e9;
+		for( auto&& group: chart_groups )
+		{
+			if( !ImGui::CollapsingHeader( group.title, ImGuiTreeNodeFlags_DefaultOpen ) )
+				continue;
+
+			std::string_view prefix( group.prefix );
+			for( auto&& chart: charts )
+				if( chart.label.compare( 0, prefix.size(), prefix ) == 0 )
+					LineChart( chart.label.substr( prefix.size() ), chart.x, chart.y, -span_s, 0.0,
+					           group.area, group.unit );
+		}
 		ImGui::End();
 
-		if( streamer.is_data_fresh && !data_got_consumed.ioctl )
+		if( collector && !data_got_consumed.ioctl )
+			ioctl_breakdown.update( collector->state().events() );
+
+		if( streamer && streamer->is_data_fresh && !data_got_consumed.ioctl )
 		{
-			atop::ioctl_breakdown( ioctl_breakdown,
-			                       streamer.get_data()[PROBE_IDX( atop::DmesgProbes::IOCTL )],
-			                       atop::DmesgProbes::IOCTL );
-			atop::ioctl_breakdown( ioctl_breakdown,
-			                       streamer.get_data()[PROBE_IDX( atop::DmesgProbes::INFO )],
-			                       atop::DmesgProbes::INFO );
+			ioctl_breakdown.update( streamer->events() );
 
 			atop::update_tflite_kernel_offload(
-			    streamer.get_data()[PROBE_IDX( atop::DmesgProbes::TIME )], bench_summary );
+			    streamer->get_data()[PROBE_IDX( atop::DmesgProbes::TIME )], bench_summary );
 			atop::update_tflite_kernel_gpu_offload(
-			    streamer.get_data()[PROBE_IDX( atop::DmesgProbes::IOCTL )], bench_summary );
+			    streamer->get_data()[PROBE_IDX( atop::DmesgProbes::IOCTL )], bench_summary );
 		}
 
-		if( logcat_streamer.is_data_fresh && !data_got_consumed.logcat )
+		if( logcat_streamer && logcat_streamer->is_data_fresh && !data_got_consumed.logcat )
 		{
 			// TODO: use enum
-			for( auto&& kv: logcat_streamer.get_data() )
+			for( auto&& kv: logcat_streamer->get_data() )
 			{
 				atop::update_tflite_driver_offload( kv.second, bench_summary );
 			}
 		}
 
 		ShowIoctlBreakdown( ioctl_breakdown, num_runs );
+		ShowSelfProfile( &self_win_b );
 		ShowBenchmarkSummary( &bench_summary_cb, bench_summary, num_runs,
 		                      frameworks[static_cast<size_t>( sel_framework )] );
 
@@ -663,10 +1174,13 @@ int main( int argc, const char** argv )
 			{
 				atop::shell_out_t benchmark_out = benchmark_futures_q.front().get();
 
+				// Summarise each process on its own and merge the samples
+				atop::BenchmarkStats process_summary;
 				atop::summarize_benchmark_output(
 				    benchmark_out,
 				    atop::string2framework( frameworks[static_cast<size_t>( sel_framework )] ),
-				    bench_summary );
+				    process_summary );
+				bench_summary.merge( process_summary );
 			}
 
 			benchmark_futures_q.pop();
@@ -682,8 +1196,11 @@ int main( int argc, const char** argv )
 			    fmt::format( "Changed model framework to: {0}",
 			                 frameworks[static_cast<size_t>( sel_framework )] ) );
 
-			models = imgui_models_vec( atop::get_models_on_device(
-			    atop::string2framework( frameworks[static_cast<size_t>( sel_framework )] ) ) );
+			// Capabilities are known since startup
+			if( !sim )
+				models = imgui_models_vec( atop::get_models_on_device(
+				    startup.device,
+				    atop::string2framework( frameworks[static_cast<size_t>( sel_framework )] ) ) );
 
 			// Reset delegate because not all frameworks support all
 			// delegates
@@ -740,7 +1257,7 @@ int main( int argc, const char** argv )
 
 		if( ImGui::Button( "Run" ) )
 		{
-			bench_summary.stats.clear();
+			bench_summary.clear();
 			ioctl_breakdown.clear();
 			auto fr = atop::string2framework( frameworks[static_cast<size_t>( sel_framework )] );
 			switch( fr )
@@ -845,7 +1362,16 @@ int main( int argc, const char** argv )
 				ImGui::Checkbox( "w/ CPU Fallback", &cpu_fallback );
 				ImGui::SameLine();
 				if( ImGui::Checkbox( "w/ Driver Inst.", &driver_logging ) )
-					toggle_driver_logging();
+				{
+					bool enabled = driver_logging;
+					device_cmds.push( "Driver logging", set_driver_logging_cmd( enabled ),
+					                  [enabled]( atop::subprocess::Result const& r ) {
+						                  if( r.ok() )
+							                  return;
+						                  driver_logging = !enabled;
+						                  toasts.Add( "Could not change driver logging" );
+					                  } );
+				}
 				ImGui::InputInt( "Runs", &num_runs );
 				ImGui::InputInt( "Warmup Runs", &num_warmup_runs );
 				ImGui::InputInt( "CPU Threads", &num_cpu_threads );
@@ -875,20 +1401,28 @@ int main( int argc, const char** argv )
 		// TODO: add option to change log to logcat, stdout, etc.
 		ImGui::SetNextWindowSize( ImVec2( 500, 400 ), ImGuiCond_FirstUseEver );
 		ImGui::Begin( "Log", &show_log_b );
-		if( streamer.is_data_fresh && !data_got_consumed.ioctl )
+		if( collector && !data_got_consumed.logcat )
+		{
+			for( auto&& kv: logcat_data )
+				for( auto&& line: kv.second )
+					log.AddLog( kv.first, line );
+		}
+
+		if( streamer && streamer->is_data_fresh && !data_got_consumed.ioctl )
 		{
-			auto data_to_log = streamer.get_data()[PROBE_IDX( streamer.utilization_probe )];
+			auto probe       = atop::dmesgProbes2string( streamer->utilization_probe );
+			auto data_to_log = streamer->get_data()[PROBE_IDX( streamer->utilization_probe )];
 			for( auto it = data_to_log.rbegin(); it != data_to_log.rend(); ++it )
-				log.AddLog( "%s\n", ( *it ).c_str() );
+				log.AddLog( probe, *it );
 		}
 
 		// TODO: could be in separate "Logcat" view
-		if( logcat_streamer.is_data_fresh && !data_got_consumed.logcat )
+		if( logcat_streamer && logcat_streamer->is_data_fresh && !data_got_consumed.logcat )
 		{
-			for( auto&& kv: logcat_streamer.get_data() )
+			for( auto&& kv: logcat_streamer->get_data() )
 			{
 				for( auto it = kv.second.rbegin(); it != kv.second.rend(); ++it )
-					log.AddLog( "%s\n", ( *it ).c_str() );
+					log.AddLog( kv.first, *it );
 			}
 		}
 		ImGui::End();
@@ -898,32 +1432,19 @@ int main( int argc, const char** argv )
 		log.Draw( "Log", &show_log_b );
 
 		ImGui::Begin( "Advanced" );
-		if( ImGui::Button( log_status.dsp ? "Stop DSP" : "Log DSP" ) )
-		{
-			if( log_status.dsp )
-				disable_dsp_log();
-			else
-				enable_dsp_log();
-			log_status.dsp ^= true;
-		}
-		if( ImGui::Button( log_status.gpu ? "Stop GPU" : "Log GPU" ) )
-		{
-			if( log_status.gpu )
-				disable_gpu_log();
-			else
-				enable_gpu_log();
-			log_status.gpu ^= true;
-		}
-		if( ImGui::Button( log_status.cam ? "Stop cam." : "Log cam." ) )
-		{
-			if( log_status.cam )
-				disable_cam_log();
-			else
-				enable_cam_log();
-			log_status.cam ^= true;
-		}
+		if( knobs.count( "dsp" ) && ImGui::Button( log_status.dsp ? "Stop DSP" : "Log DSP" ) )
+			toggle_knob_log( "DSP", log_status.dsp, enable_dsp_log_cmd, disable_dsp_log_cmd );
+		if( knobs.count( "gpu" ) && ImGui::Button( log_status.gpu ? "Stop GPU" : "Log GPU" ) )
+			toggle_knob_log( "GPU", log_status.gpu, enable_gpu_log_cmd, disable_gpu_log_cmd );
+		if( !device_cam_knobs.empty()
+		    && ImGui::Button( log_status.cam ? "Stop cam." : "Log cam." ) )
+			toggle_knob_log( "camera", log_status.cam, enable_device_cam_log_cmd,
+			                 disable_device_cam_log_cmd );
+		ImGui::Checkbox( "Self profile", &self_win_b );
 		ImGui::End();
 
+		toasts.Draw();
+
 		// One iteration => data in streamer has been processed
 		data_got_consumed.logcat = true;
 		data_got_consumed.ioctl  = true;
@@ -931,17 +1452,74 @@ int main( int argc, const char** argv )
 
 		window.clear();
 		ImGui::SFML::Render( window );
+
+		auto work_ns = static_cast<atop::util::nanoseconds_t>(
+		    std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now()
+		                                                          - frame_start )
+		        .count() );
+		if( work_ns > frame_budget_ns )
+		{
+			slow_frames++;
+			atop::logger::verbose_info(
+			    fmt::format( "Slow frame: {0:.1f} ms", atop::util::ns2ms( work_ns ) ) );
+		}
+		frame_ns.push_back( work_ns );
+		frame_cpu_ns.push_back( atop::util::thread_cpu_ns() - cpu_start );
+		frame_time.record( work_ns );
+		frame_cpu_time.record( frame_cpu_ns.back() );
+		if( frame_ns.size() > frame_window )
+		{
+			frame_ns.pop_front();
+			frame_cpu_ns.pop_front();
+		}
+
+		// Percentiles and their text are refreshed about once per second
+		frames++;
+		if( frame_start - last_stats >= std::chrono::seconds( 1 ) )
+		{
+			last_stats = frame_start;
+			frame_stats.clear();
+			frame_cpu_stats.clear();
+			for( size_t i = 0; i < frame_ns.size(); ++i )
+			{
+				frame_stats.add( frame_ns[i] );
+				frame_cpu_stats.add( frame_cpu_ns[i] );
+			}
+
+			frame_text = fmt::format(
+			    "Frame: p50 {0:.1f} ms, p99 {1:.1f} ms, max {2:.1f} ms, {3} over {4:.1f} ms\n"
+			    "Frame CPU: p50 {5:.1f} ms, p99 {6:.1f} ms; {7} drawn, {8} skipped",
+			    atop::util::ns2ms( frame_stats.percentile( 50.0 ) ),
+			    atop::util::ns2ms( frame_stats.percentile( 99.0 ) ),
+			    atop::util::ns2ms( frame_stats.max() ), slow_frames,
+			    atop::util::ns2ms( frame_budget_ns ),
+			    atop::util::ns2ms( frame_cpu_stats.percentile( 50.0 ) ),
+			    atop::util::ns2ms( frame_cpu_stats.percentile( 99.0 ) ), frames, skipped_frames );
+		}
+
 		window.display();
+		frame_displayed();
 	}
 
 	ImGui::SFML::Shutdown();
 
-	streamer_th.join();
-	cpu_th.join();
-	logcat_th.join();
+	sampler.stop();
+	device_cmds.stop();
+
+	if( args["--self-dump"] )
+	{
+		std::ofstream dump( args["--self-dump"].asString() );
+		dump << atop::selfprof::to_json( atop::selfprof::snapshot() ) << '\n';
+		if( !dump )
+			atop::logger::warn(
+			    fmt::format( "Could not write {0}", args["--self-dump"].asString() ) );
+	}
 
-	adb_setprop( "debug.nn.vlog", old_driver_logging_prop );
-	disable_kernel_logging();
+	if( !sim )
+	{
+		adb_setprop( "debug.nn.vlog", old_driver_logging_prop );
+		disable_kernel_logging();
+	}
 
 	return 0;
 }
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "collector.h"
+#include "intern.h"
+#include "logger.h"
+#include "metrics.h"
+
+std::string atop::metrics::escape_label( std::string_view value )
+{
+	std::string out;
+	out.reserve( value.size() );
+	for( auto c: value )
+	{
+		switch( c )
+		{
+			case '\\': out += "\\\\"; break;
+			case '"': out += "\\\""; break;
+			case '\n': out += "\\n"; break;
+			default: out += c;
+		}
+	}
+	return out;
+}
+
+atop::metrics::Families::Families( std::string device_ )
+    : device( escape_label( device_ ) )
+    , rates()
+    , accelerators()
+    , busy_ratios()
+    , offload_ns()
+    , cpu_utils()
+    , next_event( 0 )
+    , newest_ns( 0 )
+    , serialized()
+    , dirty()
+    , body()
+{
+	this->dirty.fill( true );
+}
+
+void atop::metrics::Families::update( protocol::Update const& u, events::EventStore const& store )
+{
+	// Interactions are streamed per 2 s
+	if( u.interactions )
+	{
+		this->rates.clear();
+		for( auto&& kv: *u.interactions )
+			this->rates[kv.first] = static_cast<double>( kv.second ) / 2.0;
+		this->dirty[Family::rate] = true;
+	}
+
+	if( u.cpu )
+	{
+		this->cpu_utils.clear();
+		for( auto&& kv: *u.cpu )
+			this->cpu_utils[kv.first] = kv.second / 100.0;
+		this->dirty[Family::cpu] = true;
+	}
+
+	if( this->next_event == store.size() )
+		return;
+
+	// Busy time per accelerator of this batch
+	std::map<intern::string_id_t, util::nanoseconds_t> batch_busy_ns;
+	auto prev_newest_ns = this->newest_ns;
+	this->next_event    = store.scan( this->next_event, [&]( events::Event const& e ) {
+		this->newest_ns = std::max( this->newest_ns, e.ts_ns );
+		if( e.kind != events::EventKinds::ioctl )
+			return;
+
+		if( e.app != events::none_id )
+			this->offload_ns[std::string( intern::app_names().name( e.app ) )] += e.duration_ns;
+		if( e.dev == events::none_id )
+			return;
+
+		batch_busy_ns[e.dev] += e.duration_ns;
+		auto& acc = this->accelerators[std::string( intern::accel_tags().name( e.dev ) )];
+		acc.ioctls++;
+		acc.busy_ns += e.duration_ns;
+		auto bucket = std::lower_bound( duration_buckets_ns.begin(), duration_buckets_ns.end(),
+		                                e.duration_ns );
+		acc.buckets[static_cast<size_t>( bucket - duration_buckets_ns.begin() )]++;
+	} );
+
+	// The first batch only starts the device clock
+	if( prev_newest_ns != 0 && this->newest_ns > prev_newest_ns )
+	{
+		auto interval_ns = static_cast<double>( this->newest_ns - prev_newest_ns );
+		for( auto&& kv: this->accelerators )
+			this->busy_ratios[kv.first] = 0.0;
+		for( auto&& kv: batch_busy_ns )
+			this->busy_ratios[std::string( intern::accel_tags().name( kv.first ) )]
+			    = std::min( 1.0, static_cast<double>( kv.second ) / interval_ns );
+		this->dirty[Family::busy_ratio] = true;
+	}
+
+	for( auto f: { Family::ioctls, Family::busy, Family::durations, Family::offload } )
+		this->dirty[f] = true;
+}
+
+std::string atop::metrics::Families::serialize( Family f ) const
+{
+	auto seconds = []( util::nanoseconds_t ns ) { return util::ns2s( ns ); };
+	auto label   = [this]( char const* name, std::string const& value ) {
+		return fmt::format( "device=\"{0}\",{1}=\"{2}\"", this->device, name,
+		                    escape_label( value ) );
+	};
+
+	std::string out;
+	switch( f )
+	{
+		case Family::rate:
+			out = "# TYPE atop_interaction_rate gauge\n"
+			      "# HELP atop_interaction_rate Accelerator interactions per second.\n";
+			for( auto&& kv: this->rates )
+				out += fmt::format( "atop_interaction_rate{{{0}}} {1}\n",
+				                    label( "accelerator", kv.first ), kv.second );
+			break;
+		case Family::ioctls:
+			out = "# TYPE atop_ioctls counter\n"
+			      "# HELP atop_ioctls IOCTL calls of accelerator drivers.\n";
+			for( auto&& kv: this->accelerators )
+				out += fmt::format( "atop_ioctls_total{{{0}}} {1}\n",
+				                    label( "accelerator", kv.first ), kv.second.ioctls );
+			break;
+		case Family::busy:
+			out = "# TYPE atop_accelerator_busy_seconds counter\n"
+			      "# HELP atop_accelerator_busy_seconds Time spent in IOCTL calls.\n";
+			for( auto&& kv: this->accelerators )
+				out += fmt::format( "atop_accelerator_busy_seconds_total{{{0}}} {1}\n",
+				                    label( "accelerator", kv.first ), seconds( kv.second.busy_ns ) );
+			break;
+		case Family::busy_ratio:
+			out = "# TYPE atop_accelerator_busy_ratio gauge\n"
+			      "# HELP atop_accelerator_busy_ratio Busy fraction since the previous sample.\n";
+			for( auto&& kv: this->busy_ratios )
+				out += fmt::format( "atop_accelerator_busy_ratio{{{0}}} {1}\n",
+				                    label( "accelerator", kv.first ), kv.second );
+			break;
+		case Family::durations:
+			out = "# TYPE atop_ioctl_duration_seconds histogram\n"
+			      "# HELP atop_ioctl_duration_seconds Durations of IOCTL calls.\n";
+			for( auto&& kv: this->accelerators )
+			{
+				auto l         = label( "accelerator", kv.first );
+				uint64_t total = 0;
+				for( size_t i = 0; i < kv.second.buckets.size(); ++i )
+				{
+					total += kv.second.buckets[i];
+					auto le = i < duration_buckets_ns.size()
+					              ? fmt::format( "{0}", seconds( duration_buckets_ns[i] ) )
+					              : std::string( "+Inf" );
+					out += fmt::format( "atop_ioctl_duration_seconds_bucket{{{0},le=\"{1}\"}} {2}\n",
+					                    l, le, total );
+				}
+				out += fmt::format( "atop_ioctl_duration_seconds_count{{{0}}} {1}\n", l, total );
+				out += fmt::format( "atop_ioctl_duration_seconds_sum{{{0}}} {1}\n", l,
+				                    seconds( kv.second.busy_ns ) );
+			}
+			break;
+		case Family::offload:
+			out = "# TYPE atop_offload_seconds counter\n"
+			      "# HELP atop_offload_seconds Time apps spent in accelerator IOCTL calls.\n";
+			for( auto&& kv: this->offload_ns )
+				out += fmt::format( "atop_offload_seconds_total{{{0}}} {1}\n",
+				                    label( "app", kv.first ), seconds( kv.second ) );
+			break;
+		case Family::cpu:
+			out = "# TYPE atop_cpu_utilization_ratio gauge\n"
+			      "# HELP atop_cpu_utilization_ratio Utilization of each CPU core.\n";
+			for( auto&& kv: this->cpu_utils )
+				out += fmt::format( "atop_cpu_utilization_ratio{{{0}}} {1}\n",
+				                    label( "cpu", kv.first ), kv.second );
+			break;
+		case Family::count: break;
+	}
+	return out;
+}
+
+std::shared_ptr<std::string const> atop::metrics::Families::text()
+{
+	if( this->body
+	    && std::none_of( this->dirty.begin(), this->dirty.end(), []( bool d ) { return d; } ) )
+		return this->body;
+
+	std::string all;
+	for( size_t f = 0; f < Family::count; ++f )
+	{
+		if( this->dirty[f] )
+			this->serialized[f] = this->serialize( static_cast<Family>( f ) );
+		this->dirty[f] = false;
+		all += this->serialized[f];
+	}
+	all += "# EOF\n";
+
+	this->body = std::make_shared<std::string const>( std::move( all ) );
+	return this->body;
+}
+
+atop::metrics::Exporter::Exporter( std::string const& addr, std::string device )
+    : listen_fd( -1 )
+    , wake_fd( -1 )
+    , unix_path()
+    , mtx()
+    , families( std::move( device ) )
+    , stopping( false )
+    , served( 0 )
+    , thread()
+{
+	auto a          = collector::parse_address( addr );
+	this->listen_fd = collector::open_socket( a, true );
+	if( a.unix_socket )
+		this->unix_path = a.host;
+
+	this->wake_fd = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if( listen( this->listen_fd, 16 ) < 0 || this->wake_fd < 0 )
+	{
+		auto e = std::runtime_error(
+		    fmt::format( "Could not serve metrics on '{0}': {1}", addr, std::strerror( errno ) ) );
+		close( this->listen_fd );
+		if( this->wake_fd >= 0 )
+			close( this->wake_fd );
+		throw e;
+	}
+
+	this->thread = std::thread( [this]() { this->serve(); } );
+}
+
+atop::metrics::Exporter::~Exporter()
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		this->stopping = true;
+	}
+	uint64_t one = 1;
+	if( write( this->wake_fd, &one, sizeof( one ) ) < 0 )
+		atop::logger::warn( "Could not stop the metrics endpoint" );
+	this->thread.join();
+
+	close( this->wake_fd );
+	close( this->listen_fd );
+	if( !this->unix_path.empty() )
+		unlink( this->unix_path.c_str() );
+}
+
+void atop::metrics::Exporter::update( protocol::Update const& u, events::EventStore const& store )
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	this->families.update( u, store );
+}
+
+void atop::metrics::Exporter::serve()
+{
+	for( ;; )
+	{
+		std::array<pollfd, 2> fds
+		    = { { { this->listen_fd, POLLIN, 0 }, { this->wake_fd, POLLIN, 0 } } };
+		if( poll( fds.data(), fds.size(), -1 ) < 0 && errno != EINTR )
+		{
+			atop::logger::warn(
+			    fmt::format( "Metrics endpoint failed: {0}", std::strerror( errno ) ) );
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( this->mtx );
+			if( this->stopping )
+				return;
+		}
+
+		if( fds[0].revents & POLLIN )
+		{
+			int fd = accept4( this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC );
+			if( fd >= 0 )
+			{
+				this->respond( fd );
+				close( fd );
+			}
+		}
+	}
+}
+
+void atop::metrics::Exporter::respond( int fd )
+{
+	// Scrapers send a short request and wait for the answer, so a stalled
+	// client only holds up the endpoint for the timeout
+	timeval timeout{ 1, 0 };
+	setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+
+	std::string request;
+	std::array<char, 1024> buf;
+	while( request.find( "\r\n\r\n" ) == std::string::npos && request.size() < 8192 )
+	{
+		auto n = recv( fd, buf.data(), buf.size(), 0 );
+		if( n <= 0 )
+			return;
+		request.append( buf.data(), static_cast<size_t>( n ) );
+	}
+
+	std::shared_ptr<std::string const> body;
+	std::string head;
+	auto target = request.substr( 0, request.find( "\r\n" ) );
+	if( target.rfind( "GET /metrics ", 0 ) == 0 || target.rfind( "GET /metrics?", 0 ) == 0 )
+	{
+		{
+			std::lock_guard<std::mutex> lock( this->mtx );
+			body = this->families.text();
+		}
+		head = fmt::format( "HTTP/1.1 200 OK\r\nContent-Type: {0}\r\nContent-Length: {1}\r\n"
+		                    "Connection: close\r\n\r\n",
+		                    content_type, body->size() );
+		this->served++;
+	}
+	else
+	{
+		body = std::make_shared<std::string const>( "Not found; metrics are at /metrics\n" );
+		head = fmt::format( "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n"
+		                    "Content-Length: {0}\r\nConnection: close\r\n\r\n",
+		                    body->size() );
+	}
+
+	std::array<std::string const*, 2> parts = { &head, body.get() };
+	for( auto const* part: parts )
+	{
+		size_t sent = 0;
+		while( sent < part->size() )
+		{
+			auto n = send( fd, part->data() + sent, part->size() - sent, MSG_NOSIGNAL );
+			if( n <= 0 )
+				return;
+			sent += static_cast<size_t>( n );
+		}
+	}
+}
@@ -0,0 +1,135 @@
+#ifndef METRICS_H_IN
+#define METRICS_H_IN
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "events.h"
+#include "protocol.h"
+#include "util.h"
+
+namespace atop
+{
+namespace metrics
+{
+// OpenMetrics (Prometheus) exposition of a collector's data
+//
+// Families are serialized when the first scrape after a change asks for
+// them, and only those whose data changed are serialized again; the
+// exposition text is shared with scrapes in flight. A scrape of
+// unchanged data therefore only copies a pointer. Exposed families, all
+// labelled with device="<serial>":
+//
+//     atop_interaction_rate{accelerator}          gauge, per second
+//     atop_ioctls_total{accelerator}              counter
+//     atop_accelerator_busy_seconds_total{..}     counter, sum of IOCTL durations
+//     atop_accelerator_busy_ratio{accelerator}    gauge, busy time over device
+//                                                 time since the previous update
+//     atop_ioctl_duration_seconds{accelerator}    histogram
+//     atop_offload_seconds_total{app}             counter, sum of an app's
+//                                                 IOCTL durations
+//     atop_cpu_utilization_ratio{cpu}             gauge
+
+constexpr auto content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+// Upper bounds of the IOCTL duration histogram buckets
+constexpr std::array<util::nanoseconds_t, 11> duration_buckets_ns
+    = { 50 * util::ns_per_us,  100 * util::ns_per_us, 250 * util::ns_per_us,
+	    500 * util::ns_per_us, util::ns_per_ms,       2500 * util::ns_per_us,
+	    5 * util::ns_per_ms,   10 * util::ns_per_ms,  25 * util::ns_per_ms,
+	    50 * util::ns_per_ms,  100 * util::ns_per_ms };
+
+// Label value with backslashes, quotes and newlines escaped
+std::string escape_label( std::string_view value );
+
+class Families
+{
+  public:
+	explicit Families( std::string device );
+
+	// Adds the interactions and CPU utilizations of u and the events
+	// appended to store since the previous call
+	void update( protocol::Update const& u, events::EventStore const& store );
+
+	// Exposition text ending in "# EOF"
+	std::shared_ptr<std::string const> text();
+
+  private:
+	enum Family : size_t
+	{
+		rate,
+		ioctls,
+		busy,
+		busy_ratio,
+		durations,
+		offload,
+		cpu,
+		count
+	};
+
+	struct Accelerator
+	{
+		uint64_t ioctls;
+		util::nanoseconds_t busy_ns;
+		std::array<uint64_t, duration_buckets_ns.size() + 1> buckets;
+	};
+
+	std::string serialize( Family f ) const;
+
+	std::string device;
+
+	std::map<std::string, double> rates;
+	std::map<std::string, Accelerator> accelerators;
+	std::map<std::string, double> busy_ratios;
+	std::map<std::string, util::nanoseconds_t> offload_ns;
+	std::map<std::string, double> cpu_utils;
+
+	size_t next_event;
+	util::nanoseconds_t newest_ns;
+
+	std::array<std::string, Family::count> serialized;
+	std::array<bool, Family::count> dirty;
+	std::shared_ptr<std::string const> body;
+};
+
+// Serves the families on GET /metrics
+class Exporter
+{
+  public:
+	// Listens on addr (see collector::parse_address); throws if that isn't
+	// possible. device labels all samples.
+	Exporter( std::string const& addr, std::string device );
+	~Exporter();
+	Exporter( Exporter const& ) = delete;
+	Exporter( Exporter&& )      = delete;
+
+	void update( protocol::Update const& u, events::EventStore const& store );
+
+	uint64_t scrapes() const { return this->served; }
+
+  private:
+	void serve();
+	void respond( int fd );
+
+	int listen_fd;
+	int wake_fd;
+	std::string unix_path;
+
+	std::mutex mtx;
+	Families families;
+	bool stopping;
+	std::atomic<uint64_t> served;
+
+	std::thread thread;
+};
+
+} // namespace metrics
+} // namespace atop
+
+#endif // METRICS_H_IN
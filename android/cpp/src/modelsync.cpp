@@ -0,0 +1,521 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "atop.h"
+#include "logger.h"
+#include "modelsync.h"
+#include "subprocess.h"
+#include "util.h"
+
+namespace fs = std::filesystem;
+
+// RFC 1321
+class Md5
+{
+  public:
+	Md5()
+	    : h{ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 }
+	    , buf()
+	    , buffered( 0 )
+	    , total( 0 )
+	{
+	}
+
+	void update( unsigned char const* data, size_t n )
+	{
+		this->total += n;
+		while( n > 0 )
+		{
+			auto take = std::min( n, this->buf.size() - this->buffered );
+			std::memcpy( this->buf.data() + this->buffered, data, take );
+			this->buffered += take;
+			data += take;
+			n -= take;
+
+			if( this->buffered == this->buf.size() )
+			{
+				this->block( this->buf.data() );
+				this->buffered = 0;
+			}
+		}
+	}
+
+	std::string hexdigest()
+	{
+		uint64_t bits = this->total * 8;
+
+		unsigned char pad[72] = { 0x80 };
+		auto pad_len          = ( this->buffered < 56 ? 56 : 120 ) - this->buffered;
+		for( size_t i = 0; i < 8; ++i )
+			pad[pad_len + i] = static_cast<unsigned char>( bits >> ( 8 * i ) );
+		this->update( pad, pad_len + 8 );
+
+		std::string hex;
+		for( auto word: this->h )
+			for( int i = 0; i < 4; ++i )
+				hex += fmt::format( "{0:02x}", ( word >> ( 8 * i ) ) & 0xff );
+		return hex;
+	}
+
+  private:
+	static uint32_t rotl( uint32_t x, uint32_t c ) { return ( x << c ) | ( x >> ( 32 - c ) ); }
+
+	void block( unsigned char const* p )
+	{
+		static constexpr uint32_t shifts[64]
+		    = { 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+		        5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+		        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+		        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21 };
+
+		// K[i] = floor( |sin( i + 1 )| * 2^32 )
+		static auto const k = []() {
+			std::array<uint32_t, 64> t{};
+			for( size_t i = 0; i < t.size(); ++i )
+			{
+				auto x = std::fabs( std::sin( static_cast<double>( i + 1 ) ) );
+				t[i]   = static_cast<uint32_t>( std::floor( x * 4294967296.0 ) );
+			}
+			return t;
+		}();
+
+		uint32_t m[16];
+		for( size_t i = 0; i < 16; ++i )
+			m[i] = static_cast<uint32_t>( p[4 * i] )
+			       | ( static_cast<uint32_t>( p[4 * i + 1] ) << 8 )
+			       | ( static_cast<uint32_t>( p[4 * i + 2] ) << 16 )
+			       | ( static_cast<uint32_t>( p[4 * i + 3] ) << 24 );
+
+		uint32_t a = this->h[0], b = this->h[1], c = this->h[2], d = this->h[3];
+		for( size_t i = 0; i < 64; ++i )
+		{
+			uint32_t f;
+			size_t g;
+			if( i < 16 )
+			{
+				f = ( b & c ) | ( ~b & d );
+				g = i;
+			}
+			else if( i < 32 )
+			{
+				f = ( d & b ) | ( ~d & c );
+				g = ( 5 * i + 1 ) % 16;
+			}
+			else if( i < 48 )
+			{
+				f = b ^ c ^ d;
+				g = ( 3 * i + 5 ) % 16;
+			}
+			else
+			{
+				f = c ^ ( b | ~d );
+				g = ( 7 * i ) % 16;
+			}
+
+			f = f + a + k[i] + m[g];
+			a = d;
+			d = c;
+			c = b;
+			b = b + rotl( f, shifts[i] );
+		}
+
+		this->h[0] += a;
+		this->h[1] += b;
+		this->h[2] += c;
+		this->h[3] += d;
+	}
+
+	std::array<uint32_t, 4> h;
+	std::array<unsigned char, 64> buf;
+	size_t buffered;
+	uint64_t total;
+};
+
+std::string atop::modelsync::md5( std::string_view data )
+{
+	Md5 m;
+	m.update( reinterpret_cast<unsigned char const*>( data.data() ), data.size() );
+	return m.hexdigest();
+}
+
+std::string atop::modelsync::md5( std::istream& is )
+{
+	Md5 m;
+	std::vector<char> buffer( 1 << 20 );
+	while( is )
+	{
+		is.read( buffer.data(), static_cast<std::streamsize>( buffer.size() ) );
+		m.update( reinterpret_cast<unsigned char const*>( buffer.data() ),
+		          static_cast<size_t>( is.gcount() ) );
+	}
+	return m.hexdigest();
+}
+
+atop::modelsync::HashCache::HashCache( std::string path_ )
+    : path( std::move( path_ ) )
+    , entries()
+    , dirty( false )
+{
+	std::ifstream is{ this->path };
+	std::string line;
+	while( std::getline( is, line ) )
+	{
+		std::istringstream ss{ line };
+		Entry e;
+		std::string file;
+		if( ss >> e.mtime >> e.size >> e.md5 && std::getline( ss >> std::ws, file ) )
+			this->entries[file] = e;
+	}
+}
+
+std::string atop::modelsync::HashCache::md5_file( std::string const& file )
+{
+	auto size  = fs::file_size( file );
+	int64_t mtime
+	    = fs::last_write_time( file ).time_since_epoch() / std::chrono::nanoseconds( 1 );
+
+	if( auto it{ this->entries.find( file ) };
+	    it != std::end( this->entries ) && it->second.mtime == mtime && it->second.size == size )
+		return it->second.md5;
+
+	std::ifstream is{ file, std::ios::binary };
+	if( !is )
+		throw std::runtime_error( fmt::format( "Could not open '{0}'", file ) );
+
+	auto digest         = md5( is );
+	this->entries[file] = Entry{ mtime, size, digest };
+	this->dirty         = true;
+	return digest;
+}
+
+void atop::modelsync::HashCache::save() const
+{
+	if( !this->dirty )
+		return;
+
+	std::error_code ec;
+	fs::create_directories( fs::path( this->path ).parent_path(), ec );
+	std::ofstream os{ this->path };
+	for( auto&& e: this->entries )
+		os << fmt::format( "{0} {1} {2} {3}\n", e.second.mtime, e.second.size, e.second.md5,
+		                   e.first );
+	if( !os )
+		atop::logger::warn( fmt::format( "Could not write hash cache '{0}'", this->path ) );
+}
+
+// Device path of a local file below local_root
+static std::string remote_path( fs::path const& local, fs::path const& local_root,
+                                std::string const& remote_root )
+{
+	return ( fs::path( remote_root ) / local.lexically_relative( local_root ) ).generic_string();
+}
+
+static bool is_below( fs::path const& p, fs::path const& root )
+{
+	auto rel = p.lexically_relative( root );
+	return !rel.empty() && *rel.begin() != "..";
+}
+
+std::string atop::modelsync::rewrite_raw_list( std::string const& local_list,
+                                               std::string const& local_root,
+                                               std::string const& remote_root,
+                                               std::map<std::string, std::string>& inputs )
+{
+	std::ifstream is{ local_list };
+	if( !is )
+		throw std::runtime_error( fmt::format( "Could not open '{0}'", local_list ) );
+
+	auto root       = fs::weakly_canonical( local_root );
+	auto list_dir   = fs::weakly_canonical( local_list ).parent_path();
+	auto remote_dir = remote_path( list_dir, root, remote_root );
+
+	std::string out, line;
+	while( std::getline( is, line ) )
+	{
+		// "#<output layer> ..." lines don't name inputs
+		if( line.empty() || line[0] == '#' )
+		{
+			out += line + '\n';
+			continue;
+		}
+
+		// Space separated inputs, each either "<path>" or "<layer>:=<path>"
+		std::istringstream ss{ line };
+		std::string token, rewritten;
+		while( ss >> token )
+		{
+			auto sep   = token.find( ":=" );
+			auto label = sep == std::string::npos ? "" : token.substr( 0, sep + 2 );
+			fs::path input{ sep == std::string::npos ? token : token.substr( sep + 2 ) };
+
+			// SNPE's scripts write paths relative to the list
+			if( input.is_relative() )
+				input = list_dir / input;
+			input = fs::weakly_canonical( input );
+			if( !fs::is_regular_file( input ) )
+				throw std::runtime_error( fmt::format( "Input '{0}' of '{1}' doesn't exist",
+				                                       input.string(), local_list ) );
+
+			auto remote = is_below( input, root )
+			                  ? remote_path( input, root, remote_root )
+			                  : remote_dir + "/inputs/" + input.filename().string();
+			inputs[input.string()] = remote;
+
+			rewritten += ( rewritten.empty() ? "" : " " ) + label + remote;
+		}
+		out += rewritten + '\n';
+	}
+
+	return out;
+}
+
+std::vector<atop::modelsync::Blob> atop::modelsync::plan( std::string const& local_root,
+                                                          std::string const& remote_root,
+                                                          HashCache& hashes )
+{
+	if( !fs::is_directory( local_root ) )
+		throw std::runtime_error( fmt::format( "'{0}' is not a directory", local_root ) );
+
+	auto root = fs::weakly_canonical( local_root );
+
+	// Remote path -> blob; inputs referenced by several lists are pushed once
+	std::map<std::string, Blob> blobs;
+	auto add_file = [&]( fs::path const& local, std::string const& remote ) {
+		if( blobs.count( remote ) == 0 )
+			blobs[remote] = Blob{ local.string(), remote, fs::file_size( local ),
+				                  hashes.md5_file( local.string() ), "" };
+	};
+
+	std::vector<fs::path> files;
+	for( auto&& entry: fs::recursive_directory_iterator( root ) )
+		if( entry.is_regular_file() )
+			files.push_back( entry.path() );
+	std::sort( files.begin(), files.end() );
+
+	for( auto&& file: files )
+	{
+		auto remote = remote_path( file, root, remote_root );
+		if( file.filename() != raw_list_name )
+		{
+			add_file( file, remote );
+			continue;
+		}
+
+		std::map<std::string, std::string> inputs;
+		auto content = rewrite_raw_list( file.string(), root.string(), remote_root, inputs );
+		blobs[remote] = Blob{ "", remote, content.size(), md5( content ), content };
+		for( auto&& input: inputs )
+			add_file( input.first, input.second );
+	}
+
+	std::vector<Blob> result;
+	result.reserve( blobs.size() );
+	for( auto&& b: blobs )
+		result.push_back( std::move( b.second ) );
+	return result;
+}
+
+std::map<std::string, std::string>
+atop::modelsync::parse_md5sum( std::vector<std::string> const& out )
+{
+	std::map<std::string, std::string> hashes;
+	for( auto&& line: out )
+	{
+		// "<32 hex digits>  <path>"; errors of missing files go to stderr
+		if( line.size() < 35 || line[32] != ' ' )
+			continue;
+		auto digest = line.substr( 0, 32 );
+		auto is_hex = []( char c ) { return std::isxdigit( static_cast<unsigned char>( c ) ); };
+		if( !std::all_of( digest.begin(), digest.end(), is_hex ) )
+			continue;
+
+		auto pth = line.substr( 33 );
+		atop::util::trim( pth );
+		hashes[pth] = digest;
+	}
+	return hashes;
+}
+
+// Runs a device shell command passed to adb as one quoted word, so that
+// neither the host nor adb reinterpret it
+static atop::shell_out_t adb_shell( std::string const& cmd )
+{
+	return atop::check_console_output(
+	    fmt::format( "adb shell {0}", atop::util::shell_quote( cmd ) ) );
+}
+
+// Runs "<cmd> <paths...>" on the device in as few adb calls as the
+// command line length allows; paths are quoted
+static atop::shell_out_t batched_adb_shell( std::string const& cmd,
+                                            std::vector<std::string> const& paths )
+{
+	static constexpr size_t max_cmd_len = 32 * 1024;
+
+	atop::shell_out_t out;
+	std::string args;
+	auto flush = [&]() {
+		if( args.empty() )
+			return;
+		auto batch = adb_shell( cmd + args );
+		out.insert( out.end(), batch.begin(), batch.end() );
+		args.clear();
+	};
+
+	for( auto&& p: paths )
+	{
+		auto quoted = atop::util::shell_quote( p );
+		if( cmd.size() + args.size() + quoted.size() + 1 > max_cmd_len )
+			flush();
+		args += " " + quoted;
+	}
+	flush();
+	return out;
+}
+
+static std::map<std::string, std::string> remote_md5s( std::vector<std::string> const& paths )
+{
+	return atop::modelsync::parse_md5sum( batched_adb_shell( "md5sum 2>/dev/null", paths ) );
+}
+
+atop::modelsync::Report atop::modelsync::sync( std::vector<Blob> const& blobs,
+                                               Options const& opts )
+{
+	Report report;
+
+	// One batched hash of all targets and of parts of an interrupted sync
+	std::vector<std::string> paths;
+	for( auto&& b: blobs )
+	{
+		paths.push_back( b.remote );
+		paths.push_back( b.remote + ".part" );
+	}
+	auto remote = remote_md5s( paths );
+	auto matches = [&remote]( std::string const& pth, std::string const& digest ) {
+		auto it = remote.find( pth );
+		return it != std::end( remote ) && it->second == digest;
+	};
+
+	std::vector<Blob const*> to_push;
+	std::vector<Blob const*> to_rename;
+	for( auto&& b: blobs )
+	{
+		if( matches( b.remote, b.md5 ) )
+			report.up_to_date++;
+		else if( matches( b.remote + ".part", b.md5 ) )
+		{
+			report.resumed++;
+			to_rename.push_back( &b );
+		}
+		else
+		{
+			to_push.push_back( &b );
+			to_rename.push_back( &b );
+		}
+	}
+
+	for( auto b: to_push )
+		report.bytes_pushed += b->size;
+	report.pushed = to_push.size();
+
+	if( opts.dry_run )
+	{
+		for( auto b: to_push )
+			spdlog::info( fmt::format( "Would push {0} ({1} bytes)", b->remote, b->size ) );
+		return report;
+	}
+
+	// Generated blobs are staged in a local temporary directory
+	auto staging = fs::temp_directory_path() / fmt::format( "atop_sync_{0}", ::getpid() );
+	fs::create_directories( staging );
+
+	// At most opts.jobs pushes are in flight on the subprocess loop
+	auto& loop = atop::subprocess::default_loop();
+	std::deque<std::pair<Blob const*, std::future<atop::subprocess::Result>>> pushes;
+	std::set<Blob const*> failed_pushes;
+	auto finish_push = [&pushes, &failed_pushes]() {
+		auto [b, f] = std::move( pushes.front() );
+		pushes.pop_front();
+		auto r = f.get();
+		if( r.ok() )
+			return;
+		atop::logger::warn( fmt::format( "Pushing {0} failed with status {1}: {2}", b->remote,
+		                                 r.status, r.out ) );
+		failed_pushes.insert( b );
+	};
+
+	for( size_t i = 0; i < to_push.size(); ++i )
+	{
+		auto b     = to_push[i];
+		auto local = b->local;
+		if( local.empty() )
+		{
+			local = ( staging / std::to_string( i ) ).string();
+			std::ofstream os{ local, std::ios::binary };
+			os << b->content;
+		}
+
+		if( pushes.size() >= static_cast<size_t>( std::max( 1, opts.jobs ) ) )
+			finish_push();
+
+		atop::logger::verbose_info( fmt::format( "Pushing {0}", b->remote ) );
+		auto cmd = fmt::format( "adb push {0} {1} 2>&1", atop::util::shell_quote( local ),
+		                        atop::util::shell_quote( b->remote + ".part" ) );
+		pushes.emplace_back( b, loop.run( cmd ) );
+	}
+	while( !pushes.empty() )
+		finish_push();
+
+	std::error_code ec;
+	fs::remove_all( staging, ec );
+
+	// Targets only change once all of them have been pushed. Parts of failed
+	// pushes may be truncated and never replace a target; their targets
+	// fail the verification below.
+	std::string renames;
+	for( auto b: to_rename )
+	{
+		if( failed_pushes.count( b ) )
+			continue;
+		renames += fmt::format( "mv {0} {1}; ", atop::util::shell_quote( b->remote + ".part" ),
+		                        atop::util::shell_quote( b->remote ) );
+		if( renames.size() > 16 * 1024 )
+		{
+			adb_shell( renames );
+			renames.clear();
+		}
+	}
+	if( !renames.empty() )
+		adb_shell( renames );
+
+	// Verify the renamed targets; a push may succeed and the rename fail
+	if( !to_rename.empty() )
+	{
+		std::vector<std::string> targets;
+		for( auto b: to_rename )
+			targets.push_back( b->remote );
+		remote = remote_md5s( targets );
+		for( auto b: to_rename )
+			if( !matches( b->remote, b->md5 ) )
+				report.failed.push_back( b->remote );
+	}
+
+	return report;
+}
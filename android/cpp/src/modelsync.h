@@ -0,0 +1,116 @@
+#ifndef MODELSYNC_H_IN
+#define MODELSYNC_H_IN
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace atop
+{
+namespace modelsync
+{
+// Content-addressed, incremental model sync
+//
+// A local directory is mirrored below a directory on the device (e.g.
+// models/ to /data/local/tmp). Files are compared by MD5; local hashes are
+// cached by size and mtime and remote hashes are computed by batched
+// md5sum calls, so only changed blobs are pushed. Blobs are pushed in
+// parallel to "<path>.part" and renamed once all pushes finished; parts
+// of failed pushes are never renamed. An interrupted sync leaves the
+// completed parts on the device; their hashes are checked on the next run
+// so they are renamed instead of pushed again. Remote paths are quoted for
+// the device shell.
+//
+// SNPE input lists (target_raw_list.txt) reference raw input files by
+// host paths. They are rewritten to the device paths of the inputs, and
+// the referenced inputs are synced along with the list.
+
+// Lowercase hex MD5 digest
+std::string md5( std::string_view data );
+std::string md5( std::istream& is );
+
+// MD5 of local files, cached by path, size and mtime in a file of lines
+// "<mtime> <size> <md5> <path>"
+class HashCache
+{
+  public:
+	explicit HashCache( std::string path );
+
+	std::string md5_file( std::string const& path );
+
+	// Writes the cache back if it changed
+	void save() const;
+
+  private:
+	struct Entry
+	{
+		int64_t mtime;
+		uint64_t size;
+		std::string md5;
+	};
+
+	std::string path;
+	std::map<std::string, Entry> entries;
+	bool dirty;
+};
+
+struct Blob
+{
+	// Local file; empty if the blob is generated (rewritten input lists)
+	std::string local;
+	std::string remote;
+
+	uint64_t size;
+	std::string md5;
+
+	// Content of generated blobs
+	std::string content;
+};
+
+static constexpr auto raw_list_name = "target_raw_list.txt";
+
+// Rewrites the paths of an SNPE input list at local_list to paths on the
+// device. Inputs below local_root map to remote_root; other inputs are
+// placed in an "inputs" directory next to the list on the device.
+// Appends the local inputs and their device paths to inputs. Throws if an
+// input doesn't exist.
+std::string rewrite_raw_list( std::string const& local_list, std::string const& local_root,
+                              std::string const& remote_root,
+                              std::map<std::string, std::string>& inputs );
+
+// Blobs mirroring the regular files below local_root to remote_root
+std::vector<Blob> plan( std::string const& local_root, std::string const& remote_root,
+                        HashCache& hashes );
+
+// Parses md5sum output lines "<md5>  <path>" into path -> md5
+std::map<std::string, std::string> parse_md5sum( std::vector<std::string> const& out );
+
+struct Options
+{
+	// Concurrent adb pushes
+	int jobs = 4;
+
+	// Only report what would be pushed
+	bool dry_run = false;
+};
+
+struct Report
+{
+	size_t up_to_date = 0;
+	size_t resumed    = 0; // Parts left by an earlier, interrupted sync
+	size_t pushed     = 0;
+	uint64_t bytes_pushed = 0;
+
+	// Remote paths whose hash didn't match after the sync
+	std::vector<std::string> failed{};
+};
+
+Report sync( std::vector<Blob> const& blobs, Options const& opts );
+
+} // namespace modelsync
+} // namespace atop
+
+#endif // MODELSYNC_H_IN
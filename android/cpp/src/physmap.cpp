@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "physmap.h"
+#include "util.h"
+
+// Ordered list of (name fragment, IP block). First match wins, so more
+// specific fragments (e.g., "smmu-kgsl") have to come before generic ones.
+static const std::array<std::pair<char const*, atop::physmap::IpBlocks>, 30> ip_rules{ {
+    { "kgsl", atop::physmap::IpBlocks::GPU },
+    { "gpu", atop::physmap::IpBlocks::GPU },
+    { "lpass", atop::physmap::IpBlocks::DSP },
+    { "adsp", atop::physmap::IpBlocks::DSP },
+    { "cdsp", atop::physmap::IpBlocks::DSP },
+    { "slpi", atop::physmap::IpBlocks::DSP },
+    { "qdsp6", atop::physmap::IpBlocks::DSP },
+    { "fastrpc", atop::physmap::IpBlocks::DSP },
+    { "hexagon", atop::physmap::IpBlocks::DSP },
+    { "modem", atop::physmap::IpBlocks::Modem },
+    { "mba", atop::physmap::IpBlocks::Modem },
+    { "mss", atop::physmap::IpBlocks::Modem },
+    { "cam", atop::physmap::IpBlocks::Camera },
+    { "csid", atop::physmap::IpBlocks::Camera },
+    { "csiphy", atop::physmap::IpBlocks::Camera },
+    { "cci", atop::physmap::IpBlocks::Camera },
+    { "ispif", atop::physmap::IpBlocks::Camera },
+    { "vfe", atop::physmap::IpBlocks::Camera },
+    { "cpp", atop::physmap::IpBlocks::Camera },
+    { "jpeg", atop::physmap::IpBlocks::Camera },
+    { "fd_", atop::physmap::IpBlocks::Camera },
+    { "venus", atop::physmap::IpBlocks::Video },
+    { "video", atop::physmap::IpBlocks::Video },
+    { "mdss", atop::physmap::IpBlocks::Display },
+    { "mdp", atop::physmap::IpBlocks::Display },
+    { "dsi", atop::physmap::IpBlocks::Display },
+    { "hdmi", atop::physmap::IpBlocks::Display },
+    { "system ram", atop::physmap::IpBlocks::DRAM },
+    { "kernel code", atop::physmap::IpBlocks::DRAM },
+    { "kernel data", atop::physmap::IpBlocks::DRAM },
+} };
+
+std::string atop::physmap::ipBlock2string( atop::physmap::IpBlocks ip )
+{
+	auto it = std::find_if( std::begin( ip_blocks_table ), std::end( ip_blocks_table ),
+	                        [&]( auto&& p ) { return p.second == ip; } );
+
+	if( it != std::end( ip_blocks_table ) )
+		return it->first;
+	else
+		throw std::runtime_error( "IP block not defined" );
+}
+
+atop::physmap::IpBlocks atop::physmap::region2ipBlock( std::string const& name )
+{
+	std::string lower{ name };
+	std::transform( lower.begin(), lower.end(), lower.begin(),
+	                []( unsigned char c ) { return static_cast<char>( std::tolower( c ) ); } );
+
+	for( auto&& rule: ip_rules )
+		if( lower.find( rule.first ) != std::string::npos )
+			return rule.second;
+
+	return atop::physmap::IpBlocks::Other;
+}
+
+void atop::physmap::PhysMap::add_region( addr_t first, addr_t last, std::string const& name,
+                                         RegionSource source, int depth )
+{
+	if( last < first )
+		throw std::runtime_error(
+		    fmt::format( "Invalid region '{0}': {1:#x}-{2:#x}", name, first, last ) );
+
+	this->regions_.push_back(
+	    Region{ first, last, name, atop::physmap::region2ipBlock( name ), source, depth } );
+	this->built_ = false;
+}
+
+void atop::physmap::PhysMap::load_iomem( std::istream& is )
+{
+	std::string line;
+	size_t line_no = 0;
+	while( std::getline( is, line ) )
+	{
+		++line_no;
+		auto indent = line.find_first_not_of( ' ' );
+		if( indent == std::string::npos )
+			continue;
+
+		// E.g., "  80080000-8185ffff : Kernel code"
+		auto dash  = line.find( '-', indent );
+		auto colon = line.find( " : ", indent );
+		if( dash == std::string::npos || colon == std::string::npos || dash > colon )
+			throw std::runtime_error(
+			    fmt::format( "Malformed iomem entry at line {0}: '{1}'", line_no, line ) );
+
+		auto first = std::stoull( line.substr( indent, dash - indent ), nullptr, 16 );
+		auto last  = std::stoull( line.substr( dash + 1, colon - dash - 1 ), nullptr, 16 );
+		auto name  = line.substr( colon + 3 );
+		atop::util::trim( name );
+
+		this->add_region( first, last, name, RegionSource::iomem, static_cast<int>( indent / 2 ) );
+	}
+}
+
+void atop::physmap::PhysMap::load_iomem( std::string const& path )
+{
+	std::ifstream is{ path };
+	if( !is )
+		throw std::runtime_error( fmt::format( "Could not open iomem file '{0}'", path ) );
+	this->load_iomem( is );
+}
+
+// Combines consecutive 32-bit cells into one value (e.g., <0x0 0x85800000>)
+static atop::physmap::addr_t combine_cells( std::vector<atop::physmap::addr_t> const& cells,
+                                            size_t pos, int count )
+{
+	atop::physmap::addr_t val = 0;
+	for( int i = 0; i < count; ++i )
+		val = ( val << 32 ) | cells[pos + static_cast<size_t>( i )];
+	return val;
+}
+
+static int parse_cells_property( std::string const& line )
+{
+	auto lt = line.find( '<' );
+	if( lt == std::string::npos )
+		return 2;
+	return static_cast<int>( std::stoul( line.substr( lt + 1 ), nullptr, 0 ) );
+}
+
+void atop::physmap::PhysMap::load_dts_carveouts( std::istream& is )
+{
+	std::string line;
+	int depth          = 0;
+	int reserved_depth = -1; // depth of the "reserved-memory" node body
+	int address_cells  = 2;
+	int size_cells     = 2;
+	std::string node_name;
+
+	while( std::getline( is, line ) )
+	{
+		atop::util::trim( line );
+		if( line.empty() )
+			continue;
+
+		if( line.back() == '{' )
+		{
+			++depth;
+			auto name = line.substr( 0, line.size() - 1 );
+			atop::util::trim( name );
+
+			if( reserved_depth < 0 && name == "reserved-memory" )
+				reserved_depth = depth;
+			else if( reserved_depth > 0 && depth == reserved_depth + 1 )
+				node_name = name.substr( 0, name.find( '@' ) );
+			continue;
+		}
+
+		if( line.rfind( "};", 0 ) == 0 )
+		{
+			if( depth == reserved_depth )
+				reserved_depth = -1;
+			--depth;
+			continue;
+		}
+
+		if( reserved_depth < 0 )
+			continue;
+
+		if( depth == reserved_depth )
+		{
+			if( line.rfind( "#address-cells", 0 ) == 0 )
+				address_cells = parse_cells_property( line );
+			else if( line.rfind( "#size-cells", 0 ) == 0 )
+				size_cells = parse_cells_property( line );
+		}
+		else if( depth == reserved_depth + 1 && line.rfind( "reg = <", 0 ) == 0 )
+		{
+			std::vector<addr_t> cells;
+			auto body = line.substr( line.find( '<' ) + 1 );
+			body      = body.substr( 0, body.find( '>' ) );
+			for( auto&& cell: atop::util::split( body, ' ' ) )
+				if( !cell.empty() )
+					cells.push_back( std::stoull( cell, nullptr, 0 ) );
+
+			auto stride = static_cast<size_t>( address_cells + size_cells );
+			for( size_t i = 0; stride > 0 && i + stride <= cells.size(); i += stride )
+			{
+				auto base = combine_cells( cells, i, address_cells );
+				auto size = combine_cells( cells, i + static_cast<size_t>( address_cells ),
+				                           size_cells );
+				if( size > 0 )
+					this->add_region( base, base + size - 1, node_name, RegionSource::dts );
+			}
+		}
+	}
+}
+
+void atop::physmap::PhysMap::load_dts_carveouts( std::string const& path )
+{
+	std::ifstream is{ path };
+	if( !is )
+		throw std::runtime_error( fmt::format( "Could not open device tree file '{0}'", path ) );
+	this->load_dts_carveouts( is );
+}
+
+// Builds the implicit interval tree: with regions sorted by start address,
+// node i lives at level k where k is the number of trailing 1-bits of i.
+// See Li, H. "cgranges" for the layout.
+void atop::physmap::PhysMap::build()
+{
+	auto& a = this->regions_;
+	std::sort( a.begin(), a.end(), []( Region const& r1, Region const& r2 ) {
+		return r1.first < r2.first || ( r1.first == r2.first && r1.last > r2.last );
+	} );
+
+	auto n = a.size();
+	this->max_last_.assign( n, 0 );
+	this->max_level_ = -1;
+	this->built_     = true;
+	if( n == 0 )
+		return;
+
+	auto& max_last = this->max_last_;
+	size_t last_i  = 0;
+	addr_t last    = 0;
+	for( size_t i = 0; i < n; i += 2 )
+	{
+		last_i = i;
+		last = max_last[i] = a[i].last;
+	}
+
+	int k = 1;
+	for( ; ( size_t{ 1 } << k ) <= n; ++k )
+	{
+		size_t x    = size_t{ 1 } << ( k - 1 );
+		size_t i0   = ( x << 1 ) - 1;
+		size_t step = x << 2;
+		for( size_t i = i0; i < n; i += step )
+		{
+			addr_t el   = max_last[i - x];
+			addr_t er   = ( i + x < n ) ? max_last[i + x] : last;
+			max_last[i] = std::max( { a[i].last, el, er } );
+		}
+		last_i = ( ( last_i >> k ) & 1 ) ? last_i - x : last_i + x;
+		if( last_i < n && max_last[last_i] > last )
+			last = max_last[last_i];
+	}
+
+	this->max_level_ = k - 1;
+}
+
+template<typename Visitor>
+void atop::physmap::PhysMap::stab( addr_t addr, Visitor&& visit ) const
+{
+	struct Frame
+	{
+		int k;
+		size_t x;
+		bool left_done;
+	};
+
+	if( !this->built_ )
+		throw std::logic_error( "PhysMap::build() has to be called before lookups" );
+
+	auto const& a = this->regions_;
+	auto n        = a.size();
+	if( n == 0 )
+		return;
+
+	// Tree height is bounded by 64 so a fixed stack suffices
+	std::array<Frame, 128> stack;
+	size_t t   = 0;
+	stack[t++] = { this->max_level_, ( size_t{ 1 } << this->max_level_ ) - 1, false };
+	while( t > 0 )
+	{
+		Frame z = stack[--t];
+		if( z.k <= 3 )
+		{
+			// Small subtree: linear scan is faster than descending
+			size_t i0 = z.x >> z.k << z.k;
+			size_t i1 = std::min( n, i0 + ( size_t{ 1 } << ( z.k + 1 ) ) - 1 );
+			for( size_t i = i0; i < i1 && a[i].first <= addr; ++i )
+				if( addr <= a[i].last )
+					visit( i );
+		}
+		else if( !z.left_done )
+		{
+			size_t y   = z.x - ( size_t{ 1 } << ( z.k - 1 ) );
+			stack[t++] = { z.k, z.x, true };
+			if( y >= n || this->max_last_[y] >= addr )
+				stack[t++] = { z.k - 1, y, false };
+		}
+		else if( z.x < n && a[z.x].first <= addr )
+		{
+			if( addr <= a[z.x].last )
+				visit( z.x );
+			stack[t++] = { z.k - 1, z.x + ( size_t{ 1 } << ( z.k - 1 ) ), false };
+		}
+	}
+}
+
+int32_t atop::physmap::PhysMap::lookup_idx( addr_t addr ) const
+{
+	int32_t best = npos;
+	this->stab( addr, [&]( size_t i ) {
+		auto const& r = this->regions_[i];
+		if( best == npos || r.size() < this->regions_[static_cast<size_t>( best )].size() )
+			best = static_cast<int32_t>( i );
+	} );
+	return best;
+}
+
+atop::physmap::Region const* atop::physmap::PhysMap::lookup( addr_t addr ) const
+{
+	auto idx = this->lookup_idx( addr );
+	return ( idx == npos ) ? nullptr : &this->regions_[static_cast<size_t>( idx )];
+}
+
+std::vector<atop::physmap::Region const*> atop::physmap::PhysMap::containing( addr_t addr ) const
+{
+	std::vector<Region const*> res;
+	this->stab( addr, [&]( size_t i ) { res.push_back( &this->regions_[i] ); } );
+	std::sort( res.begin(), res.end(),
+	           []( Region const* r1, Region const* r2 ) { return r1->size() > r2->size(); } );
+	return res;
+}
+
+void atop::physmap::PhysMap::lookup_batch( addr_t const* addrs, size_t n, int32_t* out,
+                                           unsigned num_threads ) const
+{
+	// Below this many addresses per thread spawning threads doesn't pay off
+	constexpr size_t min_chunk = 1 << 16;
+
+	if( num_threads == 0 )
+		num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+	num_threads = static_cast<unsigned>(
+	    std::max<size_t>( 1, std::min<size_t>( num_threads, n / min_chunk ) ) );
+
+	auto work = [&]( size_t from, size_t to ) {
+		for( size_t i = from; i < to; ++i )
+			out[i] = this->lookup_idx( addrs[i] );
+	};
+
+	if( num_threads == 1 )
+	{
+		work( 0, n );
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	workers.reserve( num_threads - 1 );
+	size_t chunk = ( n + num_threads - 1 ) / num_threads;
+	for( unsigned t = 1; t < num_threads; ++t )
+		workers.emplace_back( work, std::min( n, t * chunk ), std::min( n, ( t + 1 ) * chunk ) );
+	work( 0, std::min( n, chunk ) );
+
+	for( auto&& w: workers )
+		w.join();
+}
@@ -0,0 +1,135 @@
+#ifndef PHYSMAP_H_IN
+#define PHYSMAP_H_IN
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace atop
+{
+namespace physmap
+{
+using addr_t = uint64_t;
+
+// IP blocks a physical address can be attributed to
+enum class IpBlocks : int
+{
+	DRAM    = 0,
+	GPU     = 1,
+	DSP     = 2,
+	Camera  = 3,
+	Video   = 4,
+	Display = 5,
+	Modem   = 6,
+	Other   = 7,
+
+	// End marker; do not add anything below
+	// Increment for each new entry
+	LAST = 8
+};
+
+std::map<std::string, IpBlocks> const ip_blocks_table
+    = { { "DRAM", IpBlocks::DRAM },       { "GPU", IpBlocks::GPU },
+        { "DSP", IpBlocks::DSP },         { "Camera", IpBlocks::Camera },
+        { "Video", IpBlocks::Video },     { "Display", IpBlocks::Display },
+        { "Modem", IpBlocks::Modem },     { "Other", IpBlocks::Other } };
+
+#define IP_IDX( ip_ ) static_cast<size_t>( ( ip_ ) )
+
+std::string ipBlock2string( IpBlocks ip );
+
+// Best-effort attribution of a region name (as found in /proc/iomem or
+// a device-tree node name) to an IP block
+IpBlocks region2ipBlock( std::string const& name );
+
+enum class RegionSource : int
+{
+	iomem,
+	dts
+};
+
+struct Region
+{
+	addr_t first; // inclusive
+	addr_t last;  // inclusive
+	std::string name;
+	IpBlocks ip;
+	RegionSource source;
+	int depth; // nesting level in /proc/iomem
+
+	addr_t size() const { return this->last - this->first + 1; }
+};
+
+// Physical address-space classifier
+//
+// Regions are kept in an implicit augmented interval tree (a sorted array
+// where each node additionally stores the largest end address of its
+// subtree) so that "which regions contain address X" is answered in
+// O(log n + k) without any per-query allocation.
+//
+// Usage:
+//     PhysMap map;
+//     map.load_iomem( "iomem.txt" );
+//     map.load_dts_carveouts( "apq8098.dts" );
+//     map.build();
+//     auto* r = map.lookup( 0x5000100 ); // -> kgsl-3d0 (GPU)
+class PhysMap
+{
+  public:
+	static constexpr int32_t npos = -1;
+
+	PhysMap()  = default;
+	~PhysMap() = default;
+
+	// Parses the "<first>-<last> : <name>" format of /proc/iomem.
+	// Indentation (two spaces per level) denotes nesting.
+	void load_iomem( std::istream& is );
+	void load_iomem( std::string const& path );
+
+	// Parses statically placed carve-outs ("reg = <...>") under the
+	// "reserved-memory" node of a decompiled device tree. Dynamically
+	// allocated pools (size/alloc-ranges only) have no fixed address
+	// and are skipped.
+	void load_dts_carveouts( std::istream& is );
+	void load_dts_carveouts( std::string const& path );
+
+	void add_region( addr_t first, addr_t last, std::string const& name, RegionSource source,
+	                 int depth = 0 );
+
+	// Must be called after the last add_region/load_* and before any lookup
+	void build();
+
+	// Innermost (smallest) region containing addr or nullptr
+	Region const* lookup( addr_t addr ) const;
+
+	// Index into regions() of the innermost region containing addr or npos
+	int32_t lookup_idx( addr_t addr ) const;
+
+	// All regions containing addr, outermost first
+	std::vector<Region const*> containing( addr_t addr ) const;
+
+	// Classifies n addresses into out[0..n) (indices into regions() or npos).
+	// Work is split across num_threads threads (0: hardware concurrency).
+	void lookup_batch( addr_t const* addrs, size_t n, int32_t* out,
+	                   unsigned num_threads = 0 ) const;
+
+	std::vector<Region> const& regions() const { return this->regions_; }
+	bool is_built() const { return this->built_; }
+
+  private:
+	template<typename Visitor> void stab( addr_t addr, Visitor&& visit ) const;
+
+	std::vector<Region> regions_{};
+
+	// Augmented subtree maximum of Region::last (same indexing as regions_)
+	std::vector<addr_t> max_last_{};
+	int max_level_ = -1;
+	bool built_    = false;
+};
+
+} // namespace physmap
+} // namespace atop
+
+#endif // PHYSMAP_H_IN
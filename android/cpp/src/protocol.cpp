@@ -0,0 +1,341 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "protocol.h"
+
+namespace
+{
+constexpr size_t header_size = 5;
+
+constexpr uint8_t snapshot_flag     = 1;
+constexpr uint8_t interactions_flag = 2;
+constexpr uint8_t cpu_flag          = 4;
+
+void put_u8( std::string& out, uint8_t v ) { out.push_back( static_cast<char>( v ) ); }
+
+void put_le( std::string& out, uint64_t v, size_t bytes )
+{
+	for( size_t i = 0; i < bytes; ++i )
+		put_u8( out, static_cast<uint8_t>( v >> ( 8 * i ) ) );
+}
+
+void put_varint( std::string& out, uint64_t v )
+{
+	while( v >= 0x80 )
+	{
+		put_u8( out, static_cast<uint8_t>( v | 0x80 ) );
+		v >>= 7;
+	}
+	put_u8( out, static_cast<uint8_t>( v ) );
+}
+
+void put_zigzag( std::string& out, int64_t v )
+{
+	put_varint( out,
+	            ( static_cast<uint64_t>( v ) << 1 ) ^ static_cast<uint64_t>( v >> 63 ) );
+}
+
+void put_string( std::string& out, std::string_view s )
+{
+	put_varint( out, s.size() );
+	out.append( s );
+}
+
+// Ids are shifted by one so that none_id takes a single byte
+void put_id( std::string& out, atop::intern::string_id_t id )
+{
+	put_varint( out, id == atop::events::none_id ? 0 : uint64_t{ id } + 1 );
+}
+
+std::string frame( atop::protocol::MessageTypes type, std::string payload )
+{
+	std::string out;
+	out.reserve( header_size + payload.size() );
+	put_le( out, payload.size(), 4 );
+	put_u8( out, static_cast<uint8_t>( type ) );
+	out += payload;
+	return out;
+}
+
+struct Reader
+{
+	std::string_view s;
+	size_t i = 0;
+
+	void need( size_t n ) const
+	{
+		if( this->s.size() - this->i < n )
+			throw std::runtime_error( "Truncated atop protocol message" );
+	}
+
+	uint8_t u8()
+	{
+		this->need( 1 );
+		return static_cast<uint8_t>( this->s[this->i++] );
+	}
+
+	uint64_t le( size_t bytes )
+	{
+		uint64_t v = 0;
+		for( size_t b = 0; b < bytes; ++b )
+			v |= uint64_t{ this->u8() } << ( 8 * b );
+		return v;
+	}
+
+	uint64_t varint()
+	{
+		uint64_t v = 0;
+		for( unsigned shift = 0; shift < 64; shift += 7 )
+		{
+			auto byte = this->u8();
+			v |= uint64_t{ byte & 0x7fu } << shift;
+			if( ( byte & 0x80 ) == 0 )
+				return v;
+		}
+		throw std::runtime_error( "Malformed varint in atop protocol message" );
+	}
+
+	int64_t zigzag()
+	{
+		auto v = this->varint();
+		return static_cast<int64_t>( v >> 1 ) ^ -static_cast<int64_t>( v & 1 );
+	}
+
+	size_t size()
+	{
+		auto n = this->varint();
+		if( n > this->s.size() - this->i )
+			throw std::runtime_error( "Truncated atop protocol message" );
+		return n;
+	}
+
+	std::string string()
+	{
+		auto n = this->size();
+		std::string str( this->s.substr( this->i, n ) );
+		this->i += n;
+		return str;
+	}
+
+	atop::intern::string_id_t id()
+	{
+		auto v = this->varint();
+		if( v == 0 )
+			return atop::events::none_id;
+		if( v > atop::events::none_id )
+			throw std::runtime_error( "String id out of range in atop protocol message" );
+		return static_cast<atop::intern::string_id_t>( v - 1 );
+	}
+};
+} // namespace
+
+std::string atop::protocol::encode_hello()
+{
+	std::string payload;
+	put_le( payload, magic, 4 );
+	put_le( payload, version, 2 );
+	return frame( MessageTypes::hello, std::move( payload ) );
+}
+
+std::string atop::protocol::encode( Update const& u )
+{
+	std::string p;
+	uint8_t flags = ( u.snapshot ? snapshot_flag : 0 )
+	                | ( u.interactions ? interactions_flag : 0 ) | ( u.cpu ? cpu_flag : 0 );
+	put_u8( p, flags );
+
+	put_varint( p, u.strings.size() );
+	for( auto&& s: u.strings )
+	{
+		put_u8( p, static_cast<uint8_t>( s.col ) );
+		put_varint( p, s.id );
+		put_string( p, s.name );
+	}
+
+	put_varint( p, u.events.size() );
+	util::nanoseconds_t prev_ts = 0;
+	for( auto&& e: u.events )
+	{
+		put_zigzag( p, static_cast<int64_t>( e.ts_ns - prev_ts ) );
+		prev_ts = e.ts_ns;
+		put_zigzag( p, e.pid );
+		put_zigzag( p, e.tid );
+		put_id( p, e.app );
+		put_id( p, e.dev );
+		put_id( p, e.cmd );
+		put_varint( p, e.duration_ns );
+		put_u8( p, static_cast<uint8_t>( e.kind ) );
+	}
+
+	if( u.interactions )
+	{
+		put_varint( p, u.interactions->size() );
+		for( auto&& [name, count]: *u.interactions )
+		{
+			put_string( p, name );
+			put_zigzag( p, count );
+		}
+	}
+
+	if( u.cpu )
+	{
+		put_varint( p, u.cpu->size() );
+		for( auto&& [name, util]: *u.cpu )
+		{
+			put_string( p, name );
+			put_zigzag( p, std::llround( util * 100.0 ) );
+		}
+	}
+
+	put_varint( p, u.log_lines.size() );
+	for( auto&& line: u.log_lines )
+		put_string( p, line );
+
+	return frame( MessageTypes::update, std::move( p ) );
+}
+
+std::vector<atop::protocol::NewString> atop::protocol::new_strings( std::vector<size_t>& known )
+{
+	std::vector<NewString> out;
+	known.resize( 3, 0 );
+	for( auto col: { events::IdColumns::app, events::IdColumns::dev, events::IdColumns::cmd } )
+	{
+		auto& names = events::interner( col );
+		auto& sent  = known[static_cast<size_t>( col )];
+		auto size   = names.size();
+		for( auto id = sent; id < size; ++id )
+		{
+			auto sid = static_cast<intern::string_id_t>( id );
+			out.push_back( NewString{ col, sid, std::string( names.name( sid ) ) } );
+		}
+		sent = size;
+	}
+	return out;
+}
+
+size_t atop::protocol::add_events( Update& u, events::EventStore const& store, size_t from,
+                                  std::vector<size_t>& known )
+{
+	auto next = store.scan( from, [&u]( events::Event const& e ) { u.events.push_back( e ); } );
+	auto strings = new_strings( known );
+	u.strings.insert( u.strings.end(), strings.begin(), strings.end() );
+	return next;
+}
+
+void atop::protocol::Decoder::feed( char const* data, size_t size )
+{
+	// Drop consumed frames before the buffer grows
+	if( this->pos > 0 && this->pos >= this->buf.size() / 2 )
+	{
+		this->buf.erase( 0, this->pos );
+		this->pos = 0;
+	}
+	this->buf.append( data, size );
+}
+
+bool atop::protocol::Decoder::next( Update& out )
+{
+	for( ;; )
+	{
+		Reader header{ std::string_view( this->buf ).substr( this->pos ) };
+		if( header.s.size() < header_size )
+			return false;
+
+		auto size = header.le( 4 );
+		auto type = header.u8();
+		if( size > max_payload )
+			throw std::runtime_error(
+			    fmt::format( "atop protocol message of {0} bytes exceeds the limit", size ) );
+		if( header.s.size() - header_size < size )
+			return false;
+
+		Reader r{ header.s.substr( header_size, size ) };
+		this->pos += header_size + size;
+
+		if( type == static_cast<uint8_t>( MessageTypes::hello ) )
+		{
+			auto m = r.le( 4 );
+			auto v = r.le( 2 );
+			if( m != magic )
+				throw std::runtime_error( "Peer doesn't speak the atop protocol" );
+			if( v != version )
+				throw std::runtime_error( fmt::format(
+				    "atop protocol version {0} of the collector is not supported (expected {1})", v,
+				    version ) );
+			this->hello_seen = true;
+			continue;
+		}
+		if( type != static_cast<uint8_t>( MessageTypes::update ) )
+			throw std::runtime_error( fmt::format( "Unknown atop protocol message {0}", type ) );
+		if( !this->hello_seen )
+			throw std::runtime_error( "atop protocol update before hello" );
+
+		Update u;
+		auto flags = r.u8();
+		u.snapshot = flags & snapshot_flag;
+
+		for( auto n = r.size(); n > 0; --n )
+		{
+			auto col = r.u8();
+			if( col > static_cast<uint8_t>( events::IdColumns::cmd ) )
+				throw std::runtime_error( "Unknown column in atop protocol message" );
+			auto id = r.varint();
+			if( id >= events::none_id )
+				throw std::runtime_error( "String id out of range in atop protocol message" );
+			NewString s{ static_cast<events::IdColumns>( col ),
+				         static_cast<intern::string_id_t>( id ), r.string() };
+			u.strings.push_back( std::move( s ) );
+		}
+
+		util::nanoseconds_t ts = 0;
+		for( auto n = r.size(); n > 0; --n )
+		{
+			events::Event e;
+			ts += static_cast<util::nanoseconds_t>( r.zigzag() );
+			e.ts_ns       = ts;
+			e.pid         = static_cast<int32_t>( r.zigzag() );
+			e.tid         = static_cast<int32_t>( r.zigzag() );
+			e.app         = r.id();
+			e.dev         = r.id();
+			e.cmd         = r.id();
+			e.duration_ns = r.varint();
+			auto kind     = r.u8();
+			if( kind > static_cast<uint8_t>( events::EventKinds::info ) )
+				throw std::runtime_error( "Unknown event kind in atop protocol message" );
+			e.kind = static_cast<events::EventKinds>( kind );
+			u.events.push_back( e );
+		}
+
+		if( flags & interactions_flag )
+		{
+			u.interactions.emplace();
+			for( auto n = r.size(); n > 0; --n )
+			{
+				auto name                 = r.string();
+				( *u.interactions )[name] = static_cast<int>( r.zigzag() );
+			}
+		}
+
+		if( flags & cpu_flag )
+		{
+			u.cpu.emplace();
+			for( auto n = r.size(); n > 0; --n )
+			{
+				auto name        = r.string();
+				( *u.cpu )[name] = static_cast<double>( r.zigzag() ) / 100.0;
+			}
+		}
+
+		for( auto n = r.size(); n > 0; --n )
+			u.log_lines.push_back( r.string() );
+
+		out = std::move( u );
+		return true;
+	}
+}
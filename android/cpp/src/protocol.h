@@ -0,0 +1,122 @@
+#ifndef PROTOCOL_H_IN
+#define PROTOCOL_H_IN
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "events.h"
+#include "intern.h"
+
+namespace atop
+{
+namespace protocol
+{
+// Binary protocol between the collector and its viewers
+//
+// A connection is a sequence of frames
+//
+//     <u32 payload size> <u8 message type> <payload>
+//
+// with integers in little endian. The collector first sends a hello frame
+// (magic "ATOP" and the protocol version), followed by an update holding
+// a snapshot of its state and then by delta updates. Viewers only read.
+//
+// Updates are encoded with LEB128 varints: interned strings are sent once
+// as dictionary entries and referenced by id, event timestamps are delta
+// coded and signed values are zigzag coded. An IOCTL event typically takes
+// 10-12 bytes.
+
+constexpr uint32_t magic   = 0x504f5441; // "ATOP"
+constexpr uint16_t version = 1;
+
+// Upper bound of payload sizes accepted by decoders
+constexpr uint32_t max_payload = 64 * 1024 * 1024;
+
+// Events per update; an event takes at most 46 bytes, so updates of this
+// many events stay well below max_payload
+constexpr size_t max_update_events = max_payload / 64;
+
+enum class MessageTypes : uint8_t
+{
+	hello  = 1,
+	update = 2
+};
+
+// Dictionary entry of an interned column
+struct NewString
+{
+	events::IdColumns col;
+	intern::string_id_t id;
+	std::string name;
+};
+
+struct Update
+{
+	// Replaces the state of the viewer instead of adding to it
+	bool snapshot = false;
+
+	std::vector<NewString> strings{};
+
+	// Ids are those of the dictionary entries
+	std::vector<events::Event> events{};
+
+	// Latest accelerator interactions and CPU utilizations (percent with
+	// a resolution of 0.01) if they changed
+	std::optional<std::map<std::string, int>> interactions{};
+	std::optional<std::map<std::string, double>> cpu{};
+
+	// Driver and logcat lines for the log view
+	std::vector<std::string> log_lines{};
+
+	bool empty() const
+	{
+		return !this->snapshot && this->strings.empty() && this->events.empty()
+		       && !this->interactions && !this->cpu && this->log_lines.empty();
+	}
+};
+
+std::string encode_hello();
+std::string encode( Update const& u );
+
+// Dictionary entries of the strings interned since the last call;
+// known holds the number of strings sent per column
+std::vector<NewString> new_strings( std::vector<size_t>& known );
+
+// Adds the rows of store from index from on to u, along with the strings
+// interned since the last call. Returns the index one past the last row.
+//
+// Rows are taken before the strings: a row's strings are interned before
+// it is appended, so every row added references strings already sent or
+// sent in u, even while other threads parse and append.
+size_t add_events( Update& u, events::EventStore const& store, size_t from,
+                   std::vector<size_t>& known );
+
+// Splits a byte stream into updates
+class Decoder
+{
+  public:
+	Decoder() = default;
+
+	void feed( char const* data, size_t size );
+
+	// Returns false until a complete update is buffered. Throws on
+	// malformed frames and on a hello of another protocol version.
+	bool next( Update& out );
+
+	bool greeted() const { return this->hello_seen; }
+
+  private:
+	std::string buf{};
+	size_t pos = 0;
+	bool hello_seen = false;
+};
+
+} // namespace protocol
+} // namespace atop
+
+#endif // PROTOCOL_H_IN
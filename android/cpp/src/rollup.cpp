@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "rollup.h"
+
+namespace
+{
+atop::rollup::Bucket empty_bucket( atop::util::nanoseconds_t t0_ns )
+{
+	return { t0_ns, 0, std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(),
+		     0.0 };
+}
+} // namespace
+
+double atop::rollup::Bucket::mean() const
+{
+	return this->count > 0 ? this->sum / static_cast<double>( this->count ) : 0.0;
+}
+
+void atop::rollup::Bucket::add( double value )
+{
+	this->count++;
+	this->min = std::min( this->min, value );
+	this->max = std::max( this->max, value );
+	this->sum += value;
+}
+
+void atop::rollup::Bucket::merge( Bucket const& other )
+{
+	this->count += other.count;
+	this->min = std::min( this->min, other.min );
+	this->max = std::max( this->max, other.max );
+	this->sum += other.sum;
+}
+
+atop::rollup::Series::Series()
+    : raw()
+    , raw_retained_ns( 0 )
+    , rings()
+    , samples( 0 )
+{
+	for( auto&& r: this->rings )
+		r = Ring{ {}, empty_bucket( 0 ), 0 };
+}
+
+void atop::rollup::Series::add( util::nanoseconds_t ts_ns, double value )
+{
+	this->samples++;
+
+	// Raw samples are kept in time order
+	auto pos = std::upper_bound(
+	    this->raw.begin(), this->raw.end(), ts_ns,
+	    []( util::nanoseconds_t ts, Sample const& s ) { return ts < s.ts_ns; } );
+	this->raw.insert( pos, Sample{ ts_ns, value } );
+
+	auto newest = this->raw.back().ts_ns;
+	while( this->raw.size() > raw_capacity
+	       || ( !this->raw.empty() && this->raw.front().ts_ns + raw_window_ns < newest ) )
+	{
+		this->raw.pop_front();
+		this->raw_retained_ns = this->raw.empty() ? newest : this->raw.front().ts_ns;
+	}
+
+	for( size_t l = 0; l < levels.size(); ++l )
+	{
+		auto& r  = this->rings[l];
+		auto res = levels[l].resolution_ns;
+		auto t0  = ts_ns - ts_ns % res;
+
+		if( r.open.count == 0 || t0 == r.open.t0_ns )
+		{
+			if( r.open.count == 0 )
+				r.open = empty_bucket( t0 );
+			r.open.add( value );
+			continue;
+		}
+
+		if( t0 < r.open.t0_ns )
+		{
+			// Late sample of a closed bucket
+			auto it = std::find_if( r.closed.rbegin(), r.closed.rend(),
+			                        [t0]( Bucket const& b ) { return b.t0_ns <= t0; } );
+			if( it != r.closed.rend() && it->t0_ns == t0 )
+				it->add( value );
+			continue;
+		}
+
+		r.closed.push_back( r.open );
+		if( r.closed.size() > levels[l].capacity )
+		{
+			r.closed.pop_front();
+			r.retained_ns = r.closed.front().t0_ns;
+		}
+		r.open = empty_bucket( t0 );
+		r.open.add( value );
+	}
+}
+
+atop::rollup::Range atop::rollup::Series::query( util::nanoseconds_t t0_ns,
+                                                 util::nanoseconds_t t1_ns,
+                                                 size_t max_points ) const
+{
+	Range out{ 0, {} };
+	if( t1_ns <= t0_ns )
+		return out;
+
+	// Raw samples if they go back far enough and aren't too many
+	if( this->raw_retained_ns <= t0_ns )
+	{
+		auto first = std::lower_bound(
+		    this->raw.begin(), this->raw.end(), t0_ns,
+		    []( Sample const& s, util::nanoseconds_t ts ) { return s.ts_ns < ts; } );
+		auto last = std::lower_bound(
+		    first, this->raw.end(), t1_ns,
+		    []( Sample const& s, util::nanoseconds_t ts ) { return s.ts_ns < ts; } );
+		if( static_cast<size_t>( std::distance( first, last ) ) <= max_points )
+		{
+			for( auto it = first; it != last; ++it )
+				out.buckets.push_back( { it->ts_ns, 1, it->value, it->value, it->value } );
+			return out;
+		}
+	}
+
+	size_t l = 0;
+	while( l + 1 < levels.size()
+	       && ( ( t1_ns - t0_ns ) / levels[l].resolution_ns > max_points
+	            || this->rings[l].retained_ns > t0_ns ) )
+		++l;
+
+	auto const& r     = this->rings[l];
+	out.resolution_ns = levels[l].resolution_ns;
+	auto overlaps     = [&]( Bucket const& b ) {
+		return b.count > 0 && b.t0_ns + out.resolution_ns > t0_ns && b.t0_ns < t1_ns;
+	};
+
+	auto first = std::lower_bound( r.closed.begin(), r.closed.end(), t0_ns,
+	                               [&out]( Bucket const& b, util::nanoseconds_t ts ) {
+		                               return b.t0_ns + out.resolution_ns <= ts;
+	                               } );
+	for( auto it = first; it != r.closed.end() && it->t0_ns < t1_ns; ++it )
+		out.buckets.push_back( *it );
+	if( overlaps( r.open ) )
+		out.buckets.push_back( r.open );
+
+	return out;
+}
+
+atop::rollup::Bucket atop::rollup::Series::summary( util::nanoseconds_t t0_ns,
+                                                    util::nanoseconds_t t1_ns ) const
+{
+	constexpr size_t points = 64;
+
+	auto total = empty_bucket( t0_ns );
+	for( auto&& b: this->query( t0_ns, t1_ns, points ).buckets )
+		total.merge( b );
+	return total;
+}
+
+void atop::rollup::Store::add( std::string const& label, util::nanoseconds_t ts_ns,
+                               double value )
+{
+	this->series[label].add( ts_ns, value );
+}
+
+atop::rollup::Series const* atop::rollup::Store::find( std::string const& label ) const
+{
+	auto it = this->series.find( label );
+	return it != this->series.end() ? &it->second : nullptr;
+}
+
+std::vector<std::string> atop::rollup::Store::labels() const
+{
+	std::vector<std::string> out;
+	for( auto&& kv: this->series )
+		out.push_back( kv.first );
+	return out;
+}
@@ -0,0 +1,127 @@
+#ifndef ROLLUP_H_IN
+#define ROLLUP_H_IN
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace rollup
+{
+// Multi-resolution time series of sampled values
+//
+// A series keeps its raw samples of the last raw_window_ns and, for
+// each of the levels below, min/max/sum/count buckets of a fixed
+// resolution in a ring of fixed capacity. Every sample is added to the
+// open bucket of each level, so levels don't depend on each other and
+// memory per series is bounded by the capacities. Queries pick the
+// finest resolution that covers the requested window with at most the
+// requested number of points, so charts of hours-long sessions read a
+// few hundred buckets instead of all samples. Not thread-safe.
+
+struct Level
+{
+	util::nanoseconds_t resolution_ns;
+	size_t capacity;
+};
+
+// 1 s for an hour, 10 s for 6 hours and 1 min for a day
+constexpr std::array<Level, 3> levels = { { { util::ns_per_s, 3600 },
+	                                        { 10 * util::ns_per_s, 2160 },
+	                                        { 60 * util::ns_per_s, 1440 } } };
+
+constexpr util::nanoseconds_t raw_window_ns = 60 * util::ns_per_s;
+constexpr size_t raw_capacity               = 4096;
+
+struct Bucket
+{
+	util::nanoseconds_t t0_ns;
+	uint64_t count;
+	double min;
+	double max;
+	double sum;
+
+	// 0 for empty buckets
+	double mean() const;
+	void add( double value );
+	void merge( Bucket const& other );
+};
+
+// Buckets of a query in time order; raw samples are returned as buckets
+// of a single sample with resolution_ns 0
+struct Range
+{
+	util::nanoseconds_t resolution_ns;
+	std::vector<Bucket> buckets;
+};
+
+class Series
+{
+  public:
+	Series();
+
+	// Samples older than the open buckets are only added to buckets
+	// still retained
+	void add( util::nanoseconds_t ts_ns, double value );
+
+	// Buckets overlapping [t0_ns, t1_ns) of the finest resolution that
+	// yields at most max_points buckets and still retains t0_ns. Falls
+	// back to the coarsest level.
+	Range query( util::nanoseconds_t t0_ns, util::nanoseconds_t t1_ns, size_t max_points ) const;
+
+	// Aggregate of [t0_ns, t1_ns) at the resolution of a query of a few
+	// points, i.e. including samples of buckets overlapping the window
+	Bucket summary( util::nanoseconds_t t0_ns, util::nanoseconds_t t1_ns ) const;
+
+	uint64_t count() const { return this->samples; }
+
+  private:
+	struct Ring
+	{
+		std::deque<Bucket> closed;
+		Bucket open;
+
+		// Start of the oldest bucket retained, 0 while nothing was evicted
+		util::nanoseconds_t retained_ns;
+	};
+
+	struct Sample
+	{
+		util::nanoseconds_t ts_ns;
+		double value;
+	};
+
+	std::deque<Sample> raw;
+	util::nanoseconds_t raw_retained_ns;
+	std::array<Ring, levels.size()> rings;
+	uint64_t samples;
+};
+
+// Series by label
+class Store
+{
+  public:
+	Store() = default;
+
+	void add( std::string const& label, util::nanoseconds_t ts_ns, double value );
+
+	// nullptr if nothing was added for label
+	Series const* find( std::string const& label ) const;
+
+	std::vector<std::string> labels() const;
+
+  private:
+	std::map<std::string, Series> series{};
+};
+
+} // namespace rollup
+} // namespace atop
+
+#endif // ROLLUP_H_IN
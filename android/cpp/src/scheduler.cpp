@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <fmt/format.h>
+
+#include "logger.h"
+#include "scheduler.h"
+
+atop::scheduler::Scheduler::Scheduler( int workers_ )
+    : mtx()
+    , wake()
+    , sources()
+    , epoch( clock::now() )
+    , changed( false )
+    , stopping( false )
+    , workers( workers_ )
+    , thread()
+{
+}
+
+atop::scheduler::Scheduler::~Scheduler() { this->stop(); }
+
+atop::scheduler::Scheduler::source_id_t
+atop::scheduler::Scheduler::add( std::string const& name, std::chrono::nanoseconds period,
+                                 sample_fn_t fn )
+{
+	if( period <= std::chrono::nanoseconds::zero() )
+		throw std::runtime_error( fmt::format( "Period of source '{0}' has to be positive", name ) );
+
+	std::lock_guard<std::mutex> lock( this->mtx );
+	this->sources.push_back(
+	    Source{ name, period, std::move( fn ), this->epoch, false, 0, 0, {}, 0 } );
+	this->changed = true;
+	this->wake.notify_one();
+	return this->sources.size() - 1;
+}
+
+atop::scheduler::Scheduler::clock::time_point
+atop::scheduler::Scheduler::next_deadline( std::chrono::nanoseconds period,
+                                           clock::time_point t ) const
+{
+	if( t < this->epoch )
+		return this->epoch;
+	return this->epoch + ( ( t - this->epoch ) / period + 1 ) * period;
+}
+
+void atop::scheduler::Scheduler::set_period( source_id_t id, std::chrono::nanoseconds period )
+{
+	if( period <= std::chrono::nanoseconds::zero() )
+		throw std::runtime_error( "Sampling period has to be positive" );
+
+	std::lock_guard<std::mutex> lock( this->mtx );
+	auto& s  = this->sources.at( id );
+	s.period = period;
+	s.next   = this->next_deadline( period, clock::now() );
+	this->changed = true;
+	this->wake.notify_one();
+}
+
+std::chrono::nanoseconds atop::scheduler::Scheduler::period( source_id_t id ) const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return this->sources.at( id ).period;
+}
+
+void atop::scheduler::Scheduler::start()
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	if( this->thread.joinable() || this->stopping )
+		return;
+
+	// Sources sample right away and then on multiples of their period
+	this->epoch = clock::now();
+	for( auto&& s: this->sources )
+		s.next = this->epoch;
+
+	this->thread = std::thread( [this]() { this->run(); } );
+}
+
+void atop::scheduler::Scheduler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		this->stopping = true;
+	}
+	this->wake.notify_one();
+
+	if( this->thread.joinable() )
+		this->thread.join();
+
+	// Wait for runs in flight
+	this->workers.stop( true );
+}
+
+void atop::scheduler::Scheduler::run()
+{
+	std::unique_lock<std::mutex> lock( this->mtx );
+	while( !this->stopping )
+	{
+		auto earliest = clock::time_point::max();
+		for( auto&& s: this->sources )
+			earliest = std::min( earliest, s.next );
+
+		this->changed = false;
+		auto woken    = [this]() { return this->stopping || this->changed; };
+		if( earliest == clock::time_point::max() )
+		{
+			this->wake.wait( lock, woken );
+			continue;
+		}
+		if( this->wake.wait_until( lock, earliest, woken ) )
+			continue;
+
+		auto now = clock::now();
+		for( size_t i = 0; i < this->sources.size(); ++i )
+		{
+			auto& s = this->sources[i];
+			if( s.next > now )
+				continue;
+
+			auto scheduled = s.next;
+			s.next         = this->next_deadline( s.period, now );
+			if( s.running )
+			{
+				s.overruns++;
+				continue;
+			}
+
+			s.running = true;
+			s.jitter.push_back( static_cast<util::nanoseconds_t>(
+			    std::chrono::duration_cast<std::chrono::nanoseconds>( now - scheduled ).count() ) );
+			if( s.jitter.size() > jitter_window )
+				s.jitter.pop_front();
+
+			// Sources may be added while a run is in flight; the worker only
+			// touches the source list under the lock
+			this->workers.push( [this, i, scheduled, fn = s.fn, name = s.name]( int ) {
+				auto t0 = clock::now();
+				try
+				{
+					fn( scheduled );
+				}
+				catch( std::exception const& e )
+				{
+					atop::logger::warn(
+					    fmt::format( "Sampling '{0}' failed: {1}", name, e.what() ) );
+				}
+				auto took
+				    = std::chrono::duration_cast<std::chrono::nanoseconds>( clock::now() - t0 );
+
+				std::lock_guard<std::mutex> guard( this->mtx );
+				auto& done       = this->sources[i];
+				done.running     = false;
+				done.runs++;
+				done.last_run_ns = static_cast<util::nanoseconds_t>( took.count() );
+			} );
+		}
+	}
+}
+
+std::vector<atop::scheduler::Scheduler::SourceStats> atop::scheduler::Scheduler::stats() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	std::vector<SourceStats> result;
+	result.reserve( this->sources.size() );
+	for( auto&& s: this->sources )
+	{
+		SourceStats st{ s.name, s.period, s.runs, s.overruns, {}, s.last_run_ns };
+		for( auto j: s.jitter )
+			st.jitter.add( j );
+		result.push_back( std::move( st ) );
+	}
+	return result;
+}
+
+atop::scheduler::AdaptivePeriod::AdaptivePeriod( std::chrono::nanoseconds initial,
+                                                 AdaptiveOptions const& opts_ )
+    : opts( opts_ )
+    , current( std::clamp( initial, opts_.min, opts_.max ) )
+{
+	if( opts_.min <= std::chrono::nanoseconds::zero() || opts_.min > opts_.max )
+		throw std::runtime_error( "Adaptive period bounds have to be positive and ordered" );
+	if( opts_.target_fill <= 0.0 || opts_.target_fill > 1.0 || opts_.backoff <= 1.0 )
+		throw std::runtime_error( "Invalid adaptive period parameters" );
+}
+
+std::chrono::nanoseconds atop::scheduler::AdaptivePeriod::update( double fill, bool active,
+                                                                  bool wrapped )
+{
+	auto scaled = [this]( double factor ) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		    std::chrono::duration<double, std::nano>( static_cast<double>( this->current.count() )
+		                                              * factor ) );
+	};
+
+	if( wrapped )
+		this->current = this->opts.min;
+	else if( !active || fill <= 0.0 )
+		this->current = scaled( this->opts.backoff );
+	else
+		this->current = scaled( std::min( this->opts.target_fill / fill, this->opts.backoff ) );
+
+	this->current = std::clamp( this->current, this->opts.min, this->opts.max );
+	return this->current;
+}
@@ -0,0 +1,143 @@
+#ifndef SCHEDULER_H_IN
+#define SCHEDULER_H_IN
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ctpl.h"
+#include "stats.h"
+#include "util.h"
+
+namespace atop
+{
+namespace scheduler
+{
+// Periodic sampling of several sources by one scheduler thread
+//
+// Each source runs at multiples of its period from the start of the
+// scheduler, so sources with commensurate periods sample at the same
+// instants and late runs don't shift later ones. The scheduler waits on
+// a condition variable for the earliest deadline; period changes and
+// stop() wake it immediately. Due sources run on a small worker pool so
+// that a slow source (e.g. an adb round trip) doesn't delay the others.
+// A source that is still running when it is due again skips that period
+// (an overrun).
+//
+// Scheduling jitter, the delay between a run's deadline and its start,
+// is kept for the last jitter_window runs of each source.
+class Scheduler
+{
+  public:
+	using clock         = std::chrono::steady_clock;
+	using source_id_t   = size_t;
+	using sample_fn_t   = std::function<void( clock::time_point scheduled )>;
+
+	static constexpr size_t jitter_window = 256;
+
+	explicit Scheduler( int workers = 4 );
+	~Scheduler();
+	Scheduler( Scheduler const& ) = delete;
+	Scheduler( Scheduler&& )      = delete;
+
+	source_id_t add( std::string const& name, std::chrono::nanoseconds period, sample_fn_t fn );
+
+	// Takes effect at the next multiple of the new period
+	void set_period( source_id_t id, std::chrono::nanoseconds period );
+	std::chrono::nanoseconds period( source_id_t id ) const;
+
+	void start();
+
+	// Returns without waiting for a deadline; runs in flight are finished
+	void stop();
+
+	struct SourceStats
+	{
+		std::string name;
+		std::chrono::nanoseconds period;
+		uint64_t runs;
+		uint64_t overruns;
+
+		// Nanoseconds of the last jitter_window runs
+		stats::Samples jitter;
+
+		// Duration of the last run
+		util::nanoseconds_t last_run_ns;
+	};
+
+	std::vector<SourceStats> stats() const;
+
+  private:
+	struct Source
+	{
+		std::string name;
+		std::chrono::nanoseconds period;
+		sample_fn_t fn;
+		clock::time_point next;
+		bool running;
+		uint64_t runs;
+		uint64_t overruns;
+		std::deque<util::nanoseconds_t> jitter;
+		util::nanoseconds_t last_run_ns;
+	};
+
+	// First multiple of period after the start that is later than t
+	clock::time_point next_deadline( std::chrono::nanoseconds period, clock::time_point t ) const;
+
+	void run();
+
+	mutable std::mutex mtx;
+	std::condition_variable wake;
+	std::vector<Source> sources;
+	clock::time_point epoch;
+	bool changed;
+	bool stopping;
+
+	ctpl::thread_pool workers;
+	std::thread thread;
+};
+
+// Poll period of a source that buffers between polls (e.g. the kernel
+// ring of dmesg)
+//
+// While the source is active the period is chosen so that about
+// target_fill of the buffer is written between polls: it shrinks as the
+// observed fill grows and grows by at most backoff per poll. While the
+// source is quiet the period backs off exponentially. A wrapped buffer
+// resets the period to the minimum.
+struct AdaptiveOptions
+{
+	std::chrono::nanoseconds min = std::chrono::milliseconds( 500 );
+	std::chrono::nanoseconds max = std::chrono::seconds( 8 );
+	double target_fill           = 0.25;
+	double backoff               = 2.0;
+};
+
+class AdaptivePeriod
+{
+  public:
+	explicit AdaptivePeriod( std::chrono::nanoseconds initial,
+	                         AdaptiveOptions const& opts = AdaptiveOptions() );
+
+	// fill is the fraction of the buffer written since the last poll and
+	// active whether the poll returned events of interest. Returns the
+	// next period.
+	std::chrono::nanoseconds update( double fill, bool active, bool wrapped );
+	std::chrono::nanoseconds period() const { return this->current; }
+
+  private:
+	AdaptiveOptions opts;
+	std::chrono::nanoseconds current;
+};
+
+} // namespace scheduler
+} // namespace atop
+
+#endif // SCHEDULER_H_IN
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "selfprof.h"
+
+namespace
+{
+struct Registry
+{
+	std::mutex mtx{};
+
+	// Map nodes don't move, so references to the metrics stay valid
+	std::map<std::string, atop::selfprof::Timer> timers{};
+	std::map<std::string, atop::selfprof::Counter> counters{};
+	std::map<std::string, atop::selfprof::Gauge> gauges{};
+};
+
+Registry& registry()
+{
+	static Registry r;
+	return r;
+}
+
+template<typename Metric_t>
+Metric_t& find_or_create( std::map<std::string, Metric_t>& metrics, std::string const& name )
+{
+	std::lock_guard<std::mutex> lock( registry().mtx );
+	return metrics.try_emplace( name ).first->second;
+}
+} // namespace
+
+void atop::selfprof::Timer::record( util::nanoseconds_t ns )
+{
+	this->n.fetch_add( 1, std::memory_order_relaxed );
+	this->total.fetch_add( ns, std::memory_order_relaxed );
+	this->last.store( ns, std::memory_order_relaxed );
+
+	auto prev = this->max.load( std::memory_order_relaxed );
+	while( ns > prev && !this->max.compare_exchange_weak( prev, ns, std::memory_order_relaxed ) )
+		;
+}
+
+atop::selfprof::ScopedTimer::ScopedTimer( Timer& timer )
+    : target( timer )
+    , start( std::chrono::steady_clock::now() )
+{
+}
+
+atop::selfprof::ScopedTimer::~ScopedTimer()
+{
+	this->target.record( static_cast<util::nanoseconds_t>(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now()
+	                                                          - this->start )
+	        .count() ) );
+}
+
+atop::selfprof::Timer& atop::selfprof::timer( std::string const& name )
+{
+	return find_or_create( registry().timers, name );
+}
+
+atop::selfprof::Counter& atop::selfprof::counter( std::string const& name )
+{
+	return find_or_create( registry().counters, name );
+}
+
+atop::selfprof::Gauge& atop::selfprof::gauge( std::string const& name )
+{
+	return find_or_create( registry().gauges, name );
+}
+
+std::vector<atop::selfprof::Metric> atop::selfprof::snapshot()
+{
+	auto& r = registry();
+	std::vector<Metric> metrics;
+	{
+		std::lock_guard<std::mutex> lock( r.mtx );
+		for( auto&& kv: r.timers )
+			metrics.push_back( { kv.first, Kinds::timer, kv.second.count(), kv.second.total_ns(),
+			                     kv.second.max_ns(), kv.second.last_ns(), 0 } );
+		for( auto&& kv: r.counters )
+			metrics.push_back( { kv.first, Kinds::counter, 0, 0, 0, 0,
+			                     static_cast<int64_t>( kv.second.value() ) } );
+		for( auto&& kv: r.gauges )
+			metrics.push_back( { kv.first, Kinds::gauge, 0, 0, 0, 0, kv.second.value() } );
+	}
+
+	std::sort( metrics.begin(), metrics.end(),
+	           []( Metric const& a, Metric const& b ) { return a.name < b.name; } );
+	return metrics;
+}
+
+std::string atop::selfprof::to_json( std::vector<Metric> const& metrics )
+{
+	// Names are identifiers chosen by atop, so they need no escaping
+	std::string json = "{";
+	for( auto&& m: metrics )
+	{
+		if( json.size() > 1 )
+			json += ", ";
+		if( m.kind == Kinds::timer )
+			json += fmt::format(
+			    R"("{0}": {{"count": {1}, "total_ns": {2}, "max_ns": {3}, "last_ns": {4}}})",
+			    m.name, m.count, m.total_ns, m.max_ns, m.last_ns );
+		else
+			json += fmt::format( R"("{0}": {1})", m.name, m.value );
+	}
+	return json + "}";
+}
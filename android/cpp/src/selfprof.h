@@ -0,0 +1,128 @@
+#ifndef SELFPROF_H_IN
+#define SELFPROF_H_IN
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace selfprof
+{
+// Timers and counters of atop's own pipeline stages
+//
+// Stages look up their metrics by name once (e.g. into a function-local
+// static reference) and update them with relaxed atomics, so a timed
+// scope costs two clock reads and a few atomic adds. Names are
+// "<stage>.<what>", e.g. "adb.command" or "dmesg.regex". snapshot() reads
+// all of them for the "Self" panel and the JSON dump, which tell apart
+// time spent waiting for the device, in transport and in parsing.
+
+class Timer
+{
+  public:
+	Timer() = default;
+
+	void record( util::nanoseconds_t ns );
+
+	uint64_t count() const { return this->n.load( std::memory_order_relaxed ); }
+	util::nanoseconds_t total_ns() const { return this->total.load( std::memory_order_relaxed ); }
+	util::nanoseconds_t max_ns() const { return this->max.load( std::memory_order_relaxed ); }
+	util::nanoseconds_t last_ns() const { return this->last.load( std::memory_order_relaxed ); }
+
+  private:
+	std::atomic<uint64_t> n{ 0 };
+	std::atomic<util::nanoseconds_t> total{ 0 };
+	std::atomic<util::nanoseconds_t> max{ 0 };
+	std::atomic<util::nanoseconds_t> last{ 0 };
+};
+
+// Monotonic count, e.g. of lines or bytes
+class Counter
+{
+  public:
+	Counter() = default;
+
+	void add( uint64_t delta ) { this->n.fetch_add( delta, std::memory_order_relaxed ); }
+	uint64_t value() const { return this->n.load( std::memory_order_relaxed ); }
+
+  private:
+	std::atomic<uint64_t> n{ 0 };
+};
+
+// Current level, e.g. of a queue
+class Gauge
+{
+  public:
+	Gauge() = default;
+
+	void set( int64_t value ) { this->v.store( value, std::memory_order_relaxed ); }
+	int64_t value() const { return this->v.load( std::memory_order_relaxed ); }
+
+  private:
+	std::atomic<int64_t> v{ 0 };
+};
+
+// Records the lifetime of the scope into a timer
+class ScopedTimer
+{
+  public:
+	explicit ScopedTimer( Timer& timer );
+	~ScopedTimer();
+	ScopedTimer( ScopedTimer const& ) = delete;
+	ScopedTimer( ScopedTimer&& )      = delete;
+
+  private:
+	Timer& target;
+	std::chrono::steady_clock::time_point start;
+};
+
+// Returns fn() and records its duration into timer
+template<typename Fn> auto timed( Timer& timer, Fn&& fn )
+{
+	ScopedTimer t( timer );
+	return fn();
+}
+
+// Process-wide metrics, created on first use; references stay valid
+Timer& timer( std::string const& name );
+Counter& counter( std::string const& name );
+Gauge& gauge( std::string const& name );
+
+enum class Kinds
+{
+	timer,
+	counter,
+	gauge
+};
+
+struct Metric
+{
+	std::string name;
+	Kinds kind;
+
+	// Timers
+	uint64_t count;
+	util::nanoseconds_t total_ns;
+	util::nanoseconds_t max_ns;
+	util::nanoseconds_t last_ns;
+
+	// Counters and gauges
+	int64_t value;
+};
+
+// All metrics sorted by name
+std::vector<Metric> snapshot();
+
+// {"<name>": {"count": .., "total_ns": .., "max_ns": .., "last_ns": ..},
+//  "<name>": <value>, ...}
+std::string to_json( std::vector<Metric> const& metrics );
+
+} // namespace selfprof
+} // namespace atop
+
+#endif // SELFPROF_H_IN
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "stats.h"
+
+atop::stats::Samples::Samples()
+    : samples()
+    , sorted( true )
+    , total( 0 )
+    , lo( std::numeric_limits<util::nanoseconds_t>::max() )
+    , hi( 0 )
+    , avg( 0.0 )
+    , m2( 0.0 )
+{
+}
+
+void atop::stats::Samples::add( util::nanoseconds_t sample )
+{
+	this->sorted = this->samples.empty() || ( this->sorted && this->samples.back() <= sample );
+	this->samples.push_back( sample );
+
+	this->total += sample;
+	this->lo = std::min( this->lo, sample );
+	this->hi = std::max( this->hi, sample );
+
+	auto x     = static_cast<double>( sample );
+	auto delta = x - this->avg;
+	this->avg += delta / static_cast<double>( this->samples.size() );
+	this->m2 += delta * ( x - this->avg );
+}
+
+void atop::stats::Samples::merge( Samples const& other )
+{
+	if( other.empty() )
+		return;
+	if( this->empty() )
+	{
+		*this = other;
+		return;
+	}
+
+	auto n_a   = static_cast<double>( this->samples.size() );
+	auto n_b   = static_cast<double>( other.samples.size() );
+	auto n     = n_a + n_b;
+	auto delta = other.avg - this->avg;
+	this->avg += delta * n_b / n;
+	this->m2 += other.m2 + delta * delta * n_a * n_b / n;
+
+	this->total += other.total;
+	this->lo = std::min( this->lo, other.lo );
+	this->hi = std::max( this->hi, other.hi );
+
+	this->samples.insert( this->samples.end(), other.samples.begin(), other.samples.end() );
+	this->sorted = false;
+}
+
+void atop::stats::Samples::clear()
+{
+	*this = Samples();
+}
+
+double atop::stats::Samples::variance() const
+{
+	// Sample (unbiased) variance
+	if( this->samples.size() < 2 )
+		return 0.0;
+	return this->m2 / static_cast<double>( this->samples.size() - 1 );
+}
+
+double atop::stats::Samples::stddev() const
+{
+	return std::sqrt( this->variance() );
+}
+
+atop::util::nanoseconds_t atop::stats::Samples::percentile( double p ) const
+{
+	if( this->samples.empty() )
+		throw std::runtime_error( "Percentile of empty sample set" );
+	if( !( p > 0.0 && p <= 100.0 ) )
+		throw std::runtime_error( fmt::format( "Percentile {0} out of range (0, 100]", p ) );
+
+	if( !this->sorted )
+	{
+		std::sort( this->samples.begin(), this->samples.end() );
+		this->sorted = true;
+	}
+
+	auto n    = this->samples.size();
+	auto rank = static_cast<size_t>( std::ceil( p / 100.0 * static_cast<double>( n ) ) );
+	return this->samples[std::min( n, std::max<size_t>( rank, 1 ) ) - 1];
+}
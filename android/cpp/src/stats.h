@@ -0,0 +1,62 @@
+#ifndef STATS_H_IN
+#define STATS_H_IN
+
+#include <cstdint>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace stats
+{
+// Latency samples with streaming moments
+//
+// Count, mean, variance, minimum and maximum are updated on every add()
+// (Welford's algorithm) and combined exactly by merge() (Chan et al.'s
+// pairwise update), so per-process results can be summarised separately
+// and merged afterwards. All samples are kept for exact nearest-rank
+// percentiles; they are sorted lazily on the first percentile query
+// after an update. Not thread-safe.
+class Samples
+{
+  public:
+	Samples();
+
+	void add( util::nanoseconds_t sample );
+	void merge( Samples const& other );
+	void clear();
+
+	size_t count() const { return this->samples.size(); }
+	bool empty() const { return this->samples.empty(); }
+
+	util::nanoseconds_t sum() const { return this->total; }
+	util::nanoseconds_t min() const { return this->lo; }
+	util::nanoseconds_t max() const { return this->hi; }
+
+	// In nanoseconds; 0 if there are no samples
+	double mean() const { return this->avg; }
+	double variance() const;
+	double stddev() const;
+
+	// Nearest-rank percentile, p in (0, 100]; throws if there are no samples
+	util::nanoseconds_t percentile( double p ) const;
+
+	// Insertion order is not preserved across percentile queries
+	std::vector<util::nanoseconds_t> const& values() const { return this->samples; }
+
+  private:
+	mutable std::vector<util::nanoseconds_t> samples;
+	mutable bool sorted;
+
+	util::nanoseconds_t total;
+	util::nanoseconds_t lo;
+	util::nanoseconds_t hi;
+	double avg;
+	double m2; // Sum of squared deviations from the mean
+};
+
+} // namespace stats
+} // namespace atop
+
+#endif // STATS_H_IN
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "logger.h"
+#include "subprocess.h"
+
+extern char** environ;
+
+static std::runtime_error sys_error( std::string const& what )
+{
+	return std::runtime_error( fmt::format( "{0} failed: {1}", what, std::strerror( errno ) ) );
+}
+
+atop::subprocess::Loop::Loop()
+    : mtx()
+    , epoll_fd( epoll_create1( EPOLL_CLOEXEC ) )
+    , wake_fd( eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK ) )
+    , stopping( false )
+    , commands()
+    , thread()
+{
+	if( this->epoll_fd < 0 || this->wake_fd < 0 )
+		throw sys_error( "Creating the subprocess event loop" );
+
+	epoll_event ev{};
+	ev.events  = EPOLLIN;
+	ev.data.fd = this->wake_fd;
+	if( epoll_ctl( this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &ev ) < 0 )
+		throw sys_error( "epoll_ctl" );
+
+	this->thread = std::thread( [this]() { this->io_loop(); } );
+}
+
+atop::subprocess::Loop::~Loop()
+{
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		this->stopping = true;
+	}
+	uint64_t one = 1;
+	if( write( this->wake_fd, &one, sizeof( one ) ) < 0 )
+		std::abort();
+	this->thread.join();
+
+	for( auto&& [fd, c]: this->commands )
+	{
+		kill( -c.pid, SIGKILL );
+		waitpid( c.pid, nullptr, 0 );
+		close( fd );
+		c.result.set_exception( std::make_exception_ptr(
+		    std::runtime_error( "Subprocess loop stopped before the command finished" ) ) );
+	}
+
+	close( this->wake_fd );
+	close( this->epoll_fd );
+}
+
+std::future<atop::subprocess::Result>
+atop::subprocess::Loop::run( std::string const& cmd, std::chrono::milliseconds timeout )
+{
+	std::array<int, 2> fds;
+	if( pipe2( fds.data(), O_CLOEXEC ) < 0 )
+		throw sys_error( "pipe2" );
+
+	// Own process group so that a timeout kills the children of the shell
+	// as well
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t no_signals;
+	sigemptyset( &no_signals );
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_addopen( &actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0 );
+	posix_spawn_file_actions_adddup2( &actions, fds[1], STDOUT_FILENO );
+	posix_spawnattr_init( &attr );
+	posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK );
+	posix_spawnattr_setpgroup( &attr, 0 );
+	posix_spawnattr_setsigmask( &attr, &no_signals );
+
+	std::string sh = "sh", c = "-c", command = cmd;
+	std::array<char*, 4> argv = { sh.data(), c.data(), command.data(), nullptr };
+
+	pid_t pid;
+	int err = posix_spawn( &pid, "/bin/sh", &actions, &attr, argv.data(), environ );
+	posix_spawn_file_actions_destroy( &actions );
+	posix_spawnattr_destroy( &attr );
+	close( fds[1] );
+	if( err != 0 )
+	{
+		close( fds[0] );
+		throw std::runtime_error(
+		    fmt::format( "Could not run '{0}': {1}", cmd, std::strerror( err ) ) );
+	}
+	fcntl( fds[0], F_SETFL, fcntl( fds[0], F_GETFL ) | O_NONBLOCK );
+
+	auto deadline = timeout > no_timeout ? clock::now() + timeout : clock::time_point::max();
+
+	std::future<Result> result;
+	{
+		std::lock_guard<std::mutex> lock( this->mtx );
+		auto& added = this->commands[fds[0]];
+		added.pid       = pid;
+		added.deadline  = deadline;
+		added.timed_out = false;
+		added.closed    = false;
+		result          = added.result.get_future();
+
+		epoll_event ev{};
+		ev.events  = EPOLLIN;
+		ev.data.fd = fds[0];
+		if( epoll_ctl( this->epoll_fd, EPOLL_CTL_ADD, fds[0], &ev ) < 0 )
+		{
+			auto e = sys_error( "epoll_ctl" );
+			kill( -pid, SIGKILL );
+			waitpid( pid, nullptr, 0 );
+			close( fds[0] );
+			this->commands.erase( fds[0] );
+			throw e;
+		}
+	}
+
+	// Wake the loop to account for the new deadline
+	if( deadline != clock::time_point::max() )
+	{
+		uint64_t one = 1;
+		if( write( this->wake_fd, &one, sizeof( one ) ) < 0 )
+			throw sys_error( "Waking the subprocess loop" );
+	}
+
+	return result;
+}
+
+size_t atop::subprocess::Loop::running() const
+{
+	std::lock_guard<std::mutex> lock( this->mtx );
+	return this->commands.size();
+}
+
+int atop::subprocess::Loop::wait_timeout_ms()
+{
+	auto now  = clock::now();
+	auto next = clock::time_point::max();
+	for( auto&& kv: this->commands )
+	{
+		// Exited processes are polled for
+		if( kv.second.closed )
+			return 10;
+		if( !kv.second.timed_out )
+			next = std::min( next, kv.second.deadline );
+	}
+
+	if( next == clock::time_point::max() )
+		return -1;
+	if( next <= now )
+		return 0;
+	return static_cast<int>(
+	    std::chrono::ceil<std::chrono::milliseconds>( next - now ).count() );
+}
+
+void atop::subprocess::Loop::on_readable( int fd, Command& c )
+{
+	std::array<char, 64 * 1024> buf;
+	for( ;; )
+	{
+		auto n = read( fd, buf.data(), buf.size() );
+		if( n > 0 )
+			c.out.append( buf.data(), static_cast<size_t>( n ) );
+		else if( n < 0 && errno == EINTR )
+			continue;
+		else if( n < 0 && errno == EAGAIN )
+			return;
+		else
+			break;
+	}
+
+	// The fd stays open until the command is reaped so that its number,
+	// the key of the command, isn't reused in the meantime
+	epoll_ctl( this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr );
+	c.closed = true;
+}
+
+void atop::subprocess::Loop::reap()
+{
+	auto now = clock::now();
+	for( auto it = this->commands.begin(); it != this->commands.end(); )
+	{
+		auto& c = it->second;
+		if( !c.timed_out && c.deadline <= now )
+		{
+			kill( -c.pid, SIGKILL );
+			c.timed_out = true;
+		}
+
+		int status;
+		if( !c.closed || waitpid( c.pid, &status, WNOHANG ) != c.pid )
+		{
+			++it;
+			continue;
+		}
+
+		Result r;
+		r.out       = std::move( c.out );
+		r.timed_out = c.timed_out;
+		if( WIFEXITED( status ) )
+			r.status = WEXITSTATUS( status );
+		else if( WIFSIGNALED( status ) )
+			r.status = 128 + WTERMSIG( status );
+		c.result.set_value( std::move( r ) );
+
+		close( it->first );
+		it = this->commands.erase( it );
+	}
+}
+
+void atop::subprocess::Loop::io_loop()
+{
+	std::array<epoll_event, 64> events;
+	for( ;; )
+	{
+		int timeout;
+		{
+			std::lock_guard<std::mutex> lock( this->mtx );
+			if( this->stopping )
+				return;
+			timeout = this->wait_timeout_ms();
+		}
+
+		int n = epoll_wait( this->epoll_fd, events.data(), static_cast<int>( events.size() ),
+		                    timeout );
+		if( n < 0 && errno != EINTR )
+			atop::logger::log_and_exit(
+			    fmt::format( "Subprocess loop failed: {0}", std::strerror( errno ) ) );
+
+		std::lock_guard<std::mutex> lock( this->mtx );
+		for( int i = 0; i < n; ++i )
+		{
+			int fd = events[static_cast<size_t>( i )].data.fd;
+			if( fd == this->wake_fd )
+			{
+				uint64_t count;
+				while( read( this->wake_fd, &count, sizeof( count ) ) > 0 )
+					continue;
+				continue;
+			}
+
+			auto it = this->commands.find( fd );
+			if( it != this->commands.end() )
+				this->on_readable( fd, it->second );
+		}
+
+		this->reap();
+	}
+}
+
+atop::subprocess::Loop& atop::subprocess::default_loop()
+{
+	static Loop loop;
+	return loop;
+}
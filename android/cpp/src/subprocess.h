@@ -0,0 +1,91 @@
+#ifndef SUBPROCESS_H_IN
+#define SUBPROCESS_H_IN
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+namespace atop
+{
+namespace subprocess
+{
+// Asynchronous shell commands multiplexed on one I/O thread
+//
+// Commands are run by "/bin/sh -c" like popen(); stdin is /dev/null and
+// stderr is inherited. The stdout pipes of all running commands are
+// watched by a single epoll loop, so any number of commands can run
+// concurrently without a thread per command. Each command resolves a
+// future with its output and exit status. Commands exceeding their timeout
+// are killed together with their children.
+
+struct Result
+{
+	std::string out;
+
+	// Exit code, 128 + signal if the command was killed by a signal
+	int status     = 0;
+	bool timed_out = false;
+
+	bool ok() const { return !this->timed_out && this->status == 0; }
+};
+
+constexpr std::chrono::milliseconds no_timeout{ 0 };
+
+class Loop
+{
+  public:
+	Loop();
+	~Loop();
+	Loop( Loop const& ) = delete;
+	Loop( Loop&& )      = delete;
+
+	// Throws if the command could not be started
+	std::future<Result> run( std::string const& cmd,
+	                         std::chrono::milliseconds timeout = no_timeout );
+
+	size_t running() const;
+
+  private:
+	using clock = std::chrono::steady_clock;
+
+	struct Command
+	{
+		pid_t pid;
+		std::string out;
+		std::promise<Result> result;
+		clock::time_point deadline;
+		bool timed_out;
+
+		// Output closed; waiting for the process to exit
+		bool closed;
+	};
+
+	void io_loop();
+	void on_readable( int fd, Command& c );
+	void reap();
+	int wait_timeout_ms();
+
+	mutable std::mutex mtx;
+	int epoll_fd;
+	int wake_fd;
+	bool stopping;
+
+	// Running commands by the fd of their stdout pipe
+	std::map<int, Command> commands;
+
+	std::thread thread;
+};
+
+// Loop shared by all adb helpers
+Loop& default_loop();
+
+} // namespace subprocess
+} // namespace atop
+
+#endif // SUBPROCESS_H_IN
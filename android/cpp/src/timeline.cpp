@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "events.h"
+#include "intern.h"
+#include "timeline.h"
+#include "util.h"
+
+// Microseconds with nanosecond resolution
+static std::string us( atop::util::nanoseconds_t ns )
+{
+	return fmt::format( "{0}.{1:03}", ns / 1000, ns % 1000 );
+}
+
+bool atop::timeline::parse_time_line( std::string_view line, TimedCall& out )
+{
+	constexpr std::string_view time_prefix = "TIME ";
+
+	size_t i = 0;
+	if( !atop::util::parse_dmesg_ts( line, out.ts_ns, i ) )
+		return false;
+	while( i < line.size() && line[i] == ' ' )
+		++i;
+
+	auto msg = atop::util::trimmed( line.substr( i ) );
+	if( msg.substr( 0, time_prefix.size() ) != time_prefix )
+		return false;
+
+	// The duration follows the last colon
+	auto colon = msg.rfind( ": " );
+	if( colon == std::string_view::npos )
+		return false;
+	size_t j = colon + 2;
+	if( !atop::util::parse_decimal_ns( msg, j, atop::util::ns_per_s, out.duration_ns ) )
+		return false;
+
+	auto what_end = msg.find( ' ', time_prefix.size() );
+	out.name      = std::string(
+        msg.substr( time_prefix.size(), std::min( what_end, colon ) - time_prefix.size() ) );
+
+	// The tag is the text between the last field and the duration
+	auto fields_end = msg.rfind( ')', colon );
+	if( fields_end != std::string_view::npos && fields_end > what_end )
+	{
+		auto tag = atop::util::trimmed( msg.substr( fields_end + 1, colon - fields_end - 1 ) );
+		if( !tag.empty() )
+			out.name += fmt::format( " {0}", tag );
+	}
+
+	out.app = atop::events::none_id;
+	if( auto app = atop::events::field( msg, "(app: " ); !app.empty() )
+		out.app = atop::intern::app_names().intern( app );
+	out.pid = atop::events::pid_field( msg, "(pid: " );
+
+	return true;
+}
+
+std::string atop::timeline::escape_json( std::string_view s )
+{
+	std::string out;
+	out.reserve( s.size() );
+	for( auto c: s )
+	{
+		switch( c )
+		{
+			case '\\': out += "\\\\"; break;
+			case '"': out += "\\\""; break;
+			case '\n': out += "\\n"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if( static_cast<unsigned char>( c ) < 0x20 )
+					out += fmt::format( "\\u{0:04x}", static_cast<unsigned>( c ) );
+				else
+					out += c;
+		}
+	}
+	return out;
+}
+
+atop::timeline::Writer::Writer( std::ostream& os_ )
+    : os( os_ )
+    , closed( false )
+    , records( 0 )
+    , named_pids()
+    , lanes()
+    , event()
+    , call()
+{
+	this->os << "[\n";
+	this->metadata( "process_name", accelerators_pid, 0, "Accelerators" );
+	this->metadata( "process_name", cpu_pid, 0, "CPU" );
+}
+
+atop::timeline::Writer::~Writer()
+{
+	this->close();
+}
+
+void atop::timeline::Writer::close()
+{
+	if( this->closed )
+		return;
+	this->os << "\n]\n";
+	this->os.flush();
+	this->closed = true;
+}
+
+void atop::timeline::Writer::record( std::string const& json )
+{
+	if( this->records > 0 )
+		this->os << ",\n";
+	this->os << json;
+	this->records++;
+}
+
+void atop::timeline::Writer::metadata( char const* what, int32_t pid, int32_t tid,
+                                       std::string_view name )
+{
+	this->record( fmt::format( R"({{"ph":"M","name":"{0}","pid":{1},"tid":{2},)"
+	                           R"("args":{{"name":"{3}"}}}})",
+	                           what, pid, tid, escape_json( name ) ) );
+}
+
+int32_t atop::timeline::Writer::process( int32_t pid, intern::string_id_t app )
+{
+	if( pid == events::no_pid )
+		pid = app == events::none_id ? unknown_app_pid
+		                             : app_pid_base + static_cast<int32_t>( app );
+
+	// Processes are named after the app of their first call reporting one
+	if( this->named_pids.count( pid ) == 0 && ( app != events::none_id || pid >= unknown_app_pid ) )
+	{
+		this->named_pids.insert( pid );
+		this->metadata( "process_name", pid, 0,
+		                app == events::none_id ? "unknown" : intern::app_names().name( app ) );
+	}
+	return pid;
+}
+
+int32_t atop::timeline::Writer::lane( intern::string_id_t dev, util::nanoseconds_t start_ns,
+                                      util::nanoseconds_t end_ns )
+{
+	auto& ends = this->lanes[dev];
+	auto free  = std::find_if( ends.begin(), ends.end(),
+                              [start_ns]( util::nanoseconds_t end ) { return end <= start_ns; } );
+	if( free == ends.end() && ends.size() < max_lanes )
+	{
+		auto const& name = intern::accel_tags().name( dev );
+		ends.push_back( 0 );
+		free = std::prev( ends.end() );
+		this->metadata( "thread_name", accelerators_pid,
+		                static_cast<int32_t>( dev * max_lanes + ends.size() ),
+		                ends.size() == 1 ? std::string( name )
+		                                 : fmt::format( "{0} #{1}", name, ends.size() ) );
+	}
+	else if( free == ends.end() )
+		free = std::prev( ends.end() );
+
+	*free = std::max( *free, end_ns );
+	return static_cast<int32_t>( dev * max_lanes + static_cast<size_t>( free - ends.begin() ) + 1 );
+}
+
+void atop::timeline::Writer::add( events::Event const& e )
+{
+	auto pid  = this->process( e.pid, e.app );
+	auto tid  = e.tid != events::no_pid ? e.tid : pid;
+	auto name = escape_json( e.cmd != events::none_id ? intern::ioctl_cmds().name( e.cmd )
+	                                                  : std::string_view( "ioctl" ) );
+
+	std::string args;
+	if( e.app != events::none_id )
+		args = fmt::format( R"("app":"{0}")", escape_json( intern::app_names().name( e.app ) ) );
+
+	if( e.kind == events::EventKinds::info )
+	{
+		this->record( fmt::format( R"({{"ph":"i","s":"t","cat":"info","name":"{0}",)"
+		                           R"("pid":{1},"tid":{2},"ts":{3},"args":{{{4}}}}})",
+		                           name, pid, tid, us( e.ts_ns ), args ) );
+		return;
+	}
+
+	auto start_ns = e.ts_ns - std::min( e.ts_ns, e.duration_ns );
+	if( e.dev != events::none_id )
+		args += fmt::format( R"({0}"dev":"{1}")", args.empty() ? "" : ",",
+		                     escape_json( intern::accel_tags().name( e.dev ) ) );
+
+	this->record( fmt::format( R"({{"ph":"X","cat":"ioctl","name":"{0}","pid":{1},"tid":{2},)"
+	                           R"("ts":{3},"dur":{4},"args":{{{5}}}}})",
+	                           name, pid, tid, us( start_ns ), us( e.duration_ns ), args ) );
+
+	if( e.dev == events::none_id )
+		return;
+	this->record( fmt::format( R"({{"ph":"X","cat":"accelerator","name":"{0}","pid":{1},)"
+	                           R"("tid":{2},"ts":{3},"dur":{4},"args":{{{5}}}}})",
+	                           name, accelerators_pid, this->lane( e.dev, start_ns, e.ts_ns ),
+	                           us( start_ns ), us( e.duration_ns ), args ) );
+}
+
+void atop::timeline::Writer::add( TimedCall const& c )
+{
+	auto pid = this->process( c.pid, c.app );
+
+	std::string args;
+	if( c.app != events::none_id )
+		args = fmt::format( R"("app":"{0}")", escape_json( intern::app_names().name( c.app ) ) );
+
+	this->record( fmt::format( R"({{"ph":"X","cat":"time","name":"{0}","pid":{1},"tid":{1},)"
+	                           R"("ts":{2},"dur":{3},"args":{{{4}}}}})",
+	                           escape_json( c.name ), pid,
+	                           us( c.ts_ns - std::min( c.ts_ns, c.duration_ns ) ),
+	                           us( c.duration_ns ), args ) );
+}
+
+void atop::timeline::Writer::add_cpu( util::nanoseconds_t ts_ns,
+                                      std::map<std::string, double> const& utils )
+{
+	if( utils.empty() )
+		return;
+
+	std::string args;
+	for( auto&& kv: utils )
+		args += fmt::format( R"({0}"{1}":{2})", args.empty() ? "" : ",", escape_json( kv.first ),
+		                     kv.second );
+	this->record( fmt::format( R"({{"ph":"C","name":"utilization","pid":{0},"ts":{1},)"
+	                           R"("args":{{{2}}}}})",
+	                           cpu_pid, us( ts_ns ), args ) );
+}
+
+bool atop::timeline::Writer::add_line( std::string_view line )
+{
+	if( events::parse_dmesg_line( line, this->event ) )
+		this->add( this->event );
+	else if( parse_time_line( line, this->call ) )
+		this->add( this->call );
+	else
+		return false;
+	return true;
+}
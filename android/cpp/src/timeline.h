@@ -0,0 +1,111 @@
+#ifndef TIMELINE_H_IN
+#define TIMELINE_H_IN
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "events.h"
+#include "intern.h"
+#include "util.h"
+
+namespace atop
+{
+namespace timeline
+{
+// Timeline of a session in the Chrome trace event format
+//
+// The output opens in Perfetto (ui.perfetto.dev) and chrome://tracing.
+// Each call becomes a slice on the track of its thread, and IOCTL calls
+// also become a slice on the track of their accelerator. INFO lines are
+// instant events and CPU utilizations are counter tracks. Events are
+// written as they are added in the JSON array format, whose closing
+// bracket is optional, so memory stays bounded by the number of tracks
+// and an interrupted export still loads.
+//
+// Calls without pid are put on a process per app. Accelerators have one
+// thread per lane: a call overlapping all calls in the existing lanes
+// opens a new lane, since slices of a thread have to nest.
+
+// Pids of the synthetic processes, beyond Linux' largest pid (2^22)
+constexpr int32_t accelerators_pid = 1 << 23;
+constexpr int32_t cpu_pid          = accelerators_pid + 1;
+constexpr int32_t unknown_app_pid  = accelerators_pid + 2;
+constexpr int32_t app_pid_base     = accelerators_pid + 3;
+
+// Lanes per accelerator; further overlapping calls share the last lane
+constexpr size_t max_lanes = 16;
+
+// "[ 3633.459327] TIME <what> (s): (app: ..) (pid: ..) <tag>: <seconds>"
+// as written by the instrumented FastRPC and TFLite libraries
+struct TimedCall
+{
+	util::nanoseconds_t ts_ns;
+	int32_t pid;
+	intern::string_id_t app;
+	std::string name; // "<what>" or "<what> <tag>"
+	util::nanoseconds_t duration_ns;
+};
+
+bool parse_time_line( std::string_view line, TimedCall& out );
+
+// Characters of s escaped for a JSON string
+std::string escape_json( std::string_view s );
+
+class Writer
+{
+  public:
+	explicit Writer( std::ostream& os );
+	~Writer();
+	Writer( Writer const& ) = delete;
+	Writer( Writer&& )      = delete;
+
+	// Calls end at the timestamp of their line
+	void add( events::Event const& e );
+	void add( TimedCall const& c );
+
+	// Utilization of each core in percent
+	void add_cpu( util::nanoseconds_t ts_ns, std::map<std::string, double> const& utils );
+
+	// Adds an IOCTL, INFO or TIME line; returns false for other lines
+	bool add_line( std::string_view line );
+
+	// Writes the closing bracket; called by the destructor
+	void close();
+
+	uint64_t written() const { return this->records; }
+
+  private:
+	// Pid of the process track of a call; names the process on first use
+	int32_t process( int32_t pid, intern::string_id_t app );
+
+	// Tid of the first free lane of dev for [start_ns, end_ns)
+	int32_t lane( intern::string_id_t dev, util::nanoseconds_t start_ns,
+	              util::nanoseconds_t end_ns );
+
+	void metadata( char const* what, int32_t pid, int32_t tid, std::string_view name );
+	void record( std::string const& json );
+
+	std::ostream& os;
+	bool closed;
+	uint64_t records;
+
+	std::unordered_set<int32_t> named_pids;
+
+	// End of the latest call per lane
+	std::unordered_map<intern::string_id_t, std::vector<util::nanoseconds_t>> lanes;
+
+	// Scratch event of add_line()
+	events::Event event;
+	TimedCall call;
+};
+
+} // namespace timeline
+} // namespace atop
+
+#endif // TIMELINE_H_IN
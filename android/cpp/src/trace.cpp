@@ -0,0 +1,552 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <lz4.h>
+
+#include "trace.h"
+#include "util.h"
+
+namespace
+{
+// Bytes of templates with a special meaning; literal ones are escaped
+constexpr char plain_number  = '\x01';
+constexpr char padded_number = '\x02'; // followed by the width
+constexpr char escape        = '\x03';
+
+// Longer runs of digits may not fit into 64 bits and are kept as text
+constexpr size_t max_digits = 19;
+
+constexpr size_t block_header_size = 28;
+constexpr size_t index_entry_size  = 28;
+constexpr size_t trailer_size      = 12;
+
+// Text segments up to this size are copied with a single fixed-size copy
+constexpr size_t short_copy = 16;
+
+// Upper bound of block sizes accepted by readers
+constexpr uint32_t max_block_bytes = 1u << 30;
+
+bool is_digit( char c ) { return c >= '0' && c <= '9'; }
+
+void put_le( std::string& out, uint64_t v, size_t bytes )
+{
+	for( size_t i = 0; i < bytes; ++i )
+		out.push_back( static_cast<char>( v >> ( 8 * i ) ) );
+}
+
+uint64_t get_le( char const* p, size_t bytes )
+{
+	uint64_t v = 0;
+	for( size_t i = 0; i < bytes; ++i )
+		v |= uint64_t{ static_cast<uint8_t>( p[i] ) } << ( 8 * i );
+	return v;
+}
+
+void put_varint( std::string& out, uint64_t v )
+{
+	while( v >= 0x80 )
+	{
+		out.push_back( static_cast<char>( v | 0x80 ) );
+		v >>= 7;
+	}
+	out.push_back( static_cast<char>( v ) );
+}
+
+void put_zigzag( std::string& out, int64_t v )
+{
+	put_varint( out, ( static_cast<uint64_t>( v ) << 1 ) ^ static_cast<uint64_t>( v >> 63 ) );
+}
+
+[[noreturn]] void corrupt() { throw std::runtime_error( "Corrupt trace block" ); }
+
+uint64_t get_varint( char const*& p, char const* end )
+{
+	// Most deltas take a single byte
+	if( p != end && ( static_cast<uint8_t>( *p ) & 0x80 ) == 0 )
+		return static_cast<uint8_t>( *p++ );
+
+	uint64_t v = 0;
+	for( unsigned shift = 0; shift < 64 && p != end; shift += 7 )
+	{
+		auto byte = static_cast<uint8_t>( *p++ );
+		v |= uint64_t{ byte & 0x7fu } << shift;
+		if( ( byte & 0x80 ) == 0 )
+			return v;
+	}
+	corrupt();
+}
+
+int64_t get_zigzag( char const*& p, char const* end )
+{
+	auto v = get_varint( p, end );
+	return static_cast<int64_t>( v >> 1 ) ^ -static_cast<int64_t>( v & 1 );
+}
+
+bool read_exactly( std::istream& is, char* out, size_t n )
+{
+	is.read( out, static_cast<std::streamsize>( n ) );
+	return static_cast<size_t>( is.gcount() ) == n;
+}
+
+// Text followed by a number, if kind isn't 0
+struct Segment
+{
+	uint32_t text_off;
+	uint32_t text_len;
+	char kind;
+	uint8_t width;
+};
+
+struct CompiledTemplate
+{
+	uint32_t first_segment;
+	uint32_t segments;
+	uint32_t first_number;
+	uint32_t numbers;
+};
+
+constexpr char digit_pairs[] = "00010203040506070809101112131415161718192021222324"
+                               "25262728293031323334353637383940414243444546474849"
+                               "50515253545556575859606162636465666768697071727374"
+                               "75767778798081828384858687888990919293949596979899";
+
+// Writes v at out, which has room for max_digits; returns the end
+char* write_number( char* out, uint64_t v, char kind, uint8_t width )
+{
+	char buf[max_digits];
+	char* end   = buf + sizeof( buf );
+	char* begin = end;
+	while( v >= 100 )
+	{
+		auto pair = v % 100 * 2;
+		v /= 100;
+		*--begin = digit_pairs[pair + 1];
+		*--begin = digit_pairs[pair];
+	}
+	if( v >= 10 )
+	{
+		*--begin = digit_pairs[v * 2 + 1];
+		*--begin = digit_pairs[v * 2];
+	}
+	else
+		*--begin = static_cast<char>( '0' + v );
+
+	if( kind == padded_number )
+		while( end - begin < width && begin != buf )
+			*--begin = '0';
+
+	auto n = static_cast<size_t>( end - begin );
+	std::memcpy( out, begin, n );
+	return out + n;
+}
+} // namespace
+
+atop::trace::Writer::Writer( std::ostream& os_, size_t block_bytes_ )
+    : os( os_ )
+    , block_bytes( block_bytes_ )
+    , closed( false )
+    , templates()
+    , dict()
+    , lines_buf()
+    , block_lines( 0 )
+    , min_ns( no_ts )
+    , max_ns( 0 )
+    , tmpl()
+    , nums()
+    , index()
+    , total_lines( 0 )
+    , total_text( 0 )
+    , written( 0 )
+{
+	std::string header;
+	put_le( header, magic, 4 );
+	put_le( header, version, 2 );
+	put_le( header, 0, 2 );
+	this->os.write( header.data(), static_cast<std::streamsize>( header.size() ) );
+	this->written = header.size();
+}
+
+atop::trace::Writer::~Writer()
+{
+	try
+	{
+		this->close();
+	}
+	catch( std::exception const& )
+	{
+		// Errors are only reported by explicit calls to close()
+	}
+}
+
+void atop::trace::Writer::add( std::string_view line )
+{
+	this->tmpl.clear();
+	this->nums.clear();
+
+	for( size_t i = 0; i < line.size(); )
+	{
+		if( !is_digit( line[i] ) )
+		{
+			if( line[i] == plain_number || line[i] == padded_number || line[i] == escape )
+				this->tmpl.push_back( escape );
+			this->tmpl.push_back( line[i++] );
+			continue;
+		}
+
+		size_t j = i;
+		while( j < line.size() && is_digit( line[j] ) )
+			++j;
+
+		auto digits = j - i;
+		if( digits > max_digits )
+		{
+			this->tmpl.append( line.substr( i, digits ) );
+			i = j;
+			continue;
+		}
+
+		uint64_t v = 0;
+		for( size_t k = i; k < j; ++k )
+			v = v * 10 + static_cast<uint64_t>( line[k] - '0' );
+		this->nums.push_back( v );
+
+		if( line[i] == '0' && digits > 1 )
+		{
+			this->tmpl.push_back( padded_number );
+			this->tmpl.push_back( static_cast<char>( digits ) );
+		}
+		else
+			this->tmpl.push_back( plain_number );
+		i = j;
+	}
+
+	auto it = this->templates.find( this->tmpl );
+	if( it == this->templates.end() )
+	{
+		auto id = static_cast<uint32_t>( this->templates.size() );
+		put_varint( this->dict, this->tmpl.size() );
+		this->dict += this->tmpl;
+		it = this->templates
+		         .emplace( this->tmpl, Template{ id, std::vector<uint64_t>( this->nums.size() ) } )
+		         .first;
+	}
+
+	put_varint( this->lines_buf, it->second.id );
+	auto& prev = it->second.prev;
+	for( size_t k = 0; k < this->nums.size(); ++k )
+	{
+		put_zigzag( this->lines_buf, static_cast<int64_t>( this->nums[k] - prev[k] ) );
+		prev[k] = this->nums[k];
+	}
+
+	util::nanoseconds_t ts;
+	size_t pos;
+	if( util::parse_dmesg_ts( line, ts, pos ) )
+	{
+		this->min_ns = std::min( this->min_ns, ts );
+		this->max_ns = std::max( this->max_ns, ts );
+	}
+
+	this->block_lines++;
+	this->total_lines++;
+	this->total_text += line.size() + 1;
+
+	if( this->dict.size() + this->lines_buf.size() >= this->block_bytes )
+		this->flush();
+}
+
+void atop::trace::Writer::flush()
+{
+	if( this->block_lines == 0 )
+		return;
+
+	std::string raw;
+	raw.reserve( this->dict.size() + this->lines_buf.size() + 8 );
+	put_varint( raw, this->templates.size() );
+	raw += this->dict;
+	raw += this->lines_buf;
+	if( raw.size() > max_block_bytes )
+		throw std::runtime_error( "Trace block exceeds the maximum block size" );
+
+	auto raw_size = static_cast<int>( raw.size() );
+	std::string out( block_header_size + static_cast<size_t>( LZ4_compressBound( raw_size ) ),
+	                 '\0' );
+	auto compressed = LZ4_compress_default( raw.data(), out.data() + block_header_size, raw_size,
+	                                        LZ4_compressBound( raw_size ) );
+	if( compressed <= 0 )
+		throw std::runtime_error( "Could not compress trace block" );
+	out.resize( block_header_size + static_cast<size_t>( compressed ) );
+
+	BlockInfo info{ this->written, this->block_lines, this->min_ns,
+		            this->min_ns == no_ts ? no_ts : this->max_ns };
+	std::string header;
+	put_le( header, static_cast<uint64_t>( compressed ), 4 );
+	put_le( header, raw.size(), 4 );
+	put_le( header, info.lines, 4 );
+	put_le( header, info.min_ns, 8 );
+	put_le( header, info.max_ns, 8 );
+	out.replace( 0, block_header_size, header );
+
+	this->index.push_back( info );
+	this->os.write( out.data(), static_cast<std::streamsize>( out.size() ) );
+	if( !this->os )
+		throw std::runtime_error( "Could not write trace" );
+	this->written += out.size();
+
+	// Blocks are decoded independently
+	this->templates.clear();
+	this->dict.clear();
+	this->lines_buf.clear();
+	this->block_lines = 0;
+	this->min_ns      = no_ts;
+	this->max_ns      = 0;
+}
+
+void atop::trace::Writer::close()
+{
+	if( this->closed )
+		return;
+	this->closed = true;
+
+	this->flush();
+
+	std::string out;
+	put_le( out, 0, 4 );
+	put_le( out, this->index.size(), 4 );
+	for( auto&& b: this->index )
+	{
+		put_le( out, b.offset, 8 );
+		put_le( out, b.lines, 4 );
+		put_le( out, b.min_ns, 8 );
+		put_le( out, b.max_ns, 8 );
+	}
+	put_le( out, this->written, 8 );
+	put_le( out, magic, 4 );
+
+	this->os.write( out.data(), static_cast<std::streamsize>( out.size() ) );
+	this->os.flush();
+	if( !this->os )
+		throw std::runtime_error( "Could not write trace" );
+	this->written += out.size();
+}
+
+atop::trace::Reader::Reader( std::istream& is_ )
+    : is( is_ )
+    , index()
+    , compressed()
+    , raw()
+    , line()
+{
+	char header[8];
+	this->is.seekg( 0 );
+	if( !read_exactly( this->is, header, sizeof( header ) ) || get_le( header, 4 ) != magic )
+		throw std::runtime_error( "Not an atop trace" );
+	if( get_le( header + 4, 2 ) != version )
+		throw std::runtime_error(
+		    fmt::format( "Unsupported trace version {0}", get_le( header + 4, 2 ) ) );
+
+	this->is.seekg( 0, std::ios::end );
+	auto size = static_cast<uint64_t>( this->is.tellg() );
+
+	// Index of a complete trace
+	char trailer[trailer_size];
+	if( size >= sizeof( header ) + 8 + trailer_size
+	    && this->is.seekg( static_cast<std::streamoff>( size - trailer_size ) )
+	    && read_exactly( this->is, trailer, sizeof( trailer ) )
+	    && get_le( trailer + 8, 4 ) == magic )
+	{
+		auto index_off = get_le( trailer, 8 );
+		char counts[8];
+		this->is.seekg( static_cast<std::streamoff>( index_off ) );
+		if( index_off < size && read_exactly( this->is, counts, sizeof( counts ) )
+		    && get_le( counts, 4 ) == 0 )
+		{
+			// The entries lie between the counts and the trailer
+			auto entry_bytes = get_le( counts + 4, 4 ) * index_entry_size;
+			if( index_off + sizeof( counts ) + trailer_size > size
+			    || entry_bytes > size - index_off - sizeof( counts ) - trailer_size )
+				corrupt();
+			std::string entries( entry_bytes, '\0' );
+			if( !read_exactly( this->is, entries.data(), entries.size() ) )
+				throw std::runtime_error( "Truncated trace index" );
+
+			for( size_t off = 0; off < entries.size(); off += index_entry_size )
+			{
+				auto p = entries.data() + off;
+				this->index.push_back( { get_le( p, 8 ), static_cast<uint32_t>( get_le( p + 8, 4 ) ),
+				                         get_le( p + 12, 8 ), get_le( p + 20, 8 ) } );
+			}
+			return;
+		}
+	}
+
+	// Otherwise blocks are found by their headers
+	this->is.clear();
+	for( uint64_t off = sizeof( header ); off + block_header_size <= size; )
+	{
+		char block[block_header_size];
+		this->is.seekg( static_cast<std::streamoff>( off ) );
+		if( !read_exactly( this->is, block, sizeof( block ) ) )
+			break;
+
+		auto compressed_size = get_le( block, 4 );
+		if( compressed_size == 0 || off + block_header_size + compressed_size > size )
+			break;
+
+		this->index.push_back( { off, static_cast<uint32_t>( get_le( block + 8, 4 ) ),
+		                         get_le( block + 12, 8 ), get_le( block + 20, 8 ) } );
+		off += block_header_size + compressed_size;
+	}
+	this->is.clear();
+}
+
+uint64_t atop::trace::Reader::read_block( size_t i, line_fn_t const& fn )
+{
+	char header[block_header_size];
+	this->is.clear();
+	this->is.seekg( static_cast<std::streamoff>( this->index.at( i ).offset ) );
+	if( !read_exactly( this->is, header, sizeof( header ) ) )
+		throw std::runtime_error( "Truncated trace block" );
+
+	auto compressed_size = static_cast<uint32_t>( get_le( header, 4 ) );
+	auto raw_size        = static_cast<uint32_t>( get_le( header + 4, 4 ) );
+	auto lines           = static_cast<uint32_t>( get_le( header + 8, 4 ) );
+	if( compressed_size > max_block_bytes || raw_size > max_block_bytes )
+		corrupt();
+
+	this->compressed.resize( compressed_size );
+	if( !read_exactly( this->is, this->compressed.data(), compressed_size ) )
+		throw std::runtime_error( "Truncated trace block" );
+
+	this->raw.resize( raw_size );
+	if( LZ4_decompress_safe( this->compressed.data(), this->raw.data(),
+	                         static_cast<int>( compressed_size ), static_cast<int>( raw_size ) )
+	    != static_cast<int>( raw_size ) )
+		corrupt();
+
+	char const* p   = this->raw.data();
+	char const* end = p + this->raw.size();
+
+	// Templates are split into text and number segments once per block
+	std::string text;
+	std::vector<Segment> segments;
+	// Each template takes at least its size byte
+	auto template_count = get_varint( p, end );
+	if( template_count > static_cast<uint64_t>( end - p ) )
+		corrupt();
+	std::vector<CompiledTemplate> templates( template_count );
+	uint32_t numbers = 0;
+	uint64_t max_line = 0;
+	for( auto&& t: templates )
+	{
+		auto size = get_varint( p, end );
+		if( size > static_cast<uint64_t>( end - p ) )
+			corrupt();
+		std::string_view tmpl( p, size );
+		p += size;
+
+		t = { static_cast<uint32_t>( segments.size() ), 0, numbers, 0 };
+		Segment seg{ static_cast<uint32_t>( text.size() ), 0, 0, 0 };
+		for( size_t k = 0; k < tmpl.size(); ++k )
+		{
+			char c = tmpl[k];
+			if( c == escape && k + 1 < tmpl.size() )
+				c = tmpl[++k];
+			else if( c == plain_number || c == padded_number )
+			{
+				seg.kind = c;
+				if( c == padded_number )
+				{
+					if( ++k == tmpl.size() )
+						corrupt();
+					seg.width = static_cast<uint8_t>( tmpl[k] );
+				}
+				seg.text_len = static_cast<uint32_t>( text.size() ) - seg.text_off;
+				segments.push_back( seg );
+				t.numbers++;
+				seg = { static_cast<uint32_t>( text.size() ), 0, 0, 0 };
+				continue;
+			}
+			text.push_back( c );
+		}
+		seg.text_len = static_cast<uint32_t>( text.size() ) - seg.text_off;
+		segments.push_back( seg );
+
+		t.segments = static_cast<uint32_t>( segments.size() ) - t.first_segment;
+		numbers += t.numbers;
+		max_line = std::max( max_line, size + t.numbers * max_digits );
+	}
+
+	// Lines are rendered into a buffer large enough for any of them
+	// and short segments are copied with a fixed size, so both have some
+	// slack at their end
+	this->line.resize( max_line + short_copy );
+	text.resize( text.size() + short_copy );
+
+	// Previous numbers of each template
+	std::vector<uint64_t> prev( numbers, 0 );
+
+	uint64_t bytes = 0;
+	for( uint32_t l = 0; l < lines; ++l )
+	{
+		auto id = get_varint( p, end );
+		if( id >= templates.size() )
+			corrupt();
+
+		auto const& t = templates[id];
+		auto* values  = prev.data() + t.first_number;
+		char* out = this->line.data();
+		for( uint32_t s = 0; s < t.segments; ++s )
+		{
+			auto const& seg = segments[t.first_segment + s];
+			if( seg.text_len <= short_copy )
+				std::memcpy( out, text.data() + seg.text_off, short_copy );
+			else
+				std::memcpy( out, text.data() + seg.text_off, seg.text_len );
+			out += seg.text_len;
+			if( seg.kind != 0 )
+			{
+				*values += static_cast<uint64_t>( get_zigzag( p, end ) );
+				out = write_number( out, *values++, seg.kind, seg.width );
+			}
+		}
+
+		auto size = static_cast<size_t>( out - this->line.data() );
+		fn( std::string_view( this->line.data(), size ) );
+		bytes += size + 1;
+	}
+
+	return bytes;
+}
+
+uint64_t atop::trace::Reader::read( line_fn_t const& fn, util::nanoseconds_t t0_ns,
+                                    util::nanoseconds_t t1_ns )
+{
+	uint64_t bytes = 0;
+	for( size_t i = 0; i < this->index.size(); ++i )
+	{
+		auto const& b = this->index[i];
+		if( b.min_ns != no_ts && ( b.max_ns < t0_ns || b.min_ns >= t1_ns ) )
+			continue;
+		bytes += this->read_block( i, fn );
+	}
+	return bytes;
+}
+
+bool atop::trace::is_trace( std::istream& is )
+{
+	char header[4];
+	auto pos   = is.tellg();
+	bool match = read_exactly( is, header, sizeof( header ) ) && get_le( header, 4 ) == magic;
+	is.clear();
+	is.seekg( pos );
+	return match;
+}
@@ -0,0 +1,147 @@
+#ifndef TRACE_H_IN
+#define TRACE_H_IN
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "util.h"
+
+namespace atop
+{
+namespace trace
+{
+// Compressed on-disk format of captured dmesg and logcat text
+//
+// Lines are split into a template, which is the text with each run of
+// digits replaced by a placeholder, and the numbers of those runs. E.g.
+//
+//     [ 3633.459327] IOCTL kgsl: (channel: 3) (app: benchmark_model) ...
+//
+// has the template "[ #.#] IOCTL kgsl: (channel: #) (app: benchmark_model) ..."
+// so the repeated app, cmd and channel strings are stored once per block
+// in a dictionary of templates and a line takes the id of its template
+// plus the numbers, delta coded against the previous line of the same
+// template as zigzag varints. Blocks of lines are LZ4 compressed.
+//
+//     file   := header block* index trailer
+//     header := "ATRC" <u16 version> <u16 0>
+//     block  := <u32 compressed size> <u32 raw size> <u32 lines>
+//               <u64 min ns> <u64 max ns> <LZ4 compressed payload>
+//     index  := <u32 0> <u32 blocks> (<u64 offset> <u32 lines> <u64 min ns> <u64 max ns>)*
+//     trailer:= <u64 offset of index> "ATRC"
+//
+// with integers in little endian. Blocks are independent of each other,
+// so they can be decoded in any order. min/max ns span the dmesg
+// timestamps of a block's lines (no_ts if it has none). Files without
+// index (e.g. of an interrupted capture) are read up to their last
+// complete block. The text is reproduced byte by byte.
+
+constexpr uint32_t magic   = 0x43525441; // "ATRC"
+constexpr uint16_t version = 1;
+
+constexpr util::nanoseconds_t no_ts = std::numeric_limits<util::nanoseconds_t>::max();
+
+struct BlockInfo
+{
+	uint64_t offset;
+	uint32_t lines;
+	util::nanoseconds_t min_ns;
+	util::nanoseconds_t max_ns;
+};
+
+class Writer
+{
+  public:
+	// Blocks are cut once their payload reaches block_bytes before
+	// compression
+	explicit Writer( std::ostream& os, size_t block_bytes = 1024 * 1024 );
+	~Writer();
+	Writer( Writer const& ) = delete;
+	Writer( Writer&& )      = delete;
+
+	// Line without trailing newline
+	void add( std::string_view line );
+
+	// Writes the last block and the index; called by the destructor
+	void close();
+
+	uint64_t lines() const { return this->total_lines; }
+	uint64_t text_bytes() const { return this->total_text; }
+	uint64_t bytes_written() const { return this->written; }
+
+  private:
+	struct Template
+	{
+		uint32_t id;
+		std::vector<uint64_t> prev;
+	};
+
+	void flush();
+
+	std::ostream& os;
+	size_t block_bytes;
+	bool closed;
+
+	// Payload of the current block
+	std::unordered_map<std::string, Template> templates;
+	std::string dict;
+	std::string lines_buf;
+	uint32_t block_lines;
+	util::nanoseconds_t min_ns;
+	util::nanoseconds_t max_ns;
+
+	// Scratch space of add()
+	std::string tmpl;
+	std::vector<uint64_t> nums;
+
+	std::vector<BlockInfo> index;
+	uint64_t total_lines;
+	uint64_t total_text;
+	uint64_t written;
+};
+
+class Reader
+{
+  public:
+	using line_fn_t = std::function<void( std::string_view )>;
+
+	// Throws if is doesn't hold a trace
+	explicit Reader( std::istream& is );
+
+	std::vector<BlockInfo> const& blocks() const { return this->index; }
+
+	// Calls fn for each line of block i. Returns the bytes of text.
+	uint64_t read_block( size_t i, line_fn_t const& fn );
+
+	// Calls fn for each line of the blocks that may hold lines with
+	// dmesg timestamps in [t0_ns, t1_ns) and of those without dmesg
+	// timestamps; all blocks by default
+	uint64_t read( line_fn_t const& fn, util::nanoseconds_t t0_ns = 0,
+	               util::nanoseconds_t t1_ns = no_ts );
+
+  private:
+	std::istream& is;
+	std::vector<BlockInfo> index;
+
+	// Buffers reused across blocks
+	std::string compressed;
+	std::string raw;
+	std::string line;
+};
+
+// Whether the seekable stream starts with a trace header; doesn't
+// consume it
+bool is_trace( std::istream& is );
+
+} // namespace trace
+} // namespace atop
+
+#endif // TRACE_H_IN
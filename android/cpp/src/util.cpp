@@ -1,9 +1,16 @@
 #include <algorithm>
 #include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <time.h>
+
+#include <fmt/format.h>
 #include <re2/re2.h>
 
 #include "util.h"
@@ -30,6 +37,27 @@ void atop::util::trim( std::string& s )
 	rtrim( s );
 }
 
+std::string_view atop::util::trimmed( std::string_view s )
+{
+	while( !s.empty() && std::isspace( static_cast<unsigned char>( s.front() ) ) )
+		s.remove_prefix( 1 );
+	while( !s.empty() && std::isspace( static_cast<unsigned char>( s.back() ) ) )
+		s.remove_suffix( 1 );
+	return s;
+}
+
+std::string atop::util::shell_quote( std::string_view s )
+{
+	// Single quotes can't be escaped within single quotes: close, escape, reopen
+	std::string quoted = "'";
+	for( auto c: s )
+		if( c == '\'' )
+			quoted += "'\\''";
+		else
+			quoted += c;
+	return quoted + "'";
+}
+
 std::vector<std::string> atop::util::split( const std::string& s, char delimiter )
 {
 	std::vector<std::string> tokens;
@@ -70,6 +98,174 @@ bool atop::util::regex_find( RE2 const& pattern, std::string_view str,
                                  static_cast<int>(args_count) );
 }
 
+static bool is_digit( char c ) { return static_cast<unsigned>( c - '0' ) < 10u; }
+
+static constexpr uint64_t pow10( size_t n )
+{
+	uint64_t p = 1;
+	while( n-- > 0 )
+		p *= 10;
+	return p;
+}
+
+// a * b unless it overflows
+static bool checked_mul( uint64_t a, uint64_t b, uint64_t& out )
+{
+	if( b != 0 && a > std::numeric_limits<uint64_t>::max() / b )
+		return false;
+	out = a * b;
+	return true;
+}
+
+bool atop::util::parse_decimal_ns( std::string_view str, size_t& pos, nanoseconds_t unit_ns,
+                                   nanoseconds_t& out )
+{
+	size_t i         = pos;
+	uint64_t integer = 0;
+	for( ; i < str.size() && is_digit( str[i] ); ++i )
+	{
+		auto digit = static_cast<uint64_t>( str[i] - '0' );
+		if( !checked_mul( integer, 10, integer )
+		    || integer > std::numeric_limits<uint64_t>::max() - digit )
+			return false;
+		integer += digit;
+	}
+	if( i == pos )
+		return false;
+
+	// At most 9 fractional digits are significant
+	uint64_t frac      = 0;
+	size_t frac_digits = 0;
+	if( i < str.size() && str[i] == '.' )
+	{
+		auto frac_start = ++i;
+		for( ; i < str.size() && is_digit( str[i] ); ++i )
+			if( i - frac_start < 9 )
+				frac = frac * 10 + static_cast<uint64_t>( str[i] - '0' );
+		frac_digits = std::min<size_t>( i - frac_start, 9 );
+	}
+
+	// Optional exponent as printed by "%g"; an 'e' without digits is
+	// left unparsed
+	size_t exp    = 0;
+	bool negative = false;
+	if( i + 1 < str.size() && ( str[i] == 'e' || str[i] == 'E' ) )
+	{
+		size_t j = i + 1;
+		if( str[j] == '+' || str[j] == '-' )
+			negative = str[j++] == '-';
+		auto exp_start = j;
+		for( ; j < str.size() && is_digit( str[j] ); ++j )
+			if( exp <= 19 )
+				exp = exp * 10 + static_cast<size_t>( str[j] - '0' );
+		if( j > exp_start )
+			i = j;
+		else
+			negative = false;
+	}
+
+	// value = ( integer + frac / 10^frac_digits ) * 10^exp * unit_ns,
+	// rejected if it overflows
+	uint64_t denom = pow10( frac_digits );
+	uint64_t whole, part;
+	if( negative )
+	{
+		if( !checked_mul( integer, unit_ns, whole ) || !checked_mul( frac, unit_ns, part ) )
+			return false;
+		part /= denom;
+	}
+	else
+	{
+		uint64_t scale;
+		if( exp > 19 || !checked_mul( pow10( exp ), unit_ns, scale )
+		    || !checked_mul( integer, scale, whole ) )
+			return false;
+		if( scale % denom == 0 )
+			part = frac * ( scale / denom );
+		else if( checked_mul( frac, scale, part ) )
+			part /= denom;
+		else
+			return false;
+	}
+	if( whole > std::numeric_limits<uint64_t>::max() - part )
+		return false;
+
+	out = whole + part;
+	if( negative )
+		out = exp > 19 ? 0 : out / pow10( exp );
+	pos = i;
+	return true;
+}
+
+atop::util::nanoseconds_t atop::util::decimal2ns( std::string_view str, nanoseconds_t unit_ns )
+{
+	auto is_space = []( char c ) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+	size_t pos = 0;
+	while( pos < str.size() && is_space( str[pos] ) )
+		++pos;
+
+	nanoseconds_t ns;
+	bool ok = parse_decimal_ns( str, pos, unit_ns, ns );
+	while( ok && pos < str.size() && is_space( str[pos] ) )
+		++pos;
+	if( !ok || pos != str.size() )
+		throw std::runtime_error( fmt::format( "Malformed decimal '{0}'", str ) );
+	return ns;
+}
+
+atop::util::nanoseconds_t atop::util::thread_cpu_ns()
+{
+	timespec ts{};
+	if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) != 0 )
+		return 0;
+	return static_cast<nanoseconds_t>( ts.tv_sec ) * ns_per_s
+	       + static_cast<nanoseconds_t>( ts.tv_nsec );
+}
+
+bool atop::util::parse_dmesg_ts( std::string_view line, nanoseconds_t& ts, size_t& pos )
+{
+	size_t i = 0;
+	while( i < line.size() && line[i] == ' ' )
+		++i;
+	if( i == line.size() || line[i] != '[' )
+		return false;
+	for( ++i; i < line.size() && line[i] == ' '; )
+		++i;
+	if( !parse_decimal_ns( line, i, ns_per_s, ts ) || i == line.size() || line[i] != ']' )
+		return false;
+
+	pos = i + 1;
+	return true;
+}
+
+atop::util::RegexMatcher::RegexMatcher( std::string const& pattern_str )
+    : pattern( pattern_str )
+    , captures()
+    , args()
+    , arg_ptrs()
+{
+	if( !this->pattern.ok() )
+		throw std::runtime_error( fmt::format( "Invalid pattern '{0}': {1}", pattern_str,
+		                                       this->pattern.error() ) );
+
+	auto args_count = static_cast<size_t>( this->pattern.NumberOfCapturingGroups() );
+	this->captures.resize( args_count );
+	this->args.reserve( args_count );
+	this->arg_ptrs.reserve( args_count );
+	for( size_t i = 0; i < args_count; ++i )
+	{
+		this->args.emplace_back( &this->captures[i] );
+		this->arg_ptrs.push_back( &this->args.back() );
+	}
+}
+
+bool atop::util::RegexMatcher::find( std::string_view str )
+{
+	re2::StringPiece piece( str.data(), str.size() );
+	return RE2::FindAndConsumeN( &piece, this->pattern, this->arg_ptrs.data(),
+	                             static_cast<int>( this->arg_ptrs.size() ) );
+}
+
 std::string atop::util::basepath( std::string const& file_path )
 {
 	char sep = '/';
@@ -80,3 +276,16 @@ std::string atop::util::basepath( std::string const& file_path )
 
 	return "";
 }
+
+std::string atop::util::cache_dir()
+{
+	std::filesystem::path dir;
+	if( auto xdg = std::getenv( "XDG_CACHE_HOME" ); xdg && *xdg )
+		dir = xdg;
+	else if( auto home = std::getenv( "HOME" ); home && *home )
+		dir = std::filesystem::path( home ) / ".cache";
+	else
+		dir = std::filesystem::temp_directory_path();
+
+	return ( dir / "atop" ).string();
+}
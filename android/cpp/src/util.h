@@ -1,8 +1,11 @@
 #ifndef UTIL_H_IN
 #define UTIL_H_IN
 
+#include <cstdint>
 #include <random>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <re2/re2.h>
 
@@ -13,13 +16,77 @@ namespace util
 void ltrim( std::string& s );
 void rtrim( std::string& s );
 void trim( std::string& s );
+
+// s without leading and trailing whitespace
+std::string_view trimmed( std::string_view s );
 std::string basepath( std::string const& file_path );
 
+// Per-user cache directory of atop: $XDG_CACHE_HOME/atop, falling back to
+// ~/.cache/atop
+std::string cache_dir();
+
 std::vector<std::string> split( const std::string&, char delimiter );
 
+// s as a single word of a POSIX shell command, in single quotes
+std::string shell_quote( std::string_view s );
+
 bool regex_find( RE2 const& pattern, std::string_view str,
                            std::vector<std::string>& results );
 
+// Allocation-free alternative to regex_find for hot paths: capture
+// storage is set up once and captures point into the searched string.
+// Not thread-safe; use one matcher per thread.
+class RegexMatcher
+{
+  public:
+	explicit RegexMatcher( std::string const& pattern );
+	RegexMatcher( RegexMatcher const& ) = delete;
+	RegexMatcher( RegexMatcher&& )      = delete;
+
+	bool find( std::string_view str );
+
+	// Capture i of the last successful find()
+	std::string_view operator[]( size_t i ) const
+	{
+		return std::string_view( this->captures[i].data(), this->captures[i].size() );
+	}
+
+  private:
+	RE2 pattern;
+	std::vector<re2::StringPiece> captures;
+	std::vector<RE2::Arg> args;
+	std::vector<RE2::Arg*> arg_ptrs;
+};
+
+// Time base of atop: durations and timestamps are unsigned nanoseconds
+using nanoseconds_t = uint64_t;
+
+constexpr nanoseconds_t ns_per_us = 1000;
+constexpr nanoseconds_t ns_per_ms = 1000 * ns_per_us;
+constexpr nanoseconds_t ns_per_s  = 1000 * ns_per_ms;
+
+inline double ns2ms( nanoseconds_t ns ) { return static_cast<double>( ns ) / 1.0e6; }
+inline double ns2s( nanoseconds_t ns ) { return static_cast<double>( ns ) / 1.0e9; }
+
+// CPU time consumed by the calling thread
+nanoseconds_t thread_cpu_ns();
+
+// Fixed-point parsing of non-negative decimals such as "3633.459327",
+// "0.000012345" (kernel "%llu.%09u") or "1.5e+03" into multiples of
+// unit_ns without going through floating point. Fractional digits below
+// nanosecond resolution are truncated. Parsing starts at str[pos]; on
+// success pos points past the number. Fails if the value overflows.
+bool parse_decimal_ns( std::string_view str, size_t& pos, nanoseconds_t unit_ns,
+                       nanoseconds_t& out );
+
+// As above for a string holding just the number and optional whitespace;
+// throws if malformed or out of range
+nanoseconds_t decimal2ns( std::string_view str, nanoseconds_t unit_ns );
+
+// Timestamp of a dmesg line "[ 3633.459327] ..." (seconds since boot).
+// On success pos points past the closing bracket.
+bool parse_dmesg_ts( std::string_view line, nanoseconds_t& ts, size_t& pos );
+
 class NotImplementedException : public std::logic_error
 {
   public:
@@ -0,0 +1,127 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <catch2/catch.hpp>
+
+#include "alp.h"
+#include "physmap.h"
+
+using atop::physmap::IpBlocks;
+
+static atop::physmap::PhysMap small_map()
+{
+	atop::physmap::PhysMap map;
+	std::istringstream iomem{ "05000000-0503ffff : kgsl-3d0\n"
+	                          "80000000-857fffff : System RAM\n" };
+	map.load_iomem( iomem );
+	map.build();
+	return map;
+}
+
+TEST_CASE( "Trace records are parsed", "[alp]" )
+{
+	atop::alp::Access a;
+	REQUIRE( !atop::alp::parse_trace_line( "# ts pid kind addr size", a ) );
+	REQUIRE( !atop::alp::parse_trace_line( "   ", a ) );
+
+	REQUIRE( atop::alp::parse_trace_line( "1500 42 W 0x80001000 64", a ) );
+	REQUIRE( a.ts_ns == 1500 );
+	REQUIRE( a.pid == 42 );
+	REQUIRE( a.kind == atop::alp::AccessKind::Write );
+	REQUIRE( a.addr == 0x80001000 );
+	REQUIRE( a.size == 64 );
+
+	REQUIRE( atop::alp::parse_trace_line( "7 1 R 5000000", a ) );
+	REQUIRE( a.addr == 0x5000000 );
+	REQUIRE( a.size == 4 );
+
+	REQUIRE_THROWS( atop::alp::parse_trace_line( "7 1 Q 5000000", a ) );
+}
+
+TEST_CASE( "Pipeline reports per-IP accesses per window", "[alp]" )
+{
+	auto map = small_map();
+
+	std::stringstream trace;
+	for( int i = 0; i < 10000; ++i )
+	{
+		// window 0: GPU reads, window 1: DRAM writes, plus fetches and
+		// accesses of another process
+		trace << i << " 1 R 0x5000000 16\n";
+		trace << 1000000 + i << " 1 W 0x80000000 8\n";
+		trace << i << " 1 X 0x5000000 4\n";
+		trace << i << " 2 R 0x5000000 4\n";
+	}
+	trace << "5 1 R 0x1 4\n"; // not in any region
+
+	atop::alp::IdentityTranslator identity;
+	atop::alp::Options opts;
+	opts.window_ns   = 1000000;
+	opts.batch_size  = 128;
+	opts.queue_depth = 2;
+	opts.pids        = { 1 };
+
+	auto windows = atop::alp::estimate( trace, map, identity, opts );
+	REQUIRE( windows.size() == 2 );
+
+	REQUIRE( windows[0].window_start_ns == 0 );
+	REQUIRE( windows[0].accesses[IP_IDX( IpBlocks::GPU )] == 10000 );
+	REQUIRE( windows[0].bytes[IP_IDX( IpBlocks::GPU )] == 160000 );
+	REQUIRE( windows[0].unmapped == 1 );
+
+	REQUIRE( windows[1].window_start_ns == 1000000 );
+	REQUIRE( windows[1].accesses[IP_IDX( IpBlocks::DRAM )] == 10000 );
+	REQUIRE( windows[1].accesses[IP_IDX( IpBlocks::GPU )] == 0 );
+	REQUIRE( windows[1].bandwidth( IpBlocks::DRAM, opts.window_ns ) == Approx( 80000 / 1.0e-3 ) );
+}
+
+TEST_CASE( "Malformed traces are reported", "[alp]" )
+{
+	auto map = small_map();
+	std::stringstream trace{ "1 1 R 0x5000000\nnot a record\n" };
+	atop::alp::IdentityTranslator identity;
+	REQUIRE_THROWS( atop::alp::estimate( trace, map, identity ) );
+}
+
+TEST_CASE( "Virtual addresses are translated through pagemap", "[alp]" )
+{
+	char dir_template[] = "/tmp/atop_pagemapXXXXXX";
+	std::string root    = mkdtemp( dir_template );
+	mkdir( ( root + "/7" ).c_str(), 0755 );
+
+	atop::alp::PagemapTranslator translator( root );
+	auto page_size = translator.get_page_size();
+
+	// Virtual page 0x10 -> physical frame of 0x80000000 (present)
+	// Virtual page 0x11 -> not present
+	{
+		std::ofstream pagemap( root + "/7/pagemap", std::ios::binary );
+		uint64_t present = ( uint64_t{ 1 } << 63 ) | ( 0x80000000 / page_size );
+		uint64_t absent  = 0;
+		pagemap.seekp( static_cast<std::streamoff>( 0x10 * sizeof( uint64_t ) ) );
+		pagemap.write( reinterpret_cast<char const*>( &present ), sizeof( present ) );
+		pagemap.write( reinterpret_cast<char const*>( &absent ), sizeof( absent ) );
+	}
+
+	atop::alp::batch_t batch( 3 );
+	batch[0].pid  = 7;
+	batch[0].addr = 0x10 * page_size + 0x24;
+	batch[1].pid  = 7;
+	batch[1].addr = 0x11 * page_size;
+	batch[2].pid  = 8; // no pagemap
+	batch[2].addr = 0x10 * page_size;
+
+	translator.translate( batch );
+	REQUIRE( batch[0].addr == 0x80000024 );
+	REQUIRE( batch[1].addr == atop::alp::untranslated );
+	REQUIRE( batch[2].addr == atop::alp::untranslated );
+
+	std::remove( ( root + "/7/pagemap" ).c_str() );
+	rmdir( ( root + "/7" ).c_str() );
+	rmdir( root.c_str() );
+}
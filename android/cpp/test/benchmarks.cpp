@@ -0,0 +1,211 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+#include <re2/re2.h>
+
+#include "atop.h"
+#include "downsample.h"
+#include "events.h"
+#include "intern.h"
+#include "trace.h"
+#include "util.h"
+
+bool VERBOSE{ false };
+
+static atop::shell_out_t synthetic_ioctl_log( size_t n )
+{
+	static char const* apps[] = { "benchmark_model", "hexagon_app", "cameraserver", "mediaserver" };
+	static char const* cmds[]
+	    = { "IOCTL_KGSL_GPU_COMMAND", "FASTRPC_IOCTL_INVOKE", "ION_IOC_ALLOC", "CAM_QUERY_CAP" };
+
+	atop::shell_out_t lines;
+	lines.reserve( n );
+	for( size_t i = 0; i < n; ++i )
+		lines.push_back( fmt::format( "[ {0}.{1:06}] IOCTL kgsl: (app: {2}) (cmd: {3} [{4}]) tag",
+		                              3600 + i / 1000, i % 1000, apps[i % 4], cmds[( i / 4 ) % 4],
+		                              i % 16 ) );
+	return lines;
+}
+
+// Map based aggregation atop used before interning app names and commands
+static void legacy_breakdown( std::map<std::string, std::map<std::string, int>>& breakdown,
+                              atop::shell_out_t const& data )
+{
+	std::string tag_pattern = R"([\(\)\w\s:\-]*)";
+	std::string cmd_pattern = R"(\(cmd: ([\w\s]+) \[[\d]+\]\))";
+	std::string app_pattern
+	    = tag_pattern + R"(\(app: ([\w_:@\-]+)\))" + " " + cmd_pattern + tag_pattern;
+	RE2 re( R"(\[[\d\.\s*]+\] IOCTL [a-zA-Z]+)" + app_pattern );
+
+	std::string app, cmd;
+	for( auto&& line: data )
+	{
+		if( RE2::PartialMatch( line, re, &app, &cmd ) )
+			breakdown[app][cmd] += 1;
+	}
+}
+
+TEST_CASE( "IOCTL breakdown aggregation", "[!benchmark]" )
+{
+	auto lines = synthetic_ioctl_log( 10000 );
+
+	BENCHMARK( "std::map of strings" )
+	{
+		std::map<std::string, std::map<std::string, int>> breakdown;
+		legacy_breakdown( breakdown, lines );
+		return breakdown.size();
+	};
+
+	BENCHMARK( "event store and interned flat table" )
+	{
+		atop::events::EventStore store;
+		atop::events::Event e;
+		for( auto&& line: lines )
+			if( atop::events::parse_dmesg_line( line, e ) )
+				store.append( e );
+
+		atop::IoctlBreakdown breakdown;
+		breakdown.update( store );
+		return breakdown.rows().size();
+	};
+}
+
+TEST_CASE( "Accelerator tag counts", "[!benchmark]" )
+{
+	auto lines = synthetic_ioctl_log( 10000 );
+
+	// IoctlDmesgStreamer::interactions used to compile the pattern per line
+	BENCHMARK( "RE2 per line" )
+	{
+		std::map<std::string, int> counts;
+		for( auto&& line: lines )
+		{
+			std::string tag;
+			RE2 re( R"(IOCTL ([\w]+):)" );
+			if( RE2::PartialMatch( line, re, &tag ) )
+				counts[tag] += 1;
+		}
+		return counts.size();
+	};
+
+	BENCHMARK( "parse into event store" )
+	{
+		atop::events::EventStore store;
+		atop::events::Event e;
+		for( auto&& line: lines )
+			if( atop::events::parse_dmesg_line( line, e ) )
+				store.append( e );
+		return store.size();
+	};
+
+	atop::events::EventStore store;
+	atop::events::Event e;
+	for( auto&& line: lines )
+		if( atop::events::parse_dmesg_line( line, e ) )
+			store.append( e );
+
+	BENCHMARK( "count_by on event store" )
+	{
+		return store.count_by( atop::events::IdColumns::dev, atop::events::Query{} ).size();
+	};
+}
+
+TEST_CASE( "Event store scans", "[!benchmark]" )
+{
+	constexpr uint64_t n = 1 << 20;
+
+	atop::events::EventStore store;
+	std::vector<atop::events::Event> batch;
+	for( uint64_t i = 0; i < n; ++i )
+		batch.push_back( atop::events::Event{ i * 1000, static_cast<int32_t>( i % 8 ), 0,
+		                                      static_cast<atop::intern::string_id_t>( i % 5 ),
+		                                      static_cast<atop::intern::string_id_t>( i % 3 ), 0,
+		                                      i % 100, atop::events::EventKinds::ioctl } );
+	store.append( batch );
+
+	atop::events::Query q;
+	q.t0_ns = 0;
+	q.t1_ns = n * 1000;
+	q.app   = 2;
+
+	BENCHMARK( "count" ) { return store.count( q ); };
+	BENCHMARK( "sum_duration" ) { return store.sum_duration( q ); };
+	BENCHMARK( "histogram" ) { return store.histogram( q, 1000000 ).size(); };
+
+	// Zone maps skip all chunks outside of the window
+	auto recent  = q;
+	recent.t0_ns = ( n - 1000 ) * 1000;
+	BENCHMARK( "count of recent window" ) { return store.count( recent ); };
+}
+
+TEST_CASE( "Dmesg timestamp parsing", "[!benchmark]" )
+{
+	auto lines = synthetic_ioctl_log( 10000 );
+
+	// extract_unformatted_dmesg_ts used to go through RE2 and std::stod
+	BENCHMARK( "RE2 and std::stod" )
+	{
+		static RE2 pattern{ R"(\[([\s\d\.?]+)\])" };
+		double sum = 0.0;
+		std::string ts;
+		for( auto&& line: lines )
+			if( RE2::PartialMatch( line, pattern, &ts ) )
+				sum += std::stod( ts );
+		return sum;
+	};
+
+	BENCHMARK( "fixed point" )
+	{
+		atop::util::nanoseconds_t sum = 0, ts;
+		size_t end;
+		for( auto&& line: lines )
+			if( atop::util::parse_dmesg_ts( line, ts, end ) )
+				sum += ts;
+		return sum;
+	};
+}
+
+TEST_CASE( "Trace decoding", "[!benchmark]" )
+{
+	auto lines = synthetic_ioctl_log( 100000 );
+
+	std::ostringstream os;
+	atop::trace::Writer w( os );
+	for( auto&& line: lines )
+		w.add( line );
+	w.close();
+
+	// Throughput in text bytes is text_bytes() over the time per run
+	std::istringstream is( os.str() );
+	atop::trace::Reader r( is );
+	BENCHMARK( fmt::format( "{0} bytes of text", w.text_bytes() ) )
+	{
+		size_t n = 0;
+		r.read( [&n]( std::string_view line ) { n += line.size(); } );
+		return n;
+	};
+}
+
+TEST_CASE( "LTTB downsampling", "[!benchmark]" )
+{
+	// A day of 10 Hz samples reduced to the width of a chart
+	size_t const n = 1000000;
+	std::vector<double> x( n ), y( n );
+	for( size_t i = 0; i < n; ++i )
+	{
+		x[i] = static_cast<double>( i ) / 10.0;
+		y[i] = static_cast<double>( ( i * 7919 ) % 1000 );
+	}
+
+	BENCHMARK( "10^6 points to 2000" )
+	{
+		return atop::downsample::lttb( x.data(), y.data(), n, 2000 ).size();
+	};
+}
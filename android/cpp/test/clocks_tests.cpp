@@ -0,0 +1,106 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "clocks.h"
+
+using atop::util::ns_per_ms;
+using atop::util::ns_per_s;
+
+TEST_CASE( "Logcat timestamps are parsed", "[clocks]" )
+{
+	atop::util::nanoseconds_t ts = 0;
+	size_t pos                   = 0;
+
+	REQUIRE( atop::clocks::parse_logcat_ts( "01-01 00:00:01.250  1234  1240 I tag: hi", ts, pos ) );
+	REQUIRE( ts == ns_per_s + 250 * ns_per_ms );
+	REQUIRE( pos == 18 );
+
+	REQUIRE( atop::clocks::parse_logcat_ts( "03-01 10:20:30.000", ts, pos ) );
+	REQUIRE( ts == ( ( ( 60 * 24 + 10 ) * 60 + 20 ) * 60 + 30 ) * ns_per_s );
+
+	atop::util::nanoseconds_t leap = 0;
+	REQUIRE( atop::clocks::parse_logcat_ts( "02-29 23:59:59.999", leap, pos ) );
+	REQUIRE( leap < ts );
+
+	REQUIRE_FALSE( atop::clocks::parse_logcat_ts( "13-01 00:00:00.000", ts, pos ) );
+	REQUIRE_FALSE( atop::clocks::parse_logcat_ts( "01-01 24:00:00.000", ts, pos ) );
+	REQUIRE_FALSE( atop::clocks::parse_logcat_ts( "1-01 00:00:00.000", ts, pos ) );
+	REQUIRE_FALSE( atop::clocks::parse_logcat_ts( "--------- beginning of main", ts, pos ) );
+}
+
+TEST_CASE( "Monotonic logcat timestamps are parsed", "[clocks]" )
+{
+	atop::util::nanoseconds_t ts = 0;
+	size_t pos                   = 0;
+
+	REQUIRE( atop::clocks::parse_monotonic_ts( "  3633.459  1234  1240 I tag: hi", ts, pos ) );
+	REQUIRE( ts == 3633 * ns_per_s + 459 * ns_per_ms );
+	REQUIRE( pos == 10 );
+
+	REQUIRE_FALSE( atop::clocks::parse_monotonic_ts( "01-01 00:00:01.250 I tag: hi", ts, pos ) );
+	REQUIRE_FALSE( atop::clocks::parse_monotonic_ts( "3633 I tag: hi", ts, pos ) );
+}
+
+TEST_CASE( "Sync lines pair both clocks", "[clocks]" )
+{
+	atop::util::nanoseconds_t dmesg = 0, logcat = 0;
+
+	REQUIRE( atop::clocks::parse_sync_line( "[  100.500000] atop-clock 01-01 00:00:01.250123456",
+	                                        dmesg, logcat ) );
+	REQUIRE( dmesg == 100 * ns_per_s + 500 * ns_per_ms );
+	REQUIRE( logcat == 1250123456 );
+
+	REQUIRE_FALSE(
+	    atop::clocks::parse_sync_line( "[  100.500000] kgsl: atop-clock", dmesg, logcat ) );
+	REQUIRE_FALSE( atop::clocks::parse_sync_line( "[  100.500000] adsprpc: open", dmesg, logcat ) );
+	REQUIRE_FALSE(
+	    atop::clocks::parse_sync_line( "atop-clock 01-01 00:00:01.250", dmesg, logcat ) );
+}
+
+TEST_CASE( "Offsets are the minimum over the window", "[clocks]" )
+{
+	atop::clocks::OffsetEstimator estimator( 2 );
+	REQUIRE_FALSE( estimator.offset() );
+	REQUIRE_THROWS( estimator.to_reference( 0 ) );
+
+	// Delays of the reference reading only increase the difference
+	estimator.add( 10 * ns_per_s + 30, 2 * ns_per_s );
+	estimator.add( 11 * ns_per_s + 10, 3 * ns_per_s );
+	REQUIRE( estimator.offset() == static_cast<int64_t>( 8 * ns_per_s + 10 ) );
+	REQUIRE( estimator.to_reference( 5 * ns_per_s ) == 13 * ns_per_s + 10 );
+
+	// The oldest pair falls out of the window
+	estimator.add( 12 * ns_per_s + 20, 4 * ns_per_s );
+	estimator.add( 13 * ns_per_s + 20, 5 * ns_per_s );
+	REQUIRE( estimator.offset() == static_cast<int64_t>( 8 * ns_per_s + 20 ) );
+
+	// Negative offsets clamp at the reference clock's epoch
+	atop::clocks::OffsetEstimator behind;
+	behind.add( ns_per_s, 5 * ns_per_s );
+	REQUIRE( behind.offset() == -4 * static_cast<int64_t>( ns_per_s ) );
+	REQUIRE( behind.to_reference( 6 * ns_per_s ) == 2 * ns_per_s );
+	REQUIRE( behind.to_reference( ns_per_s ) == 0 );
+}
+
+TEST_CASE( "Sources are merged in timestamp order", "[clocks]" )
+{
+	std::vector<std::vector<atop::clocks::TimedLine>> sources{
+		{ { 1, "d1" }, { 3, "d3" }, { 3, "d3b" }, { 7, "d7" } },
+		{ { 5, "l5" }, { 0, "l0" }, { 3, "l3" } },
+		{},
+	};
+
+	std::vector<std::pair<size_t, std::string>> merged;
+	atop::clocks::merge( sources, [&merged]( size_t s, atop::clocks::TimedLine const& l ) {
+		merged.emplace_back( s, l.text );
+	} );
+
+	std::vector<std::pair<size_t, std::string>> expected{
+		{ 1, "l0" }, { 0, "d1" }, { 0, "d3" }, { 0, "d3b" },
+		{ 1, "l3" }, { 1, "l5" }, { 0, "d7" },
+	};
+	REQUIRE( merged == expected );
+}
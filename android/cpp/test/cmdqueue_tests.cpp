@@ -0,0 +1,58 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "cmdqueue.h"
+
+using namespace std::chrono_literals;
+
+TEST_CASE( "Commands run in order and complete on poll()", "[cmdqueue]" )
+{
+	std::string trace = "/tmp/atop_cmdqueue_" + std::to_string( ::getpid() );
+	std::vector<int> statuses;
+
+	atop::cmdqueue::CommandQueue q;
+	auto caller = std::this_thread::get_id();
+	auto record = [&]( atop::subprocess::Result const& r ) {
+		REQUIRE( std::this_thread::get_id() == caller );
+		statuses.push_back( r.status );
+	};
+	q.push( "first", "sleep 0.1; echo 1 > " + trace, record );
+	q.push( "second", "echo 2 >> " + trace + "; exit 4", record );
+	q.push( "no callback", "true" );
+
+	// Callbacks are only delivered by poll()
+	std::this_thread::sleep_for( 20ms );
+	REQUIRE( q.pending() > 0 );
+	REQUIRE( statuses.empty() );
+
+	for( int i = 0; i < 100 && q.pending() > 0; ++i )
+		std::this_thread::sleep_for( 20ms );
+	REQUIRE( q.pending() == 0 );
+	REQUIRE( statuses.empty() );
+
+	REQUIRE( q.poll() == 3 );
+	REQUIRE( statuses == std::vector<int>{ 0, 4 } );
+	REQUIRE( q.poll() == 0 );
+
+	atop::subprocess::Loop loop;
+	REQUIRE( loop.run( "cat " + trace + "; rm " + trace ).get().out == "1\n2\n" );
+}
+
+TEST_CASE( "Stopping runs queued commands and rejects new ones", "[cmdqueue]" )
+{
+	atop::cmdqueue::CommandQueue q( 100ms );
+	bool timed_out = false;
+	q.push( "slow", "sleep 5",
+	        [&]( atop::subprocess::Result const& r ) { timed_out = r.timed_out; } );
+	q.stop();
+
+	REQUIRE( q.poll() == 1 );
+	REQUIRE( timed_out );
+	REQUIRE_THROWS( q.push( "late", "true" ) );
+}
@@ -0,0 +1,287 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+
+#include "collector.h"
+#include "events.h"
+#include "protocol.h"
+
+using namespace std::chrono_literals;
+using atop::events::Event;
+using atop::events::EventKinds;
+using atop::events::IdColumns;
+
+static Event event_from( std::string const& line )
+{
+	Event e;
+	REQUIRE( atop::events::parse_dmesg_line( line, e ) );
+	return e;
+}
+
+static atop::protocol::Update sample_update( std::vector<size_t>& known )
+{
+	atop::protocol::Update u;
+	u.events.push_back( event_from( "[ 100.000001] IOCTL kgsl: (app: viewer_test) (cmd: "
+	                                "IOCTL_KGSL_GPU_COMMAND [12]) (time: 0.000012345)" ) );
+	u.events.push_back( event_from( "[ 100.000501] IOCTL cDSP: (app: viewer_test) (cmd: "
+	                                "FASTRPC_IOCTL_INVOKE_FD [3]) (pid: 4321) (tgid: 4300)" ) );
+	u.events.push_back( event_from( "[ 99.5] INFO: (app: viewer_test) invalidate cache" ) );
+	u.strings      = atop::protocol::new_strings( known );
+	u.interactions = std::map<std::string, int>{ { "kgsl", 1 }, { "cDSP", 1 } };
+	u.cpu          = std::map<std::string, double>{ { "cpu0", 12.34 }, { "cpu1", 0.0 } };
+	u.log_lines    = { "line 1", "line 2" };
+	return u;
+}
+
+TEST_CASE( "Updates survive encoding", "[collector]" )
+{
+	std::vector<size_t> known;
+	auto u = sample_update( known );
+	REQUIRE( !u.strings.empty() );
+	REQUIRE( atop::protocol::new_strings( known ).empty() );
+
+	auto bytes = atop::protocol::encode_hello() + atop::protocol::encode( u );
+
+	// Frames may arrive in arbitrary pieces
+	atop::protocol::Decoder d;
+	atop::protocol::Update out;
+	for( size_t i = 0; i + 1 < bytes.size(); ++i )
+	{
+		d.feed( &bytes[i], 1 );
+		REQUIRE( !d.next( out ) );
+	}
+	d.feed( &bytes.back(), 1 );
+	REQUIRE( d.greeted() );
+	REQUIRE( d.next( out ) );
+	REQUIRE( !d.next( out ) );
+
+	REQUIRE( !out.snapshot );
+	REQUIRE( out.strings.size() == u.strings.size() );
+	for( size_t i = 0; i < u.strings.size(); ++i )
+	{
+		REQUIRE( out.strings[i].col == u.strings[i].col );
+		REQUIRE( out.strings[i].id == u.strings[i].id );
+		REQUIRE( out.strings[i].name == u.strings[i].name );
+	}
+	REQUIRE( out.events.size() == u.events.size() );
+	for( size_t i = 0; i < u.events.size(); ++i )
+	{
+		REQUIRE( out.events[i].ts_ns == u.events[i].ts_ns );
+		REQUIRE( out.events[i].pid == u.events[i].pid );
+		REQUIRE( out.events[i].tid == u.events[i].tid );
+		REQUIRE( out.events[i].app == u.events[i].app );
+		REQUIRE( out.events[i].dev == u.events[i].dev );
+		REQUIRE( out.events[i].cmd == u.events[i].cmd );
+		REQUIRE( out.events[i].duration_ns == u.events[i].duration_ns );
+		REQUIRE( out.events[i].kind == u.events[i].kind );
+	}
+	REQUIRE( out.interactions == u.interactions );
+	REQUIRE( out.cpu->at( "cpu0" ) == Approx( 12.34 ) );
+	REQUIRE( out.log_lines == u.log_lines );
+
+	// Events without new strings are compact
+	atop::protocol::Update events_only;
+	events_only.events = std::vector<Event>( 100, u.events[0] );
+	REQUIRE( atop::protocol::encode( events_only ).size() < 100 * 16 );
+}
+
+TEST_CASE( "Malformed streams are rejected", "[collector]" )
+{
+	atop::protocol::Update out;
+	auto update = atop::protocol::encode( atop::protocol::Update{} );
+
+	atop::protocol::Decoder no_hello;
+	no_hello.feed( update.data(), update.size() );
+	REQUIRE_THROWS( no_hello.next( out ) );
+
+	auto hello = atop::protocol::encode_hello();
+	hello[9]++; // version
+	atop::protocol::Decoder other_version;
+	other_version.feed( hello.data(), hello.size() );
+	REQUIRE_THROWS( other_version.next( out ) );
+
+	std::string huge = { '\xff', '\xff', '\xff', '\xff', '\x02' };
+	atop::protocol::Decoder too_large;
+	too_large.feed( huge.data(), huge.size() );
+	REQUIRE_THROWS( too_large.next( out ) );
+
+	// Counts beyond the payload
+	auto bytes = atop::protocol::encode_hello() + std::string{ 3, 0, 0, 0, 2, 0, 5, 0 };
+	atop::protocol::Decoder truncated;
+	truncated.feed( bytes.data(), bytes.size() );
+	REQUIRE_THROWS( truncated.next( out ) );
+}
+
+TEST_CASE( "Collector addresses", "[collector]" )
+{
+	auto a = atop::collector::parse_address( "unix:/tmp/atop.sock" );
+	REQUIRE( a.unix_socket );
+	REQUIRE( a.host == "/tmp/atop.sock" );
+
+	a = atop::collector::parse_address( "7433" );
+	REQUIRE( !a.unix_socket );
+	REQUIRE( a.host == "127.0.0.1" );
+	REQUIRE( a.port == 7433 );
+
+	a = atop::collector::parse_address( "::1:80" );
+	REQUIRE( a.host == "::1" );
+	REQUIRE( a.port == 80 );
+
+	REQUIRE_THROWS( atop::collector::parse_address( "unix:" ) );
+	REQUIRE_THROWS( atop::collector::parse_address( "host:" ) );
+	REQUIRE_THROWS( atop::collector::parse_address( "host:70000" ) );
+}
+
+template<typename Pred> static bool eventually( Pred&& pred )
+{
+	for( int i = 0; i < 200 && !pred(); ++i )
+		std::this_thread::sleep_for( 10ms );
+	return pred();
+}
+
+TEST_CASE( "Viewers get a snapshot and then deltas", "[collector]" )
+{
+	auto addr = "unix:/tmp/atop_collector_test_" + std::to_string( ::getpid() );
+	atop::collector::Server server( addr );
+
+	std::vector<size_t> known;
+	auto first = sample_update( known );
+	server.publish( first );
+
+	int updates = 0;
+	atop::collector::Client early( addr, [&updates]( auto const& ) { updates++; } );
+	REQUIRE( eventually( [&]() { return server.subscribers() == 1; } ) );
+	REQUIRE( eventually( [&]() { return early.state().events().size() == 3; } ) );
+
+	atop::protocol::Update delta;
+	delta.events.push_back( event_from( "[ 101.0] IOCTL kgsl: (app: viewer_test) (cmd: "
+	                                    "IOCTL_KGSL_GPU_COMMAND [12]) (time: 0.000001)" ) );
+	delta.strings      = atop::protocol::new_strings( known );
+	delta.interactions = std::map<std::string, int>{ { "kgsl", 2 } };
+	delta.log_lines    = { "line 3" };
+	server.publish( delta );
+
+	atop::collector::Client late( addr );
+	for( auto* c: { &early, &late } )
+	{
+		REQUIRE( eventually( [&]() { return c->state().events().size() == 4; } ) );
+		REQUIRE( c->connected() );
+		REQUIRE( c->state().interactions() == *delta.interactions );
+		REQUIRE( c->state().cpu().at( "cpu0" ) == Approx( 12.34 ) );
+		REQUIRE( c->state().log_lines()
+		         == std::vector<std::string>{ "line 1", "line 2", "line 3" } );
+
+		atop::events::Query q;
+		q.kind = EventKinds::ioctl;
+		auto by_dev = c->state().events().count_by( IdColumns::dev, q );
+		atop::intern::string_id_t kgsl;
+		REQUIRE( atop::intern::accel_tags().find( "kgsl", kgsl ) );
+		REQUIRE( by_dev[kgsl] == 2 );
+	}
+	REQUIRE( updates == 2 );
+	REQUIRE( server.subscribers() == 2 );
+}
+
+TEST_CASE( "Mirrors keep a bounded window and snapshot it in chunks", "[collector]" )
+{
+	std::vector<size_t> known;
+	auto u = sample_update( known );
+	auto e = u.events[0];
+	u.events.clear();
+
+	// Several minutes of events, one per 30 ms
+	auto const n = 3 * atop::events::EventStore::chunk_rows;
+	for( size_t i = 0; i < n; ++i )
+	{
+		e.ts_ns = i * 30'000'000;
+		u.events.push_back( e );
+	}
+
+	atop::collector::State state;
+	state.apply( u );
+	REQUIRE( state.events().size() < n );
+	REQUIRE( state.events().size() >= atop::events::live_retention_ns / 30'000'000 );
+
+	auto parts = state.snapshot( 1000 );
+	REQUIRE( parts.size() == ( state.events().size() + 999 ) / 1000 );
+	REQUIRE( parts[0].snapshot );
+	REQUIRE( !parts[0].strings.empty() );
+	for( size_t i = 1; i < parts.size(); ++i )
+	{
+		REQUIRE( !parts[i].snapshot );
+		REQUIRE( parts[i].strings.empty() );
+		REQUIRE( parts[i].events.size() <= 1000 );
+	}
+
+	// A viewer applying the parts ends up with the same events
+	auto bytes = atop::protocol::encode_hello();
+	for( auto&& p: parts )
+		bytes += atop::protocol::encode( p );
+	atop::protocol::Decoder d;
+	d.feed( bytes.data(), bytes.size() );
+	atop::collector::State viewer;
+	atop::protocol::Update out;
+	while( d.next( out ) )
+		viewer.apply( out );
+	REQUIRE( viewer.events().size() == state.events().size() );
+	atop::events::Query q;
+	REQUIRE( viewer.events().count_by( IdColumns::dev, q )
+	         == state.events().count_by( IdColumns::dev, q ) );
+}
+
+TEST_CASE( "Events appended during a publish arrive with their strings", "[collector]" )
+{
+	// Publishes from another thread while new names are interned and
+	// their events appended, as the sampling workers of the collector do
+	atop::events::EventStore store;
+	std::atomic<bool> done{ false };
+	std::thread writer( [&]() {
+		for( int i = 0; i < 20000; ++i )
+		{
+			auto line = fmt::format( "[ 0.{0:06}] IOCTL kgsl: (app: concurrent_{0}) (cmd: "
+			                         "IOCTL_KGSL_CONCURRENT_{0} [12]) (time: 0.000001)",
+			                         i + 1 );
+			Event e;
+			if( atop::events::parse_dmesg_line( line, e ) )
+				store.append( e );
+		}
+		done = true;
+	} );
+
+	atop::collector::State viewer;
+	std::vector<size_t> known;
+	size_t sent = 0;
+	auto publish = [&]() {
+		atop::protocol::Update u;
+		sent = atop::protocol::add_events( u, store, sent, known );
+		viewer.apply( u );
+	};
+	bool last = false;
+	while( !last )
+	{
+		last = done;
+		REQUIRE_NOTHROW( publish() );
+	}
+	writer.join();
+
+	REQUIRE( sent == 20000 );
+	REQUIRE( viewer.events().size() == store.size() );
+}
+
+TEST_CASE( "Viewers notice a stopped collector", "[collector]" )
+{
+	auto addr = "unix:/tmp/atop_collector_test_" + std::to_string( ::getpid() );
+	auto server = std::make_unique<atop::collector::Server>( addr );
+	atop::collector::Client c( addr );
+	REQUIRE( eventually( [&]() { return server->subscribers() == 1; } ) );
+
+	server.reset();
+	REQUIRE( eventually( [&]() { return !c.connected(); } ) );
+	REQUIRE_THROWS( atop::collector::Client( addr ) );
+}
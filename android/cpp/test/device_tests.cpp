@@ -0,0 +1,95 @@
+#include <cstdlib>
+
+#include <catch2/catch.hpp>
+
+#include "atop.h"
+
+TEST_CASE( "Parse startup probe output", "[device]" )
+{
+	atop::shell_out_t out = { "user=root",
+		                      "nn_vlog=1",
+		                      "framework=tflite",
+		                      "framework=SNPE",
+		                      "model.tflite=/data/local/tmp/mobilenet_v1.tflite",
+		                      "model.tflite=/data/local/tmp/mobilenet_v1_quant.tflite",
+		                      "model.SNPE=/data/local/tmp/snpebm/models/inception/inception.dlc",
+		                      "file=4 0bee89b07a248e27c83fc3d5951213c1 /data/local/tmp/a.tflite",
+		                      "knob=gpu",
+		                      "cache_key=google/x:13/TQ1A/1:user/release-keys@1792398168",
+		                      "setup output without key" };
+
+	auto info = atop::parse_device_probe( out );
+	REQUIRE( info.root );
+	REQUIRE( info.nn_vlog == "1" );
+	REQUIRE( info.frameworks.count( atop::Frameworks::tflite ) == 1 );
+	REQUIRE( info.frameworks.count( atop::Frameworks::SNPE ) == 1 );
+	REQUIRE( info.frameworks.count( atop::Frameworks::tflite_app ) == 0 );
+
+	REQUIRE( atop::get_models_on_device( info, atop::Frameworks::tflite ).size() == 2 );
+	REQUIRE( atop::get_models_on_device( info, atop::Frameworks::SNPE )[0]
+	         == "/data/local/tmp/snpebm/models/inception/inception.dlc" );
+
+	REQUIRE( info.model_files["/data/local/tmp/a.tflite"].size == 4 );
+	REQUIRE( info.model_files["/data/local/tmp/a.tflite"].md5
+	         == "0bee89b07a248e27c83fc3d5951213c1" );
+	REQUIRE( info.knobs == std::set<std::string>{ "gpu" } );
+	REQUIRE( info.cache_key == "google/x:13/TQ1A/1:user/release-keys@1792398168" );
+
+	// The app runs the binary's models
+	REQUIRE( info.models[atop::Frameworks::tflite_app].size() == 2 );
+
+	REQUIRE( info.malformed_lines == 0 );
+
+	auto user = atop::parse_device_probe( { "user=shell", "nn_vlog=" } );
+	REQUIRE_FALSE( user.root );
+	REQUIRE( user.nn_vlog.empty() );
+	REQUIRE( user.models[atop::Frameworks::tflite].empty() );
+
+	// Truncated or corrupt cache lines are skipped
+	auto corrupt = atop::parse_device_probe(
+	    { "file=4x 0bee89b07a248e27c83fc3d5951213c1 /data/local/tmp/a.tflite",
+	      "file=99999999999999999999 0bee89b07a248e27c83fc3d5951213c1 /data/local/tmp/b.tflite",
+	      "file= 0bee89b07a248e27c83fc3d5951213c1 /data/local/tmp/c.tflite", "file=4",
+	      "framework=tfl", "model.tfl=/data/local/tmp/d.tflite", "knob=dsp" } );
+	REQUIRE( corrupt.model_files.empty() );
+	REQUIRE( corrupt.frameworks.empty() );
+	REQUIRE( corrupt.knobs == std::set<std::string>{ "dsp" } );
+	REQUIRE( corrupt.malformed_lines == 6 );
+}
+
+TEST_CASE( "Device caches are kept per serial", "[device]" )
+{
+	setenv( "XDG_CACHE_HOME", "/tmp/atop-cache", 1 );
+	REQUIRE( atop::device_cache_path( "emulator-5554" ) == "/tmp/atop-cache/atop/emulator-5554" );
+	REQUIRE( atop::device_cache_path( "192.168.1.2:5555" )
+	         == "/tmp/atop-cache/atop/192.168.1.2_5555" );
+	REQUIRE( atop::device_cache_path( "../x" ) == "/tmp/atop-cache/atop/.._x" );
+	unsetenv( "XDG_CACHE_HOME" );
+}
+
+TEST_CASE( "dmesg coverage between polls", "[device]" )
+{
+	atop::shell_out_t log = { "[   10.000000] a", "continued", "[   11.000000] bb",
+		                      "[   12.500000] ccc" };
+
+	auto first = atop::dmesg_coverage( log, 0 );
+	REQUIRE( first.bytes == 17 + 10 + 18 + 19 );
+	REQUIRE( first.new_bytes == first.bytes );
+	REQUIRE( first.newest_ns == 12'500'000'000 );
+	REQUIRE( !first.wrapped );
+
+	// Only lines after the previous newest one are new
+	auto again = atop::dmesg_coverage( log, 11'000'000'000 );
+	REQUIRE( again.new_bytes == 19 );
+	REQUIRE( !again.wrapped );
+
+	auto quiet = atop::dmesg_coverage( log, first.newest_ns );
+	REQUIRE( quiet.new_bytes == 0 );
+	REQUIRE( quiet.newest_ns == first.newest_ns );
+
+	// The ring no longer holds the line following the previous dump
+	auto wrapped = atop::dmesg_coverage( log, 9'000'000'000 );
+	REQUIRE( wrapped.wrapped );
+	REQUIRE( wrapped.gap_start_ns == 9'000'000'001 );
+	REQUIRE( wrapped.gap_end_ns == 10'000'000'000 );
+}
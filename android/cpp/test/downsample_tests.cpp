@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "downsample.h"
+
+TEST_CASE( "LTTB keeps short series", "[downsample]" )
+{
+	std::vector<double> x = { 0, 1, 2, 3 }, y = { 1, 5, 2, 4 };
+	REQUIRE( atop::downsample::lttb( x.data(), y.data(), x.size(), 10 )
+	         == std::vector<size_t>{ 0, 1, 2, 3 } );
+	REQUIRE( atop::downsample::lttb( x.data(), y.data(), x.size(), 2 ).size() == 4 );
+	REQUIRE( atop::downsample::lttb( x.data(), y.data(), 0, 10 ).empty() );
+}
+
+TEST_CASE( "LTTB selects threshold points and keeps peaks", "[downsample]" )
+{
+	constexpr size_t n = 100000;
+	std::vector<double> x( n ), y( n );
+	for( size_t i = 0; i < n; ++i )
+	{
+		x[i] = static_cast<double>( i );
+		y[i] = std::sin( static_cast<double>( i ) / 1000.0 );
+	}
+
+	// Single-sample spikes that striding would miss
+	y[12345] = 50.0;
+	y[67891] = -50.0;
+
+	auto kept = atop::downsample::lttb( x.data(), y.data(), n, 500 );
+	REQUIRE( kept.size() == 500 );
+	REQUIRE( kept.front() == 0 );
+	REQUIRE( kept.back() == n - 1 );
+	for( size_t i = 1; i < kept.size(); ++i )
+		REQUIRE( kept[i - 1] < kept[i] );
+
+	REQUIRE( std::find( kept.begin(), kept.end(), 12345 ) != kept.end() );
+	REQUIRE( std::find( kept.begin(), kept.end(), 67891 ) != kept.end() );
+
+	// Exactly three points: first, the most extreme one and last
+	std::vector<double> px = { 0, 1, 2, 3, 4 }, py = { 0, 1, 9, 1, 0 };
+	REQUIRE( atop::downsample::lttb( px.data(), py.data(), px.size(), 3 )
+	         == std::vector<size_t>{ 0, 2, 4 } );
+}
@@ -0,0 +1,182 @@
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "events.h"
+#include "intern.h"
+
+using atop::events::Event;
+using atop::events::EventKinds;
+using atop::events::EventStore;
+using atop::events::IdColumns;
+using atop::events::Query;
+
+TEST_CASE( "Parse instrumented driver lines", "[events]" )
+{
+	Event e;
+
+	REQUIRE( atop::events::parse_dmesg_line(
+	    "[ 3633.459327] IOCTL kgsl: (app: benchmark_model) (cmd: IOCTL_KGSL_GPU_COMMAND [12]) "
+	    "(device: kgsl-3d0) (time: 0.000012345)",
+	    e ) );
+	REQUIRE( e.kind == EventKinds::ioctl );
+	REQUIRE( e.ts_ns == 3633459327000ull );
+	REQUIRE( atop::intern::accel_tags().name( e.dev ) == "kgsl" );
+	REQUIRE( atop::intern::app_names().name( e.app ) == "benchmark_model" );
+	REQUIRE( atop::intern::ioctl_cmds().name( e.cmd ) == "IOCTL_KGSL_GPU_COMMAND" );
+	REQUIRE( e.duration_ns == 12345 );
+	REQUIRE( e.pid == atop::events::no_pid );
+
+	REQUIRE( atop::events::parse_dmesg_line(
+	    "[   12.5] IOCTL cDSP: (channel: cdsprpc-smd) (app: hexagon_app) (cmd: "
+	    "FASTRPC_IOCTL_INVOKE_FD [3]) (pid: 4321) (tgid: 4300) (cid: 3) (sessionid: 0) ",
+	    e ) );
+	REQUIRE( e.ts_ns == 12500000000ull );
+	REQUIRE( atop::intern::accel_tags().name( e.dev ) == "cDSP" );
+	REQUIRE( atop::intern::ioctl_cmds().name( e.cmd ) == "FASTRPC_IOCTL_INVOKE_FD" );
+	REQUIRE( e.tid == 4321 );
+	REQUIRE( e.pid == 4300 );
+	REQUIRE( e.duration_ns == 0 );
+
+	REQUIRE( atop::events::parse_dmesg_line( "[ 1.000001] INFO: (app: hexagon_app) invalidate cache",
+	                                         e ) );
+	REQUIRE( e.kind == EventKinds::info );
+	REQUIRE( e.dev == atop::events::none_id );
+	REQUIRE( atop::intern::ioctl_cmds().name( e.cmd ) == "invalidate cache" );
+
+	REQUIRE_FALSE( atop::events::parse_dmesg_line( "[ 1.0] TIME: something", e ) );
+	REQUIRE_FALSE( atop::events::parse_dmesg_line( "IOCTL kgsl: (app: a)", e ) );
+	REQUIRE_FALSE( atop::events::parse_dmesg_line( "[ abc] IOCTL kgsl: (app: a)", e ) );
+}
+
+TEST_CASE( "Fields of driver lines", "[events]" )
+{
+	std::string_view line = "TIME ioctl (app: a b) (pid: 42) (tgid: x) (cid: 3";
+	REQUIRE( atop::events::field( line, "(app: " ) == "a b" );
+	REQUIRE( atop::events::field( line, "(cid: " ).empty() );
+	REQUIRE( atop::events::field( line, "(cmd: " ).empty() );
+	REQUIRE( atop::events::pid_field( line, "(pid: " ) == 42 );
+	REQUIRE( atop::events::pid_field( line, "(tgid: " ) == atop::events::no_pid );
+	REQUIRE( atop::events::pid_field( line, "(sessionid: " ) == atop::events::no_pid );
+}
+
+TEST_CASE( "Aggregation queries match a row-wise scan", "[events]" )
+{
+	auto apps = std::vector<atop::intern::string_id_t>{ atop::intern::app_names().intern( "a0" ),
+		                                                atop::intern::app_names().intern( "a1" ),
+		                                                atop::intern::app_names().intern( "a2" ) };
+	auto devs = std::vector<atop::intern::string_id_t>{ atop::intern::accel_tags().intern( "d0" ),
+		                                                atop::intern::accel_tags().intern( "d1" ) };
+
+	// Several chunks with timestamps slightly out of order
+	std::mt19937_64 gen( 7 );
+	std::vector<Event> rows;
+	EventStore store;
+	for( uint64_t i = 0; i < 3 * EventStore::chunk_rows + 17; ++i )
+	{
+		Event e{ i * 1000 + gen() % 1500,
+			     static_cast<int32_t>( gen() % 4 ),
+			     atop::events::no_pid,
+			     apps[gen() % apps.size()],
+			     ( gen() % 5 == 0 ) ? atop::events::none_id : devs[gen() % devs.size()],
+			     atop::events::none_id,
+			     gen() % 100,
+			     ( gen() % 3 == 0 ) ? EventKinds::info : EventKinds::ioctl };
+		rows.push_back( e );
+		if( i % 2 )
+			store.append( e );
+		else
+			store.append( std::vector<Event>{ e } );
+	}
+	REQUIRE( store.size() == rows.size() );
+
+	Query q;
+	q.t0_ns = 2'000'000;
+	q.t1_ns = 9'500'000;
+	q.kind  = EventKinds::ioctl;
+	q.app   = apps[1];
+
+	uint64_t count = 0, sum = 0;
+	std::vector<uint64_t> hist( 8, 0 );
+	std::vector<uint64_t> by_dev( atop::intern::accel_tags().size(), 0 );
+	for( auto&& e: rows )
+	{
+		if( e.ts_ns < q.t0_ns || e.ts_ns >= q.t1_ns || e.kind != *q.kind || e.app != *q.app )
+			continue;
+		++count;
+		sum += e.duration_ns;
+		hist[( e.ts_ns - q.t0_ns ) / 1'000'000] += 1;
+		if( e.dev != atop::events::none_id )
+			by_dev[e.dev] += 1;
+	}
+	REQUIRE( count > 0 );
+
+	REQUIRE( store.count( q ) == count );
+	REQUIRE( store.sum_duration( q ) == sum );
+	REQUIRE( store.histogram( q, 1'000'000 ) == hist );
+	REQUIRE( store.count_by( IdColumns::dev, q ) == by_dev );
+
+	Query by_pid;
+	by_pid.pid = 3;
+	uint64_t pid_count = 0;
+	for( auto&& e: rows )
+		pid_count += ( e.pid == 3 );
+	REQUIRE( store.count( by_pid ) == pid_count );
+	REQUIRE( store.count( Query{} ) == rows.size() );
+
+	REQUIRE_THROWS( store.histogram( Query{}, 1000 ) );
+	REQUIRE_THROWS( store.histogram( q, 0 ) );
+}
+
+TEST_CASE( "Scans resume where they left off", "[events]" )
+{
+	EventStore store;
+	for( uint64_t i = 0; i < EventStore::chunk_rows + 10; ++i )
+		store.append( Event{ i, 0, 0, 0, 0, 0, i, EventKinds::ioctl } );
+
+	uint64_t expected = 5;
+	auto next         = store.scan( 5, [&expected]( Event const& e ) {
+        REQUIRE( e.ts_ns == expected );
+        REQUIRE( e.duration_ns == expected );
+        ++expected;
+    } );
+	REQUIRE( next == store.size() );
+	REQUIRE( expected == store.size() );
+
+	REQUIRE( store.scan( next, []( Event const& ) { FAIL(); } ) == next );
+
+	store.clear();
+	REQUIRE( store.size() == 0 );
+	REQUIRE( store.count( Query{} ) == 0 );
+}
+
+TEST_CASE( "Old chunks are evicted without renumbering rows", "[events]" )
+{
+	EventStore store;
+	auto const n = 2 * EventStore::chunk_rows + 10;
+	for( uint64_t i = 0; i < n; ++i )
+		store.append( Event{ i, 0, 0, 0, 0, 0, 1, EventKinds::ioctl } );
+
+	// The second chunk still holds a row at ts_ns
+	REQUIRE( store.evict_before( EventStore::chunk_rows + 1 ) == EventStore::chunk_rows );
+	REQUIRE( store.first_row() == EventStore::chunk_rows );
+	REQUIRE( store.size() == n - EventStore::chunk_rows );
+	REQUIRE( store.count( Query{} ) == n - EventStore::chunk_rows );
+
+	// Scans from evicted rows start at the oldest stored one
+	uint64_t expected = EventStore::chunk_rows;
+	auto next         = store.scan( 3, [&expected]( Event const& e ) {
+        REQUIRE( e.ts_ns == expected );
+        ++expected;
+    } );
+	REQUIRE( next == n );
+	REQUIRE( expected == n );
+
+	// The partly filled chunk is kept even when all of its rows are old
+	REQUIRE( store.evict_before( n ) == EventStore::chunk_rows );
+	REQUIRE( store.size() == 10 );
+	REQUIRE( store.scan( next, []( Event const& ) { FAIL(); } ) == next );
+}
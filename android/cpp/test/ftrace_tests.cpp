@@ -0,0 +1,312 @@
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+
+#include "ftrace.h"
+
+static constexpr auto header_page = "\tfield: u64 timestamp;\toffset:0;\tsize:8;\tsigned:0;\n"
+                                    "\tfield: local_t commit;\toffset:8;\tsize:8;\tsigned:1;\n"
+                                    "\tfield: int overwrite;\toffset:8;\tsize:1;\tsigned:1;\n"
+                                    "\tfield: char data;\toffset:16;\tsize:4080;\tsigned:0;\n";
+
+static constexpr auto print_format = R"(name: print
+ID: 5
+format:
+	field:unsigned short common_type;	offset:0;	size:2;	signed:0;
+	field:unsigned char common_flags;	offset:2;	size:1;	signed:0;
+	field:unsigned char common_preempt_count;	offset:3;	size:1;	signed:0;
+	field:int common_pid;	offset:4;	size:4;	signed:1;
+
+	field:unsigned long ip;	offset:8;	size:8;	signed:0;
+	field:char buf[];	offset:16;	size:0;	signed:0;
+
+print fmt: "%ps: %s", (void *)REC->ip, REC->buf
+)";
+
+static constexpr auto bprint_format = R"(name: bprint
+ID: 6
+format:
+	field:unsigned short common_type;	offset:0;	size:2;	signed:0;
+	field:unsigned char common_flags;	offset:2;	size:1;	signed:0;
+	field:unsigned char common_preempt_count;	offset:3;	size:1;	signed:0;
+	field:int common_pid;	offset:4;	size:4;	signed:1;
+
+	field:unsigned long ip;	offset:8;	size:8;	signed:0;
+	field:const char * fmt;	offset:16;	size:8;	signed:0;
+	field:u32 buf[];	offset:24;	size:0;	signed:0;
+
+print fmt: "%ps: %s", (void *)REC->ip, REC->fmt
+)";
+
+static constexpr auto ioctl_fmt
+    = "IOCTL %s: (app: %s) (cmd: %s [%u]) (pid: %u) (tgid: %d) (time: %llu.%0.9u)\n";
+static constexpr uint64_t ioctl_fmt_addr = 0xffffffffc0a1b2c3;
+
+// Little endian bytes of v
+static std::string le( uint64_t v, size_t size )
+{
+	std::string s;
+	for( size_t i = 0; i < size; ++i )
+		s += static_cast<char>( ( v >> ( 8 * i ) ) & 0xff );
+	return s;
+}
+
+static std::string from_hex( std::string_view hex )
+{
+	std::string s;
+	for( size_t i = 0; i + 1 < hex.size(); i += 2 )
+		s += static_cast<char>( std::stoi( std::string( hex.substr( i, 2 ) ), nullptr, 16 ) );
+	return s;
+}
+
+// Arguments of ioctl_fmt as packed by vbin_printf()
+static std::string ioctl_args( std::string const& app, uint32_t pid, uint64_t time_ns )
+{
+	std::string args = std::string( "adsprpc-smd" ) + '\0' + app + '\0' + "FASTRPC_IOCTL_INVOKE_FD"
+	                   + '\0';
+	args.resize( ( args.size() + 3 ) / 4 * 4, '\0' );
+	return args + le( 3, 4 ) + le( pid, 4 ) + le( pid - 1, 4 ) + le( time_ns / 1000000000, 8 )
+	       + le( time_ns % 1000000000, 4 );
+}
+
+static std::string print_payload( std::string const& text )
+{
+	return le( 5, 2 ) + le( 0, 2 ) + le( 42, 4 ) + le( 0xffffffff814b589d, 8 ) + text + '\0';
+}
+
+static std::string bprint_payload( uint64_t fmt_addr, std::string const& args )
+{
+	return le( 6, 2 ) + le( 0, 2 ) + le( 42, 4 ) + le( 0xffffffff814b589d, 8 ) + le( fmt_addr, 8 )
+	       + args;
+}
+
+// Page of the layout of header_page
+class PageBuilder
+{
+  public:
+	explicit PageBuilder( uint64_t ts_ns )
+	    : page( le( ts_ns, 8 ) + le( 0, 8 ) )
+	{
+	}
+
+	void record( uint32_t delta, std::string payload )
+	{
+		payload.resize( ( payload.size() + 3 ) / 4 * 4, '\0' );
+		if( payload.size() <= 28 * 4 )
+			this->page += le( payload.size() / 4 | delta << 5, 4 );
+		else
+			this->page += le( delta << 5, 4 ) + le( payload.size() + 4, 4 );
+		this->page += payload;
+	}
+
+	void extend( uint64_t delta )
+	{
+		this->page += le( 30 | ( delta & ( ( 1 << 27 ) - 1 ) ) << 5, 4 ) + le( delta >> 27, 4 );
+	}
+
+	void discarded( uint32_t delta, uint32_t bytes )
+	{
+		this->page += le( 29 | delta << 5, 4 ) + le( bytes, 4 ) + std::string( bytes - 4, 'x' );
+	}
+
+	std::string finish( bool missed = false )
+	{
+		auto commit = ( this->page.size() - 16 ) | ( missed ? 1ULL << 31 : 0 );
+		auto out    = this->page.substr( 0, 8 ) + le( commit, 8 ) + this->page.substr( 16 );
+		out.resize( 4096, '\0' );
+		return out;
+	}
+
+  private:
+	std::string page;
+};
+
+TEST_CASE( "Parse ftrace formats", "[ftrace]" )
+{
+	auto print = atop::ftrace::parse_format( print_format );
+	REQUIRE( print.name == "print" );
+	REQUIRE( print.id == 5 );
+	REQUIRE( print.fields.size() == 6 );
+	REQUIRE( print.field( "buf" )->offset == 16 );
+	REQUIRE( print.field( "buf" )->size == 0 );
+	REQUIRE( print.field( "common_pid" )->is_signed );
+	REQUIRE( print.field( "missing" ) == nullptr );
+
+	auto bprint = atop::ftrace::parse_format( bprint_format );
+	REQUIRE( bprint.field( "fmt" )->type == "const char *" );
+
+	auto exec = atop::ftrace::parse_format(
+	    "name: sched_process_exec\nID: 365\nformat:\n"
+	    "\tfield:__data_loc char[] filename;\toffset:8;\tsize:4;\tsigned:0;\n"
+	    "\tfield:char comm[16];\toffset:12;\tsize:16;\tsigned:1;\n" );
+	REQUIRE( exec.field( "filename" )->data_loc );
+	REQUIRE( exec.field( "comm" )->size == 16 );
+
+	REQUIRE_THROWS( atop::ftrace::parse_format( "name: x\nformat:\n" ) );
+	REQUIRE_THROWS( atop::ftrace::parse_format( "name: x\nID: 1\n\tfield:int a;\toffset:0;\n" ) );
+
+	auto layout = atop::ftrace::parse_header_page( header_page );
+	REQUIRE( layout.commit_offset == 8 );
+	REQUIRE( layout.commit_size == 8 );
+	REQUIRE( layout.data_offset == 16 );
+	REQUIRE( layout.page_size == 4096 );
+
+	auto formats = atop::ftrace::parse_printk_formats(
+	    "0xffffffffc0a1b2c3 : \"IOCTL %s: \\\"x\\\"\\n\"\n0xffffffff8100 : \"b\"\ngarbage\n" );
+	REQUIRE( formats.size() == 2 );
+	REQUIRE( formats[0xffffffffc0a1b2c3] == "IOCTL %s: \"x\"\n" );
+	REQUIRE( formats[0xffffffff8100] == "b" );
+}
+
+TEST_CASE( "Format binary printk arguments", "[ftrace]" )
+{
+	auto args = ioctl_args( "benchmark_model", 123, 1000012345 );
+	REQUIRE( atop::ftrace::format_binary( ioctl_fmt, args )
+	         == "IOCTL adsprpc-smd: (app: benchmark_model) (cmd: FASTRPC_IOCTL_INVOKE_FD [3]) "
+	            "(pid: 123) (tgid: 122) (time: 1.000012345)\n" );
+
+	// Shorts and chars are aligned to their size, negative values sign extended
+	args = le( 0xfffe, 2 ) + "z" + std::string( 1, '\0' ) + le( 7, 4 ) + le( 255, 4 )
+	       + le( 0xff, 4 );
+	REQUIRE( atop::ftrace::format_binary( "%hd %c %*d %x%%", args ) == "-2 z     255 ff%" );
+
+	// Stops at missing arguments
+	REQUIRE( atop::ftrace::format_binary( "a %u b %u", le( 1, 4 ) ) == "a 1 b " );
+}
+
+TEST_CASE( "Decode ftrace pages", "[ftrace]" )
+{
+	auto layout = atop::ftrace::parse_header_page( header_page );
+
+	// Recorded from trace_pipe_raw after two trace_marker writes
+	auto recorded = from_hex( "6137ac4fae0b00004800000000000000"
+	                          "0900000005000001161900009d584b81"
+	                          "ffffffff68656c6c6f2054494d452078"
+	                          "3a20302e310a000007eb080005000001"
+	                          "161900009d584b81ffffffff7365636f"
+	                          "6e640a00" );
+	recorded.resize( 4096, '\0' );
+
+	std::vector<atop::ftrace::Record> records;
+	auto collect = [&records]( atop::ftrace::Record const& r ) { records.push_back( r ); };
+	REQUIRE_FALSE( atop::ftrace::decode_page( recorded, layout, 0, collect ) );
+	REQUIRE( records.size() == 2 );
+	REQUIRE( records[0].ts_ns == 12843288901473 );
+	REQUIRE( records[1].ts_ns == 12843288901473 + 18264 );
+	REQUIRE( records[0].type() == 5 );
+
+	auto print = atop::ftrace::parse_format( print_format );
+	REQUIRE( atop::ftrace::string( records[0], *print.field( "buf" ) ) == "hello TIME x: 0.1\n" );
+	REQUIRE( atop::ftrace::string( records[1], *print.field( "buf" ) ) == "second\n" );
+	REQUIRE( atop::ftrace::integer( records[0], *print.field( "common_pid" ) ) == 0x1916 );
+
+	// Long records, time extensions and discarded records
+	PageBuilder b( 1000 );
+	b.record( 5, print_payload( "short" ) );
+	b.extend( 1ULL << 30 );
+	b.discarded( 7, 16 );
+	b.record( 10, print_payload( std::string( 200, 'l' ) ) );
+	records.clear();
+	REQUIRE( atop::ftrace::decode_page( b.finish( true ), layout, 3, collect ) );
+	REQUIRE( records.size() == 2 );
+	REQUIRE( records[0].ts_ns == 1005 );
+	REQUIRE( records[1].ts_ns == 1005 + ( 1ULL << 30 ) + 10 );
+	REQUIRE( records[1].cpu == 3 );
+	REQUIRE( atop::ftrace::string( records[1], *print.field( "buf" ) ) == std::string( 200, 'l' ) );
+
+	// Records beyond the commit
+	auto corrupt = b.finish();
+	corrupt[8]   = static_cast<char>( 0xf0 );
+	REQUIRE_THROWS( atop::ftrace::decode_page( corrupt, layout, 0, collect ) );
+}
+
+TEST_CASE( "Merge per-CPU ftrace streams", "[ftrace]" )
+{
+	namespace fs = std::filesystem;
+	auto root    = fs::temp_directory_path() / fmt::format( "atop_ftrace_{0}", getpid() );
+	fs::create_directories( root / "events" / "ftrace" / "print" );
+	fs::create_directories( root / "events" / "ftrace" / "bprint" );
+	auto write = [&root]( fs::path const& path, std::string const& data ) {
+		fs::create_directories( ( root / path ).parent_path() );
+		std::ofstream( root / path, std::ios::binary ) << data;
+	};
+	write( "events/header_page", header_page );
+	write( "events/ftrace/print/format", print_format );
+	write( "events/ftrace/bprint/format", bprint_format );
+	write( "printk_formats", fmt::format( "{0:#x} : \"{1}\\n\"\n", ioctl_fmt_addr,
+	                                      std::string( ioctl_fmt, std::strlen( ioctl_fmt ) - 1 ) ) );
+
+	// CPU 0 logs at 10 and 30 us and on a second page at 50 us, CPU 1 at
+	// 20 us and an unknown format at 40 us
+	PageBuilder cpu0( 10000 );
+	cpu0.record( 0, bprint_payload( ioctl_fmt_addr, ioctl_args( "a", 10, 100 ) ) );
+	cpu0.record( 20000, print_payload( "INFO: (app: a) opening\n" ) );
+	PageBuilder cpu0_next( 50000 );
+	cpu0_next.record( 0, print_payload( "third" ) );
+	write( "per_cpu/cpu0/trace_pipe_raw", cpu0.finish() + cpu0_next.finish() );
+
+	PageBuilder cpu1( 20000 );
+	cpu1.record( 0, bprint_payload( ioctl_fmt_addr, ioctl_args( "b", 20, 200 ) ) );
+	cpu1.record( 20000, bprint_payload( 0x1234, ioctl_args( "c", 30, 300 ) ) );
+	write( "per_cpu/cpu1/trace_pipe_raw", cpu1.finish() );
+
+	std::vector<std::string> lines;
+	auto n = atop::ftrace::read_messages(
+	    root.string(), [&lines]( atop::util::nanoseconds_t ts_ns, std::string_view msg ) {
+		    lines.push_back( atop::ftrace::dmesg_line( ts_ns, msg ) );
+	    } );
+	REQUIRE( n == 4 );
+	REQUIRE( lines.size() == 4 );
+	REQUIRE( lines[0]
+	         == "[    0.000010] IOCTL adsprpc-smd: (app: a) (cmd: FASTRPC_IOCTL_INVOKE_FD [3]) "
+	            "(pid: 10) (tgid: 9) (time: 0.000000100)" );
+	REQUIRE( lines[1].rfind( "[    0.000020] IOCTL adsprpc-smd: (app: b)", 0 ) == 0 );
+	REQUIRE( lines[2] == "[    0.000030] INFO: (app: a) opening" );
+	REQUIRE( lines[3] == "[    0.000050] third" );
+
+	fs::remove_all( root );
+	REQUIRE_THROWS( atop::ftrace::read_messages( root.string(), []( auto, auto ) {} ) );
+}
+
+TEST_CASE( "Read a local tracefs", "[ftrace]" )
+{
+	// Uses an instance with its own buffer; needs root and a mounted tracefs
+	std::string tracefs = "/sys/kernel/tracing";
+	auto instance       = fmt::format( "{0}/instances/atop_test_{1}", tracefs, getpid() );
+	if( access( ( tracefs + "/instances" ).c_str(), W_OK ) != 0
+	    || mkdir( instance.c_str(), 0755 ) != 0 )
+	{
+		WARN( "No writable tracefs at " << tracefs );
+		return;
+	}
+
+	{
+		std::ofstream marker( instance + "/trace_marker" );
+		marker << "INFO: (app: atop_test) first" << std::flush;
+		marker << "INFO: (app: atop_test) second" << std::flush;
+	}
+
+	std::vector<std::string> messages;
+	atop::util::nanoseconds_t prev_ns = 0;
+	bool ordered                      = true;
+	atop::ftrace::read_messages(
+	    instance, [&]( atop::util::nanoseconds_t ts_ns, std::string_view msg ) {
+		    ordered = ordered && ts_ns >= prev_ns;
+		    prev_ns = ts_ns;
+		    messages.emplace_back( msg );
+	    } );
+	rmdir( instance.c_str() );
+
+	REQUIRE( ordered );
+	REQUIRE( messages == std::vector<std::string>{ "INFO: (app: atop_test) first",
+	                                               "INFO: (app: atop_test) second" } );
+}
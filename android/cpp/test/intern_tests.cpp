@@ -0,0 +1,108 @@
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "atop.h"
+#include "events.h"
+#include "intern.h"
+#include "util.h"
+
+TEST_CASE( "Interned strings get dense stable ids", "[intern]" )
+{
+	atop::intern::StringInterner interner;
+	auto a = interner.intern( "vendor.qti.hardware" );
+	auto b = interner.intern( "com.example.app" );
+	REQUIRE( a == 0 );
+	REQUIRE( b == 1 );
+
+	std::string copy = "vendor.qti.hardware";
+	REQUIRE( interner.intern( copy ) == a );
+	REQUIRE( interner.name( b ) == "com.example.app" );
+	REQUIRE( interner.size() == 2 );
+
+	atop::intern::string_id_t id;
+	REQUIRE( interner.find( "com.example.app", id ) );
+	REQUIRE( id == b );
+	REQUIRE_FALSE( interner.find( "unknown", id ) );
+	REQUIRE_THROWS_AS( interner.name( 42 ), std::out_of_range );
+
+	// Views of earlier names stay valid while the interner grows
+	auto view = interner.name( a );
+	for( int i = 0; i < 1000; ++i )
+		interner.intern( std::to_string( i ) );
+	REQUIRE( view == "vendor.qti.hardware" );
+}
+
+TEST_CASE( "Flat counter grows and clears", "[intern]" )
+{
+	atop::intern::FlatCounter counter( 4 );
+	for( uint32_t i = 0; i < 500; ++i )
+		counter.increment( atop::intern::pack( i % 7, i ), i % 3 == 0 ? 2 : 1 );
+	counter.increment( atop::intern::pack( 3, 10 ), 5 );
+
+	REQUIRE( counter.size() == 500 );
+	REQUIRE( counter.get( atop::intern::pack( 3, 10 ) ) == 6 );
+	REQUIRE( counter.get( atop::intern::pack( 0, 1 ) ) == 0 );
+
+	int64_t total = 0;
+	counter.for_each( [&total]( uint64_t key, int64_t cnt ) {
+		REQUIRE( atop::intern::unpack_hi( key ) == atop::intern::unpack_lo( key ) % 7 );
+		total += cnt;
+	} );
+	REQUIRE( total == 500 + 167 + 5 );
+
+	counter.clear();
+	REQUIRE( counter.empty() );
+	REQUIRE( counter.get( atop::intern::pack( 3, 10 ) ) == 0 );
+}
+
+TEST_CASE( "Regex matcher exposes captures as views", "[intern]" )
+{
+	atop::util::RegexMatcher matcher( R"(app: ([\w\.]+) cmd: (\w+))" );
+	REQUIRE( matcher.find( "[ 1.0] app: benchmark_model cmd: EXEC trailing" ) );
+	REQUIRE( matcher[0] == "benchmark_model" );
+	REQUIRE( matcher[1] == "EXEC" );
+	REQUIRE_FALSE( matcher.find( "no match" ) );
+	REQUIRE_THROWS( atop::util::RegexMatcher( "(unbalanced" ) );
+}
+
+TEST_CASE( "IOCTL and INFO breakdowns", "[intern]" )
+{
+	atop::shell_out_t lines
+	    = { "[ 3633.459327] IOCTL kgsl: (app: benchmark_model) (cmd: IOCTL_KGSL_GPU_COMMAND [12]) gpu",
+		    "[ 3633.459400] IOCTL kgsl: (app: benchmark_model) (cmd: IOCTL_KGSL_GPU_COMMAND [12]) gpu",
+		    "[ 3633.459500] IOCTL adsprpc: (app: hexagon_app) (cmd: FASTRPC_IOCTL_INVOKE [3]) dsp",
+		    "[ 3633.459600] unrelated line",
+		    "[ 3633.5] INFO: (app: benchmark_model) open /dev/kgsl-3d0" };
+
+	atop::events::EventStore store;
+	atop::events::Event e;
+	for( auto&& line: lines )
+		if( atop::events::parse_dmesg_line( line, e ) )
+			store.append( e );
+
+	atop::IoctlBreakdown breakdown;
+	REQUIRE( breakdown.empty() );
+	breakdown.update( store );
+
+	REQUIRE( breakdown.count( "benchmark_model", "IOCTL_KGSL_GPU_COMMAND" ) == 2 );
+	REQUIRE( breakdown.count( "hexagon_app", "FASTRPC_IOCTL_INVOKE" ) == 1 );
+	REQUIRE( breakdown.count( "hexagon_app", "IOCTL_KGSL_GPU_COMMAND" ) == 0 );
+
+	auto const& rows = breakdown.rows();
+	REQUIRE( rows.size() == 3 );
+	REQUIRE( atop::intern::app_names().name( rows[0].app ) == "benchmark_model" );
+	REQUIRE( atop::intern::ioctl_cmds().name( rows[0].cmd ) == "IOCTL_KGSL_GPU_COMMAND" );
+	REQUIRE( atop::intern::ioctl_cmds().name( rows[1].cmd ) == "open /dev/kgsl-3d0" );
+	REQUIRE( atop::intern::app_names().name( rows[2].app ) == "hexagon_app" );
+
+	// Only events appended after the last update are counted
+	breakdown.clear();
+	REQUIRE( breakdown.empty() );
+	REQUIRE( breakdown.rows().empty() );
+	store.append( e );
+	breakdown.update( store );
+	REQUIRE( breakdown.count( "benchmark_model", "open /dev/kgsl-3d0" ) == 1 );
+	REQUIRE( breakdown.count( "benchmark_model", "IOCTL_KGSL_GPU_COMMAND" ) == 0 );
+}
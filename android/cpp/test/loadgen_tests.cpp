@@ -0,0 +1,83 @@
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include <catch2/catch.hpp>
+
+#include "loadgen.h"
+
+using namespace std::chrono_literals;
+
+TEST_CASE( "Models config with optional weights", "[loadgen]" )
+{
+	std::istringstream cfg{ "# comment\n"
+	                        "/data/local/tmp/a.tflite\n"
+	                        "\n"
+	                        "/data/local/tmp/b.tflite 3.5\n" };
+	auto models = atop::loadgen::parse_models_cfg( cfg );
+	REQUIRE( models.size() == 2 );
+	REQUIRE( models[0].path == "/data/local/tmp/a.tflite" );
+	REQUIRE( models[0].weight == 1.0 );
+	REQUIRE( models[1].weight == 3.5 );
+}
+
+TEST_CASE( "Arrival processes have the configured mean rate", "[loadgen]" )
+{
+	constexpr int n = 20000;
+
+	atop::loadgen::PoissonArrivals poisson( 100.0, 1 );
+	std::chrono::nanoseconds total{ 0 };
+	for( int i = 0; i < n; ++i )
+		total += *poisson.next_gap();
+	REQUIRE( std::chrono::duration<double>( total ).count() / n == Approx( 0.01 ).epsilon( 0.05 ) );
+
+	// On average 1s on and 3s off: a quarter of the in-burst rate
+	atop::loadgen::BurstyArrivals bursty( 100.0, 1.0, 3.0, 1 );
+	total = 0ns;
+	for( int i = 0; i < n; ++i )
+		total += *bursty.next_gap();
+	REQUIRE( std::chrono::duration<double>( total ).count() / n == Approx( 0.04 ).epsilon( 0.15 ) );
+
+	std::istringstream offsets{ "0.5\n1.5\n1.75\n" };
+	atop::loadgen::TraceArrivals trace( offsets );
+	REQUIRE( *trace.next_gap() == 500ms );
+	REQUIRE( *trace.next_gap() == 1000ms );
+	REQUIRE( *trace.next_gap() == 250ms );
+	REQUIRE( !trace.next_gap() );
+}
+
+TEST_CASE( "Requests queue behind busy execution slots", "[loadgen]" )
+{
+	// Three requests arriving at once on a single slot
+	std::istringstream offsets{ "0.01\n0.01\n0.01\n" };
+	atop::loadgen::TraceArrivals trace( offsets );
+
+	std::atomic<int> running{ 0 };
+	std::atomic<int> max_running{ 0 };
+	auto runner = [&]( std::string const& model ) {
+		max_running = std::max( max_running.load(), ++running );
+		std::this_thread::sleep_for( 20ms );
+		--running;
+		return model == "a";
+	};
+
+	atop::loadgen::Options opts;
+	opts.concurrency = 1;
+	auto requests    = atop::loadgen::run( { { "a", 1.0 } }, trace, runner, opts );
+
+	REQUIRE( requests.size() == 3 );
+	REQUIRE( max_running == 1 );
+	for( auto&& r: requests )
+	{
+		REQUIRE( r.ok );
+		REQUIRE( r.service_ns() >= 20000000 );
+	}
+	REQUIRE( requests[2].queueing_ns() >= 40000000 );
+
+	auto s = atop::loadgen::summarize( { 1000000, 2000000, 3000000, 4000000 } );
+	REQUIRE( s.count == 4 );
+	REQUIRE( s.mean == Approx( 2.5 ) );
+	REQUIRE( s.p50 == Approx( 2.0 ) );
+	REQUIRE( s.max == Approx( 4.0 ) );
+}
@@ -0,0 +1,117 @@
+#include <string>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+
+#include "intern.h"
+#include "logview.h"
+
+TEST_CASE( "Log buffers keep lines in order", "[logview]" )
+{
+	atop::logview::LogBuffer buf;
+	buf.add( "logcat", "first" );
+	buf.add( "logcat", "" );
+	buf.add( "IOCTL", "third" );
+
+	REQUIRE( buf.first() == 0 );
+	REQUIRE( buf.end() == 3 );
+	REQUIRE( buf.text( 0 ) == "first" );
+	REQUIRE( buf.text( 1 ).empty() );
+	REQUIRE( buf.text( 2 ) == "third" );
+	REQUIRE( atop::logview::sources().name( buf.info( 2 ).source ) == "IOCTL" );
+
+	// Sequence numbers continue after clearing
+	buf.clear();
+	REQUIRE( buf.first() == 3 );
+	REQUIRE( buf.end() == 3 );
+	buf.add( "logcat", "fourth" );
+	REQUIRE( buf.text( 3 ) == "fourth" );
+}
+
+TEST_CASE( "Log buffers are bounded", "[logview]" )
+{
+	constexpr size_t capacity = 4 * atop::logview::LogBuffer::chunk_bytes;
+	atop::logview::LogBuffer buf( capacity );
+
+	for( int i = 0; i < 100000; ++i )
+		buf.add( "logcat", fmt::format( "line {0}", i ) );
+
+	REQUIRE( buf.bytes() <= capacity );
+	REQUIRE( buf.end() == 100000 );
+	REQUIRE( buf.first() > 0 );
+	REQUIRE( buf.text( buf.first() ) == fmt::format( "line {0}", buf.first() ) );
+	REQUIRE( buf.text( buf.end() - 1 ) == "line 99999" );
+
+	// Overlong lines are truncated to a chunk
+	buf.add( "logcat", std::string( 2 * atop::logview::LogBuffer::chunk_bytes, 'x' ) );
+	REQUIRE( buf.text( buf.end() - 1 ).size() < atop::logview::LogBuffer::chunk_bytes );
+}
+
+TEST_CASE( "Log filters", "[logview]" )
+{
+	atop::logview::LogBuffer buf;
+	buf.add( "IOCTL", "[ 1.000000] IOCTL kgsl: (channel: 3) (app: camera) (pid: 1) (cmd: "
+	                  "IOCTL_KGSL_GPU_COMMAND [7]) (time: 0.000100)" );
+	buf.add( "IOCTL", "[ 1.000001] IOCTL cDSP: (channel: 3) (app: benchmark_model) (pid: 2) "
+	                  "(cmd: FASTRPC_IOCTL_INVOKE_FD [3]) (time: 0.000200)" );
+	buf.add( "tflite", "10-19 09:07:58.045  1234  1256 I tflite  : Replacing 12 node(s)" );
+
+	atop::logview::View view;
+	atop::logview::Filter all;
+	REQUIRE_FALSE( all.active() );
+	view.update( buf, all );
+	REQUIRE( view.size() == 3 );
+
+	atop::logview::Filter text;
+	text.set_text( "camera, node" );
+	REQUIRE( text.active() );
+	view.update( buf, text );
+	REQUIRE( view.size() == 2 );
+	REQUIRE( view[0] == 0 );
+	REQUIRE( view[1] == 2 );
+
+	text.set_text( "-IOCTL" );
+	view.update( buf, text );
+	REQUIRE( view.size() == 1 );
+	REQUIRE( view[0] == 2 );
+
+	atop::logview::Filter app;
+	app.app = atop::intern::app_names().intern( "benchmark_model" );
+	view.update( buf, app );
+	REQUIRE( view.size() == 1 );
+	REQUIRE( view[0] == 1 );
+
+	atop::logview::Filter source;
+	source.source = atop::logview::sources().intern( "tflite" );
+	view.update( buf, source );
+	REQUIRE( view.size() == 1 );
+	REQUIRE( view[0] == 2 );
+}
+
+TEST_CASE( "Log views filter incrementally", "[logview]" )
+{
+	constexpr size_t capacity = 2 * atop::logview::LogBuffer::chunk_bytes;
+	atop::logview::LogBuffer buf( capacity );
+	atop::logview::View view;
+	atop::logview::Filter odd;
+	odd.set_text( "odd" );
+
+	for( int i = 0; i < 50000; ++i )
+	{
+		buf.add( "logcat", fmt::format( "{0} {1}", i % 2 ? "odd" : "even", i ) );
+		if( i % 1000 == 0 )
+			view.update( buf, odd );
+	}
+	view.update( buf, odd );
+
+	// Evicted matches are dropped
+	REQUIRE( view.size() > 0 );
+	REQUIRE( view[0] >= buf.first() );
+	REQUIRE( buf.text( view[view.size() - 1] ) == "odd 49999" );
+	for( size_t i = 0; i < view.size(); ++i )
+		REQUIRE( view[i] % 2 == 1 );
+
+	buf.clear();
+	view.update( buf, odd );
+	REQUIRE( view.size() == 0 );
+}
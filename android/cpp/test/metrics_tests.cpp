@@ -0,0 +1,109 @@
+#include <array>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+
+#include "collector.h"
+#include "events.h"
+#include "metrics.h"
+
+static atop::events::Event ioctl_event( std::string const& dev, std::string const& app,
+                                        double ts_s, double duration_s )
+{
+	atop::events::Event e;
+	REQUIRE( atop::events::parse_dmesg_line(
+	    fmt::format( "[ {0:.6f}] IOCTL {1}: (app: {2}) (cmd: FASTRPC_IOCTL_INVOKE_FD [3]) "
+	                 "(time: {3:.9f})",
+	                 ts_s, dev, app, duration_s ),
+	    e ) );
+	return e;
+}
+
+static bool contains( std::string const& text, std::string const& line )
+{
+	return text.find( line + "\n" ) != std::string::npos;
+}
+
+TEST_CASE( "Metric families", "[metrics]" )
+{
+	atop::events::EventStore store;
+	atop::metrics::Families families( "serial \"1\"" );
+
+	// Only interactions and CPU utilizations before any events
+	atop::protocol::Update u;
+	u.interactions = std::map<std::string, int>{ { "mdsp", 8 } };
+	u.cpu          = std::map<std::string, double>{ { "cpu0", 25.0 } };
+	families.update( u, store );
+	auto text      = families.text();
+	std::string d = R"(device="serial \"1\"")";
+	REQUIRE( contains( *text, "atop_interaction_rate{" + d + ",accelerator=\"mdsp\"} 4" ) );
+	REQUIRE( contains( *text, "atop_cpu_utilization_ratio{" + d + ",cpu=\"cpu0\"} 0.25" ) );
+	REQUIRE( text->size() >= 6 );
+	REQUIRE( text->compare( text->size() - 6, 6, "# EOF\n" ) == 0 );
+
+	// Unchanged families are not serialized again
+	REQUIRE( families.text() == text );
+
+	store.append( ioctl_event( "mdsp", "metrics_test", 10.0, 0.00002 ) );
+	store.append( ioctl_event( "mdsp", "metrics_test", 10.5, 0.003 ) );
+	families.update( atop::protocol::Update{}, store );
+	store.append( ioctl_event( "mdsp", "metrics_test", 11.0, 0.2 ) );
+	families.update( atop::protocol::Update{}, store );
+
+	auto updated = families.text();
+	REQUIRE( updated != text );
+	auto const& t = *updated;
+	auto l        = d + ",accelerator=\"mdsp\"";
+	REQUIRE( contains( t, "atop_ioctls_total{" + l + "} 3" ) );
+	REQUIRE( contains( t, "atop_ioctl_duration_seconds_bucket{" + l + ",le=\"5e-05\"} 1" ) );
+	REQUIRE( contains( t, "atop_ioctl_duration_seconds_bucket{" + l + ",le=\"0.005\"} 2" ) );
+	REQUIRE( contains( t, "atop_ioctl_duration_seconds_bucket{" + l + ",le=\"0.1\"} 2" ) );
+	REQUIRE( contains( t, "atop_ioctl_duration_seconds_bucket{" + l + ",le=\"+Inf\"} 3" ) );
+	REQUIRE( contains( t, "atop_ioctl_duration_seconds_count{" + l + "} 3" ) );
+	REQUIRE( contains( t, "atop_offload_seconds_total{" + d + ",app=\"metrics_test\"} 0.20302" ) );
+
+	// The second batch spans 0.5 s of device time with 0.2 s busy
+	REQUIRE( contains( t, "atop_accelerator_busy_ratio{" + l + "} 0.4" ) );
+
+	// Families keep their order
+	REQUIRE( t.find( "# TYPE atop_interaction_rate gauge" )
+	         < t.find( "# TYPE atop_ioctl_duration_seconds histogram" ) );
+}
+
+TEST_CASE( "Metrics endpoint", "[metrics]" )
+{
+	auto path = fmt::format( "/tmp/atop_metrics_test_{0}.sock", getpid() );
+	atop::metrics::Exporter exporter( "unix:" + path, "test" );
+
+	atop::events::EventStore store;
+	atop::protocol::Update u;
+	u.cpu = std::map<std::string, double>{ { "cpu0", 50.0 } };
+	exporter.update( u, store );
+
+	auto get = [&path]( std::string const& request ) {
+		int fd = atop::collector::open_socket( atop::collector::parse_address( "unix:" + path ),
+		                                       false );
+		REQUIRE( send( fd, request.data(), request.size(), 0 )
+		         == static_cast<ssize_t>( request.size() ) );
+		std::string response;
+		std::array<char, 4096> buf;
+		ssize_t n;
+		while( ( n = recv( fd, buf.data(), buf.size(), 0 ) ) > 0 )
+			response.append( buf.data(), static_cast<size_t>( n ) );
+		close( fd );
+		return response;
+	};
+
+	auto ok = get( "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n" );
+	REQUIRE( ok.rfind( "HTTP/1.1 200 OK\r\n", 0 ) == 0 );
+	REQUIRE( ok.find( atop::metrics::content_type ) != std::string::npos );
+	REQUIRE( contains( ok, R"(atop_cpu_utilization_ratio{device="test",cpu="cpu0"} 0.5)" ) );
+	REQUIRE( exporter.scrapes() == 1 );
+
+	auto missing = get( "GET / HTTP/1.1\r\n\r\n" );
+	REQUIRE( missing.rfind( "HTTP/1.1 404 Not Found\r\n", 0 ) == 0 );
+	REQUIRE( exporter.scrapes() == 1 );
+}
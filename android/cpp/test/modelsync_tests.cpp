@@ -0,0 +1,152 @@
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#include <catch2/catch.hpp>
+
+#include "modelsync.h"
+
+namespace fs = std::filesystem;
+
+static void write_file( fs::path const& p, std::string const& content )
+{
+	fs::create_directories( p.parent_path() );
+	std::ofstream os{ p, std::ios::binary };
+	os << content;
+}
+
+TEST_CASE( "MD5 test suite of RFC 1321", "[modelsync]" )
+{
+	using atop::modelsync::md5;
+	REQUIRE( md5( "" ) == "d41d8cd98f00b204e9800998ecf8427e" );
+	REQUIRE( md5( "a" ) == "0cc175b9c0f1b6a831c399e269772661" );
+	REQUIRE( md5( "abc" ) == "900150983cd24fb0d6963f7d28e17f72" );
+	REQUIRE( md5( "message digest" ) == "f96b697d7cb7938d525a2f31aaf161d0" );
+	REQUIRE( md5( "abcdefghijklmnopqrstuvwxyz" ) == "c3fcd3d76192e4007dfb496cca67e13b" );
+	REQUIRE( md5( "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789" )
+	         == "d174ab98d277d9f5a5611c2c9f419d9f" );
+	REQUIRE( md5( "1234567890123456789012345678901234567890123456789012345678901234567890123456"
+	              "7890" )
+	         == "57edf4a22be3c955ac49da2e2107b67a" );
+
+	// Streams are hashed in chunks
+	std::string big( 3 * 1024 * 1024 + 17, 'x' );
+	std::istringstream is{ big };
+	REQUIRE( md5( is ) == md5( big ) );
+}
+
+TEST_CASE( "Sync plan mirrors files and rewrites SNPE input lists", "[modelsync]" )
+{
+	auto tmp = fs::temp_directory_path() / "atop_modelsync_test";
+	fs::remove_all( tmp );
+	auto root = tmp / "models";
+
+	write_file( root / "mobilenet.tflite", "tflite" );
+	write_file( root / "snpebm/models/inception/inception.dlc", "dlc" );
+	write_file( root / "snpebm/models/inception/cropped/chairs.raw", "chairs" );
+	write_file( tmp / "dataset/plastic_cup.raw", "cup" );
+	write_file( root / "snpebm/models/inception/target_raw_list.txt",
+	            "#softmax:0\ncropped/chairs.raw\ninput:=" + ( tmp / "dataset/plastic_cup.raw" ).string()
+	                + "\n" );
+
+	atop::modelsync::HashCache hashes( ( tmp / "hashes" ).string() );
+	auto blobs = atop::modelsync::plan( root.string(), "/data/local/tmp", hashes );
+
+	std::map<std::string, atop::modelsync::Blob> by_remote;
+	for( auto&& b: blobs )
+		by_remote[b.remote] = b;
+
+	REQUIRE( by_remote.size() == 5 );
+	REQUIRE( by_remote["/data/local/tmp/mobilenet.tflite"].md5
+	         == atop::modelsync::md5( "tflite" ) );
+	REQUIRE( by_remote["/data/local/tmp/mobilenet.tflite"].size == 6 );
+
+	// Inputs outside of the synced directory are placed next to the list
+	auto const& list = by_remote["/data/local/tmp/snpebm/models/inception/target_raw_list.txt"];
+	REQUIRE( list.local.empty() );
+	REQUIRE( list.content
+	         == "#softmax:0\n"
+	            "/data/local/tmp/snpebm/models/inception/cropped/chairs.raw\n"
+	            "input:=/data/local/tmp/snpebm/models/inception/inputs/plastic_cup.raw\n" );
+	REQUIRE( list.md5 == atop::modelsync::md5( list.content ) );
+	REQUIRE( by_remote["/data/local/tmp/snpebm/models/inception/inputs/plastic_cup.raw"].md5
+	         == atop::modelsync::md5( "cup" ) );
+
+	// Cached hashes survive a reload and are used while files are unchanged
+	hashes.save();
+	atop::modelsync::HashCache reloaded( ( tmp / "hashes" ).string() );
+	REQUIRE( reloaded.md5_file( ( root / "mobilenet.tflite" ).string() )
+	         == atop::modelsync::md5( "tflite" ) );
+
+	write_file( root / "snpebm/models/inception/target_raw_list.txt", "missing.raw\n" );
+	REQUIRE_THROWS( atop::modelsync::plan( root.string(), "/data/local/tmp", hashes ) );
+
+	fs::remove_all( tmp );
+}
+
+TEST_CASE( "Parse md5sum output", "[modelsync]" )
+{
+	auto hashes = atop::modelsync::parse_md5sum(
+	    { "d41d8cd98f00b204e9800998ecf8427e  /data/local/tmp/a.tflite",
+	      "md5sum: /data/local/tmp/b.tflite: No such file or directory",
+	      "0cc175b9c0f1b6a831c399e269772661  /data/local/tmp/c.part" } );
+
+	REQUIRE( hashes.size() == 2 );
+	REQUIRE( hashes["/data/local/tmp/a.tflite"] == "d41d8cd98f00b204e9800998ecf8427e" );
+	REQUIRE( hashes["/data/local/tmp/c.part"] == "0cc175b9c0f1b6a831c399e269772661" );
+}
+
+TEST_CASE( "Sync quotes remote paths and keeps targets of failed pushes", "[modelsync]" )
+{
+	auto tmp = fs::temp_directory_path() / "atop_modelsync_sync_test";
+	fs::remove_all( tmp );
+
+	// adb running device commands locally; pushes of "fail" files are cut off
+	write_file( tmp / "bin/adb", "#!/bin/sh\n"
+	                             "case \"$1\" in\n"
+	                             "shell) shift; exec sh -c \"$*\" ;;\n"
+	                             "push) case \"$2\" in *fail*) echo cut > \"$3\"; exit 1 ;; esac\n"
+	                             "      cp \"$2\" \"$3\" ;;\n"
+	                             "esac\n" );
+	fs::permissions( tmp / "bin/adb", fs::perms::owner_all );
+	std::string path = getenv( "PATH" );
+	setenv( "PATH", ( ( tmp / "bin" ).string() + ":" + path ).c_str(), 1 );
+
+	auto device = tmp / "device dir";
+	write_file( tmp / "host/it's $(touch pwned).tflite", "model" );
+	write_file( tmp / "host/fail.tflite", "new" );
+	write_file( device / "fail.tflite", "old" );
+
+	std::vector<atop::modelsync::Blob> blobs;
+	for( std::string name: { "it's $(touch pwned).tflite", "fail.tflite" } )
+	{
+		std::ifstream is{ tmp / "host" / name, std::ios::binary };
+		blobs.push_back( atop::modelsync::Blob{ ( tmp / "host" / name ).string(),
+			                                    ( device / name ).string(),
+			                                    fs::file_size( tmp / "host" / name ),
+			                                    atop::modelsync::md5( is ), "" } );
+	}
+
+	auto report = atop::modelsync::sync( blobs, {} );
+	setenv( "PATH", path.c_str(), 1 );
+
+	REQUIRE( report.pushed == 2 );
+	REQUIRE( report.failed == std::vector<std::string>{ ( device / "fail.tflite" ).string() } );
+
+	std::ifstream pushed{ device / "it's $(touch pwned).tflite" };
+	REQUIRE( std::string( std::istreambuf_iterator<char>( pushed ), {} ) == "model" );
+	REQUIRE_FALSE( fs::exists( device / "it's $(touch pwned).tflite.part" ) );
+	REQUIRE_FALSE( fs::exists( "pwned" ) );
+
+	// The truncated part doesn't replace the target
+	std::ifstream kept{ device / "fail.tflite" };
+	REQUIRE( std::string( std::istreambuf_iterator<char>( kept ), {} ) == "old" );
+	REQUIRE( fs::exists( device / "fail.tflite.part" ) );
+
+	fs::remove_all( tmp );
+}
@@ -0,0 +1,129 @@
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "physmap.h"
+
+using atop::physmap::IpBlocks;
+using atop::physmap::PhysMap;
+
+static const char* iomem_sample = R"(05000000-0503ffff : kgsl-3d0
+05040000-0504ffff : /soc/arm,smmu-kgsl@5040000
+05100000-0513ffff : /soc/arm,smmu-lpass_q6@5100000
+06002000-06002fff : stm-base
+  06002000-06002fff : stm-base
+0ca30000-0ca303ff : csid
+80000000-857fffff : System RAM
+  80080000-8185ffff : Kernel code
+  823a0000-829b6fff : Kernel data
+95300000-17e3bffff : System RAM
+)";
+
+static const char* dts_sample = R"(/ {
+	reserved-memory {
+		#size-cells = <0x2>;
+		ranges;
+		#address-cells = <0x2>;
+
+		removed_regions@85800000 {
+			reg = <0x0 0x85800000 0x0 0x3700000>;
+			no-map;
+		};
+
+		secure_region {
+			size = <0x0 0x5c00000>;
+			reusable;
+		};
+
+		pil_adsp_region@8b200000 {
+			reg = <0x0 0x8b200000 0x0 0x1a00000>;
+			no-map;
+		};
+	};
+
+	soc {
+		kgsl@5000000 {
+			reg = <0x5000000 0x40000>;
+		};
+	};
+};
+)";
+
+static PhysMap sample_map()
+{
+	PhysMap map;
+	std::istringstream iomem{ iomem_sample };
+	std::istringstream dts{ dts_sample };
+	map.load_iomem( iomem );
+	map.load_dts_carveouts( dts );
+	map.build();
+	return map;
+}
+
+TEST_CASE( "iomem and device-tree regions are parsed", "[physmap]" )
+{
+	auto map = sample_map();
+
+	// 10 iomem entries + 2 statically placed carve-outs
+	REQUIRE( map.regions().size() == 12 );
+	REQUIRE( map.lookup( 0x8b200000 )->name == "pil_adsp_region" );
+	REQUIRE( map.lookup( 0x8b200000 )->ip == IpBlocks::DSP );
+	REQUIRE( map.lookup( 0x85800000 )->name == "removed_regions" );
+}
+
+TEST_CASE( "Innermost region owns an address", "[physmap]" )
+{
+	auto map = sample_map();
+
+	REQUIRE( map.lookup( 0x05000010 )->ip == IpBlocks::GPU );
+	REQUIRE( map.lookup( 0x05100000 )->ip == IpBlocks::DSP );
+	REQUIRE( map.lookup( 0x0ca30004 )->ip == IpBlocks::Camera );
+	REQUIRE( map.lookup( 0x80100000 )->name == "Kernel code" );
+	REQUIRE( map.lookup( 0x84000000 )->name == "System RAM" );
+	REQUIRE( map.lookup( 0x17e3bffff )->ip == IpBlocks::DRAM );
+	REQUIRE( map.lookup( 0x17e3c0000 ) == nullptr );
+	REQUIRE( map.lookup( 0x0 ) == nullptr );
+
+	auto nested = map.containing( 0x80100000 );
+	REQUIRE( nested.size() == 2 );
+	REQUIRE( nested[0]->name == "System RAM" );
+	REQUIRE( nested[1]->name == "Kernel code" );
+}
+
+TEST_CASE( "Batch lookup matches a linear scan", "[physmap]" )
+{
+	PhysMap map;
+	std::mt19937_64 gen( 42 );
+	std::uniform_int_distribution<uint64_t> start_dis( 0, 1ull << 32 );
+	std::uniform_int_distribution<uint64_t> len_dis( 1, 1 << 20 );
+	for( int i = 0; i < 1000; ++i )
+	{
+		auto first = start_dis( gen );
+		map.add_region( first, first + len_dis( gen ), "region",
+		                atop::physmap::RegionSource::iomem );
+	}
+	map.build();
+
+	std::vector<uint64_t> addrs( 200000 );
+	for( auto& a: addrs )
+		a = start_dis( gen );
+
+	std::vector<int32_t> owners( addrs.size() );
+	map.lookup_batch( addrs.data(), addrs.size(), owners.data(), 4 );
+
+	auto const& regions = map.regions();
+	for( size_t i = 0; i < addrs.size(); i += 97 )
+	{
+		uint64_t best_size = 0;
+		for( auto&& r: regions )
+			if( r.first <= addrs[i] && addrs[i] <= r.last && ( best_size == 0 || r.size() < best_size ) )
+				best_size = r.size();
+
+		if( best_size == 0 )
+			REQUIRE( owners[i] == PhysMap::npos );
+		else
+			REQUIRE( regions[static_cast<size_t>( owners[i] )].size() == best_size );
+	}
+}
@@ -0,0 +1,114 @@
+#include <cmath>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "rollup.h"
+
+using atop::util::ns_per_s;
+
+TEST_CASE( "Buckets aggregate samples", "[rollup]" )
+{
+	atop::rollup::Series s;
+	for( int i = 0; i < 10; ++i )
+		s.add( static_cast<uint64_t>( i ) * ns_per_s / 10, i );
+
+	auto sum = s.summary( 0, ns_per_s );
+	REQUIRE( sum.count == 10 );
+	REQUIRE( sum.min == 0.0 );
+	REQUIRE( sum.max == 9.0 );
+	REQUIRE( sum.mean() == Approx( 4.5 ) );
+
+	// Few samples are returned raw
+	auto raw = s.query( 0, ns_per_s, 100 );
+	REQUIRE( raw.resolution_ns == 0 );
+	REQUIRE( raw.buckets.size() == 10 );
+	REQUIRE( raw.buckets[3].t0_ns == 3 * ns_per_s / 10 );
+	REQUIRE( raw.buckets[3].max == 3.0 );
+
+	// Otherwise buckets of 1 s
+	auto coarse = s.query( 0, ns_per_s, 5 );
+	REQUIRE( coarse.resolution_ns == ns_per_s );
+	REQUIRE( coarse.buckets.size() == 1 );
+	REQUIRE( coarse.buckets[0].count == 10 );
+}
+
+TEST_CASE( "Long sessions roll up into coarser buckets", "[rollup]" )
+{
+	atop::rollup::Series s;
+
+	// One sample per second for 8 hours; the value is the minute
+	constexpr uint64_t secs = 8 * 3600;
+	for( uint64_t t = 0; t < secs; ++t )
+		s.add( t * ns_per_s, static_cast<double>( t / 60 ) );
+	REQUIRE( s.count() == secs );
+
+	uint64_t end = secs * ns_per_s;
+
+	// The last minute at full resolution
+	auto recent = s.query( end - 60 * ns_per_s, end, 100 );
+	REQUIRE( recent.resolution_ns == 0 );
+	REQUIRE( recent.buckets.size() == 60 );
+
+	// The last 10 minutes in 1 s buckets
+	auto ten_min = s.query( end - 600 * ns_per_s, end, 1000 );
+	REQUIRE( ten_min.resolution_ns == ns_per_s );
+	REQUIRE( ten_min.buckets.size() == 600 );
+
+	// 1 s buckets are only kept for an hour and 10 s buckets for 6 hours
+	auto two_hours = s.query( end - 7200 * ns_per_s, end, 1000 );
+	REQUIRE( two_hours.resolution_ns == 10 * ns_per_s );
+	REQUIRE( two_hours.buckets.size() == 720 );
+
+	auto session = s.query( 0, end, 1000 );
+	REQUIRE( session.resolution_ns == 60 * ns_per_s );
+	REQUIRE( session.buckets.size() == 480 );
+	for( size_t i = 0; i < session.buckets.size(); ++i )
+	{
+		auto const& b = session.buckets[i];
+		REQUIRE( b.t0_ns == i * 60 * ns_per_s );
+		REQUIRE( b.count == 60 );
+		REQUIRE( b.min == static_cast<double>( i ) );
+		REQUIRE( b.max == static_cast<double>( i ) );
+	}
+
+	// Partial buckets at the window's edges are included
+	auto edges = s.query( 90 * ns_per_s, 150 * ns_per_s, 10 );
+	REQUIRE( edges.resolution_ns == 60 * ns_per_s );
+	REQUIRE( edges.buckets.size() == 2 );
+	REQUIRE( edges.buckets.front().t0_ns == 60 * ns_per_s );
+}
+
+TEST_CASE( "Late samples", "[rollup]" )
+{
+	atop::rollup::Series s;
+	s.add( 5 * ns_per_s, 1.0 );
+	s.add( 6 * ns_per_s, 2.0 );
+	s.add( 5 * ns_per_s + 1, 7.0 );
+
+	auto r = s.query( 0, 10 * ns_per_s, 100 );
+	REQUIRE( r.resolution_ns == 0 );
+	REQUIRE( r.buckets.size() == 3 );
+	REQUIRE( r.buckets[1].max == 7.0 );
+
+	auto b = s.query( 0, 10 * ns_per_s, 2 );
+	REQUIRE( b.resolution_ns == 10 * ns_per_s );
+	REQUIRE( b.buckets[0].count == 3 );
+
+	auto per_s = s.query( 5 * ns_per_s, 7 * ns_per_s, 2 );
+	REQUIRE( per_s.resolution_ns == ns_per_s );
+	REQUIRE( per_s.buckets.size() == 2 );
+	REQUIRE( per_s.buckets[0].count == 2 );
+	REQUIRE( per_s.buckets[0].max == 7.0 );
+}
+
+TEST_CASE( "Store of series", "[rollup]" )
+{
+	atop::rollup::Store store;
+	REQUIRE( store.find( "kgsl" ) == nullptr );
+
+	store.add( "kgsl", ns_per_s, 3.0 );
+	store.add( "cpu0", ns_per_s, 12.5 );
+	REQUIRE( store.labels() == std::vector<std::string>{ "cpu0", "kgsl" } );
+	REQUIRE( store.find( "kgsl" )->summary( 0, 2 * ns_per_s ).max == 3.0 );
+}
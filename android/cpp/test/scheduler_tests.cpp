@@ -0,0 +1,135 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "scheduler.h"
+
+using namespace std::chrono_literals;
+using atop::scheduler::Scheduler;
+
+// Whether pred holds within a timeout generous enough for loaded machines
+template<typename Pred> static bool eventually( Pred&& pred )
+{
+	auto end = Scheduler::clock::now() + 10s;
+	while( !pred() )
+	{
+		if( Scheduler::clock::now() > end )
+			return false;
+		std::this_thread::sleep_for( 1ms );
+	}
+	return true;
+}
+
+TEST_CASE( "Sources sample on multiples of their period", "[scheduler]" )
+{
+	std::mutex mtx;
+	std::vector<Scheduler::clock::time_point> fast_runs, slow_runs;
+
+	Scheduler s;
+	auto fast = s.add( "fast", 20ms, [&]( Scheduler::clock::time_point t ) {
+		std::lock_guard<std::mutex> lock( mtx );
+		fast_runs.push_back( t );
+	} );
+	s.add( "slow", 100ms, [&]( Scheduler::clock::time_point t ) {
+		std::lock_guard<std::mutex> lock( mtx );
+		slow_runs.push_back( t );
+	} );
+	auto t0 = Scheduler::clock::now();
+	s.start();
+	std::this_thread::sleep_for( 330ms );
+	REQUIRE( eventually( [&]() {
+		std::lock_guard<std::mutex> lock( mtx );
+		return slow_runs.size() >= 2;
+	} ) );
+	s.stop();
+	auto elapsed = Scheduler::clock::now() - t0;
+
+	// Late deadlines are skipped, so a loaded machine only lowers the
+	// counts: at most one run per deadline, and the fast source is due at
+	// every deadline of the slow one
+	REQUIRE( fast_runs.size() <= static_cast<size_t>( elapsed / 20ms ) + 1 );
+	REQUIRE( slow_runs.size() <= static_cast<size_t>( elapsed / 100ms ) + 1 );
+	REQUIRE( fast_runs.size() >= slow_runs.size() );
+
+	// Both sources run on multiples of their period from a common start
+	for( size_t i = 1; i < fast_runs.size(); ++i )
+	{
+		REQUIRE( fast_runs[i] > fast_runs[i - 1] );
+		REQUIRE( ( fast_runs[i] - fast_runs[0] ) % 20ms == 0ns );
+	}
+	for( auto t: slow_runs )
+		REQUIRE( ( t - slow_runs[0] ) % 100ms == 0ns );
+	REQUIRE( slow_runs[0] == fast_runs[0] );
+
+	auto st = s.stats();
+	REQUIRE( st.size() == 2 );
+	REQUIRE( st[fast].name == "fast" );
+	REQUIRE( st[fast].runs == fast_runs.size() );
+	REQUIRE( st[fast].jitter.count() == fast_runs.size() );
+}
+
+TEST_CASE( "Stopping doesn't wait for the next deadline", "[scheduler]" )
+{
+	std::atomic<int> runs = 0;
+	Scheduler s;
+	s.add( "hourly", 1h, [&]( auto ) { runs++; } );
+	s.start();
+	REQUIRE( eventually( [&]() { return runs == 1; } ) );
+
+	auto t0 = Scheduler::clock::now();
+	s.stop();
+	REQUIRE( Scheduler::clock::now() - t0 < 5s );
+	REQUIRE( runs == 1 );
+}
+
+TEST_CASE( "Period changes and overruns", "[scheduler]" )
+{
+	std::atomic<int> runs = 0;
+	Scheduler s;
+	auto id = s.add( "src", 1h, [&]( auto ) { runs++; } );
+	REQUIRE_THROWS( s.set_period( id, 0ns ) );
+	REQUIRE_THROWS( s.add( "bad", -1s, []( auto ) {} ) );
+
+	s.start();
+	REQUIRE( eventually( [&]() { return runs == 1; } ) );
+
+	// Takes effect without waiting for the hourly deadline
+	s.set_period( id, 10ms );
+	REQUIRE( s.period( id ) == 10ms );
+	REQUIRE( eventually( [&]() { return runs > 5; } ) );
+
+	// A source slower than its period skips deadlines
+	auto slow = s.add( "slow", 10ms, []( auto ) { std::this_thread::sleep_for( 35ms ); } );
+	REQUIRE( eventually( [&]() { return s.stats()[slow].overruns > 0; } ) );
+	s.stop();
+}
+
+TEST_CASE( "Adaptive period follows buffer fill and activity", "[scheduler]" )
+{
+	atop::scheduler::AdaptivePeriod p( 2s );
+	REQUIRE( p.period() == 2s );
+
+	// Quiet sources back off exponentially up to the maximum
+	REQUIRE( p.update( 0.0, false, false ) == 4s );
+	REQUIRE( p.update( 0.01, false, false ) == 8s );
+	REQUIRE( p.update( 0.0, false, false ) == 8s );
+
+	// Busy sources are polled so that a quarter of the buffer fills up
+	REQUIRE( p.update( 1.0, true, false ) == 2s );
+	REQUIRE( p.update( 0.5, true, false ) == 1s );
+	REQUIRE( p.update( 0.25, true, false ) == 1s );
+
+	// Growth per poll is bounded by the backoff factor
+	REQUIRE( p.update( 0.01, true, false ) == 2s );
+
+	// Wrapped buffers reset to the minimum period
+	REQUIRE( p.update( 0.1, true, true ) == 500ms );
+	REQUIRE( p.update( 1.0, true, false ) == 500ms );
+
+	REQUIRE_THROWS( atop::scheduler::AdaptivePeriod( 1s, { 2s, 1s, 0.25, 2.0 } ) );
+	REQUIRE_THROWS( atop::scheduler::AdaptivePeriod( 1s, { 1s, 2s, 0.25, 1.0 } ) );
+}
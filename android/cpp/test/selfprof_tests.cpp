@@ -0,0 +1,58 @@
+#include <map>
+#include <string>
+
+#include <catch2/catch.hpp>
+
+#include "fifo.h"
+#include "selfprof.h"
+
+TEST_CASE( "Self-profiling timers and counters", "[selfprof]" )
+{
+	auto& t = atop::selfprof::timer( "test.stage" );
+	REQUIRE( &t == &atop::selfprof::timer( "test.stage" ) );
+
+	t.record( 300 );
+	t.record( 100 );
+	REQUIRE( t.count() == 2 );
+	REQUIRE( t.total_ns() == 400 );
+	REQUIRE( t.max_ns() == 300 );
+	REQUIRE( t.last_ns() == 100 );
+
+	auto n = atop::selfprof::timed( t, []() { return 42; } );
+	REQUIRE( n == 42 );
+	REQUIRE( t.count() == 3 );
+
+	atop::selfprof::counter( "test.lines" ).add( 10 );
+	atop::selfprof::counter( "test.lines" ).add( 5 );
+	atop::selfprof::gauge( "test.depth" ).set( 7 );
+
+	auto metrics = atop::selfprof::snapshot();
+	for( size_t i = 1; i < metrics.size(); ++i )
+		REQUIRE( metrics[i - 1].name < metrics[i].name );
+
+	std::map<std::string, atop::selfprof::Metric> by_name;
+	for( auto&& m: metrics )
+		by_name.emplace( m.name, m );
+	REQUIRE( by_name.at( "test.stage" ).kind == atop::selfprof::Kinds::timer );
+	REQUIRE( by_name.at( "test.stage" ).count == 3 );
+	REQUIRE( by_name.at( "test.lines" ).value == 15 );
+	REQUIRE( by_name.at( "test.depth" ).value == 7 );
+
+	auto json = atop::selfprof::to_json( metrics );
+	REQUIRE( json.front() == '{' );
+	REQUIRE( json.back() == '}' );
+	REQUIRE( json.find( R"("test.lines": 15)" ) != std::string::npos );
+	REQUIRE( json.find( R"("test.stage": {"count": 3, "total_ns": )" ) != std::string::npos );
+}
+
+TEST_CASE( "FIFOs report depth and wait time", "[selfprof]" )
+{
+	atop::fifo::FIFO<std::map<std::string, int>> fifo( "test" );
+	fifo.push_data( { { "kgsl", 1 } } );
+	fifo.push_data( { { "kgsl", 2 } } );
+	REQUIRE( atop::selfprof::gauge( "fifo.test.depth" ).value() == 2 );
+
+	REQUIRE( fifo.pop_data().at( "kgsl" ) == 1 );
+	REQUIRE( atop::selfprof::gauge( "fifo.test.depth" ).value() == 1 );
+	REQUIRE( atop::selfprof::timer( "fifo.test.wait" ).count() == 1 );
+}
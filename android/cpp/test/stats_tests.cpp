@@ -0,0 +1,103 @@
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "atop.h"
+#include "stats.h"
+
+TEST_CASE( "Streaming sample moments", "[stats]" )
+{
+	atop::stats::Samples s;
+	REQUIRE( s.empty() );
+	REQUIRE( s.mean() == 0.0 );
+	REQUIRE( s.variance() == 0.0 );
+	REQUIRE_THROWS( s.percentile( 50.0 ) );
+
+	for( atop::util::nanoseconds_t v: { 2u, 4u, 4u, 4u, 5u, 5u, 7u, 9u } )
+		s.add( v );
+
+	REQUIRE( s.count() == 8 );
+	REQUIRE( s.sum() == 40 );
+	REQUIRE( s.min() == 2 );
+	REQUIRE( s.max() == 9 );
+	REQUIRE( s.mean() == Approx( 5.0 ) );
+	REQUIRE( s.variance() == Approx( 32.0 / 7.0 ) );
+
+	REQUIRE( s.percentile( 50.0 ) == 4 );
+	REQUIRE( s.percentile( 90.0 ) == 9 );
+	REQUIRE( s.percentile( 100.0 ) == 9 );
+	REQUIRE( s.percentile( 1.0 ) == 2 );
+	REQUIRE_THROWS( s.percentile( 0.0 ) );
+	REQUIRE_THROWS( s.percentile( 101.0 ) );
+
+	s.clear();
+	REQUIRE( s.empty() );
+	REQUIRE( s.sum() == 0 );
+}
+
+TEST_CASE( "Merged samples equal samples added at once", "[stats]" )
+{
+	std::vector<atop::util::nanoseconds_t> values( 1000 );
+	std::iota( values.begin(), values.end(), 1000000 );
+
+	atop::stats::Samples all, a, b, empty;
+	for( size_t i = 0; i < values.size(); ++i )
+	{
+		// Unordered insertion to exercise lazy sorting
+		auto v = values[( i * 7919 ) % values.size()];
+		all.add( v );
+		( i % 3 == 0 ? a : b ).add( v );
+	}
+
+	a.merge( empty );
+	empty.merge( b );
+	a.merge( empty );
+
+	REQUIRE( a.count() == all.count() );
+	REQUIRE( a.sum() == all.sum() );
+	REQUIRE( a.min() == all.min() );
+	REQUIRE( a.max() == all.max() );
+	REQUIRE( a.mean() == Approx( all.mean() ) );
+	REQUIRE( a.variance() == Approx( all.variance() ) );
+	for( double p: { 1.0, 50.0, 90.0, 99.0, 99.9, 100.0 } )
+		REQUIRE( a.percentile( p ) == all.percentile( p ) );
+}
+
+TEST_CASE( "Benchmark summaries keep one sample per run", "[stats]" )
+{
+	atop::shell_out_t snpe_out = { "Dnn Runtime Load/Deserialize/Create/De-Init Statistics:",
+		                           "Init: 1000 us",
+		                           "Average Statistics:",
+		                           "Forward Propagate Time: 200 us",
+		                           "RPC Execute: 150 us",
+		                           "Accelerator: 100 us",
+		                           "Layer Times:",
+		                           "Dnn Runtime Load/Deserialize/Create/De-Init Statistics:",
+		                           "Init: 3000 us",
+		                           "Average Statistics:",
+		                           "Forward Propagate Time: 400 us",
+		                           "RPC Execute: 170 us",
+		                           "Accelerator: 100 us",
+		                           "Layer Times:" };
+
+	atop::BenchmarkStats total, process;
+	atop::summarize_benchmark_output( snpe_out, atop::Frameworks::SNPE, process );
+	REQUIRE( process[atop::BenchmarkPhases::inference].count() == 2 );
+	REQUIRE( process[atop::BenchmarkPhases::inference].mean() == Approx( 300000.0 ) );
+	REQUIRE( process[atop::BenchmarkPhases::init].max() == 3000000 );
+	REQUIRE( process[atop::BenchmarkPhases::offload].percentile( 50.0 ) == 50000 );
+	REQUIRE( process[atop::BenchmarkPhases::preproc].empty() );
+
+	total.merge( process );
+	total.merge( process );
+	REQUIRE( total[atop::BenchmarkPhases::inference].count() == 4 );
+	REQUIRE( total[atop::BenchmarkPhases::inference].mean() == Approx( 300000.0 ) );
+
+	total.clear();
+	for( auto&& s: total.phases )
+		REQUIRE( s.empty() );
+
+	REQUIRE( atop::phase2string( atop::BenchmarkPhases::delegation ) == "delegation" );
+}
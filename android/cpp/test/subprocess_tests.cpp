@@ -0,0 +1,64 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "subprocess.h"
+
+using namespace std::chrono_literals;
+
+TEST_CASE( "Commands report output and exit status", "[subprocess]" )
+{
+	atop::subprocess::Loop loop;
+
+	auto r = loop.run( "printf 'a\\nb\\n'; echo err >&2" ).get();
+	REQUIRE( r.ok() );
+	REQUIRE( r.out == "a\nb\n" );
+
+	r = loop.run( "read x; echo \"[$x]\"; exit 3" ).get();
+	REQUIRE( r.status == 3 );
+	REQUIRE( !r.timed_out );
+	REQUIRE( !r.ok() );
+	REQUIRE( r.out == "[]\n" );
+
+	// Output larger than the pipe buffer
+	r = loop.run( "head -c 1000000 /dev/zero" ).get();
+	REQUIRE( r.out.size() == 1000000 );
+
+	REQUIRE( loop.running() == 0 );
+}
+
+TEST_CASE( "Many commands run concurrently on one loop", "[subprocess]" )
+{
+	atop::subprocess::Loop loop;
+
+	auto t0 = std::chrono::steady_clock::now();
+	std::vector<std::future<atop::subprocess::Result>> results;
+	for( int i = 0; i < 200; ++i )
+		results.push_back( loop.run( "sleep 0.2; echo " + std::to_string( i ) ) );
+
+	for( size_t i = 0; i < results.size(); ++i )
+		REQUIRE( results[i].get().out == std::to_string( i ) + "\n" );
+
+	// Sequentially this would take 40 s
+	REQUIRE( std::chrono::steady_clock::now() - t0 < 10s );
+}
+
+TEST_CASE( "Commands exceeding their timeout are killed", "[subprocess]" )
+{
+	atop::subprocess::Loop loop;
+
+	auto t0   = std::chrono::steady_clock::now();
+	auto slow = loop.run( "echo started; sleep 10 & sleep 10", 100ms );
+	auto fast = loop.run( "echo done", 5s );
+
+	auto r = slow.get();
+	REQUIRE( r.timed_out );
+	REQUIRE( r.status == 128 + 9 );
+	REQUIRE( r.out == "started\n" );
+	REQUIRE( std::chrono::steady_clock::now() - t0 < 5s );
+
+	REQUIRE( fast.get().ok() );
+}
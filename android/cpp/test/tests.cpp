@@ -1,5 +1,7 @@
 #include <catch2/catch.hpp>
 
+bool VERBOSE{ false };
+
 unsigned int Factorial(unsigned int number)
 {
   return number <= 1 ? number : Factorial(number - 1) * number;
@@ -0,0 +1,105 @@
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+
+#include "intern.h"
+#include "timeline.h"
+
+static size_t occurrences( std::string const& text, std::string const& what )
+{
+	size_t n = 0;
+	for( auto pos = text.find( what ); pos != std::string::npos; pos = text.find( what, pos + 1 ) )
+		n++;
+	return n;
+}
+
+TEST_CASE( "Parse TIME lines", "[timeline]" )
+{
+	atop::timeline::TimedCall c;
+	REQUIRE( atop::timeline::parse_time_line(
+	    "[ 12.500000] TIME ioctl (s): (app: timeline_app) (pid: 123) getinfo: 0.009123", c ) );
+	REQUIRE( c.ts_ns == 12500000000 );
+	REQUIRE( c.pid == 123 );
+	REQUIRE( atop::intern::app_names().name( c.app ) == "timeline_app" );
+	REQUIRE( c.name == "ioctl getinfo" );
+	REQUIRE( c.duration_ns == 9123000 );
+
+	REQUIRE( atop::timeline::parse_time_line(
+	    "[ 13.000000] TIME internal_invoke (s): (app: timeline_app): 0.5", c ) );
+	REQUIRE( c.name == "internal_invoke" );
+	REQUIRE( c.pid == atop::events::no_pid );
+	REQUIRE( c.duration_ns == 500000000 );
+
+	REQUIRE_FALSE( atop::timeline::parse_time_line( "[ 13.000000] INFO: (app: a) start", c ) );
+	REQUIRE_FALSE( atop::timeline::parse_time_line( "TIME ioctl (s): 0.1", c ) );
+}
+
+TEST_CASE( "Escape JSON strings", "[timeline]" )
+{
+	REQUIRE( atop::timeline::escape_json( "a\"b\\c\n\x01" ) == "a\\\"b\\\\c\\n\\u0001" );
+}
+
+TEST_CASE( "Timeline of driver lines", "[timeline]" )
+{
+	std::ostringstream os;
+	{
+		atop::timeline::Writer w( os );
+		REQUIRE( w.add_line( "[ 1.000100] IOCTL tl_dsp: (app: tl_app) (pid: 11) (tgid: 10) "
+		                     "(cmd: FASTRPC_IOCTL_INVOKE_FD [3]) (time: 0.000100)" ) );
+
+		// Overlaps the first call, so it takes a second lane
+		REQUIRE( w.add_line( "[ 1.000150] IOCTL tl_dsp: (app: tl_app) (pid: 12) (tgid: 10) "
+		                     "(cmd: FASTRPC_IOCTL_INVOKE_FD [3]) (time: 0.000100)" ) );
+
+		// Starts after both ended
+		REQUIRE( w.add_line( "[ 1.000300] IOCTL tl_dsp: (app: tl_app) (pid: 11) (tgid: 10) "
+		                     "(cmd: FASTRPC_IOCTL_INVOKE_FD [3]) (time: 0.000010)" ) );
+
+		// INFO lines have no pid, so they go to a process of their app
+		REQUIRE( w.add_line( "[ 1.000400] INFO: (app: tl_app) started" ) );
+		REQUIRE_FALSE( w.add_line( "[ 1.000400] unrelated" ) );
+		w.add_cpu( 1000000000, { { "cpu0", 12.5 }, { "cpu1", 50.0 } } );
+		REQUIRE( w.written() == 14 );
+	}
+
+	auto json = os.str();
+	REQUIRE( json.rfind( "[\n", 0 ) == 0 );
+	REQUIRE( json.compare( json.size() - 3, 3, "\n]\n" ) == 0 );
+
+	auto dev = atop::intern::accel_tags().intern( "tl_dsp" );
+	auto tid = [dev]( size_t lane ) { return dev * atop::timeline::max_lanes + lane; };
+	auto lane_name = [&tid]( size_t lane, char const* name ) {
+		return fmt::format( R"("tid":{0},"args":{{"name":"{1}"}})", tid( lane ), name );
+	};
+	REQUIRE( occurrences( json, R"("pid":10,"tid":0,"args":{"name":"tl_app"})" ) == 1 );
+	REQUIRE( occurrences( json, lane_name( 1, "tl_dsp" ) ) == 1 );
+	REQUIRE( occurrences( json, lane_name( 2, "tl_dsp #2" ) ) == 1 );
+
+	// Thread slices start at the line's timestamp minus the duration
+	REQUIRE( occurrences( json, R"("pid":10,"tid":11,"ts":1000000.000,"dur":100.000,)" ) == 1 );
+	REQUIRE( occurrences( json, R"("pid":10,"tid":12,"ts":1000050.000,"dur":100.000,)" ) == 1 );
+
+	// The third call reuses the first lane
+	REQUIRE( occurrences( json, fmt::format( R"("tid":{0},"ts":)", tid( 1 ) ) ) == 2 );
+	REQUIRE( occurrences( json, fmt::format( R"("tid":{0},"ts":)", tid( 2 ) ) ) == 1 );
+
+	REQUIRE( occurrences( json, R"("ph":"i","s":"t","cat":"info","name":"started")" ) == 1 );
+	REQUIRE( occurrences( json, R"("ts":1000000.000,"args":{"cpu0":12.5,"cpu1":50})" ) == 1 );
+}
+
+TEST_CASE( "Timeline of calls without pid", "[timeline]" )
+{
+	std::ostringstream os;
+	atop::timeline::Writer w( os );
+	REQUIRE( w.add_line( "[ 2.0] IOCTL kgsl: (app: tl_gpu_app) (cmd: IOCTL_KGSL_GPUOBJ_SYNC [1]) "
+	                     "(time: 0.000012345)" ) );
+	w.close();
+
+	auto app = atop::intern::app_names().intern( "tl_gpu_app" );
+	auto pid   = atop::timeline::app_pid_base + static_cast<int32_t>( app );
+	auto slice = fmt::format( R"("pid":{0},"tid":{0},"ts":1999987.655,"dur":12.345,)", pid );
+	REQUIRE( occurrences( os.str(), slice ) == 1 );
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+#include <fmt/format.h>
+#include <lz4.h>
+
+#include "trace.h"
+
+static std::vector<std::string> sample_lines()
+{
+	std::vector<std::string> lines;
+	for( int i = 0; i < 2000; ++i )
+		lines.push_back( fmt::format( "[ {0:4}.{1:06}] IOCTL cDSP: (channel: {2}) (app: "
+		                              "benchmark_model) (pid: 4321) (cmd: FASTRPC_IOCTL_INVOKE_FD "
+		                              "[{3}]) (time: 0.000{4:06})",
+		                              900 + i / 100, i * 37 % 1000000, i % 4, i % 3, i * 7 ) );
+
+	// Zero padded numbers, long digit runs, escapes and empty lines
+	lines.push_back( "10-19 09:07:58.045  1234  1256 I tflite  : Replacing 12 node(s)" );
+	lines.push_back( "id 123456789012345678901234567890 and 18446744073709551615" );
+	lines.push_back( std::string( "ctl \x01\x02\x03 bytes 007" ) + '\0' + "0" );
+	lines.push_back( "" );
+	lines.push_back( "0000" );
+	return lines;
+}
+
+static std::string write_trace( std::vector<std::string> const& lines, size_t block_bytes )
+{
+	std::ostringstream os;
+	atop::trace::Writer w( os, block_bytes );
+	for( auto&& l: lines )
+		w.add( l );
+	w.close();
+	REQUIRE( w.lines() == lines.size() );
+	REQUIRE( w.bytes_written() == os.str().size() );
+	return os.str();
+}
+
+static std::vector<std::string> read_all( std::string const& trace )
+{
+	std::istringstream is( trace );
+	atop::trace::Reader r( is );
+	std::vector<std::string> lines;
+	r.read( [&]( std::string_view l ) { lines.emplace_back( l ); } );
+	return lines;
+}
+
+TEST_CASE( "Traces reproduce the text", "[trace]" )
+{
+	auto lines = sample_lines();
+
+	for( size_t block_bytes: { size_t{ 64 }, size_t{ 4096 }, size_t{ 1024 * 1024 } } )
+	{
+		auto trace = write_trace( lines, block_bytes );
+		REQUIRE( read_all( trace ) == lines );
+	}
+
+	// An empty trace
+	REQUIRE( read_all( write_trace( {}, 4096 ) ).empty() );
+}
+
+TEST_CASE( "Traces are compact", "[trace]" )
+{
+	auto lines = sample_lines();
+	lines.resize( 2000 );
+
+	size_t text = 0;
+	for( auto&& l: lines )
+		text += l.size() + 1;
+
+	auto trace = write_trace( lines, 1024 * 1024 );
+	REQUIRE( trace.size() * 10 < text );
+}
+
+TEST_CASE( "Trace index", "[trace]" )
+{
+	auto lines = sample_lines();
+	lines.resize( 2000 );
+	auto trace = write_trace( lines, 4096 );
+
+	std::istringstream is( trace );
+	atop::trace::Reader r( is );
+	REQUIRE( r.blocks().size() > 2 );
+
+	uint64_t total = 0;
+	for( auto&& b: r.blocks() )
+	{
+		REQUIRE( b.min_ns <= b.max_ns );
+		total += b.lines;
+	}
+	REQUIRE( total == lines.size() );
+
+	// Only the blocks of the window are decoded
+	std::vector<std::string> window;
+	auto t0 = 905 * atop::util::ns_per_s, t1 = 906 * atop::util::ns_per_s;
+	r.read( [&]( std::string_view l ) { window.emplace_back( l ); }, t0, t1 );
+	REQUIRE( window.size() >= 100 );
+	REQUIRE( window.size() < lines.size() / 2 );
+	for( size_t i = 500; i < 600; ++i )
+		REQUIRE( std::find( window.begin(), window.end(), lines[i] ) != window.end() );
+}
+
+TEST_CASE( "Truncated and malformed traces", "[trace]" )
+{
+	auto lines = sample_lines();
+	auto trace = write_trace( lines, 4096 );
+
+	// Without index only complete blocks are read
+	std::istringstream is( trace.substr( 0, trace.size() / 2 ) );
+	atop::trace::Reader r( is );
+	REQUIRE( !r.blocks().empty() );
+	std::vector<std::string> prefix;
+	r.read( [&]( std::string_view l ) { prefix.emplace_back( l ); } );
+	REQUIRE( !prefix.empty() );
+	REQUIRE( prefix.size() < lines.size() );
+	REQUIRE( std::equal( prefix.begin(), prefix.end(), lines.begin() ) );
+
+	std::istringstream text( "[ 1.0] not a trace\n" );
+	REQUIRE_FALSE( atop::trace::is_trace( text ) );
+	REQUIRE_THROWS( atop::trace::Reader( text ) );
+
+	std::istringstream valid( trace );
+	REQUIRE( atop::trace::is_trace( valid ) );
+
+	// Corrupt payload of the first block
+	auto corrupt = trace;
+	for( size_t i = 8 + 28; i < 8 + 28 + 64; ++i )
+		corrupt[i] = '\xff';
+	std::istringstream bad( corrupt );
+	atop::trace::Reader br( bad );
+	REQUIRE_THROWS( br.read_block( 0, []( std::string_view ) {} ) );
+
+	// Counts beyond the file are rejected before allocating
+	std::istringstream indexed( trace );
+	auto entries = atop::trace::Reader( indexed ).blocks().size();
+	auto huge    = trace;
+	huge.replace( huge.size() - 12 - entries * 28 - 4, 4, "\xff\xff\xff\xff" );
+	std::istringstream huge_index( huge );
+	REQUIRE_THROWS_WITH( atop::trace::Reader( huge_index ), "Corrupt trace block" );
+
+	std::string raw = "\xff\xff\xff\xff\x0f"; // template count
+	std::string compressed( static_cast<size_t>( LZ4_compressBound( 5 ) ), '\0' );
+	compressed.resize( static_cast<size_t>(
+	    LZ4_compress_default( raw.data(), compressed.data(), 5, LZ4_compressBound( 5 ) ) ) );
+	std::string block( 28, '\0' );
+	block[0] = static_cast<char>( compressed.size() );
+	block[4] = static_cast<char>( raw.size() );
+	std::istringstream huge_templates( trace.substr( 0, 8 ) + block + compressed );
+	atop::trace::Reader hr( huge_templates );
+	REQUIRE( hr.blocks().size() == 1 );
+	REQUIRE_THROWS_WITH( hr.read_block( 0, []( std::string_view ) {} ), "Corrupt trace block" );
+}
@@ -0,0 +1,102 @@
+#include <string>
+
+#include <catch2/catch.hpp>
+
+#include "util.h"
+
+using atop::util::decimal2ns;
+using atop::util::ns_per_ms;
+using atop::util::ns_per_s;
+using atop::util::ns_per_us;
+
+TEST_CASE( "Fixed-point decimals are exact", "[util]" )
+{
+	REQUIRE( decimal2ns( "3633.459327", ns_per_s ) == 3633459327000ull );
+	REQUIRE( decimal2ns( "0.000012345", ns_per_s ) == 12345 );
+	REQUIRE( decimal2ns( "18446744073", ns_per_s ) == 18446744073000000000ull );
+	REQUIRE( decimal2ns( "12", ns_per_us ) == 12000 );
+	REQUIRE( decimal2ns( "1.5", ns_per_ms ) == 1500000 );
+	REQUIRE( decimal2ns( "  7.", ns_per_s ) == 7 * ns_per_s );
+
+	// Digits below nanosecond resolution are truncated
+	REQUIRE( decimal2ns( "1.0000000019", ns_per_s ) == 1000000001 );
+	REQUIRE( decimal2ns( "0.0015", ns_per_us ) == 1 );
+
+	// Scientific notation of tflite's benchmark_model
+	REQUIRE( decimal2ns( "1.23457e+06", ns_per_us ) == 1234570000ull );
+	REQUIRE( decimal2ns( "5e3", ns_per_us ) == 5000000 );
+	REQUIRE( decimal2ns( "1e-05", ns_per_s ) == 10000 );
+	REQUIRE( decimal2ns( "2.5E-3", ns_per_s ) == 2500000 );
+	REQUIRE( decimal2ns( "1e-30", ns_per_s ) == 0 );
+	REQUIRE( decimal2ns( "42\r\n", ns_per_us ) == 42000 );
+
+	// Summing 0.1 s ten times is exact, unlike with doubles
+	uint64_t sum = 0;
+	for( int i = 0; i < 10; ++i )
+		sum += decimal2ns( "0.1", ns_per_s );
+	REQUIRE( sum == ns_per_s );
+
+	REQUIRE_THROWS( decimal2ns( "", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( ".5", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( "-1", ns_per_s ) );
+
+	// Trailing garbage
+	REQUIRE_THROWS( decimal2ns( "1.5s", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( "1e", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( "1e-", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( "3 4", ns_per_s ) );
+
+	// Overflow
+	REQUIRE_THROWS( decimal2ns( "18446744074", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( "99999999999999999999", 1 ) );
+	REQUIRE_THROWS( decimal2ns( "1e19", ns_per_s ) );
+	REQUIRE_THROWS( decimal2ns( "1e25", 1 ) );
+	REQUIRE_THROWS( decimal2ns( "1.9e10", ns_per_s ) );
+	REQUIRE( decimal2ns( "18446744073709551615", 1 ) == 18446744073709551615ull );
+}
+
+TEST_CASE( "Dmesg timestamps", "[util]" )
+{
+	atop::util::nanoseconds_t ts;
+	size_t pos;
+
+	std::string line = "[ 3633.459327] IOCTL kgsl: ...";
+	REQUIRE( atop::util::parse_dmesg_ts( line, ts, pos ) );
+	REQUIRE( ts == 3633459327000ull );
+	REQUIRE( line.substr( pos ) == " IOCTL kgsl: ..." );
+
+	REQUIRE( atop::util::parse_dmesg_ts( "[    0.000000] Booting", ts, pos ) );
+	REQUIRE( ts == 0 );
+
+	REQUIRE_FALSE( atop::util::parse_dmesg_ts( "3633.459327] IOCTL", ts, pos ) );
+	REQUIRE_FALSE( atop::util::parse_dmesg_ts( "[ 3633.459327 IOCTL", ts, pos ) );
+	REQUIRE_FALSE( atop::util::parse_dmesg_ts( "[ ] IOCTL", ts, pos ) );
+}
+
+TEST_CASE( "Thread CPU time", "[util]" )
+{
+	auto t0 = atop::util::thread_cpu_ns();
+	volatile uint64_t sum = 0;
+	for( uint64_t i = 0; i < 10000000; ++i )
+		sum = sum + i;
+	auto t1 = atop::util::thread_cpu_ns();
+	REQUIRE( t0 > 0 );
+	REQUIRE( t1 > t0 );
+}
+
+TEST_CASE( "Shell quoting", "[util]" )
+{
+	using atop::util::shell_quote;
+	REQUIRE( shell_quote( "/data/local/tmp/a.tflite" ) == "'/data/local/tmp/a.tflite'" );
+	REQUIRE( shell_quote( "my model $(rm -rf x).dlc" ) == "'my model $(rm -rf x).dlc'" );
+	REQUIRE( shell_quote( "it's" ) == "'it'\\''s'" );
+	REQUIRE( shell_quote( "" ) == "''" );
+}
+
+TEST_CASE( "Trimmed views", "[util]" )
+{
+	using atop::util::trimmed;
+	REQUIRE( trimmed( " \tTIME ioctl: 0.1\r\n" ) == "TIME ioctl: 0.1" );
+	REQUIRE( trimmed( "a b" ) == "a b" );
+	REQUIRE( trimmed( " \n " ).empty() );
+}
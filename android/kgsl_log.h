@@ -107,11 +107,20 @@ KGSL_LOG_ERR(_dev->dev, _dev->pwr_log, fmt, ##args)
 #define KGSL_PWR_CRIT(_dev, fmt, args...) \
 KGSL_LOG_CRIT(_dev->dev, _dev->pwr_log, fmt, ##args)
 
+/* ATOP_TRACE_PRINTK logs into the ftrace ring buffer, formatted by atop */
+#ifdef ATOP_TRACE_PRINTK
+#define KGSL_PERF_INFO(_dev, fmt, args...) \
+		do {			   \
+		if(_dev->perf_log >= 6)	   \
+			trace_printk(fmt, ##args); \
+		} while(0)
+#else
 #define KGSL_PERF_INFO(_dev, fmt, args...) \
 		do {			   \
 		if(_dev->perf_log >= 6)	   \
 			pr_info(fmt, ##args); \
 		} while(0)
+#endif
 
 /*
  * Core error messages - these are for core KGSL functions that have